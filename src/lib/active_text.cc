@@ -22,28 +22,53 @@
 #include "text_content.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
+#include <algorithm>
 
 using std::list;
+using std::vector;
 using std::pair;
 using std::make_pair;
 using boost::weak_ptr;
 using boost::shared_ptr;
 using boost::optional;
 
+ActiveText::ActiveText ()
+	: _next_key (0)
+{
+
+}
+
+bool
+ActiveText::by_content_then_key (Period const * a, Period const * b)
+{
+	if (a->content < b->content) {
+		return true;
+	} else if (b->content < a->content) {
+		return false;
+	}
+
+	return a->key < b->key;
+}
+
 /** Get the open captions that should be burnt into a given period.
  *  @param period Period of interest.
  *  @param always_burn_captions Always burn captions even if their content is not set to burn.
+ *  @return Captions, grouped by content and otherwise in the order that they were added.
  */
 list<PlayerText>
 ActiveText::get_burnt (DCPTimePeriod period, bool always_burn_captions) const
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	list<PlayerText> ps;
+	vector<Period const *> burnt;
 
-	for (Map::const_iterator i = _data.begin(); i != _data.end(); ++i) {
+	/* Only periods which start before the end of the period of interest can overlap it,
+	   and clear_before() will have removed most of those which finish before its start.
+	*/
+	for (Index::const_iterator i = _by_from.begin(); i != _by_from.end() && i->first < period.to; ++i) {
+		Period const * j = i->second;
 
-		shared_ptr<const TextContent> caption = i->first.lock ();
+		shared_ptr<const TextContent> caption = j->content.lock ();
 		if (!caption) {
 			continue;
 		}
@@ -53,15 +78,20 @@ ActiveText::get_burnt (DCPTimePeriod period, bool always_burn_captions) const
 			continue;
 		}
 
-		BOOST_FOREACH (Period j, i->second) {
-			DCPTimePeriod test (j.from, j.to.get_value_or(DCPTime::max()));
-			optional<DCPTimePeriod> overlap = period.overlap (test);
-			if (overlap && overlap->duration() > DCPTime(period.duration().get() / 2)) {
-				ps.push_back (j.subs);
-			}
+		DCPTimePeriod test (j->from, j->to.get_value_or(DCPTime::max()));
+		optional<DCPTimePeriod> overlap = period.overlap (test);
+		if (overlap && overlap->duration() > DCPTime(period.duration().get() / 2)) {
+			burnt.push_back (j);
 		}
 	}
 
+	sort (burnt.begin(), burnt.end(), by_content_then_key);
+
+	list<PlayerText> ps;
+	BOOST_FOREACH (Period const * i, burnt) {
+		ps.push_back (i->subs);
+	}
+
 	return ps;
 }
 
@@ -73,19 +103,28 @@ ActiveText::clear_before (DCPTime time)
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	Map updated;
-	for (Map::const_iterator i = _data.begin(); i != _data.end(); ++i) {
-		list<Period> as;
-		BOOST_FOREACH (Period j, i->second) {
-			if (!j.to || j.to.get() >= time) {
-				as.push_back (j);
-			}
-		}
-		if (!as.empty ()) {
-			updated[i->first] = as;
-		}
+	while (!_by_to.empty() && _by_to.begin()->first < time) {
+		remove (_by_to.begin()->second);
+	}
+}
+
+/** Remove a period from _periods and our indices; _mutex must be held */
+void
+ActiveText::remove (Period* period)
+{
+	_by_from.erase (period->from_index);
+	if (period->to) {
+		_by_to.erase (period->to_index);
+	}
+
+	ContentMap::iterator i = _by_content.find (period->content);
+	DCPOMATIC_ASSERT (i != _by_content.end());
+	i->second.erase (period->key);
+	if (i->second.empty()) {
+		_by_content.erase (i);
 	}
-	_data = updated;
+
+	_periods.erase (period->key);
 }
 
 /** Add a new subtitle with a from time.
@@ -98,10 +137,11 @@ ActiveText::add_from (weak_ptr<const TextContent> content, PlayerText ps, DCPTim
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	if (_data.find(content) == _data.end()) {
-		_data[content] = list<Period>();
-	}
-	_data[content].push_back (Period (ps, from));
+	uint64_t const key = _next_key++;
+	Period& period = _periods[key];
+	period = Period (key, content, ps, from);
+	period.from_index = _by_from.insert (make_pair (from, &period));
+	_by_content[content].insert (key);
 }
 
 /** Add the to time for the last subtitle added from a piece of content.
@@ -114,15 +154,24 @@ ActiveText::add_to (weak_ptr<const TextContent> content, DCPTime to)
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	DCPOMATIC_ASSERT (_data.find(content) != _data.end());
+	ContentMap::const_iterator i = _by_content.find (content);
+	DCPOMATIC_ASSERT (i != _by_content.end());
+
+	Periods::iterator j = _periods.find (*i->second.rbegin());
+	DCPOMATIC_ASSERT (j != _periods.end());
+	Period& period = j->second;
 
-	_data[content].back().to = to;
+	if (period.to) {
+		_by_to.erase (period.to_index);
+	}
+	period.to = to;
+	period.to_index = _by_to.insert (make_pair (to, &period));
 
-	BOOST_FOREACH (StringText& i, _data[content].back().subs.string) {
-		i.set_out (dcp::Time(to.seconds(), 1000));
+	BOOST_FOREACH (StringText& k, period.subs.string) {
+		k.set_out (dcp::Time(to.seconds(), 1000));
 	}
 
-	return make_pair (_data[content].back().subs, _data[content].back().from);
+	return make_pair (period.subs, period.from);
 }
 
 /** @param content Some content.
@@ -133,17 +182,16 @@ ActiveText::have (weak_ptr<const TextContent> content) const
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	Map::const_iterator i = _data.find(content);
-	if (i == _data.end()) {
-		return false;
-	}
-
-	return !i->second.empty();
+	ContentMap::const_iterator i = _by_content.find (content);
+	return i != _by_content.end() && !i->second.empty();
 }
 
 void
 ActiveText::clear ()
 {
 	boost::mutex::scoped_lock lm (_mutex);
-	_data.clear ();
+	_periods.clear ();
+	_by_from.clear ();
+	_by_to.clear ();
+	_by_content.clear ();
 }
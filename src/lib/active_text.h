@@ -26,17 +26,25 @@
 #include "player_text.h"
 #include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <stdint.h>
 #include <list>
 #include <map>
+#include <set>
 
 class TextContent;
 
 /** @class ActiveText
  *  @brief A class to maintain information on active subtitles for Player.
+ *
+ *  Subtitles are indexed by the times that they start and finish, so that finding the ones
+ *  to burn into a frame only looks at those which have started, and removing the ones which
+ *  have finished only looks at those.
  */
 class ActiveText : public boost::noncopyable
 {
 public:
+	ActiveText ();
+
 	std::list<PlayerText> get_burnt (DCPTimePeriod period, bool always_burn_captions) const;
 	void clear_before (DCPTime time);
 	void clear ();
@@ -45,23 +53,49 @@ public:
 	bool have (boost::weak_ptr<const TextContent> content) const;
 
 private:
+	class Period;
+
+	typedef std::multimap<DCPTime, Period*> Index;
+
 	class Period
 	{
 	public:
 		Period () {}
 
-		Period (PlayerText s, DCPTime f)
-			: subs (s)
+		Period (uint64_t k, boost::weak_ptr<const TextContent> c, PlayerText s, DCPTime f)
+			: key (k)
+			, content (c)
+			, subs (s)
 			, from (f)
 		{}
 
+		/** our key in _periods */
+		uint64_t key;
+		boost::weak_ptr<const TextContent> content;
 		PlayerText subs;
 		DCPTime from;
 		boost::optional<DCPTime> to;
+		/** our entry in _by_from */
+		Index::iterator from_index;
+		/** our entry in _by_to, if to is set */
+		Index::iterator to_index;
 	};
 
-	typedef std::map<boost::weak_ptr<const TextContent>, std::list<Period> > Map;
+	typedef std::map<uint64_t, Period> Periods;
+	typedef std::map<boost::weak_ptr<const TextContent>, std::set<uint64_t> > ContentMap;
+
+	void remove (Period* period);
+	static bool by_content_then_key (Period const * a, Period const * b);
 
 	mutable boost::mutex _mutex;
-	Map _data;
+	/** all our periods, keyed by the order in which they were added */
+	Periods _periods;
+	/** all our periods in order of their from time */
+	Index _by_from;
+	/** the periods which have a to time, in order of that time */
+	Index _by_to;
+	/** keys of the periods from each piece of content */
+	ContentMap _by_content;
+	/** key to give to the next period that is added */
+	uint64_t _next_key;
 };
@@ -29,6 +29,14 @@
 #include "filter.h"
 #include "audio_filter_graph.h"
 #include "config.h"
+#include "content_audio_analysis.h"
+#include "decoder.h"
+#include "decoder_factory.h"
+#include "audio_decoder.h"
+#include "video_decoder.h"
+#include "text_decoder.h"
+#include "dcp_decoder.h"
+#include "dcpomatic_log.h"
 extern "C" {
 #include <libavutil/channel_layout.h>
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
@@ -36,6 +44,7 @@ extern "C" {
 #endif
 }
 #include <boost/foreach.hpp>
+#include <algorithm>
 #include <iostream>
 
 #include "i18n.h"
@@ -45,6 +54,11 @@ using std::vector;
 using std::max;
 using std::min;
 using std::cout;
+using std::list;
+using std::pair;
+using std::make_pair;
+using std::find;
+using std::sort;
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 #if BOOST_VERSION >= 106100
@@ -52,6 +66,7 @@ using namespace boost::placeholders;
 #endif
 
 int const AnalyseAudioJob::_num_points = 1024;
+int const AnalyseAudioJob::_levels = 4;
 
 /** @param from_zero true to analyse audio from time 0 in the playlist, otherwise begin at Playlist::start */
 AnalyseAudioJob::AnalyseAudioJob (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist, bool from_zero)
@@ -59,8 +74,10 @@ AnalyseAudioJob::AnalyseAudioJob (shared_ptr<const Film> film, shared_ptr<const
 	, _playlist (playlist)
 	, _path (film->audio_analysis_path(playlist))
 	, _from_zero (from_zero)
+	, _compose (true)
 	, _done (0)
 	, _samples_per_point (1)
+	, _top_samples_per_point (1)
 	, _current (0)
 	, _sample_peak (new float[film->audio_channels()])
 	, _sample_peak_frame (new Frame[film->audio_channels()])
@@ -109,17 +126,18 @@ AnalyseAudioJob::json_name () const
 void
 AnalyseAudioJob::run ()
 {
-	shared_ptr<Player> player (new Player (_film, _playlist));
-	player->set_ignore_video ();
-	player->set_ignore_text ();
-	player->set_fast ();
-	player->set_play_referenced ();
-	player->Audio.connect (bind (&AnalyseAudioJob::analyse, this, _1, _2));
-
 	DCPTime const length = _playlist->length (_film);
 
 	Frame const len = DCPTime (length - _start).frames_round (_film->audio_frame_rate());
-	_samples_per_point = max (int64_t (1), len / _num_points);
+	/* Level 0 of the analysis has enough points to zoom in by this factor and still have
+	   about _num_points points on the plot.
+	*/
+	int64_t zoom = 1;
+	for (int i = 1; i < _levels; ++i) {
+		zoom *= AudioAnalysis::level_factor;
+	}
+	_samples_per_point = max (int64_t (1), len / (_num_points * zoom));
+	_top_samples_per_point = _samples_per_point * zoom;
 
 	delete[] _current;
 	_current = new AudioPoint[_film->audio_channels ()];
@@ -132,32 +150,50 @@ AnalyseAudioJob::run ()
 		}
 	}
 
-	if (has_any_audio) {
-		player->seek (_start, true);
-		_done = 0;
-		while (!player->pass ()) {}
-	}
+	if (has_any_audio && _compose && can_compose ()) {
+		compose ();
+	} else {
+		if (has_any_audio) {
+			shared_ptr<Player> player (new Player (_film, _playlist));
+			player->set_ignore_video ();
+			player->set_ignore_text ();
+			player->set_fast ();
+			player->set_play_referenced ();
+			player->Audio.connect (bind (&AnalyseAudioJob::analyse, this, _1, _2));
+			player->seek (_start, true);
+			_done = 0;
+			while (!player->pass ()) {}
+
+			if (_done % _samples_per_point) {
+				/* Add the last, partial point */
+				for (int i = 0; i < _film->audio_channels(); ++i) {
+					_current[i][AudioPoint::RMS] = sqrt (_current[i][AudioPoint::RMS] / (_done % _samples_per_point));
+					_analysis->add_point (i, _current[i]);
+				}
+			}
+		}
 
-	vector<AudioAnalysis::PeakTime> sample_peak;
-	for (int i = 0; i < _film->audio_channels(); ++i) {
-		sample_peak.push_back (
-			AudioAnalysis::PeakTime (_sample_peak[i], DCPTime::from_frames (_sample_peak_frame[i], _film->audio_frame_rate ()))
-			);
-	}
-	_analysis->set_sample_peak (sample_peak);
+		vector<AudioAnalysis::PeakTime> sample_peak;
+		for (int i = 0; i < _film->audio_channels(); ++i) {
+			sample_peak.push_back (
+				AudioAnalysis::PeakTime (_sample_peak[i], DCPTime::from_frames (_sample_peak_frame[i], _film->audio_frame_rate ()))
+				);
+		}
+		_analysis->set_sample_peak (sample_peak);
 
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
-	if (Config::instance()->analyse_ebur128 ()) {
-		void* eb = _ebur128->get("Parsed_ebur128_0")->priv;
-		vector<float> true_peak;
-		for (int i = 0; i < _film->audio_channels(); ++i) {
-			true_peak.push_back (av_ebur128_get_true_peaks(eb)[i]);
+		if (Config::instance()->analyse_ebur128 ()) {
+			void* eb = _ebur128->get("Parsed_ebur128_0")->priv;
+			vector<float> true_peak;
+			for (int i = 0; i < _film->audio_channels(); ++i) {
+				true_peak.push_back (av_ebur128_get_true_peaks(eb)[i]);
+			}
+			_analysis->set_true_peak (true_peak);
+			_analysis->set_integrated_loudness (av_ebur128_get_integrated_loudness(eb));
+			_analysis->set_loudness_range (av_ebur128_get_loudness_range(eb));
 		}
-		_analysis->set_true_peak (true_peak);
-		_analysis->set_integrated_loudness (av_ebur128_get_integrated_loudness(eb));
-		_analysis->set_loudness_range (av_ebur128_get_loudness_range(eb));
-	}
 #endif
+	}
 
 	if (_playlist->content().size() == 1) {
 		/* If there was only one piece of content in this analysis we may later need to know what its
@@ -170,6 +206,7 @@ AnalyseAudioJob::run ()
 	}
 
 	_analysis->set_samples_per_point (_samples_per_point);
+	_analysis->add_levels (_top_samples_per_point);
 	_analysis->set_sample_rate (_film->audio_frame_rate ());
 	_analysis->write (_path);
 
@@ -177,6 +214,332 @@ AnalyseAudioJob::run ()
 	set_state (FINISHED_OK);
 }
 
+/** @return true if we can make our analysis by combining analyses of each piece of content.
+ *  This is only possible if no two content channels are ever mixed into the same DCP
+ *  channel, and if there is no audio processor.
+ */
+bool
+AnalyseAudioJob::can_compose () const
+{
+	if (_film->audio_processor ()) {
+		return false;
+	}
+
+	/* Each point in the coarsest level must cover at least one of the blocks in a
+	   ContentAudioAnalysis; if not, the playlist is short and so quick to analyse anyway.
+	*/
+	if (_top_samples_per_point < _film->audio_frame_rate() / 10) {
+		return false;
+	}
+
+	list<pair<DCPTimePeriod, vector<bool> > > used;
+
+	BOOST_FOREACH (shared_ptr<Content> i, _playlist->content ()) {
+		if (!i->audio) {
+			continue;
+		}
+
+		vector<bool> outputs (_film->audio_channels(), false);
+		BOOST_FOREACH (AudioStreamPtr j, i->audio->streams ()) {
+			AudioMapping const mapping = j->mapping ();
+			for (int k = 0; k < mapping.input_channels(); ++k) {
+				for (int l = 0; l < std::min (mapping.output_channels(), _film->audio_channels()); ++l) {
+					if (mapping.get (k, l) != 0) {
+						if (outputs[l]) {
+							/* Two content channels are mixed into this output */
+							return false;
+						}
+						outputs[l] = true;
+					}
+				}
+			}
+		}
+
+		DCPTimePeriod const period (i->position(), i->end(_film));
+		for (list<pair<DCPTimePeriod, vector<bool> > >::const_iterator j = used.begin(); j != used.end(); ++j) {
+			if (!j->first.overlap (period)) {
+				continue;
+			}
+			for (int k = 0; k < _film->audio_channels(); ++k) {
+				if (outputs[k] && j->second[k]) {
+					/* Two pieces of content are mixed into this output */
+					return false;
+				}
+			}
+		}
+
+		used.push_back (make_pair (period, outputs));
+	}
+
+	return true;
+}
+
+/** @return Analysis of a piece of content's audio on its own, taken from disk if it was made
+ *  before, otherwise made now.
+ *  @param index Index of this content among the audio content in the playlist, for progress reporting.
+ *  @param count Number of pieces of audio content in the playlist.
+ */
+shared_ptr<ContentAudioAnalysis>
+AnalyseAudioJob::content_analysis (shared_ptr<const Content> content, int index, int count)
+{
+	boost::filesystem::path const path = _film->content_audio_analysis_path (content);
+	if (boost::filesystem::exists (path)) {
+		try {
+			return shared_ptr<ContentAudioAnalysis> (new ContentAudioAnalysis (path));
+		} catch (std::exception& e) {
+			LOG_WARNING ("Could not read content audio analysis %1 (%2); analysing again", path.string(), e.what());
+		}
+	}
+
+	vector<AudioStreamPtr> const streams = content->audio->streams ();
+	vector<int> channels;
+	BOOST_FOREACH (AudioStreamPtr i, streams) {
+		channels.push_back (i->channels ());
+	}
+
+	shared_ptr<ContentAudioAnalysis> analysis (new ContentAudioAnalysis (_film->audio_frame_rate(), channels));
+
+	shared_ptr<Decoder> decoder = decoder_factory (_film, content, true);
+	if (decoder && decoder->audio) {
+		if (decoder->video) {
+			decoder->video->set_ignore (true);
+		}
+		BOOST_FOREACH (shared_ptr<TextDecoder> i, decoder->text) {
+			i->set_ignore (true);
+		}
+		shared_ptr<DCPDecoder> dcp = boost::dynamic_pointer_cast<DCPDecoder> (decoder);
+		if (dcp) {
+			dcp->set_decode_referenced (true);
+		}
+
+		decoder->audio->Data.connect (bind (&AnalyseAudioJob::analyse_content, this, analysis, streams, _1, _2));
+
+		double const length = content->full_length(_film).seconds ();
+		while (!decoder->pass ()) {
+			if (length > 0) {
+				set_progress ((index + std::min (1.0, decoder->position().seconds() / length)) / count);
+			}
+		}
+	}
+
+	analysis->write (path);
+	return analysis;
+}
+
+void
+AnalyseAudioJob::analyse_content (shared_ptr<ContentAudioAnalysis> analysis, vector<AudioStreamPtr> streams, AudioStreamPtr stream, ContentAudio audio)
+{
+	vector<AudioStreamPtr>::const_iterator i = find (streams.begin(), streams.end(), stream);
+	DCPOMATIC_ASSERT (i != streams.end());
+	if (audio.frame >= 0) {
+		analysis->analyse (i - streams.begin(), audio.audio, audio.frame);
+	}
+}
+
+/** @return Weighting of a DCP channel in a loudness measurement, as in ITU-R BS.1770 */
+static double
+loudness_weight (int channel)
+{
+	switch (channel) {
+	case 3:
+		/* LFE */
+		return 0;
+	case 4:
+	case 5:
+	case 10:
+	case 11:
+		/* Surrounds */
+		return 1.41;
+	default:
+		return 1;
+	}
+}
+
+/** @return Loudnesses of the windows of some audio.
+ *  @param energy Sum of the squares of the K-weighted samples for each channel in each 100ms block.
+ *  @param block_size Number of frames in each block.
+ *  @param window Number of blocks in each window.
+ */
+static vector<double>
+window_loudnesses (vector<vector<double> > const & energy, int block_size, int window)
+{
+	vector<double> loudnesses;
+	if (energy.empty() || int(energy[0].size()) < window) {
+		return loudnesses;
+	}
+
+	for (size_t i = 0; i + window <= energy[0].size(); ++i) {
+		double sum = 0;
+		for (size_t j = 0; j < energy.size(); ++j) {
+			double const weight = loudness_weight (j);
+			for (int k = 0; k < window; ++k) {
+				sum += weight * energy[j][i + k];
+			}
+		}
+		loudnesses.push_back (-0.691 + 10 * log10 (std::max (sum / (window * block_size), 1e-20)));
+	}
+
+	return loudnesses;
+}
+
+/** @return Loudnesses which pass an absolute gate of -70LUFS and then a relative gate
+ *  of some level below the mean of those that pass the absolute gate.
+ */
+static vector<double>
+gate (vector<double> const & loudnesses, double relative)
+{
+	double sum = 0;
+	int n = 0;
+	BOOST_FOREACH (double i, loudnesses) {
+		if (i > -70) {
+			sum += pow (10, (i + 0.691) / 10);
+			++n;
+		}
+	}
+
+	vector<double> gated;
+	if (n == 0) {
+		return gated;
+	}
+
+	double const threshold = -0.691 + 10 * log10 (sum / n) - relative;
+	BOOST_FOREACH (double i, loudnesses) {
+		if (i > -70 && i > threshold) {
+			gated.push_back (i);
+		}
+	}
+
+	return gated;
+}
+
+/** Make our analysis from analyses of each piece of content */
+void
+AnalyseAudioJob::compose ()
+{
+	int const channels = _film->audio_channels ();
+	int const rate = _film->audio_frame_rate ();
+	Frame const start = _start.frames_round (rate);
+	Frame const length = DCPTime (_playlist->length(_film) - _start).frames_round (rate);
+
+	/* Our finest level can't have points shorter than the blocks in the content analyses */
+	while (_samples_per_point < rate / 10) {
+		_samples_per_point *= AudioAnalysis::level_factor;
+	}
+
+	/* This is the number of points that analyse() would add */
+	int const points = length > 0 ? (length - 1) / _samples_per_point + 1 : 0;
+
+	vector<vector<float> > peak (channels, vector<float> (points, 0));
+	vector<vector<double> > squares (channels, vector<double> (points, 0));
+	vector<vector<double> > energy (channels);
+	vector<float> true_peak (channels, 0);
+	vector<AudioAnalysis::PeakTime> sample_peak (channels, AudioAnalysis::PeakTime (0, DCPTime ()));
+
+	list<shared_ptr<Content> > content;
+	BOOST_FOREACH (shared_ptr<Content> i, _playlist->content ()) {
+		if (i->audio) {
+			content.push_back (i);
+		}
+	}
+
+	int index = 0;
+	BOOST_FOREACH (shared_ptr<Content> i, content) {
+		shared_ptr<ContentAudioAnalysis> analysis = content_analysis (i, index, content.size());
+		++index;
+
+		int const block_size = analysis->block_size ();
+		for (int j = 0; j < channels; ++j) {
+			energy[j].resize (length / block_size + 1, 0);
+		}
+
+		/* Offset to add to a frame index within the content to get a frame index within our analysis */
+		Frame const offset = DCPTime(i->position() - DCPTime(i->trim_start(), FrameRateChange(_film, i))).frames_round(rate) - start;
+		/* Range of frame indices within our analysis that this content covers */
+		Frame const from = max (Frame (0), i->position().frames_round(rate) - start);
+		Frame const to = std::min (length, i->end(_film).frames_round(rate) - start);
+
+		float const gain = pow (10, i->audio->gain() / 20);
+		vector<AudioStreamPtr> const streams = i->audio->streams ();
+		for (int j = 0; j < std::min (int(streams.size()), analysis->streams()); ++j) {
+			AudioMapping const mapping = streams[j]->mapping ();
+			for (int k = 0; k < std::min (mapping.input_channels(), analysis->channels(j)); ++k) {
+				for (int l = 0; l < std::min (mapping.output_channels(), channels); ++l) {
+					float const g = fabsf (mapping.get(k, l) * gain);
+					if (g == 0) {
+						continue;
+					}
+
+					vector<ContentAudioAnalysis::Block> const & blocks = analysis->blocks (j, k);
+					for (size_t m = 0; m < blocks.size(); ++m) {
+						Frame const f = Frame (m) * block_size + offset;
+						if (f < from || f >= to) {
+							continue;
+						}
+
+						int const p = f / _samples_per_point;
+						if (p >= points) {
+							continue;
+						}
+
+						ContentAudioAnalysis::Block const & b = blocks[m];
+						peak[l][p] = max (peak[l][p], g * b.peak);
+						squares[l][p] += g * g * b.sum_squares;
+						energy[l][f / block_size] += g * g * b.weighted_sum_squares;
+						true_peak[l] = max (true_peak[l], g * b.true_peak);
+						if (g * b.peak > sample_peak[l].peak) {
+							sample_peak[l] = AudioAnalysis::PeakTime (g * b.peak, DCPTime::from_frames (f + b.peak_offset, rate));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < channels; ++i) {
+		for (int j = 0; j < points; ++j) {
+			/* analyse() never records anything lower than this */
+			float const floor = 10e-7;
+			AudioPoint p;
+			p[AudioPoint::PEAK] = max (peak[i][j], floor);
+			/* The last point may be partial */
+			int64_t const frames = std::min (_samples_per_point, length - j * _samples_per_point);
+			p[AudioPoint::RMS] = max (float (sqrt (squares[i][j] / frames)), floor);
+			_analysis->add_point (i, p);
+		}
+	}
+
+	_analysis->set_sample_peak (sample_peak);
+
+#ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
+	if (Config::instance()->analyse_ebur128 ()) {
+		_analysis->set_true_peak (true_peak);
+
+		int const block_size = rate / 10;
+
+		/* Integrated loudness from 400ms windows with a relative gate of 10LU (BS.1770) */
+		vector<double> gated = gate (window_loudnesses (energy, block_size, 4), 10);
+		if (gated.empty ()) {
+			_analysis->set_integrated_loudness (-70);
+		} else {
+			double sum = 0;
+			BOOST_FOREACH (double i, gated) {
+				sum += pow (10, (i + 0.691) / 10);
+			}
+			_analysis->set_integrated_loudness (-0.691 + 10 * log10 (sum / gated.size()));
+		}
+
+		/* Loudness range from 3s windows with a relative gate of 20LU (EBU Tech 3342) */
+		gated = gate (window_loudnesses (energy, block_size, 30), 20);
+		if (gated.size() < 2) {
+			_analysis->set_loudness_range (0);
+		} else {
+			sort (gated.begin(), gated.end());
+			_analysis->set_loudness_range (gated[lrint((gated.size() - 1) * 0.95)] - gated[lrint((gated.size() - 1) * 0.1)]);
+		}
+	}
+#endif
+}
+
 void
 AnalyseAudioJob::analyse (shared_ptr<const AudioBuffers> b, DCPTime time)
 {
@@ -209,7 +572,7 @@ AnalyseAudioJob::analyse (shared_ptr<const AudioBuffers> b, DCPTime time)
 				_sample_peak_frame[j] = _done + i;
 			}
 
-			if (((_done + i) % _samples_per_point) == 0) {
+			if (((_done + i + 1) % _samples_per_point) == 0) {
 				_current[j][AudioPoint::RMS] = sqrt (_current[j][AudioPoint::RMS] / _samples_per_point);
 				_analysis->add_point (j, _current[j]);
 				_current[j] = AudioPoint ();
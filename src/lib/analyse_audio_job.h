@@ -26,6 +26,8 @@
 #include "audio_point.h"
 #include "types.h"
 #include "dcpomatic_time.h"
+#include "content_audio.h"
+#include <vector>
 
 class AudioBuffers;
 class AudioAnalysis;
@@ -33,6 +35,9 @@ class Playlist;
 class AudioPoint;
 class AudioFilterGraph;
 class Filter;
+class Content;
+class ContentAudioAnalysis;
+struct analyse_audio_compose_test;
 
 /** @class AnalyseAudioJob
  *  @brief A job to analyse the audio of a film and make a note of its
@@ -40,6 +45,10 @@ class Filter;
  *
  *  After computing the peak and RMS levels the job will write a file
  *  to Film::audio_analysis_path.
+ *
+ *  Where possible the analysis is made by combining analyses of each
+ *  piece of content on its own (see ContentAudioAnalysis), which are
+ *  kept so that only new or changed content need be decoded next time.
  */
 class AnalyseAudioJob : public Job
 {
@@ -56,16 +65,29 @@ public:
 	}
 
 private:
+	friend struct ::analyse_audio_compose_test;
+
 	void analyse (boost::shared_ptr<const AudioBuffers>, DCPTime time);
+	bool can_compose () const;
+	void compose ();
+	boost::shared_ptr<ContentAudioAnalysis> content_analysis (boost::shared_ptr<const Content> content, int index, int count);
+	void analyse_content (
+		boost::shared_ptr<ContentAudioAnalysis> analysis, std::vector<AudioStreamPtr> streams, AudioStreamPtr stream, ContentAudio audio
+		);
 
 	boost::shared_ptr<const Playlist> _playlist;
 	/** playlist's audio analysis path when the job was created */
 	boost::filesystem::path _path;
 	DCPTime _start;
 	bool _from_zero;
+	/** true to make the analysis from content analyses if we can */
+	bool _compose;
 
 	int64_t _done;
+	/** samples per point in level 0 of the analysis */
 	int64_t _samples_per_point;
+	/** samples per point in the coarsest level of the analysis */
+	int64_t _top_samples_per_point;
 	AudioPoint* _current;
 
 	float* _sample_peak;
@@ -76,5 +98,8 @@ private:
 	boost::shared_ptr<AudioFilterGraph> _ebur128;
 	std::vector<Filter const *> _filters;
 
+	/** approximate number of points in the coarsest level of the analysis */
 	static const int _num_points;
+	/** number of levels in the analysis */
+	static const int _levels;
 };
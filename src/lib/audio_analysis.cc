@@ -23,8 +23,8 @@
 #include "util.h"
 #include "playlist.h"
 #include "audio_content.h"
-#include <dcp/raw_convert.h>
-#include <libxml++/libxml++.h>
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <stdint.h>
@@ -45,123 +45,233 @@ using std::list;
 using boost::shared_ptr;
 using boost::optional;
 using boost::dynamic_pointer_cast;
-using dcp::raw_convert;
 
-int const AudioAnalysis::_current_state_version = 3;
+int const AudioAnalysis::level_factor = 4;
+
+/** Identifier at the start of each analysis file; change this if the file format changes */
+#define AUDIO_ANALYSIS_MAGIC 0x44434103
 
 AudioAnalysis::AudioAnalysis (int channels)
+	: _samples_per_point (1)
+	, _sample_rate (0)
 {
-	_data.resize (channels);
+	_data.resize (1);
+	_data[0].resize (channels);
 }
 
 AudioAnalysis::AudioAnalysis (boost::filesystem::path filename)
 {
-	cxml::Document f ("AudioAnalysis");
-	f.read_file (filename);
-
-	if (f.optional_number_child<int>("Version").get_value_or(1) < _current_state_version) {
-		/* Too old.  Throw an exception so that this analysis is re-run. */
-		throw OldFormatError ("Audio analysis file is too old");
+	FILE* f = fopen_boost (filename, "rb");
+	if (!f) {
+		throw OpenFileError (filename, errno, OpenFileError::READ);
 	}
 
-	BOOST_FOREACH (cxml::NodePtr i, f.node_children ("Channel")) {
-		vector<AudioPoint> channel;
+	try {
+		int32_t magic;
+		checked_fread (&magic, sizeof(magic), f, filename);
+		if (magic != AUDIO_ANALYSIS_MAGIC) {
+			/* Probably an old XML analysis.  Throw an exception so that this analysis is re-run. */
+			throw OldFormatError ("Audio analysis file is too old");
+		}
+
+		int32_t header[4];
+		checked_fread (header, sizeof(header), f, filename);
+		int const channels = header[0];
+		int const levels = header[1];
+		_sample_rate = header[2];
+		bool const have_loudness = header[3];
+
+		checked_fread (&_samples_per_point, sizeof(_samples_per_point), f, filename);
 
-		BOOST_FOREACH (cxml::NodePtr j, i->node_children ("Point")) {
-			channel.push_back (AudioPoint (j));
+		double gain;
+		checked_fread (&gain, sizeof(gain), f, filename);
+		if (!std::isnan (gain)) {
+			_analysis_gain = gain;
 		}
 
-		_data.push_back (channel);
-	}
+		for (int i = 0; i < channels; ++i) {
+			float peak;
+			int64_t time;
+			checked_fread (&peak, sizeof(peak), f, filename);
+			checked_fread (&time, sizeof(time), f, filename);
+			_sample_peak.push_back (PeakTime (peak, DCPTime (time)));
+		}
 
-	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children ("SamplePeak")) {
-		_sample_peak.push_back (
-			PeakTime (
-				dcp::raw_convert<float>(i->content()), DCPTime(i->number_attribute<Frame>("Time"))
-				)
-			);
-	}
+		if (have_loudness) {
+			_true_peak.resize (channels);
+			checked_fread (&_true_peak[0], channels * sizeof(float), f, filename);
+			float loudness[2];
+			checked_fread (loudness, sizeof(loudness), f, filename);
+			_integrated_loudness = loudness[0];
+			_loudness_range = loudness[1];
+		}
 
-	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children ("TruePeak")) {
-		_true_peak.push_back (dcp::raw_convert<float> (i->content ()));
+		/* Read the points for each level and channel in one go, and then unpack them */
+		_data.resize (levels);
+		vector<float> buffer;
+		for (int i = 0; i < levels; ++i) {
+			_data[i].resize (channels);
+			for (int j = 0; j < channels; ++j) {
+				int32_t points;
+				checked_fread (&points, sizeof(points), f, filename);
+				buffer.resize (points * AudioPoint::COUNT);
+				if (points > 0) {
+					checked_fread (&buffer[0], buffer.size() * sizeof(float), f, filename);
+				}
+				_data[i][j].resize (points);
+				float const * p = buffer.empty() ? 0 : &buffer[0];
+				for (int k = 0; k < points; ++k) {
+					for (int l = 0; l < AudioPoint::COUNT; ++l) {
+						_data[i][j][k][l] = *p++;
+					}
+				}
+			}
+		}
+	} catch (...) {
+		fclose (f);
+		throw;
 	}
 
-	_integrated_loudness = f.optional_number_child<float> ("IntegratedLoudness");
-	_loudness_range = f.optional_number_child<float> ("LoudnessRange");
-
-	_analysis_gain = f.optional_number_child<double> ("AnalysisGain");
-	_samples_per_point = f.number_child<int64_t> ("SamplesPerPoint");
-	_sample_rate = f.number_child<int64_t> ("SampleRate");
+	fclose (f);
 }
 
 void
 AudioAnalysis::add_point (int c, AudioPoint const & p)
 {
 	DCPOMATIC_ASSERT (c < channels ());
-	_data[c].push_back (p);
+	DCPOMATIC_ASSERT (levels() == 1);
+	_data[0][c].push_back (p);
+}
+
+/** Make the levels after level 0 by combining its points.
+ *  @param samples_per_point Samples per point to stop at; no level will have more than this.
+ */
+void
+AudioAnalysis::add_levels (int64_t samples_per_point)
+{
+	_data.resize (1);
+
+	while (this->samples_per_point(levels() - 1) * level_factor <= samples_per_point) {
+		vector<vector<AudioPoint> > const & from = _data.back ();
+		vector<vector<AudioPoint> > to (from.size());
+		for (size_t i = 0; i < from.size(); ++i) {
+			for (size_t j = 0; j < from[i].size(); j += level_factor) {
+				AudioPoint p;
+				size_t const n = std::min (size_t (level_factor), from[i].size() - j);
+				for (size_t k = j; k < j + n; ++k) {
+					AudioPoint q = from[i][k];
+					p[AudioPoint::PEAK] = max (p[AudioPoint::PEAK], q[AudioPoint::PEAK]);
+					p[AudioPoint::RMS] += pow (q[AudioPoint::RMS], 2);
+				}
+				p[AudioPoint::RMS] = sqrt (p[AudioPoint::RMS] / n);
+				to[i].push_back (p);
+			}
+		}
+		_data.push_back (to);
+	}
 }
 
 AudioPoint
-AudioAnalysis::get_point (int c, int p) const
+AudioAnalysis::get_point (int c, int p, int level) const
 {
-	DCPOMATIC_ASSERT (p < points (c));
-	return _data[c][p];
+	DCPOMATIC_ASSERT (p < points (c, level));
+	return _data[level][c][p];
 }
 
 int
 AudioAnalysis::channels () const
 {
-	return _data.size ();
+	return _data[0].size ();
 }
 
 int
-AudioAnalysis::points (int c) const
+AudioAnalysis::points (int c, int level) const
 {
+	DCPOMATIC_ASSERT (level < levels ());
 	DCPOMATIC_ASSERT (c < channels ());
-	return _data[c].size ();
+	return _data[level][c].size ();
 }
 
-void
-AudioAnalysis::write (boost::filesystem::path filename)
+int64_t
+AudioAnalysis::samples_per_point (int level) const
 {
-	shared_ptr<xmlpp::Document> doc (new xmlpp::Document);
-	xmlpp::Element* root = doc->create_root_node ("AudioAnalysis");
-
-	root->add_child("Version")->add_child_text (raw_convert<string> (_current_state_version));
-
-	BOOST_FOREACH (vector<AudioPoint>& i, _data) {
-		xmlpp::Element* channel = root->add_child ("Channel");
-		BOOST_FOREACH (AudioPoint& j, i) {
-			j.as_xml (channel->add_child ("Point"));
-		}
-	}
-
-	for (size_t i = 0; i < _sample_peak.size(); ++i) {
-		xmlpp::Element* n = root->add_child("SamplePeak");
-		n->add_child_text (raw_convert<string> (_sample_peak[i].peak));
-		n->set_attribute ("Time", raw_convert<string> (_sample_peak[i].time.get()));
+	int64_t spp = _samples_per_point;
+	for (int i = 0; i < level; ++i) {
+		spp *= level_factor;
 	}
+	return spp;
+}
 
-	BOOST_FOREACH (float i, _true_peak) {
-		root->add_child("TruePeak")->add_child_text (raw_convert<string> (i));
+void
+AudioAnalysis::write (boost::filesystem::path filename)
+{
+	/* Write to a temporary file and then rename so that we never have a partially-written
+	   analysis with the proper name.
+	*/
+	boost::filesystem::path tmp = filename;
+	tmp += ".tmp";
+
+	FILE* f = fopen_boost (tmp, "wb");
+	if (!f) {
+		throw OpenFileError (tmp, errno, OpenFileError::WRITE);
 	}
 
-	if (_integrated_loudness) {
-		root->add_child("IntegratedLoudness")->add_child_text (raw_convert<string> (_integrated_loudness.get ()));
-	}
+	try {
+		bool const have_loudness = _integrated_loudness && _loudness_range && int(_true_peak.size()) == channels();
+
+		int32_t const header[5] = {
+			AUDIO_ANALYSIS_MAGIC,
+			channels(),
+			levels(),
+			_sample_rate,
+			have_loudness ? 1 : 0
+		};
+		checked_fwrite (header, sizeof(header), f, tmp);
+		checked_fwrite (&_samples_per_point, sizeof(_samples_per_point), f, tmp);
+
+		double const gain = _analysis_gain.get_value_or (NAN);
+		checked_fwrite (&gain, sizeof(gain), f, tmp);
+
+		for (int i = 0; i < channels(); ++i) {
+			float peak = 0;
+			int64_t time = 0;
+			if (i < int(_sample_peak.size())) {
+				peak = _sample_peak[i].peak;
+				time = _sample_peak[i].time.get();
+			}
+			checked_fwrite (&peak, sizeof(peak), f, tmp);
+			checked_fwrite (&time, sizeof(time), f, tmp);
+		}
 
-	if (_loudness_range) {
-		root->add_child("LoudnessRange")->add_child_text (raw_convert<string> (_loudness_range.get ()));
-	}
+		if (have_loudness) {
+			checked_fwrite (&_true_peak[0], _true_peak.size() * sizeof(float), f, tmp);
+			float const loudness[2] = { _integrated_loudness.get(), _loudness_range.get() };
+			checked_fwrite (loudness, sizeof(loudness), f, tmp);
+		}
 
-	if (_analysis_gain) {
-		root->add_child("AnalysisGain")->add_child_text (raw_convert<string> (_analysis_gain.get ()));
+		vector<float> buffer;
+		BOOST_FOREACH (vector<vector<AudioPoint> > const & i, _data) {
+			BOOST_FOREACH (vector<AudioPoint> const & j, i) {
+				int32_t const points = j.size ();
+				checked_fwrite (&points, sizeof(points), f, tmp);
+				buffer.clear ();
+				BOOST_FOREACH (AudioPoint k, j) {
+					for (int l = 0; l < AudioPoint::COUNT; ++l) {
+						buffer.push_back (k[l]);
+					}
+				}
+				if (!buffer.empty()) {
+					checked_fwrite (&buffer[0], buffer.size() * sizeof(float), f, tmp);
+				}
+			}
+		}
+	} catch (...) {
+		fclose (f);
+		throw;
 	}
 
-	root->add_child("SamplesPerPoint")->add_child_text (raw_convert<string> (_samples_per_point));
-	root->add_child("SampleRate")->add_child_text (raw_convert<string> (_sample_rate));
-
-	doc->write_to_file_formatted (filename.string ());
+	fclose (f);
+	boost::filesystem::rename (tmp, filename);
 }
 
 float
@@ -23,17 +23,20 @@
 
 #include "dcpomatic_time.h"
 #include "audio_point.h"
-#include <libcxml/cxml.h>
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
 #include <vector>
 
-namespace xmlpp {
-	class Element;
-}
-
 class Playlist;
 
+/** @class AudioAnalysis
+ *  @brief Peak and RMS levels of some audio, with some overall measurements.
+ *
+ *  The levels are kept at a number of resolutions.  Level 0 has the most points;
+ *  each subsequent level has level_factor times fewer, so that a plot can use
+ *  whichever level suits the section of audio that it is showing.
+ */
 class AudioAnalysis : public boost::noncopyable
 {
 public:
@@ -41,6 +44,7 @@ public:
 	explicit AudioAnalysis (boost::filesystem::path);
 
 	void add_point (int c, AudioPoint const & p);
+	void add_levels (int64_t samples_per_point);
 
 	struct PeakTime {
 		PeakTime (float p, DCPTime t)
@@ -68,10 +72,14 @@ public:
 		_loudness_range = r;
 	}
 
-	AudioPoint get_point (int c, int p) const;
-	int points (int c) const;
+	AudioPoint get_point (int c, int p, int level = 0) const;
+	int points (int c, int level = 0) const;
 	int channels () const;
 
+	int levels () const {
+		return _data.size ();
+	}
+
 	std::vector<PeakTime> sample_peak () const {
 		return _sample_peak;
 	}
@@ -100,10 +108,9 @@ public:
 		_analysis_gain = gain;
 	}
 
-	int64_t samples_per_point () const {
-		return _samples_per_point;
-	}
+	int64_t samples_per_point (int level = 0) const;
 
+	/** @param spp Samples per point in level 0 */
 	void set_samples_per_point (int64_t spp) {
 		_samples_per_point = spp;
 	}
@@ -120,8 +127,12 @@ public:
 
 	float gain_correction (boost::shared_ptr<const Playlist> playlist);
 
+	/** Number of points in each level which are combined to make one point in the next */
+	static int const level_factor;
+
 private:
-	std::vector<std::vector<AudioPoint> > _data;
+	/** Points in each level, for each channel */
+	std::vector<std::vector<std::vector<AudioPoint> > > _data;
 	std::vector<PeakTime> _sample_peak;
 	std::vector<float> _true_peak;
 	boost::optional<float> _integrated_loudness;
@@ -131,10 +142,9 @@ private:
 	 *  happened.
 	 */
 	boost::optional<double> _analysis_gain;
+	/** Samples per point in level 0 */
 	int64_t _samples_per_point;
 	int _sample_rate;
-
-	static int const _current_state_version;
 };
 
 #endif
@@ -20,14 +20,66 @@
 
 #include "audio_buffers.h"
 #include "dcpomatic_assert.h"
+#include "buffer_pool.h"
+#include <boost/atomic.hpp>
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
 #include <cassert>
 #include <cstring>
 #include <cmath>
 #include <stdexcept>
 
 using std::bad_alloc;
+using std::vector;
 using boost::shared_ptr;
 
+/** Memory for the channels of some AudioBuffers, which is given back to the pool
+ *  when the last AudioBuffers using it is finished with it.
+ */
+struct AudioBuffers::Storage : public boost::noncopyable
+{
+	Storage (int channels, int32_t frames)
+		: references (0)
+	{
+		for (int i = 0; i < channels; ++i) {
+			data.push_back (static_cast<float*> (BufferPool::instance()->allocate (frames * sizeof (float))));
+		}
+	}
+
+	~Storage ()
+	{
+		BOOST_FOREACH (float* i, data) {
+			BufferPool::instance()->release (i);
+		}
+	}
+
+	/** one block for each channel */
+	vector<float*> data;
+	/** number of AudioBuffers using this storage */
+	boost::atomic<int> references;
+};
+
+void
+intrusive_ptr_add_ref (AudioBuffers::Storage* storage)
+{
+	/* Whoever is adding a reference already has one, so nobody can be deciding to
+	   write to the data or to delete it on the strength of this count.
+	*/
+	storage->references.fetch_add (1, boost::memory_order_relaxed);
+}
+
+void
+intrusive_ptr_release (AudioBuffers::Storage* storage)
+{
+	/* Release so that what we did with the data happens before the last user
+	   deletes it, or (see make_writable) decides that it may write to it.
+	*/
+	if (storage->references.fetch_sub (1, boost::memory_order_release) == 1) {
+		boost::atomic_thread_fence (boost::memory_order_acquire);
+		delete storage;
+	}
+}
+
 /** Construct an AudioBuffers.  Audio data is undefined after this constructor.
  *  @param channels Number of channels.
  *  @param frames Number of frames to reserve space for.
@@ -52,6 +104,27 @@ AudioBuffers::AudioBuffers (boost::shared_ptr<const AudioBuffers> other)
 	copy_from (other.get(), other->_frames, 0, 0);
 }
 
+/** Construct an AudioBuffers which uses some of the data of another without copying it.
+ *  If either AudioBuffers is changed afterwards it will get its own copy of the data first.
+ *  @param other AudioBuffers to use data from.
+ *  @param offset Index of the first frame in `other' to use.
+ *  @param frames Number of frames to use.
+ */
+AudioBuffers::AudioBuffers (shared_ptr<const AudioBuffers> other, int32_t offset, int32_t frames)
+	: _channels (other->_channels)
+	, _frames (frames)
+	, _allocated_frames (frames)
+	, _storage (other->_storage)
+{
+	DCPOMATIC_ASSERT (offset >= 0 && frames >= 0);
+	DCPOMATIC_ASSERT ((offset + frames) <= other->_allocated_frames);
+
+	allocate_pointers ();
+	for (int i = 0; i < _channels; ++i) {
+		_data[i] = other->_data[i] + offset;
+	}
+}
+
 AudioBuffers &
 AudioBuffers::operator= (AudioBuffers const & other)
 {
@@ -82,27 +155,50 @@ AudioBuffers::allocate (int channels, int32_t frames)
 	_frames = frames;
 	_allocated_frames = frames;
 
+	allocate_pointers ();
+	_storage.reset (new Storage (_channels, frames));
+	for (int i = 0; i < _channels; ++i) {
+		_data[i] = _storage->data[i];
+	}
+}
+
+/** Allocate _data for _channels pointers, without setting them */
+void
+AudioBuffers::allocate_pointers ()
+{
 	_data = static_cast<float**> (malloc (_channels * sizeof (float *)));
 	if (!_data) {
 		throw bad_alloc ();
 	}
-
-	for (int i = 0; i < _channels; ++i) {
-		_data[i] = static_cast<float*> (malloc (frames * sizeof (float)));
-		if (!_data[i]) {
-			throw bad_alloc ();
-		}
-	}
 }
 
 void
 AudioBuffers::deallocate ()
 {
+	free (_data);
+	_storage.reset ();
+}
+
+/** Make sure that our data is not shared with any other AudioBuffers, by copying it
+ *  if necessary; this must be called before changing the data.
+ */
+void
+AudioBuffers::make_writable ()
+{
+	/* Acquire, pairing with the release in intrusive_ptr_release, so that if we are now the only
+	   user of the data anything that the other users did with it happens before we change it.
+	*/
+	if (_storage->references.load (boost::memory_order_acquire) == 1) {
+		return;
+	}
+
+	boost::intrusive_ptr<Storage> storage (new Storage (_channels, _allocated_frames));
 	for (int i = 0; i < _channels; ++i) {
-		free (_data[i]);
+		memcpy (storage->data[i], _data[i], _allocated_frames * sizeof (float));
+		_data[i] = storage->data[i];
 	}
 
-	free (_data);
+	_storage = storage;
 }
 
 /** @param c Channel index.
@@ -125,6 +221,10 @@ AudioBuffers::set_frames (int32_t f)
 {
 	DCPOMATIC_ASSERT (f <= _allocated_frames);
 
+	if (f < _frames) {
+		make_writable ();
+	}
+
 	for (int c = 0; c < _channels; ++c) {
 		for (int i = f; i < _frames; ++i) {
 			_data[c][i] = 0;
@@ -138,6 +238,8 @@ AudioBuffers::set_frames (int32_t f)
 void
 AudioBuffers::make_silent ()
 {
+	make_writable ();
+
 	for (int i = 0; i < _channels; ++i) {
 		make_silent (i);
 	}
@@ -151,6 +253,8 @@ AudioBuffers::make_silent (int c)
 {
 	DCPOMATIC_ASSERT (c >= 0 && c < _channels);
 
+	make_writable ();
+
 	for (int i = 0; i < _frames; ++i) {
 		_data[c][i] = 0;
 	}
@@ -165,6 +269,8 @@ AudioBuffers::make_silent (int32_t from, int32_t frames)
 {
 	DCPOMATIC_ASSERT ((from + frames) <= _allocated_frames);
 
+	make_writable ();
+
 	for (int c = 0; c < _channels; ++c) {
 		for (int i = from; i < (from + frames); ++i) {
 			_data[c][i] = 0;
@@ -197,6 +303,8 @@ AudioBuffers::copy_from (AudioBuffers const * from, int32_t frames_to_copy, int3
 				);
 	}
 
+	make_writable ();
+
 	for (int i = 0; i < _channels; ++i) {
 		memcpy (_data[i] + write_offset, from->_data[i] + read_offset, frames_to_copy * sizeof(float));
 	}
@@ -223,6 +331,8 @@ AudioBuffers::move (int32_t frames, int32_t from, int32_t to)
 	DCPOMATIC_ASSERT ((from + frames) <= _frames);
 	DCPOMATIC_ASSERT ((to + frames) <= _allocated_frames);
 
+	make_writable ();
+
 	for (int i = 0; i < _channels; ++i) {
 		memmove (_data[i] + to, _data[i] + from, frames * sizeof(float));
 	}
@@ -241,6 +351,8 @@ AudioBuffers::accumulate_channel (AudioBuffers const * from, int from_channel, i
 	DCPOMATIC_ASSERT (from->frames() == N);
 	DCPOMATIC_ASSERT (to_channel <= _channels);
 
+	make_writable ();
+
 	float* s = from->data (from_channel);
 	float* d = _data[to_channel];
 
@@ -260,7 +372,7 @@ AudioBuffers::ensure_size (int32_t frames)
 	}
 
 	/* Round up frames to the next power of 2 to reduce the number
-	   of realloc()s that are necessary.
+	   of reallocations that are necessary.
 	*/
 	frames--;
 	frames |= frames >> 1;
@@ -270,16 +382,17 @@ AudioBuffers::ensure_size (int32_t frames)
 	frames |= frames >> 16;
 	frames++;
 
+	boost::intrusive_ptr<Storage> storage (new Storage (_channels, frames));
 	for (int i = 0; i < _channels; ++i) {
-		_data[i] = static_cast<float*> (realloc (_data[i], frames * sizeof (float)));
-		if (!_data[i]) {
-			throw bad_alloc ();
-		}
+		float* data = storage->data[i];
+		memcpy (data, _data[i], _allocated_frames * sizeof (float));
 		for (int j = _allocated_frames; j < frames; ++j) {
-			_data[i][j] = 0;
+			data[j] = 0;
 		}
+		_data[i] = data;
 	}
 
+	_storage = storage;
 	_allocated_frames = frames;
 }
 
@@ -296,6 +409,8 @@ AudioBuffers::accumulate_frames (AudioBuffers const * from, int32_t frames, int3
 	DCPOMATIC_ASSERT (read_offset >= 0);
 	DCPOMATIC_ASSERT (write_offset >= 0);
 
+	make_writable ();
+
 	float** from_data = from->data ();
 	for (int i = 0; i < _channels; ++i) {
 		for (int j = 0; j < frames; ++j) {
@@ -310,6 +425,8 @@ AudioBuffers::apply_gain (float dB)
 {
 	float const linear = pow (10, dB / 20);
 
+	make_writable ();
+
 	for (int i = 0; i < _channels; ++i) {
 		for (int j = 0; j < _frames; ++j) {
 			_data[i][j] *= linear;
@@ -337,6 +454,7 @@ void
 AudioBuffers::copy_channel_from (AudioBuffers const * from, int from_channel, int to_channel)
 {
 	DCPOMATIC_ASSERT (from->frames() == frames());
+	make_writable ();
 	memcpy (data(to_channel), from->data(from_channel), frames() * sizeof (float));
 }
 
@@ -359,11 +477,18 @@ AudioBuffers::append (shared_ptr<const AudioBuffers> other)
 	_frames += other->frames();
 }
 
-/** Remove some frames from the start of these AudioBuffers */
+/** Remove some frames from the start of these AudioBuffers.  Nothing is copied; we
+ *  just stop using the start of our data.
+ */
 void
 AudioBuffers::trim_start (int32_t frames)
 {
-	DCPOMATIC_ASSERT (frames <= _frames);
-	move (_frames - frames, frames, 0);
-	set_frames (_frames - frames);
+	DCPOMATIC_ASSERT (frames >= 0 && frames <= _frames);
+
+	for (int i = 0; i < _channels; ++i) {
+		_data[i] += frames;
+	}
+
+	_frames -= frames;
+	_allocated_frames -= frames;
 }
@@ -26,6 +26,7 @@
 #define DCPOMATIC_AUDIO_BUFFERS_H
 
 #include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <stdint.h>
 
 /** @class AudioBuffers
@@ -34,6 +35,10 @@
  *  The use of int32_t for frame counts in this class is due to the
  *  round-up to the next power-of-2 code in ensure_size(); if that
  *  were changed the frame count could use any integer type.
+ *
+ *  Several AudioBuffers may share the same data (see the constructor which
+ *  takes an offset and a frame count); any of them which is then modified
+ *  by one of the methods here gets its own copy of the data first.
  */
 class AudioBuffers
 {
@@ -41,6 +46,7 @@ public:
 	AudioBuffers (int channels, int32_t frames);
 	AudioBuffers (AudioBuffers const &);
 	explicit AudioBuffers (boost::shared_ptr<const AudioBuffers>);
+	AudioBuffers (boost::shared_ptr<const AudioBuffers> other, int32_t offset, int32_t frames);
 	~AudioBuffers ();
 
 	AudioBuffers & operator= (AudioBuffers const &);
@@ -50,6 +56,10 @@ public:
 
 	void ensure_size (int32_t);
 
+	/** @return Pointers to the data of each channel.  The data may be shared with other
+	 *  AudioBuffers, so it must only be modified by the methods here (which take a private
+	 *  copy first) and not directly, unless these AudioBuffers were made with their own data.
+	 */
 	float** data () const {
 		return _data;
 	}
@@ -81,8 +91,15 @@ public:
 	void trim_start (int32_t frames);
 
 private:
+	struct Storage;
+
+	friend void intrusive_ptr_add_ref (Storage* storage);
+	friend void intrusive_ptr_release (Storage* storage);
+
 	void allocate (int channels, int32_t frames);
+	void allocate_pointers ();
 	void deallocate ();
+	void make_writable ();
 
 	/** Number of channels */
 	int _channels;
@@ -90,8 +107,12 @@ private:
 	int32_t _frames;
 	/** Number of frames that _data can hold */
 	int32_t _allocated_frames;
-	/** Audio data (so that, e.g. _data[2][6] is channel 2, sample 6) */
+	/** Audio data (so that, e.g. _data[2][6] is channel 2, sample 6); this points
+	 *  into _storage, but not necessarily at the start of it.
+	 */
 	float** _data;
+	/** the memory that _data points into, which may be shared with other AudioBuffers */
+	boost::intrusive_ptr<Storage> _storage;
 };
 
 #endif
@@ -72,11 +72,10 @@ AudioMerger::pull (DCPTime time)
 			DCPOMATIC_ASSERT (i.audio->frames() > 0);
 			out.push_back (make_pair (i.audio, i.time));
 		} else if (i.time < time) {
-			/* Overlaps the end of the pull period */
-			shared_ptr<AudioBuffers> audio (new AudioBuffers (i.audio->channels(), frames(DCPTime(time - i.time))));
+			/* Overlaps the end of the pull period; the part that we return shares the data with what we keep */
+			shared_ptr<AudioBuffers> audio (new AudioBuffers (i.audio, 0, frames(DCPTime(time - i.time))));
 			/* Though time > i.time, audio->frames() could be 0 if the difference in time is less than one frame */
 			if (audio->frames() > 0) {
-				audio->copy_from (i.audio.get(), audio->frames(), 0, 0);
 				out.push_back (make_pair (audio, i.time));
 				i.audio->trim_start (audio->frames ());
 				i.time += DCPTime::from_frames(audio->frames(), _frame_rate);
@@ -142,9 +141,8 @@ AudioMerger::push (boost::shared_ptr<const AudioBuffers> audio, DCPTime time)
 			}
 		}
 
-		/* Get the part of audio that we want to use */
-		shared_ptr<AudioBuffers> part (new AudioBuffers (audio->channels(), frames(i.to) - frames(i.from)));
-		part->copy_from (audio.get(), part->frames(), frames(DCPTime(i.from - time)), 0);
+		/* Get the part of audio that we want to use; this is only copied if we later change it */
+		shared_ptr<AudioBuffers> part (new AudioBuffers (audio, frames(DCPTime(i.from - time)), frames(i.to) - frames(i.from)));
 
 		if (before == _buffers.end() && after == _buffers.end()) {
 			if (part->frames() > 0) {
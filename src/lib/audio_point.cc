@@ -19,11 +19,6 @@
 */
 
 #include "audio_point.h"
-#include <dcp/raw_convert.h>
-#include <libxml++/libxml++.h>
-
-using std::string;
-using dcp::raw_convert;
 
 AudioPoint::AudioPoint ()
 {
@@ -32,12 +27,6 @@ AudioPoint::AudioPoint ()
 	}
 }
 
-AudioPoint::AudioPoint (cxml::ConstNodePtr node)
-{
-	_data[PEAK] = node->number_child<float> ("Peak");
-	_data[RMS] = node->number_child<float> ("RMS");
-}
-
 AudioPoint::AudioPoint (AudioPoint const & other)
 {
 	for (int i = 0; i < COUNT; ++i) {
@@ -58,10 +47,3 @@ AudioPoint::operator= (AudioPoint const & other)
 
 	return *this;
 }
-
-void
-AudioPoint::as_xml (xmlpp::Element* parent) const
-{
-	parent->add_child ("Peak")->add_child_text (raw_convert<string> (_data[PEAK]));
-	parent->add_child ("RMS")->add_child_text (raw_convert<string> (_data[RMS]));
-}
@@ -21,12 +21,6 @@
 #ifndef DCPOMATIC_AUDIO_POINT_H
 #define DCPOMATIC_AUDIO_POINT_H
 
-#include <libcxml/cxml.h>
-
-namespace xmlpp {
-	class Element;
-}
-
 class AudioPoint
 {
 public:
@@ -37,12 +31,9 @@ public:
 	};
 
 	AudioPoint ();
-	explicit AudioPoint (cxml::ConstNodePtr node);
 	AudioPoint (AudioPoint const &);
 	AudioPoint& operator= (AudioPoint const &);
 
-	void as_xml (xmlpp::Element *) const;
-
 	inline float& operator[] (int t) {
 		return _data[t];
 	}
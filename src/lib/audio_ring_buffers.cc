@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2019 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2020 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -21,113 +21,277 @@
 #include "audio_ring_buffers.h"
 #include "dcpomatic_assert.h"
 #include "exceptions.h"
+#include "compose.hpp"
 #include <boost/foreach.hpp>
 #include <iostream>
 
 using std::min;
+using std::max;
 using std::cout;
-using std::make_pair;
-using std::pair;
-using std::list;
 using boost::shared_ptr;
 using boost::optional;
 
-AudioRingBuffers::AudioRingBuffers ()
-	: _used_in_head (0)
+/** Number of frames of space to allocate at first; this is doubled as required */
+static Frame const initial_allocation = 32768;
+
+/** @param capacity Maximum number of frames that can be held; put() will throw if this is exceeded */
+AudioRingBuffers::AudioRingBuffers (Frame capacity)
+	: _capacity (capacity)
+	, _channels (0)
+	, _buffer (0)
+	, _readers (0)
+	, _write (0)
+	, _read (0)
+	, _start_sequence (0)
+	, _start_frame (0)
+	, _start_time (0)
+	, _underruns (0)
+	, _collisions (0)
 {
 
 }
 
+AudioRingBuffers::~AudioRingBuffers ()
+{
+	delete _buffer.load ();
+	BOOST_FOREACH (Buffer* i, _retired) {
+		delete i;
+	}
+}
+
 /** @param frame_rate Frame rate in use; this is only used to check timing consistency of the incoming data */
 void
 AudioRingBuffers::put (shared_ptr<const AudioBuffers> data, DCPTime time, int frame_rate)
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	if (!_buffer.load (boost::memory_order_relaxed)) {
+		/* No-one will look at the buffer until we have set _write, below */
+		_channels = data->channels ();
+	}
+
+	DCPOMATIC_ASSERT (data->channels() == _channels);
+
+	Frame const write = _write.load (boost::memory_order_relaxed);
+	Frame const read = _read.load (boost::memory_order_acquire);
+	Frame const frames = data->frames ();
+
+	if (write - read + frames > _capacity) {
+		throw ProgrammingError (__FILE__, __LINE__, String::compose ("Audio ring buffer overflow (%1 frames)", write - read + frames));
+	}
+
+	grow (write - read + frames, read, write);
+
+	/* Any get() that starts from now on will use the current buffer, so if there are none
+	   running no-one can be using the ones we have grown out of.
+	*/
+	if (!_retired.empty() && _readers.load() == 0) {
+		BOOST_FOREACH (Buffer* i, _retired) {
+			delete i;
+		}
+		_retired.clear ();
+	}
+
+	if (_end && write != read) {
+		if (labs(_end->get() - time.get()) > 1) {
+			cout << "bad put " << to_string(*_end) << " " << to_string(time) << "\n";
+		}
+		DCPOMATIC_ASSERT (labs(_end->get() - time.get()) < 2);
+	} else {
+		/* Either we have just been cleared, or everything has been read, so this data can
+		   have any time it likes.
+		*/
+		set_start (write, time);
+	}
 
-	if (!_buffers.empty()) {
-		DCPOMATIC_ASSERT (_buffers.front().first->channels() == data->channels());
-		DCPTime const end = (_buffers.back().second + DCPTime::from_frames(_buffers.back().first->frames(), frame_rate));
-		if (labs(end.get() - time.get()) > 1) {
-			cout << "bad put " << to_string(_buffers.back().second) << " " << _buffers.back().first->frames() << " " << to_string(time) << "\n";
+	Buffer* buffer = _buffer.load (boost::memory_order_relaxed);
+	float** p = data->data ();
+	for (Frame i = 0; i < frames; ++i) {
+		float* q = buffer->data.get() + ((write + i) % buffer->capacity) * _channels;
+		for (int j = 0; j < _channels; ++j) {
+			*q++ = p[j][i];
 		}
-		DCPOMATIC_ASSERT (labs(end.get() - time.get()) < 2);
 	}
 
-	_buffers.push_back(make_pair(data, time));
+	_write.store (write + frames, boost::memory_order_release);
+	_end = time + DCPTime::from_frames (frames, frame_rate);
 }
 
-/** @return time of the returned data; if it's not set this indicates an underrun */
+/** Write audio into out, without ever blocking.  This must only be called from one thread.
+ *  @return time of the returned data; if it's not set this indicates an underrun.
+ */
 optional<DCPTime>
 AudioRingBuffers::get (float* out, int channels, int frames)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-
-	optional<DCPTime> time;
-
-	while (frames > 0) {
-		if (_buffers.empty ()) {
-			for (int i = 0; i < frames; ++i) {
-				for (int j = 0; j < channels; ++j) {
-					*out++ = 0;
-				}
-			}
-			cout << "audio underrun; missing " << frames << "!\n";
-			return time;
-		}
+	/* This must come before we look at _buffer, so that put() does not free a buffer we are using */
+	++_readers;
 
-		pair<shared_ptr<const AudioBuffers>, DCPTime> front = _buffers.front ();
-		if (!time) {
-			time = front.second + DCPTime::from_frames(_used_in_head, 48000);
-		}
+	Frame const read = _read.load (boost::memory_order_relaxed);
+	Frame const write = _write.load (boost::memory_order_acquire);
+	/* Anything up to write is in this buffer, as put() sets the buffer before it moves _write */
+	Buffer const* buffer = _buffer.load ();
 
-		int const to_do = min (frames, front.first->frames() - _used_in_head);
-		float** p = front.first->data();
-		int const c = min (front.first->channels(), channels);
-		for (int i = 0; i < to_do; ++i) {
-			for (int j = 0; j < c; ++j) {
-				*out++ = p[j][i + _used_in_head];
-			}
-			for (int j = c; j < channels; ++j) {
-				*out++ = 0;
-			}
+	Frame start_frame;
+	DCPTime start_time;
+	bool const have_start = start (start_frame, start_time);
+
+	int to_do = 0;
+	if (have_start && read >= start_frame) {
+		to_do = min (Frame (frames), write - read);
+	}
+
+	/* If we have something to do we have seen the put() which set up _channels and _buffer */
+	int const c = to_do > 0 ? min (_channels, channels) : 0;
+	float* o = out;
+	for (int i = 0; i < to_do; ++i) {
+		float const* p = buffer->data.get() + ((read + i) % buffer->capacity) * _channels;
+		for (int j = 0; j < c; ++j) {
+			*o++ = p[j];
+		}
+		for (int j = c; j < channels; ++j) {
+			*o++ = 0;
 		}
-		_used_in_head += to_do;
-		frames -= to_do;
+	}
+
+	Frame expected = read;
+	if (!_read.compare_exchange_strong (expected, read + to_do)) {
+		/* clear() moved _read while we were copying, so what we have may be out of date
+		   (and may even have been overwritten by a later put()).  Give silence instead.
+		*/
+		++_collisions;
+		o = out;
+		to_do = 0;
+	}
+
+	--_readers;
 
-		if (_used_in_head == front.first->frames()) {
-			_buffers.pop_front ();
-			_used_in_head = 0;
+	for (int i = to_do; i < frames; ++i) {
+		for (int j = 0; j < channels; ++j) {
+			*o++ = 0;
 		}
 	}
 
-	return time;
+	if (to_do < frames) {
+		++_underruns;
+	}
+
+	if (to_do == 0) {
+		return optional<DCPTime> ();
+	}
+
+	return start_time + DCPTime::from_frames (read - start_frame, 48000);
 }
 
 optional<DCPTime>
 AudioRingBuffers::peek () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	if (_buffers.empty()) {
+	Frame const read = _read.load (boost::memory_order_acquire);
+	if (read == _write.load (boost::memory_order_acquire)) {
 		return optional<DCPTime>();
 	}
-	return _buffers.front().second;
+
+	Frame start_frame;
+	DCPTime start_time;
+	if (!start(start_frame, start_time) || read < start_frame) {
+		return optional<DCPTime>();
+	}
+
+	return start_time + DCPTime::from_frames (read - start_frame, 48000);
 }
 
 void
 AudioRingBuffers::clear ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_buffers.clear ();
-	_used_in_head = 0;
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	/* Discard everything that has been written.  get() may be moving _read at the same time,
+	   so keep trying until either we succeed or get() has taken all the data.
+	*/
+	Frame const write = _write.load (boost::memory_order_relaxed);
+	Frame read = _read.load (boost::memory_order_relaxed);
+	while (read < write && !_read.compare_exchange_weak (read, write)) {}
+
+	_end = optional<DCPTime> ();
 }
 
 Frame
-AudioRingBuffers::size () const
+AudioRingBuffers::allocated () const
+{
+	Buffer const* buffer = _buffer.load (boost::memory_order_acquire);
+	return buffer ? buffer->capacity : 0;
+}
+
+/** Make sure that our buffer can hold some number of frames, moving what is in it to a bigger
+ *  one if required.  Caller must hold a lock on _producer_mutex.
+ *  @param needed Number of frames that the buffer must be able to hold.
+ *  @param read Value of _read, which get() may have moved on since.
+ *  @param write Value of _write.
+ */
+void
+AudioRingBuffers::grow (Frame needed, Frame read, Frame write)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	Frame s = 0;
-	for (list<pair<shared_ptr<const AudioBuffers>, DCPTime> >::const_iterator i = _buffers.begin(); i != _buffers.end(); ++i) {
-		s += i->first->frames();
+	Buffer* old = _buffer.load (boost::memory_order_relaxed);
+	if (old && old->capacity >= needed) {
+		return;
+	}
+
+	Frame capacity = old ? old->capacity : min (_capacity, initial_allocation);
+	while (capacity < needed) {
+		capacity = min (_capacity, capacity * 2);
 	}
-	return s - _used_in_head;
+
+	Buffer* buffer = new Buffer (capacity, _channels);
+
+	if (old) {
+		/* get() will only read frames from read onwards, and put() will not touch old again,
+		   so anything that get() reads from old is the same as what we copy here.
+		*/
+		for (Frame i = read; i < write; ++i) {
+			std::copy (
+				old->data.get() + (i % old->capacity) * _channels,
+				old->data.get() + (i % old->capacity + 1) * _channels,
+				buffer->data.get() + (i % capacity) * _channels
+				);
+		}
+		_retired.push_back (old);
+	}
+
+	_buffer.store (buffer);
+}
+
+Frame
+AudioRingBuffers::size () const
+{
+	Frame const read = _read.load (boost::memory_order_acquire);
+	return max (Frame (0), _write.load (boost::memory_order_acquire) - read);
+}
+
+/** Note that the frame at index `frame' is at `time'.  Caller must hold a lock on _producer_mutex */
+void
+AudioRingBuffers::set_start (Frame frame, DCPTime time)
+{
+	_start_sequence.fetch_add (1, boost::memory_order_relaxed);
+	boost::atomic_thread_fence (boost::memory_order_release);
+	_start_frame.store (frame, boost::memory_order_relaxed);
+	_start_time.store (time.get(), boost::memory_order_relaxed);
+	_start_sequence.fetch_add (1, boost::memory_order_release);
+}
+
+/** Find the index and time of the frame that was noted by the last set_start(), without blocking.
+ *  @return false if set_start() has never been called.
+ */
+bool
+AudioRingBuffers::start (Frame& frame, DCPTime& time) const
+{
+	unsigned int before;
+	unsigned int after;
+	do {
+		before = _start_sequence.load (boost::memory_order_acquire);
+		frame = _start_frame.load (boost::memory_order_relaxed);
+		time = DCPTime (_start_time.load (boost::memory_order_relaxed));
+		boost::atomic_thread_fence (boost::memory_order_acquire);
+		after = _start_sequence.load (boost::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	return before > 0;
 }
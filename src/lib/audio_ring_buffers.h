@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2019 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2020 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -26,12 +26,26 @@
 #include "dcpomatic_time.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 #include <list>
 
+/** @class AudioRingBuffers
+ *  @brief A ring buffer of audio for one producer and one consumer.
+ *
+ *  put() and clear() may be called from any thread (they are serialised with a mutex)
+ *  but get() must only be called from one thread.  get() never takes a lock, so that
+ *  it can be called from a realtime audio callback.
+ *
+ *  The buffer starts small and put() doubles its size whenever what it holds would not
+ *  fit, up to a maximum capacity, so the memory used follows how much the producer keeps
+ *  ahead of the consumer.
+ */
 class AudioRingBuffers : public boost::noncopyable
 {
 public:
-	AudioRingBuffers ();
+	explicit AudioRingBuffers (Frame capacity = 48000 * 10);
+	~AudioRingBuffers ();
 
 	void put (boost::shared_ptr<const AudioBuffers> data, DCPTime time, int frame_rate);
 	boost::optional<DCPTime> get (float* out, int channels, int frames);
@@ -40,10 +54,66 @@ public:
 	void clear ();
 	Frame size () const;
 
+	/** @return Number of frames that there is currently space for */
+	Frame allocated () const;
+
+	/** @return Number of calls to get() which could not be completely satisfied */
+	int underruns () const {
+		return _underruns;
+	}
+
+	/** @return Number of calls to get() which returned silence because clear() was called while they were running */
+	int collisions () const {
+		return _collisions;
+	}
+
 private:
-	mutable boost::mutex _mutex;
-	std::list<std::pair<boost::shared_ptr<const AudioBuffers>, DCPTime> > _buffers;
-	int _used_in_head;
+	/** Some space for interleaved audio data */
+	struct Buffer
+	{
+		Buffer (Frame c, int channels)
+			: capacity (c)
+			, data (new float[c * channels])
+		{}
+
+		/** Size of the buffer, in frames */
+		Frame const capacity;
+		boost::scoped_array<float> data;
+	};
+
+	void grow (Frame needed, Frame read, Frame write);
+	void set_start (Frame frame, DCPTime time);
+	bool start (Frame& frame, DCPTime& time) const;
+
+	/** Largest size, in frames, that the buffer may grow to */
+	Frame const _capacity;
+	/** Number of channels in our buffers; this is set up by the first call to put() */
+	int _channels;
+	/** Buffer that put() writes to and get() reads from, allocated by the first call to put() */
+	boost::atomic<Buffer*> _buffer;
+	/** Buffers that we have grown out of, but which get() might still be reading */
+	std::list<Buffer*> _retired;
+	/** Number of calls to get() that are running */
+	boost::atomic<int> _readers;
+
+	/** Mutex to serialise calls to put() and clear(), and to protect _retired */
+	boost::mutex _producer_mutex;
+	/** Number of frames that have ever been written */
+	boost::atomic<Frame> _write;
+	/** Number of frames that have ever been read (or discarded by clear()) */
+	boost::atomic<Frame> _read;
+
+	/** Sequence number for _start_frame and _start_time; this is odd while they are being changed */
+	boost::atomic<unsigned int> _start_sequence;
+	/** Index of a frame whose time we know */
+	boost::atomic<Frame> _start_frame;
+	/** Time of the frame at _start_frame */
+	boost::atomic<DCPTime::Type> _start_time;
+	/** Time just after the last data that was put, if there has been some since the last clear() */
+	boost::optional<DCPTime> _end;
+
+	boost::atomic<int> _underruns;
+	boost::atomic<int> _collisions;
 };
 
 #endif
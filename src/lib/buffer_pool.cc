@@ -0,0 +1,394 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "buffer_pool.h"
+#include "metrics.h"
+#include "util.h"
+#include "dcpomatic_assert.h"
+extern "C" {
+#include <libavutil/mem.h>
+}
+#include <boost/foreach.hpp>
+#include <boost/static_assert.hpp>
+#include <cstdlib>
+#include <utility>
+
+using std::vector;
+using std::string;
+using std::make_pair;
+
+/** The header at the start of each block; the caller gets the memory after it */
+struct BufferPool::Header
+{
+	/** size class, or -1 if the block is too big to be pooled */
+	int size_class;
+	/** usable size of the block in bytes */
+	size_t size;
+};
+
+/** Number of bytes by which each thread may let the pool's counts be wrong */
+static int64_t const accounting_slack = 1024 * 1024;
+
+/** Free blocks kept by one thread, and changes to the pool's counts which it has not yet
+ *  passed on; these are kept here so that most allocations need not touch any shared state.
+ */
+struct BufferPool::ThreadCache
+{
+	explicit ThreadCache (BufferPool* pool_)
+		: pool (pool_)
+		, blocks (BufferPool::size_classes)
+		, bytes (0)
+		, reserved (0)
+		, used (0)
+		, cached (0)
+		, hits (0)
+		, misses (0)
+	{}
+
+	/** Give our blocks to the shared cache when our thread finishes */
+	~ThreadCache ()
+	{
+		cached -= bytes;
+		flush ();
+		pool->unreserve (this, reserved);
+		BOOST_FOREACH (vector<Header*> const & i, blocks) {
+			BOOST_FOREACH (Header* j, i) {
+				pool->release_to_shared (j);
+			}
+		}
+	}
+
+	/** Pass on our changes to the counts if they are big enough to matter */
+	void maybe_flush ()
+	{
+		if ((llabs (used) + llabs (cached)) >= accounting_slack) {
+			flush ();
+		}
+	}
+
+	void flush ()
+	{
+		pool->_used += used;
+		pool->_cached += cached;
+		pool->_hits += hits;
+		pool->_misses += misses;
+		used = cached = 0;
+		hits = misses = 0;
+	}
+
+	BufferPool* pool;
+	/** free blocks, indexed by size class */
+	vector<vector<Header*> > blocks;
+	/** total size of the blocks in bytes */
+	size_t bytes;
+	/** bytes of the pool's limit that we have taken for our blocks; never less than `bytes' nor more
+	 *  than thread_cache_bytes.  We keep this, even when we are not using it all, until our thread
+	 *  finishes or the pool is cleared, so that releasing and allocating the same block over and over
+	 *  does not have to take the pool's lock.
+	 */
+	size_t reserved;
+	int64_t used;
+	int64_t cached;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+/** This is a multiple of any alignment that av_malloc() uses, so the memory after
+ *  a header is aligned in the same way as the header itself.
+ */
+size_t const BufferPool::header_size = 64;
+/** Blocks bigger than this are not kept for reuse */
+size_t const BufferPool::largest_pooled = 256 * 1024 * 1024;
+/** One class for blocks of up to 256 bytes, then 4 classes for each doubling of size up to 2^28 */
+int const BufferPool::size_classes = 81;
+
+/** Maximum number of bytes to keep in each thread's cache */
+static size_t const thread_cache_bytes = 16 * 1024 * 1024;
+/** Maximum number of blocks of each size to keep in each thread's cache */
+static size_t const thread_cache_blocks = 4;
+/** Amount of the pool's limit that a thread's cache takes at a time */
+static size_t const reservation_step = 1024 * 1024;
+
+BufferPool::BufferPool ()
+	: _shared (size_classes)
+	, _shared_bytes (0)
+	, _reserved (0)
+	, _limit (256 * 1024 * 1024)
+	, _used (0)
+	, _cached (0)
+	, _misses (0)
+	, _hits (0)
+	, _enabled (true)
+{
+	BOOST_STATIC_ASSERT (sizeof (Header) <= 64);
+}
+
+BufferPool*
+BufferPool::instance ()
+{
+	/* This is never deleted so that threads which finish while the program
+	   is exiting can still give their caches back.
+	*/
+	static BufferPool* pool = new BufferPool ();
+	return pool;
+}
+
+/** @return Size class for a block of at least some size, or -1 if the block is too big to be pooled */
+int
+BufferPool::size_class (size_t size)
+{
+	if (size <= 256) {
+		return 0;
+	} else if (size > largest_pooled) {
+		return -1;
+	}
+
+	/* Find b such that 2^b < size <= 2^(b+1) */
+	int b = 0;
+	for (size_t s = size - 1; s > 1; s >>= 1) {
+		++b;
+	}
+
+	/* Then the class sizes between 2^b and 2^(b+1) are 2^b * (1 + k/4) for k = 1 to 4 */
+	size_t const base = size_t (1) << b;
+	size_t const step = base >> 2;
+	int const k = (size - base + step - 1) / step;
+	return (b - 8) * 4 + k;
+}
+
+/** @return Size of the blocks in a size class, in bytes */
+size_t
+BufferPool::class_size (int size_class)
+{
+	DCPOMATIC_ASSERT (size_class >= 0 && size_class < size_classes);
+
+	if (size_class == 0) {
+		return 256;
+	}
+
+	int const b = 8 + (size_class - 1) / 4;
+	int const k = (size_class - 1) % 4 + 1;
+	return (size_t (1) << b) + k * (size_t (1) << (b - 2));
+}
+
+/** @param size Size in bytes.
+ *  @return Block of at least that size, which must be given back with release().
+ */
+void*
+BufferPool::allocate (size_t size)
+{
+	int const c = _enabled ? size_class (size) : -1;
+	if (c < 0) {
+		Header* header = static_cast<Header*> (wrapped_av_malloc (header_size + size));
+		header->size_class = c;
+		header->size = size;
+		_used += size;
+		++_misses;
+		return reinterpret_cast<uint8_t*> (header) + header_size;
+	}
+
+	ThreadCache* cache = _thread_cache.get ();
+	if (!cache) {
+		cache = new ThreadCache (this);
+		_thread_cache.reset (cache);
+	}
+
+	Header* header = 0;
+	if (!cache->blocks[c].empty ()) {
+		header = cache->blocks[c].back ();
+		cache->blocks[c].pop_back ();
+		cache->bytes -= header->size;
+		cache->cached -= header->size;
+	} else {
+		boost::mutex::scoped_lock lm (_mutex);
+		if (!_shared[c].empty ()) {
+			header = _shared[c].back ();
+			_shared[c].pop_back ();
+			_shared_bytes -= header->size;
+			lm.unlock ();
+			_cached -= header->size;
+		}
+	}
+
+	if (header) {
+		++cache->hits;
+	} else {
+		header = static_cast<Header*> (wrapped_av_malloc (header_size + class_size (c)));
+		header->size_class = c;
+		header->size = class_size (c);
+		++cache->misses;
+	}
+
+	cache->used += header->size;
+	cache->maybe_flush ();
+	return reinterpret_cast<uint8_t*> (header) + header_size;
+}
+
+/** Give back a block that was returned by allocate().
+ *  @param block Block, or 0 to do nothing.
+ */
+void
+BufferPool::release (void* block)
+{
+	if (!block) {
+		return;
+	}
+
+	Header* header = reinterpret_cast<Header*> (static_cast<uint8_t*> (block) - header_size);
+
+	if (header->size_class < 0) {
+		_used -= header->size;
+		free_block (header);
+		return;
+	}
+
+	/* Only threads which allocate have caches; there is no point in keeping blocks
+	   for threads which just release them.
+	*/
+	ThreadCache* cache = _thread_cache.get ();
+	if (!cache) {
+		_used -= header->size;
+		release_to_shared (header);
+		return;
+	}
+
+	cache->used -= header->size;
+	if (
+		cache->blocks[header->size_class].size() < thread_cache_blocks &&
+		(cache->bytes + header->size) <= thread_cache_bytes &&
+		((cache->bytes + header->size) <= cache->reserved || reserve (cache, header->size))
+		) {
+		cache->blocks[header->size_class].push_back (header);
+		cache->bytes += header->size;
+		cache->cached += header->size;
+	} else {
+		release_to_shared (header);
+	}
+	cache->maybe_flush ();
+}
+
+/** Take some more of our limit for a thread's cache so that it can keep another block.
+ *  @param cache Calling thread's cache.
+ *  @param size Size of the block that the cache wants to keep.
+ *  @return true if the cache may keep the block.
+ */
+bool
+BufferPool::reserve (ThreadCache* cache, size_t size)
+{
+	size_t const need = cache->bytes + size - cache->reserved;
+	/* Take a bit more than we need, if we can, so that we do not have to come back so often */
+	size_t const want = std::min (std::max (need, reservation_step), thread_cache_bytes - cache->reserved);
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	size_t const available = _limit - std::min (_limit, _shared_bytes + _reserved);
+	if (available < need) {
+		return false;
+	}
+
+	size_t const take = std::min (want, available);
+	_reserved += take;
+	cache->reserved += take;
+	return true;
+}
+
+/** Give back some of the limit that a thread's cache has taken */
+void
+BufferPool::unreserve (ThreadCache* cache, size_t size)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_reserved -= size;
+	cache->reserved -= size;
+}
+
+/** Put a free block in the shared cache if there is room, otherwise free it */
+void
+BufferPool::release_to_shared (Header* header)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if ((_shared_bytes + _reserved + header->size) > _limit) {
+		lm.unlock ();
+		free_block (header);
+		return;
+	}
+
+	_shared[header->size_class].push_back (header);
+	_shared_bytes += header->size;
+	_cached += header->size;
+}
+
+void
+BufferPool::free_block (Header* header)
+{
+	av_free (header);
+}
+
+/** Set the maximum number of bytes of free blocks to keep, in the shared cache and the
+ *  threads' own caches together.  If the limit is lowered the threads keep what they already
+ *  have until they use it.
+ */
+void
+BufferPool::set_limit (size_t bytes)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_limit = bytes;
+}
+
+/** Free all the blocks in the shared cache and the calling thread's cache */
+void
+BufferPool::clear ()
+{
+	ThreadCache* cache = _thread_cache.get ();
+	if (cache) {
+		BOOST_FOREACH (vector<Header*>& i, cache->blocks) {
+			BOOST_FOREACH (Header* j, i) {
+				cache->cached -= j->size;
+				free_block (j);
+			}
+			i.clear ();
+		}
+		cache->bytes = 0;
+		cache->flush ();
+		unreserve (cache, cache->reserved);
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	BOOST_FOREACH (vector<Header*>& i, _shared) {
+		BOOST_FOREACH (Header* j, i) {
+			_cached -= j->size;
+			free_block (j);
+		}
+		i.clear ();
+	}
+	_shared_bytes = 0;
+}
+
+void
+BufferPool::metrics (Metrics& metrics) const
+{
+	string const help = "Memory in image and audio buffers";
+	metrics.add ("dcpomatic_buffer_pool_bytes", Metrics::GAUGE, help, memory_used(), make_pair (string ("state"), string ("used")));
+	metrics.add ("dcpomatic_buffer_pool_bytes", Metrics::GAUGE, help, memory_cached(), make_pair (string ("state"), string ("cached")));
+
+	string const allocations_help = "Image and audio buffers allocated, by where they came from";
+	metrics.add ("dcpomatic_buffer_pool_allocations_total", Metrics::COUNTER, allocations_help, _hits.load(), make_pair (string ("source"), string ("cache")));
+	metrics.add ("dcpomatic_buffer_pool_allocations_total", Metrics::COUNTER, allocations_help, _misses.load(), make_pair (string ("source"), string ("system")));
+}
@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/buffer_pool.h
+ *  @brief BufferPool class.
+ */
+
+#ifndef DCPOMATIC_BUFFER_POOL_H
+#define DCPOMATIC_BUFFER_POOL_H
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+class Metrics;
+
+/** @class BufferPool
+ *  @brief A pool of memory blocks for image planes and audio channels.
+ *
+ *  The encode pipeline makes and throws away lots of blocks of the same few sizes (one
+ *  for each image format and audio block length in use), so rather than giving them back
+ *  to the system we keep them to be used again.  Sizes are rounded up to one of a set of
+ *  size classes, so no more than a fifth of any block is wasted.
+ *
+ *  Each thread keeps a few free blocks of its own so that most allocations take no lock;
+ *  blocks which do not fit in a thread's cache go to a shared cache, and once that is full
+ *  they are freed.  The threads' caches take their space from the same limit as the shared
+ *  cache, a megabyte or so at a time.  Blocks can be released by any thread, not just the one that allocated them.
+ *
+ *  Blocks are aligned in the same way as memory from av_malloc() and their contents
+ *  are undefined when they are allocated.
+ */
+class BufferPool : public boost::noncopyable
+{
+public:
+	static BufferPool* instance ();
+
+	void* allocate (size_t size);
+	void release (void* block);
+
+	void set_limit (size_t bytes);
+	void clear ();
+
+	/** @param enabled false to have allocate() get every block from the system and
+	 *  release() give every block back, as happened before there was a pool; this is
+	 *  so that the pool can be compared with not having it.
+	 */
+	void set_enabled (bool enabled) {
+		_enabled = enabled;
+	}
+
+	/** @return Bytes in blocks which have been allocated and not yet released; each thread
+	 *  which allocates blocks may make this wrong by up to a megabyte.
+	 */
+	size_t memory_used () const {
+		return std::max (int64_t (0), _used.load ());
+	}
+
+	/** @return Bytes in free blocks that are being kept to be used again; each thread
+	 *  which allocates blocks may make this wrong by up to a megabyte.
+	 */
+	size_t memory_cached () const {
+		return std::max (int64_t (0), _cached.load ());
+	}
+
+	void metrics (Metrics& metrics) const;
+
+	static size_t const largest_pooled;
+
+private:
+	BufferPool ();
+
+	struct Header;
+	struct ThreadCache;
+
+	static int size_class (size_t size);
+	static size_t class_size (int size_class);
+
+	bool reserve (ThreadCache* cache, size_t size);
+	void unreserve (ThreadCache* cache, size_t size);
+	void release_to_shared (Header* header);
+	void free_block (Header* header);
+
+	static size_t const header_size;
+	static int const size_classes;
+
+	/** the calling thread's cache */
+	boost::thread_specific_ptr<ThreadCache> _thread_cache;
+
+	/** mutex to protect _shared, _shared_bytes, _reserved and _limit */
+	boost::mutex _mutex;
+	/** free blocks that any thread can use, indexed by size class */
+	std::vector<std::vector<Header*> > _shared;
+	/** total size of the blocks in _shared */
+	size_t _shared_bytes;
+	/** total of the space that the threads' caches have taken from _limit */
+	size_t _reserved;
+	/** maximum number of bytes to keep in _shared and the threads' caches */
+	size_t _limit;
+
+	/** these are only updated from time to time by threads that have caches; see ThreadCache */
+	boost::atomic<int64_t> _used;
+	boost::atomic<int64_t> _cached;
+	/** number of allocations that had to ask the system for memory */
+	boost::atomic<uint64_t> _misses;
+	/** number of allocations that used a block from a cache */
+	boost::atomic<uint64_t> _hits;
+	/** false to pass all allocations through to the system; see set_enabled() */
+	boost::atomic<bool> _enabled;
+};
+
+#endif
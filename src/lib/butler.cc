@@ -26,10 +26,16 @@
 #include "cross.h"
 #include "compose.hpp"
 #include "exceptions.h"
+#include "frame_cache.h"
+#include "config.h"
+#include "trace.h"
+#include "metrics.h"
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 using std::cout;
+using std::min;
+using std::max;
 using std::pair;
 using std::make_pair;
 using std::string;
@@ -42,14 +48,35 @@ using boost::function;
 using namespace boost::placeholders;
 #endif
 
-/** Minimum video readahead in frames */
+/** Minimum video readahead in frames; we will use more than this if we have lots of prepare threads */
 #define MINIMUM_VIDEO_READAHEAD 10
-/** Maximum video readahead in frames; should never be exceeded (by much) unless there are bugs in Player */
-#define MAXIMUM_VIDEO_READAHEAD 48
-/** Minimum audio readahead in frames */
-#define MINIMUM_AUDIO_READAHEAD (48000 * MINIMUM_VIDEO_READAHEAD / 24)
-/** Maximum audio readahead in frames; should never be exceeded (by much) unless there are bugs in Player */
-#define MAXIMUM_AUDIO_READAHEAD (48000 * MAXIMUM_VIDEO_READAHEAD / 24)
+/** Video readahead in frames to start off with; we will use more than this if we have lots of prepare threads */
+#define INITIAL_VIDEO_READAHEAD 48
+/** Maximum factor by which we will increase our video readahead after underruns */
+#define MAXIMUM_READAHEAD_GROWTH 4
+/** Largest size of our ring buffers as a multiple of the largest readahead we will use; the Player
+ *  may overshoot our readahead a little but going past this is a bug.  The audio ring buffer
+ *  only grows as big as it needs to be for the readahead that we are actually using.
+ */
+#define RING_BUFFER_HEADROOM 2
+/** Time in milliseconds between checks for audio having been taken, while the butler thread is waiting */
+#define AUDIO_POLL_INTERVAL 20
+
+/** @return Number of cores that we can use to prepare video */
+static int
+prepare_cores ()
+{
+	return max (1U, boost::thread::hardware_concurrency());
+}
+
+/** @return Audio readahead in frames to go with some video readahead; audio must keep pace with
+ *  video, otherwise it will fill up and stop us running before we have enough video.
+ */
+static Frame
+video_to_audio_readahead (Frame video)
+{
+	return 48000 * video / 24;
+}
 
 /** @param pixel_format Pixel format functor that will be used when calling ::image on PlayerVideos coming out of this
  *  butler.  This will be used (where possible) to prepare the PlayerVideos so that calling image() on them is quick.
@@ -65,6 +92,14 @@ Butler::Butler (
 	bool fast
 	)
 	: _player (player)
+	, _minimum_video_readahead (max(MINIMUM_VIDEO_READAHEAD, prepare_cores()))
+	, _maximum_video_readahead (max(INITIAL_VIDEO_READAHEAD, prepare_cores() * 2) * MAXIMUM_READAHEAD_GROWTH)
+	, _video_readahead (max(INITIAL_VIDEO_READAHEAD, prepare_cores() * 2))
+	, _memory_budget (static_cast<size_t>(Config::instance()->readahead_memory()) * 1024 * 1024)
+	, _frame_memory (0)
+	, _steady (false)
+	, _video (_maximum_video_readahead * RING_BUFFER_HEADROOM)
+	, _audio (video_to_audio_readahead(_maximum_video_readahead) * RING_BUFFER_HEADROOM)
 	, _prepare_work (new boost::asio::io_service::work (_prepare_service))
 	, _pending_seek_accurate (false)
 	, _suspended (0)
@@ -77,6 +112,7 @@ Butler::Butler (
 	, _pixel_format (pixel_format)
 	, _aligned (aligned)
 	, _fast (fast)
+	, _prepare_history (48)
 {
 	_player_video_connection = _player->Video.connect (bind (&Butler::video, this, _1, _2));
 	_player_audio_connection = _player->Audio.connect (bind (&Butler::audio, this, _1, _2, _3));
@@ -94,15 +130,25 @@ Butler::Butler (
 	   multi-thread JPEG2000 decoding.
 	*/
 
-	LOG_TIMING("start-prepare-threads %1", boost::thread::hardware_concurrency() * 2);
+	/* Our readahead is set up so that all the cores can be decoding a frame at once, and that
+	   all the threads could be; otherwise, with many cores, we would leave some of them idle.
+	*/
+	int const threads = prepare_cores() * 2;
+
+	LOG_TIMING("start-prepare-threads %1", threads);
 
-	for (size_t i = 0; i < boost::thread::hardware_concurrency() * 2; ++i) {
+	for (int i = 0; i < threads; ++i) {
 		_prepare_pool.create_thread (bind (&boost::asio::io_service::run, &_prepare_service));
 	}
 }
 
 Butler::~Butler ()
 {
+	LOG_GENERAL (
+		"Butler had %1 video underruns, %2 audio underruns and %3 audio/seek collisions",
+		_video.underruns(), _audio.underruns(), _audio.collisions()
+		);
+
 	{
 		boost::mutex::scoped_lock lm (_mutex);
 		_stop_thread = true;
@@ -121,39 +167,41 @@ Butler::~Butler ()
 	delete _thread;
 }
 
-/** Caller must hold a lock on _mutex */
-bool
-Butler::should_run () const
+/** @return Number of frames of video that we are currently trying to keep ready; this starts
+ *  off at a default, grows if we run out of video during playback and is limited so that the
+ *  video should fit into our memory budget.
+ */
+Frame
+Butler::video_readahead () const
 {
-	if (_video.size() >= MAXIMUM_VIDEO_READAHEAD * 10) {
-		/* This is way too big */
-		optional<DCPTime> pos = _audio.peek();
-		if (pos) {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler video buffers reached %1 frames (audio is %2 at %3)", _video.size(), _audio.size(), pos->get()));
-		} else {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler video buffers reached %1 frames (audio is %2)", _video.size(), _audio.size()));
-		}
+	Frame r = _video_readahead;
+	size_t const frame = _frame_memory;
+	if (frame > 0) {
+		r = min (r, static_cast<Frame>(_memory_budget / frame));
 	}
+	return max (_minimum_video_readahead, r);
+}
 
-	if (_audio.size() >= MAXIMUM_AUDIO_READAHEAD * 10) {
-		/* This is way too big */
-		optional<DCPTime> pos = _audio.peek();
-		if (pos) {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler audio buffers reached %1 frames at %2 (video is %3)", _audio.size(), pos->get(), _video.size()));
-		} else {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler audio buffers reached %1 frames (video is %3)", _audio.size(), _video.size()));
-		}
-	}
+/** Add the current state of the butler to a Metrics snapshot.  This may be called from any thread. */
+void
+Butler::metrics (Metrics& metrics) const
+{
+	metrics.add ("dcpomatic_butler_video_frames", Metrics::GAUGE, "Video frames ready to be taken from the butler", _video.size());
+	metrics.add ("dcpomatic_butler_audio_frames", Metrics::GAUGE, "Audio frames ready to be taken from the butler", _audio.size());
+	metrics.add ("dcpomatic_butler_video_readahead_frames", Metrics::GAUGE, "Video frames that the butler is trying to keep ready", video_readahead());
+	metrics.add ("dcpomatic_butler_video_underruns_total", Metrics::COUNTER, "Times that video was wanted from the butler but none was ready", _video.underruns());
+	metrics.add ("dcpomatic_butler_prepare_frames_per_second", Metrics::GAUGE, "Recent rate of preparing video frames", prepare_rate());
+}
 
-	if (_video.size() >= MAXIMUM_VIDEO_READAHEAD * 2) {
+/** Caller must hold a lock on _mutex */
+bool
+Butler::should_run () const
+{
+	if (_video.size() >= _maximum_video_readahead * 3 / 2) {
 		LOG_WARNING ("Butler video buffers reached %1 frames (audio is %2)", _video.size(), _audio.size());
 	}
 
-	if (_audio.size() >= MAXIMUM_AUDIO_READAHEAD * 2) {
+	if (_audio.size() >= video_to_audio_readahead(_maximum_video_readahead) * 3 / 2) {
 		LOG_WARNING ("Butler audio buffers reached %1 frames (video is %2)", _audio.size(), _video.size());
 	}
 
@@ -162,13 +210,14 @@ Butler::should_run () const
 		return false;
 	}
 
-	if (_video.size() < MINIMUM_VIDEO_READAHEAD || (!_disable_audio && _audio.size() < MINIMUM_AUDIO_READAHEAD)) {
+	if (_video.size() < _minimum_video_readahead || (!_disable_audio && _audio.size() < video_to_audio_readahead(_minimum_video_readahead))) {
 		/* Definitely do run: we need data */
 		return true;
 	}
 
 	/* Run if we aren't full of video or audio */
-	return (_video.size() < MAXIMUM_VIDEO_READAHEAD) && (_audio.size() < MAXIMUM_AUDIO_READAHEAD);
+	Frame const video = video_readahead ();
+	return (_video.size() < video) && (_audio.size() < video_to_audio_readahead(video));
 }
 
 void
@@ -180,7 +229,15 @@ try
 
 		/* Wait until we have something to do */
 		while (!should_run() && !_pending_seek_position) {
-			_summon.wait (lm);
+			TRACE_SCOPE (TRACE_BUTLER, "sleep");
+			if (_disable_audio) {
+				_summon.wait (lm);
+			} else {
+				/* get_audio() does not wake us up, as it must not take a lock, so look
+				   every so often to see if it has taken enough audio for us to run.
+				*/
+				_summon.timed_wait (lm, boost::get_system_time() + boost::posix_time::milliseconds (AUDIO_POLL_INTERVAL));
+			}
 		}
 
 		/* Do any seek that has been requested */
@@ -218,11 +275,12 @@ try
 	_arrived.notify_all ();
 }
 
+/** Get the next video frame.  This will only block if there is no video ready, in which case
+ *  it will wait for the butler thread to provide some.
+ */
 pair<shared_ptr<PlayerVideo>, DCPTime>
 Butler::get_video (Error* e)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-
 	if (_suspended) {
 		if (e) {
 			*e = AGAIN;
@@ -230,19 +288,43 @@ Butler::get_video (Error* e)
 		return make_pair(shared_ptr<PlayerVideo>(), DCPTime());
 	}
 
-	/* Wait for data if we have none */
-	while (_video.empty() && !_finished && !_died) {
-		_arrived.wait (lm);
-	}
+	pair<shared_ptr<PlayerVideo>, DCPTime> r = _video.get ();
 
-	if (_video.empty()) {
-		if (e) {
-			*e = _died ? DIED : NONE;
+	if (!r.first) {
+		boost::mutex::scoped_lock lm (_mutex);
+
+		if (_steady && !_finished && !_died) {
+			/* We have run out of video during playback, so try to keep more in hand */
+			Frame const current = _video_readahead;
+			Frame const grown = min (_maximum_video_readahead, current + max(Frame(1), current / 4));
+			if (grown != current) {
+				_video_readahead = grown;
+				LOG_GENERAL ("Butler video readahead increased to %1 frames after underrun", grown);
+			}
+		}
+
+		/* Wait for data if we have none, making sure that the butler knows that we want some */
+		while (_video.empty() && !_finished && !_died) {
+			TRACE_SCOPE (TRACE_BUTLER, "wait-for-video");
+			_summon.notify_all ();
+			_arrived.wait (lm);
+		}
+
+		r = _video.get ();
+		if (!r.first) {
+			if (e) {
+				*e = _died ? DIED : NONE;
+			}
+			return r;
 		}
-		return make_pair(shared_ptr<PlayerVideo>(), DCPTime());
 	}
 
-	pair<shared_ptr<PlayerVideo>, DCPTime> const r = _video.get ();
+	_steady = true;
+
+	/* This is not done with _mutex held, so the butler thread could miss it if it is just about
+	   to wait.  In that case it will hear the next one, and the buffers should be well stocked
+	   at that point anyway.
+	*/
 	_summon.notify_all ();
 	return r;
 }
@@ -272,6 +354,8 @@ Butler::seek_unlocked (DCPTime position, bool accurate)
 	_finished = false;
 	_pending_seek_position = position;
 	_pending_seek_accurate = accurate;
+	/* Running out of video just after a seek is not a sign that we need more readahead */
+	_steady = false;
 
 	{
 		boost::mutex::scoped_lock lm (_buffers_mutex);
@@ -289,10 +373,38 @@ try
 {
 	shared_ptr<PlayerVideo> video = weak_video.lock ();
 	/* If the weak_ptr cannot be locked the video obviously no longer requires any work */
-	if (video) {
-		LOG_TIMING("start-prepare in %1", thread_id());
+	if (!video) {
+		return;
+	}
+
+	shared_ptr<FrameCache> cache;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		cache = _frame_cache;
+	}
+
+	optional<string> digest;
+	if (cache) {
+		digest = video->digest (cache->pixel_format(), _aligned, _fast);
+		if (digest) {
+			shared_ptr<Image> image = cache->get (*digest);
+			if (image) {
+				video->set_image (image);
+				note_frame_memory (video->memory_used());
+				return;
+			}
+		}
+	}
+
+	{
+		TRACE_SCOPE (TRACE_BUTLER, "prepare");
 		video->prepare (_pixel_format, _aligned, _fast);
-		LOG_TIMING("finish-prepare in %1", thread_id());
+	}
+	_prepare_history.event ();
+	note_frame_memory (video->memory_used());
+
+	if (digest) {
+		cache->put (*digest, video->image(_pixel_format, _aligned, _fast));
 	}
 }
 catch (...)
@@ -302,6 +414,14 @@ catch (...)
 	_died = true;
 }
 
+/** Keep a running average of the memory used by a prepared frame */
+void
+Butler::note_frame_memory (size_t bytes)
+{
+	size_t const current = _frame_memory;
+	_frame_memory = current ? (current * 7 + bytes) / 8 : bytes;
+}
+
 void
 Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 {
@@ -316,6 +436,7 @@ Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 
 	boost::mutex::scoped_lock lm2 (_buffers_mutex);
 	_video.put (video, time);
+	TRACE_COUNTER (TRACE_BUTLER, "video-buffers", _video.size());
 }
 
 void
@@ -334,15 +455,15 @@ Butler::audio (shared_ptr<AudioBuffers> audio, DCPTime time, int frame_rate)
 }
 
 /** Try to get `frames' frames of audio and copy it into `out'.  Silence
- *  will be filled if no audio is available.
+ *  will be filled if no audio is available.  This never takes a lock, so it
+ *  is safe to call from a realtime audio callback.
  *  @return time of this audio, or unset if there was a buffer underrun.
  */
 optional<DCPTime>
 Butler::get_audio (float* out, Frame frames)
 {
-	optional<DCPTime> t = _audio.get (out, _audio_channels, frames);
-	_summon.notify_all ();
-	return t;
+	/* The butler thread will notice that we have taken some audio next time it looks (see thread()) */
+	return _audio.get (out, _audio_channels, frames);
 }
 
 void
@@ -352,6 +473,18 @@ Butler::disable_audio ()
 	_disable_audio = true;
 }
 
+/** Use a cache of prepared frames, so that frames which we have seen before need not be
+ *  decoded and processed again.  The cache's pixel format must be the one that our
+ *  pixel format functor will always return.
+ *  @param cache Cache to use, or 0 to use none.
+ */
+void
+Butler::set_frame_cache (shared_ptr<FrameCache> cache)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_frame_cache = cache;
+}
+
 pair<size_t, string>
 Butler::memory_used () const
 {
@@ -375,7 +508,8 @@ Butler::player_change (ChangeType type, bool frequent)
 		}
 
 		DCPTime seek_to;
-		DCPTime next = _video.get().second;
+		/* Don't take the frame, as we are not the thread that calls get_video() */
+		DCPTime next = _video.next_time().get_value_or(DCPTime());
 		if (_awaiting && _awaiting > next) {
 			/* We have recently done a player_changed seek and our buffers haven't been refilled yet,
 			   so assume that we're seeking to the same place as last time.
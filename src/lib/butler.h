@@ -23,15 +23,19 @@
 #include "text_ring_buffers.h"
 #include "audio_mapping.h"
 #include "exception_store.h"
+#include "event_history.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/signals2.hpp>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 
 class Player;
 class PlayerVideo;
+class FrameCache;
+class Metrics;
 
 class Butler : public ExceptionStore, public boost::noncopyable
 {
@@ -60,22 +64,47 @@ public:
 	boost::optional<TextRingBuffers::Data> get_closed_caption ();
 
 	void disable_audio ();
+	void set_frame_cache (boost::shared_ptr<FrameCache> cache);
 
 	std::pair<size_t, std::string> memory_used () const;
 
+	Frame video_readahead () const;
+
+	void metrics (Metrics& metrics) const;
+
+	/** @return Rate at which our threads are preparing (e.g. decoding) video frames, in frames per second */
+	float prepare_rate () const {
+		return _prepare_history.rate ();
+	}
+
 private:
+	friend struct butler_readahead_test;
+
 	void thread ();
 	void video (boost::shared_ptr<PlayerVideo> video, DCPTime time);
 	void audio (boost::shared_ptr<AudioBuffers> audio, DCPTime time, int frame_rate);
 	void text (PlayerText pt, TextType type, boost::optional<DCPTextTrack> track, DCPTimePeriod period);
 	bool should_run () const;
 	void prepare (boost::weak_ptr<PlayerVideo> video);
+	void note_frame_memory (size_t bytes);
 	void player_change (ChangeType type, bool frequent);
 	void seek_unlocked (DCPTime position, bool accurate);
 
 	boost::shared_ptr<Player> _player;
 	boost::thread* _thread;
 
+	Frame _minimum_video_readahead;
+	/** Most video readahead that we will use, however many underruns we have */
+	Frame _maximum_video_readahead;
+	/** Video readahead that we would like, before taking the memory budget into account */
+	boost::atomic<Frame> _video_readahead;
+	/** Approximate maximum size of the video that we keep ready, in bytes */
+	size_t _memory_budget;
+	/** Running average of the size of a prepared frame, in bytes, or 0 if we don't know yet */
+	boost::atomic<size_t> _frame_memory;
+	/** true if get_video() has returned some video since the last seek */
+	boost::atomic<bool> _steady;
+
 	/** mutex to protect _video, _audio and _closed_caption for when we are clearing them and they all need to be
 	    cleared together without any data being inserted in the interim;
 	    XXX: is this necessary now that all butler output data is timestamped? Perhaps the locked clear-out
@@ -92,11 +121,12 @@ private:
 
 	/** mutex to protect _pending_seek_position, _pending_seek_acurate, _finished, _died, _stop_thread */
 	boost::mutex _mutex;
-	boost::condition _summon;
-	boost::condition _arrived;
+	boost::condition_variable _summon;
+	boost::condition_variable _arrived;
 	boost::optional<DCPTime> _pending_seek_position;
 	bool _pending_seek_accurate;
-	int _suspended;
+	/** > 0 if we are suspended; this is atomic so that get_video() can check it without taking _mutex */
+	boost::atomic<int> _suspended;
 	bool _finished;
 	bool _died;
 	bool _stop_thread;
@@ -110,6 +140,11 @@ private:
 	bool _aligned;
 	bool _fast;
 
+	EventHistory _prepare_history;
+
+	/** Cache of prepared frames to use, or 0 */
+	boost::shared_ptr<FrameCache> _frame_cache;
+
 	/** If we are waiting to be refilled following a seek, this is the time we were
 	    seeking to.
 	*/
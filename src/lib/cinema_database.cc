@@ -0,0 +1,268 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "cinema_database.h"
+#include "cinema.h"
+#include "util.h"
+#include "dcpomatic_assert.h"
+#include <libcxml/cxml.h>
+#include <libxml++/libxml++.h>
+#include <boost/foreach.hpp>
+
+using std::string;
+using std::list;
+using std::map;
+using std::multimap;
+using std::pair;
+using std::make_pair;
+using boost::shared_ptr;
+
+/** @param directory Directory to keep the cinemas in; it will be created if it does not exist */
+CinemaDatabase::CinemaDatabase (boost::filesystem::path directory)
+	: _directory (directory)
+	, _index_changed (false)
+	, _existed (boost::filesystem::exists (index_file ()))
+{
+	boost::filesystem::create_directories (_directory);
+	read_index ();
+}
+
+void
+CinemaDatabase::read_index ()
+{
+	if (!boost::filesystem::exists (index_file ())) {
+		return;
+	}
+
+	cxml::Document f ("Cinemas");
+	f.read_file (index_file ());
+	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children ("Cinema")) {
+		string const id = i->string_child ("Id");
+		Record r;
+		r.name = i->string_child ("Name");
+		_records[id] = r;
+		_order.push_back (id);
+		_by_name.insert (make_pair (r.name, id));
+	}
+}
+
+void
+CinemaDatabase::write_index ()
+{
+	xmlpp::Document doc;
+	xmlpp::Element* root = doc.create_root_node ("Cinemas");
+	root->add_child("Version")->add_child_text ("2");
+
+	BOOST_FOREACH (string i, _order) {
+		xmlpp::Element* c = root->add_child ("Cinema");
+		c->add_child("Id")->add_child_text (i);
+		c->add_child("Name")->add_child_text (_records[i].name);
+	}
+
+	write_file_atomically (doc.write_to_string_formatted (), index_file ());
+}
+
+/** Read a cinema from disk, if we have not already done so */
+CinemaDatabase::Record&
+CinemaDatabase::load (string id)
+{
+	map<string, Record>::iterator i = _records.find (id);
+	DCPOMATIC_ASSERT (i != _records.end ());
+
+	if (!i->second.cinema) {
+		shared_ptr<cxml::Document> doc (new cxml::Document ("Cinema"));
+		doc->read_file (file (id));
+		/* Slightly grotty two-part construction of Cinema here so that we can use
+		   shared_from_this.
+		*/
+		shared_ptr<Cinema> cinema (new Cinema (doc));
+		cinema->read_screens (doc);
+		i->second.cinema = cinema;
+		i->second.written = as_string (cinema);
+	}
+
+	return i->second;
+}
+
+/** @return All cinemas, in the order that they were added */
+list<shared_ptr<Cinema> >
+CinemaDatabase::cinemas ()
+{
+	list<shared_ptr<Cinema> > c;
+	BOOST_FOREACH (string i, _order) {
+		c.push_back (load(i).cinema);
+	}
+	return c;
+}
+
+/** @return Cinema with a given ID, or 0 */
+shared_ptr<Cinema>
+CinemaDatabase::cinema (string id)
+{
+	if (_records.find (id) == _records.end ()) {
+		return shared_ptr<Cinema> ();
+	}
+
+	return load(id).cinema;
+}
+
+/** @return Cinemas with a given name, as of the last write() */
+list<shared_ptr<Cinema> >
+CinemaDatabase::find (string name)
+{
+	list<shared_ptr<Cinema> > c;
+	pair<multimap<string, string>::const_iterator, multimap<string, string>::const_iterator> r = _by_name.equal_range (name);
+	for (multimap<string, string>::const_iterator i = r.first; i != r.second; ++i) {
+		c.push_back (load(i->second).cinema);
+	}
+	return c;
+}
+
+void
+CinemaDatabase::add (shared_ptr<Cinema> cinema)
+{
+	Record r;
+	r.name = cinema->name;
+	r.cinema = cinema;
+	_records[cinema->id()] = r;
+	_order.push_back (cinema->id ());
+	_by_name.insert (make_pair (cinema->name, cinema->id()));
+	_removed.erase (cinema->id ());
+	_index_changed = true;
+}
+
+void
+CinemaDatabase::remove (shared_ptr<Cinema> cinema)
+{
+	string const id = cinema->id ();
+	map<string, Record>::iterator i = _records.find (id);
+	if (i == _records.end ()) {
+		return;
+	}
+
+	pair<multimap<string, string>::iterator, multimap<string, string>::iterator> r = _by_name.equal_range (i->second.name);
+	for (multimap<string, string>::iterator j = r.first; j != r.second; ++j) {
+		if (j->second == id) {
+			_by_name.erase (j);
+			break;
+		}
+	}
+
+	_records.erase (i);
+	_order.remove (id);
+	_removed.insert (id);
+	_index_changed = true;
+}
+
+/** Write any changes since we were opened or last written */
+void
+CinemaDatabase::write ()
+{
+	BOOST_FOREACH (string i, _order) {
+		Record& r = _records[i];
+		if (!r.cinema) {
+			/* We have never read this one so it cannot have changed */
+			continue;
+		}
+
+		string const xml = as_string (r.cinema);
+		if (xml != r.written) {
+			write_file_atomically (xml, file (i));
+			r.written = xml;
+		}
+
+		if (r.cinema->name != r.name) {
+			pair<multimap<string, string>::iterator, multimap<string, string>::iterator> n = _by_name.equal_range (r.name);
+			for (multimap<string, string>::iterator j = n.first; j != n.second; ++j) {
+				if (j->second == i) {
+					_by_name.erase (j);
+					break;
+				}
+			}
+			r.name = r.cinema->name;
+			_by_name.insert (make_pair (r.name, i));
+			_index_changed = true;
+		}
+	}
+
+	/* Write the index after any new cinemas, and before removing any old ones, so that
+	   it never refers to a file which does not exist.
+	*/
+	if (_index_changed) {
+		write_index ();
+		_index_changed = false;
+	}
+
+	BOOST_FOREACH (string i, _removed) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (file (i), ec);
+	}
+	_removed.clear ();
+}
+
+/** Add the <code>&lt;Cinema&gt;</code> children of a node, as found in the single cinemas file
+ *  that was used before CinemaDatabase existed (or in config.xml before that).
+ */
+void
+CinemaDatabase::import (cxml::Node const & node)
+{
+	BOOST_FOREACH (cxml::ConstNodePtr i, node.node_children("Cinema")) {
+		shared_ptr<Cinema> cinema (new Cinema (i));
+		cinema->read_screens (i);
+		if (_records.find (cinema->id()) == _records.end ()) {
+			add (cinema);
+		}
+	}
+}
+
+/** Write all our cinemas to a single file in the format that import() reads */
+void
+CinemaDatabase::export_to (boost::filesystem::path file)
+{
+	xmlpp::Document doc;
+	xmlpp::Element* root = doc.create_root_node ("Cinemas");
+	root->add_child("Version")->add_child_text ("1");
+
+	BOOST_FOREACH (shared_ptr<Cinema> i, cinemas ()) {
+		i->as_xml (root->add_child ("Cinema"));
+	}
+
+	write_file_atomically (doc.write_to_string_formatted (), file);
+}
+
+string
+CinemaDatabase::as_string (shared_ptr<const Cinema> cinema)
+{
+	xmlpp::Document doc;
+	cinema->as_xml (doc.create_root_node ("Cinema"));
+	return doc.write_to_string_formatted ();
+}
+
+boost::filesystem::path
+CinemaDatabase::file (string id) const
+{
+	return _directory / (id + ".xml");
+}
+
+boost::filesystem::path
+CinemaDatabase::index_file () const
+{
+	return _directory / "index.xml";
+}
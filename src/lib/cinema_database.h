@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_CINEMA_DATABASE_H
+#define DCPOMATIC_CINEMA_DATABASE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+namespace cxml {
+	class Node;
+}
+
+class Cinema;
+
+/** @class CinemaDatabase
+ *  @brief A store for cinemas (and their screens) on disk.
+ *
+ *  Each cinema is kept in its own file, named after its ID, and an index file lists
+ *  the ID and name of each cinema.  Only the index is read when the database is opened;
+ *  a cinema is read when it is asked for, and the certificates of its screens are
+ *  parsed when they are needed (see Screen).
+ *
+ *  Cinemas and screens are edited in place by their users, so write() finds any cinemas
+ *  which have changed since they were last read or written and writes just those.
+ */
+class CinemaDatabase : public boost::noncopyable
+{
+public:
+	explicit CinemaDatabase (boost::filesystem::path directory);
+
+	std::list<boost::shared_ptr<Cinema> > cinemas ();
+	boost::shared_ptr<Cinema> cinema (std::string id);
+	std::list<boost::shared_ptr<Cinema> > find (std::string name);
+
+	/** @return true if the database was already on disk when we opened it */
+	bool existed () const {
+		return _existed;
+	}
+
+	void add (boost::shared_ptr<Cinema> cinema);
+	void remove (boost::shared_ptr<Cinema> cinema);
+	void write ();
+
+	void import (cxml::Node const & node);
+	void export_to (boost::filesystem::path file);
+
+	boost::filesystem::path directory () const {
+		return _directory;
+	}
+
+private:
+	struct Record
+	{
+		std::string name;
+		/** The cinema, or 0 if it has not been read yet */
+		boost::shared_ptr<Cinema> cinema;
+		/** The cinema's XML as it was last read or written */
+		std::string written;
+	};
+
+	void read_index ();
+	void write_index ();
+	Record& load (std::string id);
+	boost::filesystem::path file (std::string id) const;
+	boost::filesystem::path index_file () const;
+	static std::string as_string (boost::shared_ptr<const Cinema> cinema);
+
+	boost::filesystem::path _directory;
+	/** IDs of our cinemas, in the order that they were added */
+	std::list<std::string> _order;
+	std::map<std::string, Record> _records;
+	/** Cinema names to IDs */
+	std::multimap<std::string, std::string> _by_name;
+	/** IDs of cinemas that have been removed since we last wrote */
+	std::set<std::string> _removed;
+	bool _index_changed;
+	bool _existed;
+};
+
+#endif
@@ -31,6 +31,8 @@
 #include "cross.h"
 #include "film.h"
 #include "dkdm_wrapper.h"
+#include "dkdm_database.h"
+#include "cinema_database.h"
 #include "compose.hpp"
 #include "crypto.h"
 #include <dcp/raw_convert.h>
@@ -66,7 +68,7 @@ using boost::shared_array;
 using dcp::raw_convert;
 
 Config* Config::_instance = 0;
-int const Config::_current_version = 3;
+int const Config::_current_version = 4;
 boost::signals2::signal<void ()> Config::FailedToLoad;
 boost::signals2::signal<void (string)> Config::Warning;
 boost::signals2::signal<bool (void)> Config::BadSignerChain;
@@ -154,6 +156,16 @@ Config::set_defaults ()
 	*/
 	_frames_in_memory_multiplier = 3;
 	_decode_reduction = optional<int>();
+	_frame_cache_memory = 0;
+	_frame_cache_disk = 0;
+	_frame_cache_directory = boost::none;
+	_j2k_cache_disk = 0;
+	_j2k_cache_directory = boost::none;
+	_thumbnail_cache_disk = 256;
+	_thumbnail_cache_directory = boost::none;
+	_readahead_memory = 2048;
+	_export_reel_threads = 2;
+	_export_segment_threads = 1;
 	_default_notify = false;
 	for (int i = 0; i < NOTIFICATION_COUNT; ++i) {
 		_notification[i] = false;
@@ -234,6 +246,25 @@ Config::backup ()
 	} catch (...) {}
 }
 
+/** Rename a file or directory that we can't read (by adding a number to its name) so that
+ *  it is kept, but no longer used.
+ */
+static void
+move_aside (boost::filesystem::path p)
+{
+	boost::system::error_code ec;
+	if (!boost::filesystem::exists (p, ec)) {
+		return;
+	}
+
+	int n = 1;
+	while (n < 100 && boost::filesystem::exists(String::compose("%1.%2", p.string(), n), ec)) {
+		++n;
+	}
+
+	boost::filesystem::rename (p, String::compose("%1.%2", p.string(), n), ec);
+}
+
 void
 Config::read ()
 try
@@ -343,9 +374,6 @@ try
 	_default_interop = f.optional_bool_child("DefaultInterop").get_value_or (false);
 	_default_kdm_directory = f.optional_string_child("DefaultKDMDirectory");
 
-	/* Load any cinemas from config.xml */
-	read_cinemas (f);
-
 	_mail_server = f.string_child ("MailServer");
 	_mail_port = f.optional_number_child<int> ("MailPort").get_value_or (25);
 
@@ -492,15 +520,18 @@ try
 		_decryption_chain = create_certificate_chain ();
 	}
 #endif
+	_dkdm_database.reset (new DKDMDatabase (f.optional_string_child("DKDMDirectory").get_value_or (path("dkdms").string ())));
 	if (f.optional_node_child("DKDMGroup")) {
-		/* New-style: all DKDMs in a group */
+		/* Old-style: all DKDMs in a group in config.xml; they will go into the database when we next write */
 		_dkdms = dynamic_pointer_cast<DKDMGroup> (DKDMBase::read (f.node_child("DKDMGroup")));
-	} else {
-		/* Old-style: one or more DKDM nodes */
+	} else if (!f.node_children("DKDM").empty()) {
+		/* Older-style: one or more DKDM nodes in config.xml */
 		_dkdms.reset (new DKDMGroup ("root"));
 		BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children("DKDM")) {
 			_dkdms->add (DKDMBase::read (i));
 		}
+	} else {
+		_dkdms = _dkdm_database->read ();
 	}
 	_cinemas_file = f.optional_string_child("CinemasFile").get_value_or (path ("cinemas.xml").string ());
 	_show_hints_before_make_dcp = f.optional_bool_child("ShowHintsBeforeMakeDCP").get_value_or (true);
@@ -535,6 +566,16 @@ try
 	}
 	_frames_in_memory_multiplier = f.optional_number_child<int>("FramesInMemoryMultiplier").get_value_or(3);
 	_decode_reduction = f.optional_number_child<int>("DecodeReduction");
+	_frame_cache_memory = f.optional_number_child<int>("FrameCacheMemory").get_value_or(0);
+	_frame_cache_disk = f.optional_number_child<int>("FrameCacheDisk").get_value_or(0);
+	_frame_cache_directory = f.optional_string_child("FrameCacheDirectory");
+	_j2k_cache_disk = f.optional_number_child<int>("J2KCacheDisk").get_value_or(0);
+	_j2k_cache_directory = f.optional_string_child("J2KCacheDirectory");
+	_thumbnail_cache_disk = f.optional_number_child<int>("ThumbnailCacheDisk").get_value_or(256);
+	_thumbnail_cache_directory = f.optional_string_child("ThumbnailCacheDirectory");
+	_readahead_memory = f.optional_number_child<int>("ReadaheadMemory").get_value_or(2048);
+	_export_reel_threads = f.optional_number_child<int>("ExportReelThreads").get_value_or(2);
+	_export_segment_threads = f.optional_number_child<int>("ExportSegmentThreads").get_value_or(1);
 	_default_notify = f.optional_bool_child("DefaultNotify").get_value_or(false);
 
 	BOOST_FOREACH (cxml::NodePtr i, f.node_children("Notification")) {
@@ -587,11 +628,10 @@ try
 	_player_lock_file = f.optional_string_child("PlayerLockFile");
 #endif
 
-	/* Replace any cinemas from config.xml with those from the configured file */
-	if (boost::filesystem::exists (_cinemas_file)) {
-		cxml::Document f ("Cinemas");
-		f.read_file (_cinemas_file);
-		read_cinemas (f);
+	if (open_cinema_database ()) {
+		/* Very old versions kept cinemas in config.xml */
+		_cinema_database->import (f);
+		_cinema_database->write ();
 	}
 }
 catch (...) {
@@ -601,6 +641,19 @@ catch (...) {
 		FailedToLoad ();
 	}
 	set_defaults ();
+	if (!_dkdm_database) {
+		_dkdm_database.reset (new DKDMDatabase (path ("dkdms")));
+	}
+	try {
+		open_cinema_database ();
+	} catch (...) {
+		/* The cinema database, or the cinemas file that it would be made from, can't be
+		   read either; keep them, but start again with no cinemas.
+		*/
+		move_aside (cinema_database_directory ());
+		move_aside (_cinemas_file);
+		open_cinema_database ();
+	}
 	/* Make a new set of signing certificates and key */
 	_signer_chain = create_certificate_chain ();
 	/* And similar for decryption of KDMs */
@@ -858,13 +911,13 @@ Config::write_config () const
 		root->add_child("PlayerHistory")->add_child_text (i.string ());
 	}
 
-	/* [XML] DKDMGroup A group of DKDMs, each with a <code>Name</code> attribute, containing other <code>&lt;DKDMGroup&gt;</code>
-	   or <code>&lt;DKDM&gt;</code> tags.
-	*/
-	/* [XML] DKDM A DKDM as XML */
-	_dkdms->as_xml (root);
+	/* [XML] DKDMDirectory Directory containing DKDMs; see DKDMDatabase. */
+	root->add_child("DKDMDirectory")->add_child_text (_dkdm_database->directory().string());
+	_dkdm_database->write (_dkdms);
 
-	/* [XML] CinemasFile Filename of cinemas list file. */
+	/* [XML] CinemasFile Filename of cinemas list file.  Cinemas are kept in a directory alongside this file,
+	   with the extension <code>.d</code>; the file itself is only read if that directory does not exist.
+	*/
 	root->add_child("CinemasFile")->add_child_text (_cinemas_file.string());
 	/* [XML] ShowHintsBeforeMakeDCP 1 to show hints in the GUI before making a DCP, otherwise 0. */
 	root->add_child("ShowHintsBeforeMakeDCP")->add_child_text (_show_hints_before_make_dcp ? "1" : "0");
@@ -932,6 +985,33 @@ Config::write_config () const
 		root->add_child("DecodeReduction")->add_child_text(raw_convert<string>(_decode_reduction.get()));
 	}
 
+	/* [XML] FrameCacheMemory Maximum size in MB of the viewer's in-memory cache of prepared frames; 0 for no cache. */
+	root->add_child("FrameCacheMemory")->add_child_text(raw_convert<string>(_frame_cache_memory));
+	/* [XML] FrameCacheDisk Maximum size in MB of the viewer's on-disk cache of prepared frames; 0 to keep frames only in memory. */
+	root->add_child("FrameCacheDisk")->add_child_text(raw_convert<string>(_frame_cache_disk));
+	if (_frame_cache_directory) {
+		/* [XML] FrameCacheDirectory Directory to use for the viewer's on-disk frame cache. */
+		root->add_child("FrameCacheDirectory")->add_child_text(_frame_cache_directory->string());
+	}
+	/* [XML] J2KCacheDisk Maximum size in MB of the on-disk cache of encoded J2K frames which is used to speed up re-makes of DCPs; 0 for no cache. */
+	root->add_child("J2KCacheDisk")->add_child_text(raw_convert<string>(_j2k_cache_disk));
+	if (_j2k_cache_directory) {
+		/* [XML] J2KCacheDirectory Directory to use for the cache of encoded J2K frames. */
+		root->add_child("J2KCacheDirectory")->add_child_text(_j2k_cache_directory->string());
+	}
+	/* [XML] ThumbnailCacheDisk Maximum size in MB of the on-disk cache of timeline thumbnails; 0 to keep thumbnails only in memory. */
+	root->add_child("ThumbnailCacheDisk")->add_child_text(raw_convert<string>(_thumbnail_cache_disk));
+	if (_thumbnail_cache_directory) {
+		/* [XML] ThumbnailCacheDirectory Directory to use for the cache of timeline thumbnails. */
+		root->add_child("ThumbnailCacheDirectory")->add_child_text(_thumbnail_cache_directory->string());
+	}
+	/* [XML] ReadaheadMemory Approximate maximum size in MB of the video that the player will decode ahead of time. */
+	root->add_child("ReadaheadMemory")->add_child_text(raw_convert<string>(_readahead_memory));
+	/* [XML] ExportReelThreads Number of reels to encode at the same time when exporting each reel to a separate file. */
+	root->add_child("ExportReelThreads")->add_child_text(raw_convert<string>(_export_reel_threads));
+	/* [XML] ExportSegmentThreads Number of segments to encode at the same time when exporting to a single file, or 1 to encode it in one go. */
+	root->add_child("ExportSegmentThreads")->add_child_text(raw_convert<string>(_export_segment_threads));
+
 	/* [XML] DefaultNotify 1 to default jobs to notify when complete, otherwise 0. */
 	root->add_child("DefaultNotify")->add_child_text(_default_notify ? "1" : "0");
 
@@ -1052,28 +1132,59 @@ Config::write_config () const
 	}
 }
 
+/** Write any changes to cinemas and screens; only the cinemas which have changed will be written */
 void
 Config::write_cinemas () const
 {
-	xmlpp::Document doc;
-	xmlpp::Element* root = doc.create_root_node ("Cinemas");
-	root->add_child("Version")->add_child_text ("1");
-
-	BOOST_FOREACH (shared_ptr<Cinema> i, _cinemas) {
-		i->as_xml (root->add_child ("Cinema"));
+	try {
+		_cinema_database->write ();
+	} catch (xmlpp::exception& e) {
+		string s = e.what ();
+		trim (s);
+		throw FileError (s, _cinema_database->directory());
 	}
+}
 
+/** Write all cinemas to a single file which can be used with set_cinemas_file() */
+void
+Config::export_cinemas (boost::filesystem::path file) const
+{
 	try {
-		doc.write_to_file_formatted (_cinemas_file.string() + ".tmp");
-		boost::filesystem::remove (_cinemas_file);
-		boost::filesystem::rename (_cinemas_file.string() + ".tmp", _cinemas_file);
+		_cinema_database->export_to (file);
 	} catch (xmlpp::exception& e) {
 		string s = e.what ();
 		trim (s);
-		throw FileError (s, _cinemas_file);
+		throw FileError (s, file);
 	}
 }
 
+list<shared_ptr<Cinema> >
+Config::cinemas () const
+{
+	return _cinema_database->cinemas ();
+}
+
+/** @return Cinemas with a given name */
+list<shared_ptr<Cinema> >
+Config::find_cinemas (string name) const
+{
+	return _cinema_database->find (name);
+}
+
+void
+Config::add_cinema (shared_ptr<Cinema> c)
+{
+	_cinema_database->add (c);
+	changed (CINEMAS);
+}
+
+void
+Config::remove_cinema (shared_ptr<Cinema> c)
+{
+	_cinema_database->remove (c);
+	changed (CINEMAS);
+}
+
 boost::filesystem::path
 Config::default_directory_or (boost::filesystem::path a) const
 {
@@ -1231,19 +1342,40 @@ Config::have_existing (string file)
 	return boost::filesystem::exists (path (file, false));
 }
 
-void
-Config::read_cinemas (cxml::Document const & f)
+/** @return Directory of the cinema database that goes with _cinemas_file; it is alongside it,
+ *  so cinemas.xml's database is cinemas.d.
+ */
+boost::filesystem::path
+Config::cinema_database_directory () const
 {
-	_cinemas.clear ();
-	list<cxml::NodePtr> cin = f.node_children ("Cinema");
-	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children("Cinema")) {
-		/* Slightly grotty two-part construction of Cinema here so that we can use
-		   shared_from_this.
-		*/
-		shared_ptr<Cinema> cinema (new Cinema (i));
-		cinema->read_screens (i);
-		_cinemas.push_back (cinema);
+	boost::filesystem::path directory = _cinemas_file;
+	directory.replace_extension (".d");
+	return directory;
+}
+
+/** Open the cinema database that goes with _cinemas_file (see cinema_database_directory()).
+ *  If the database is new it will be filled with the contents of _cinemas_file, as all
+ *  cinemas used to be kept in that file.
+ *  @return true if the database is new and _cinemas_file does not exist.
+ */
+bool
+Config::open_cinema_database ()
+{
+	_cinema_database.reset (new CinemaDatabase (cinema_database_directory ()));
+
+	if (_cinema_database->existed ()) {
+		return false;
+	}
+
+	if (!boost::filesystem::exists (_cinemas_file)) {
+		return true;
 	}
+
+	cxml::Document f ("Cinemas");
+	f.read_file (_cinemas_file);
+	_cinema_database->import (f);
+	_cinema_database->write ();
+	return false;
 }
 
 void
@@ -1253,13 +1385,15 @@ Config::set_cinemas_file (boost::filesystem::path file)
 		return;
 	}
 
+	shared_ptr<CinemaDatabase> old = _cinema_database;
 	_cinemas_file = file;
 
-	if (boost::filesystem::exists (_cinemas_file)) {
-		/* Existing file; read it in */
-		cxml::Document f ("Cinemas");
-		f.read_file (_cinemas_file);
-		read_cinemas (f);
+	if (open_cinema_database () && old) {
+		/* This is a new file, so it starts off with the cinemas that we had before */
+		BOOST_FOREACH (shared_ptr<Cinema> i, old->cinemas ()) {
+			_cinema_database->add (i);
+		}
+		_cinema_database->write ();
 	}
 
 	changed (OTHER);
@@ -41,6 +41,8 @@ class CinemaSoundProcessor;
 class DCPContentType;
 class Ratio;
 class Cinema;
+class CinemaDatabase;
+class DKDMDatabase;
 class Film;
 class DKDMGroup;
 
@@ -82,6 +84,7 @@ public:
 		PLAYER_PLAYLIST_DIRECTORY,
 		PLAYER_DEBUG_LOG,
 		HISTORY,
+		FRAME_CACHE,
 #ifdef DCPOMATIC_VARIANT_SWAROOP
 		PLAYER_BACKGROUND_IMAGE,
 #endif
@@ -146,9 +149,8 @@ public:
 		return _cinema_sound_processor;
 	}
 
-	std::list<boost::shared_ptr<Cinema> > cinemas () const {
-		return _cinemas;
-	}
+	std::list<boost::shared_ptr<Cinema> > cinemas () const;
+	std::list<boost::shared_ptr<Cinema> > find_cinemas (std::string name) const;
 
 	std::list<int> allowed_dcp_frame_rates () const {
 		return _allowed_dcp_frame_rates;
@@ -426,6 +428,52 @@ public:
 		return _decode_reduction;
 	}
 
+	/** @return maximum size of the viewer's in-memory frame cache in MB, or 0 to use no cache */
+	int frame_cache_memory () const {
+		return _frame_cache_memory;
+	}
+
+	/** @return maximum size of the viewer's on-disk frame cache in MB, or 0 to keep frames only in memory */
+	int frame_cache_disk () const {
+		return _frame_cache_disk;
+	}
+
+	boost::filesystem::path frame_cache_directory () const {
+		return _frame_cache_directory.get_value_or (path ("frame_cache", false));
+	}
+
+	/** @return maximum size in MB of the on-disk cache of encoded J2K frames, or 0 to use no cache */
+	int j2k_cache_disk () const {
+		return _j2k_cache_disk;
+	}
+
+	boost::filesystem::path j2k_cache_directory () const {
+		return _j2k_cache_directory.get_value_or (path ("j2k_cache", false));
+	}
+
+	/** @return maximum size in MB of the on-disk cache of timeline thumbnails, or 0 to keep them only in memory */
+	int thumbnail_cache_disk () const {
+		return _thumbnail_cache_disk;
+	}
+
+	boost::filesystem::path thumbnail_cache_directory () const {
+		return _thumbnail_cache_directory.get_value_or (path ("thumbnails", false));
+	}
+
+	/** @return amount of memory in MB that a butler should try to limit its video readahead to */
+	int readahead_memory () const {
+		return _readahead_memory;
+	}
+
+	/** @return number of reels to encode at the same time when exporting each reel to its own file */
+	int export_reel_threads () const {
+		return _export_reel_threads;
+	}
+
+	int export_segment_threads () const {
+		return _export_segment_threads;
+	}
+
 	bool default_notify () const {
 		return _default_notify;
 	}
@@ -592,15 +640,8 @@ public:
 		maybe_set (_tms_password, p);
 	}
 
-	void add_cinema (boost::shared_ptr<Cinema> c) {
-		_cinemas.push_back (c);
-		changed (CINEMAS);
-	}
-
-	void remove_cinema (boost::shared_ptr<Cinema> c) {
-		_cinemas.remove (c);
-		changed (CINEMAS);
-	}
+	void add_cinema (boost::shared_ptr<Cinema> c);
+	void remove_cinema (boost::shared_ptr<Cinema> c);
 
 	void set_allowed_dcp_frame_rates (std::list<int> const & r) {
 		maybe_set (_allowed_dcp_frame_rates, r);
@@ -856,6 +897,46 @@ public:
 		maybe_set (_decode_reduction, r);
 	}
 
+	void set_frame_cache_memory (int m) {
+		maybe_set (_frame_cache_memory, m, FRAME_CACHE);
+	}
+
+	void set_frame_cache_disk (int m) {
+		maybe_set (_frame_cache_disk, m, FRAME_CACHE);
+	}
+
+	void set_frame_cache_directory (boost::filesystem::path d) {
+		maybe_set (_frame_cache_directory, d, FRAME_CACHE);
+	}
+
+	void set_j2k_cache_disk (int m) {
+		maybe_set (_j2k_cache_disk, m);
+	}
+
+	void set_j2k_cache_directory (boost::filesystem::path d) {
+		maybe_set (_j2k_cache_directory, d);
+	}
+
+	void set_thumbnail_cache_disk (int m) {
+		maybe_set (_thumbnail_cache_disk, m);
+	}
+
+	void set_thumbnail_cache_directory (boost::filesystem::path d) {
+		maybe_set (_thumbnail_cache_directory, d);
+	}
+
+	void set_readahead_memory (int m) {
+		maybe_set (_readahead_memory, m);
+	}
+
+	void set_export_reel_threads (int t) {
+		maybe_set (_export_reel_threads, t);
+	}
+
+	void set_export_segment_threads (int t) {
+		maybe_set (_export_segment_threads, t);
+	}
+
 	void set_default_notify (bool n) {
 		maybe_set (_default_notify, n);
 	}
@@ -1079,6 +1160,7 @@ public:
 	void write () const;
 	void write_config () const;
 	void write_cinemas () const;
+	void export_cinemas (boost::filesystem::path file) const;
 	void link (boost::filesystem::path new_file) const;
 	void copy_and_link (boost::filesystem::path new_file) const;
 	bool have_write_permission () const;
@@ -1103,7 +1185,8 @@ private:
 	void set_kdm_email_to_default ();
 	void set_notification_email_to_default ();
 	void set_cover_sheet_to_default ();
-	void read_cinemas (cxml::Document const & f);
+	boost::filesystem::path cinema_database_directory () const;
+	bool open_cinema_database ();
 	boost::shared_ptr<dcp::CertificateChain> create_certificate_chain ();
 	boost::filesystem::path directory_or (boost::optional<boost::filesystem::path> dir, boost::filesystem::path a) const;
 	void add_to_history_internal (std::vector<boost::filesystem::path>& h, boost::filesystem::path p);
@@ -1182,7 +1265,7 @@ private:
 	*/
 	boost::optional<boost::filesystem::path> _default_kdm_directory;
 	bool _default_upload_after_make_dcp;
-	std::list<boost::shared_ptr<Cinema> > _cinemas;
+	boost::shared_ptr<CinemaDatabase> _cinema_database;
 	std::string _mail_server;
 	int _mail_port;
 	EmailProtocol _mail_protocol;
@@ -1224,6 +1307,7 @@ private:
 	std::vector<boost::filesystem::path> _history;
 	std::vector<boost::filesystem::path> _player_history;
 	boost::shared_ptr<DKDMGroup> _dkdms;
+	boost::shared_ptr<DKDMDatabase> _dkdm_database;
 	boost::filesystem::path _cinemas_file;
 	bool _show_hints_before_make_dcp;
 	bool _confirm_kdm_email;
@@ -1242,6 +1326,20 @@ private:
 	boost::optional<DKDMWriteType> _last_dkdm_write_type;
 	int _frames_in_memory_multiplier;
 	boost::optional<int> _decode_reduction;
+	int _frame_cache_memory;
+	int _frame_cache_disk;
+	/** Directory for the viewer's on-disk frame cache, if the default is not to be used */
+	boost::optional<boost::filesystem::path> _frame_cache_directory;
+	int _j2k_cache_disk;
+	/** Directory for the cache of encoded J2K frames, if the default is not to be used */
+	boost::optional<boost::filesystem::path> _j2k_cache_directory;
+	int _thumbnail_cache_disk;
+	/** Directory for the cache of timeline thumbnails, if the default is not to be used */
+	boost::optional<boost::filesystem::path> _thumbnail_cache_directory;
+	int _readahead_memory;
+	int _export_reel_threads;
+	/** number of segments to encode at once when exporting to a single file; 1 to encode the film in one go */
+	int _export_segment_threads;
 	bool _default_notify;
 	bool _notification[NOTIFICATION_COUNT];
 	boost::optional<std::string> _barco_username;
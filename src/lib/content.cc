@@ -305,6 +305,26 @@ Content::length_after_trim (shared_ptr<const Film> film) const
 	return max (DCPTime(), full_length(film) - DCPTime(trim_start() + trim_end(), film->active_frame_rate_change(position())));
 }
 
+/** @return string which identifies the images that this content will give for each of its
+ *  frames, before they are cropped, scaled and so on.  Unlike identifier() this does not
+ *  change if the content is moved or trimmed.
+ */
+string
+Content::image_identifier () const
+{
+	string s = Content::digest ();
+
+	/* Some decoders (e.g. FFmpegDecoder) use this rate to decide which of the source's
+	   frames is which content frame.
+	*/
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_video_frame_rate) {
+		s += "_" + raw_convert<string> (_video_frame_rate.get());
+	}
+
+	return s;
+}
+
 /** @return string which changes when something about this content changes which affects
  *  the appearance of its video.
  */
@@ -0,0 +1,260 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "content_audio_analysis.h"
+#include "audio_buffers.h"
+#include "cross.h"
+#include "util.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include <boost/foreach.hpp>
+#include <cmath>
+
+using std::vector;
+using std::max;
+using boost::shared_ptr;
+
+/** Identifier at the start of each analysis file; change this if the file format changes */
+#define CONTENT_AUDIO_ANALYSIS_MAGIC 0x44434102
+
+ContentAudioAnalysis::FilterState::FilterState ()
+	: position (0)
+{
+	for (int i = 0; i < 4; ++i) {
+		z[i] = 0;
+	}
+	for (int i = 0; i < 24; ++i) {
+		history[i] = 0;
+	}
+}
+
+/** @param frame_rate Frame rate of the audio that will be analysed.
+ *  @param channels Number of channels in each stream of audio that will be analysed.
+ */
+ContentAudioAnalysis::ContentAudioAnalysis (int frame_rate, vector<int> channels)
+	: _frame_rate (frame_rate)
+{
+	BOOST_FOREACH (int i, channels) {
+		_blocks.push_back (vector<vector<Block> > (i));
+		_filter_states.push_back (vector<FilterState> (i));
+	}
+
+	setup_filters ();
+}
+
+ContentAudioAnalysis::ContentAudioAnalysis (boost::filesystem::path file)
+{
+	FILE* f = fopen_boost (file, "rb");
+	if (!f) {
+		throw OpenFileError (file, errno, OpenFileError::READ);
+	}
+
+	try {
+		int32_t header[3];
+		checked_fread (header, sizeof(header), f, file);
+		if (header[0] != CONTENT_AUDIO_ANALYSIS_MAGIC) {
+			throw FileError ("Unknown audio analysis format", file);
+		}
+		_frame_rate = header[1];
+
+		vector<int32_t> channels (header[2]);
+		if (!channels.empty()) {
+			checked_fread (&channels[0], channels.size() * sizeof(int32_t), f, file);
+		}
+
+		BOOST_FOREACH (int32_t i, channels) {
+			vector<vector<Block> > stream (i);
+			for (int j = 0; j < i; ++j) {
+				int64_t size;
+				checked_fread (&size, sizeof(size), f, file);
+				stream[j].resize (size);
+				if (size > 0) {
+					checked_fread (&stream[j][0], size * sizeof(Block), f, file);
+				}
+			}
+			_blocks.push_back (stream);
+		}
+	} catch (...) {
+		fclose (f);
+		throw;
+	}
+
+	fclose (f);
+}
+
+/** Set up the coefficients of our filters for _frame_rate; the K-weighting is as described in
+ *  ITU-R BS.1770 (with coefficients calculated in the same way as libebur128).
+ */
+void
+ContentAudioAnalysis::setup_filters ()
+{
+	double f0 = 1681.974450955533;
+	double const G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+
+	double K = tan (M_PI * f0 / _frame_rate);
+	double const Vh = pow (10.0, G / 20.0);
+	double const Vb = pow (Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+
+	_pre_b[0] = (Vh + Vb * K / Q + K * K) / a0;
+	_pre_b[1] = 2.0 * (K * K - Vh) / a0;
+	_pre_b[2] = (Vh - Vb * K / Q + K * K) / a0;
+	_pre_a[0] = 1.0;
+	_pre_a[1] = 2.0 * (K * K - 1.0) / a0;
+	_pre_a[2] = (1.0 - K / Q + K * K) / a0;
+
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan (M_PI * f0 / _frame_rate);
+	a0 = 1.0 + K / Q + K * K;
+
+	_rlb_b[0] = 1.0;
+	_rlb_b[1] = -2.0;
+	_rlb_b[2] = 1.0;
+	_rlb_a[0] = 1.0;
+	_rlb_a[1] = 2.0 * (K * K - 1.0) / a0;
+	_rlb_a[2] = (1.0 - K / Q + K * K) / a0;
+
+	/* Windowed-sinc interpolation filter for finding values at 1/4, 2/4 and 3/4 of the
+	   way between the 6th and 7th of the last 12 samples.
+	*/
+	for (int p = 0; p < 4; ++p) {
+		float sum = 0;
+		for (int k = 0; k < 12; ++k) {
+			double const t = 5 + p / 4.0 - k;
+			double const sinc = t == 0 ? 1 : sin (M_PI * t) / (M_PI * t);
+			double const window = fabs(t) < 6 ? 0.5 * (1 + cos (M_PI * t / 6)) : 0;
+			_over[p][k] = sinc * window;
+			sum += _over[p][k];
+		}
+		for (int k = 0; k < 12; ++k) {
+			_over[p][k] /= sum;
+		}
+	}
+}
+
+/** Analyse some audio.
+ *  @param stream Index of the stream that the audio is from.
+ *  @param audio Audio data.
+ *  @param frame Frame index of the start of the audio within the content.
+ */
+void
+ContentAudioAnalysis::analyse (int stream, shared_ptr<const AudioBuffers> audio, Frame frame)
+{
+	DCPOMATIC_ASSERT (stream < streams());
+	DCPOMATIC_ASSERT (frame >= 0);
+
+	int const size = block_size ();
+	int const channels = std::min (audio->channels(), this->channels(stream));
+
+	for (int i = 0; i < channels; ++i) {
+		vector<Block>& blocks = _blocks[stream][i];
+		FilterState& state = _filter_states[stream][i];
+		float const * data = audio->data(i);
+
+		size_t const needed = (frame + audio->frames() + size - 1) / size;
+		if (blocks.size() < needed) {
+			blocks.resize (needed);
+		}
+
+		for (int j = 0; j < audio->frames(); ++j) {
+			Frame const f = frame + j;
+			Block& block = blocks[f / size];
+			float const s = data[j];
+
+			float const a = fabsf (s);
+			if (a > block.peak) {
+				block.peak = a;
+				block.peak_offset = f % size;
+			}
+
+			block.sum_squares += s * s;
+
+			double const pre = _pre_b[0] * s + state.z[0];
+			state.z[0] = _pre_b[1] * s - _pre_a[1] * pre + state.z[1];
+			state.z[1] = _pre_b[2] * s - _pre_a[2] * pre;
+			double const rlb = _rlb_b[0] * pre + state.z[2];
+			state.z[2] = _rlb_b[1] * pre - _rlb_a[1] * rlb + state.z[3];
+			state.z[3] = _rlb_b[2] * pre - _rlb_a[2] * rlb;
+			block.weighted_sum_squares += rlb * rlb;
+
+			state.history[state.position] = s;
+			state.history[state.position + 12] = s;
+			state.position = (state.position + 1) % 12;
+			float const * window = state.history + state.position;
+			float true_peak = fabsf (window[5]);
+			for (int p = 1; p < 4; ++p) {
+				float v = 0;
+				for (int k = 0; k < 12; ++k) {
+					v += _over[p][k] * window[k];
+				}
+				true_peak = max (true_peak, fabsf (v));
+			}
+			block.true_peak = max (block.true_peak, true_peak);
+		}
+	}
+}
+
+void
+ContentAudioAnalysis::write (boost::filesystem::path file) const
+{
+	/* Write to a temporary file and then rename so that we never have a partially-written
+	   analysis with the proper name.
+	*/
+	boost::filesystem::path tmp = file;
+	tmp += ".tmp";
+
+	FILE* f = fopen_boost (tmp, "wb");
+	if (!f) {
+		throw OpenFileError (tmp, errno, OpenFileError::WRITE);
+	}
+
+	try {
+		int32_t header[3] = {
+			CONTENT_AUDIO_ANALYSIS_MAGIC,
+			_frame_rate,
+			static_cast<int32_t> (_blocks.size())
+		};
+		checked_fwrite (header, sizeof(header), f, tmp);
+
+		BOOST_FOREACH (vector<vector<Block> > const & i, _blocks) {
+			int32_t const channels = i.size ();
+			checked_fwrite (&channels, sizeof(channels), f, tmp);
+		}
+
+		BOOST_FOREACH (vector<vector<Block> > const & i, _blocks) {
+			BOOST_FOREACH (vector<Block> const & j, i) {
+				int64_t const size = j.size ();
+				checked_fwrite (&size, sizeof(size), f, tmp);
+				if (size > 0) {
+					checked_fwrite (&j[0], size * sizeof(Block), f, tmp);
+				}
+			}
+		}
+	} catch (...) {
+		fclose (f);
+		throw;
+	}
+
+	fclose (f);
+
+	boost::filesystem::rename (tmp, file);
+}
@@ -0,0 +1,127 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_CONTENT_AUDIO_ANALYSIS_H
+#define DCPOMATIC_CONTENT_AUDIO_ANALYSIS_H
+
+#include "types.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <stdint.h>
+
+class AudioBuffers;
+
+/** @class ContentAudioAnalysis
+ *  @brief Levels of each channel of each audio stream of a piece of content, before any gain,
+ *  mapping or trimming has been applied.
+ *
+ *  The audio is split into blocks of 100ms, and for each block we keep enough information
+ *  for AnalyseAudioJob to work out the analysis of a whole playlist by combining the analyses
+ *  of its content (as long as no content channels are mixed together).
+ */
+class ContentAudioAnalysis : public boost::noncopyable
+{
+public:
+	ContentAudioAnalysis (int frame_rate, std::vector<int> channels);
+	explicit ContentAudioAnalysis (boost::filesystem::path file);
+
+	/** Levels of one channel over one block */
+	struct Block
+	{
+		Block ()
+			: peak (0)
+			, peak_offset (0)
+			, sum_squares (0)
+			, weighted_sum_squares (0)
+			, true_peak (0)
+		{}
+
+		/** Highest absolute sample value */
+		float peak;
+		/** Offset of the peak sample from the start of the block */
+		int32_t peak_offset;
+		/** Sum of the squares of the samples */
+		float sum_squares;
+		/** Sum of the squares of the samples after K-weighting (see ITU-R BS.1770) */
+		float weighted_sum_squares;
+		/** Highest absolute value of the signal after 4x over-sampling */
+		float true_peak;
+	};
+
+	void analyse (int stream, boost::shared_ptr<const AudioBuffers> audio, Frame frame);
+	void write (boost::filesystem::path file) const;
+
+	int frame_rate () const {
+		return _frame_rate;
+	}
+
+	/** @return Number of frames in each block */
+	int block_size () const {
+		return _frame_rate / 10;
+	}
+
+	int streams () const {
+		return _blocks.size ();
+	}
+
+	int channels (int stream) const {
+		return _blocks[stream].size ();
+	}
+
+	std::vector<Block> const & blocks (int stream, int channel) const {
+		return _blocks[stream][channel];
+	}
+
+private:
+	void setup_filters ();
+
+	/** State of our filters for one channel */
+	struct FilterState
+	{
+		FilterState ();
+
+		/** State of the two K-weighting biquads */
+		double z[4];
+		/** Recent samples for over-sampling, each stored twice so that the
+		 *  last 12 are always contiguous.
+		 */
+		float history[24];
+		int position;
+	};
+
+	int _frame_rate;
+	/** Blocks for each channel of each stream */
+	std::vector<std::vector<std::vector<Block> > > _blocks;
+	/** Filter states for each channel of each stream */
+	std::vector<std::vector<FilterState> > _filter_states;
+
+	/** K-weighting pre-filter coefficients */
+	double _pre_b[3];
+	double _pre_a[3];
+	/** K-weighting RLB filter coefficients */
+	double _rlb_b[3];
+	double _rlb_a[3];
+	/** Coefficients for each phase of the over-sampling filter */
+	float _over[4][12];
+};
+
+#endif
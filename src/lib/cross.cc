@@ -31,18 +31,23 @@ extern "C" {
 #ifdef DCPOMATIC_LINUX
 #include <unistd.h>
 #include <mntent.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #endif
 #ifdef DCPOMATIC_WINDOWS
 #include <windows.h>
 #undef DATADIR
 #include <shlwapi.h>
 #include <shellapi.h>
+#include <psapi.h>
 #include <fcntl.h>
 #endif
 #ifdef DCPOMATIC_OSX
 #include <sys/sysctl.h>
+#include <mach/mach.h>
 #include <mach-o/dyld.h>
 #include <IOKit/pwr_mgt/IOPMLib.h>
+#include <pthread.h>
 #endif
 #ifdef DCPOMATIC_POSIX
 #include <sys/types.h>
@@ -427,6 +432,54 @@ thread_id ()
 #endif
 }
 
+/** Ask the OS to give the calling thread as little CPU time as possible
+ *  when other threads want it.
+ */
+void
+set_background_priority ()
+{
+#ifdef DCPOMATIC_LINUX
+	/* On Linux the nice value of a thread is set using its kernel thread ID */
+	setpriority (PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+#ifdef DCPOMATIC_WINDOWS
+	SetThreadPriority (GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+#ifdef DCPOMATIC_OSX
+	pthread_set_qos_class_self_np (QOS_CLASS_BACKGROUND, 0);
+#endif
+}
+
+/** @return Amount of physical memory that this process is using, in bytes, if we can find out */
+boost::optional<size_t>
+resident_memory ()
+{
+#ifdef DCPOMATIC_LINUX
+	/* The second field of statm is the resident set size in pages */
+	std::ifstream f ("/proc/self/statm");
+	size_t total = 0;
+	size_t resident = 0;
+	if (f >> total >> resident) {
+		return resident * sysconf (_SC_PAGESIZE);
+	}
+#endif
+#ifdef DCPOMATIC_WINDOWS
+	/* This is the kernel32 version of GetProcessMemoryInfo, so it doesn't need psapi.dll */
+	PROCESS_MEMORY_COUNTERS counters;
+	if (K32GetProcessMemoryInfo (GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.WorkingSetSize;
+	}
+#endif
+#ifdef DCPOMATIC_OSX
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info (mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+		return info.resident_size;
+	}
+#endif
+	return boost::optional<size_t> ();
+}
+
 int
 avio_open_boost (AVIOContext** s, boost::filesystem::path file, int flags)
 {
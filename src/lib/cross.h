@@ -29,6 +29,7 @@
 #include <IOKit/pwr_mgt/IOPMLib.h>
 #endif
 #include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
 
 #ifdef DCPOMATIC_WINDOWS
 #define WEXITSTATUS(w) (w)
@@ -54,6 +55,8 @@ extern int dcpomatic_fseek (FILE *, int64_t, int);
 extern void start_batch_converter (boost::filesystem::path dcpomatic);
 extern void start_player (boost::filesystem::path dcpomatic);
 extern uint64_t thread_id ();
+extern void set_background_priority ();
+extern boost::optional<size_t> resident_memory ();
 extern int avio_open_boost (AVIOContext** s, boost::filesystem::path file, int flags);
 extern boost::filesystem::path home_directory ();
 extern std::string command_and_read (std::string cmd);
@@ -26,7 +26,10 @@
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/crypto.h>
 #include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+#include <boost/functional/hash.hpp>
 
 using std::string;
 using boost::shared_array;
@@ -121,3 +124,42 @@ dcpomatic::crypto_key_length ()
 {
 	return EVP_CIPHER_key_length (CIPHER);
 }
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/** Locks for OpenSSL to use; see setup_openssl_threads() */
+static boost::mutex* openssl_mutexes = 0;
+
+static void
+openssl_locking (int mode, int n, char const *, int)
+{
+	if (mode & CRYPTO_LOCK) {
+		openssl_mutexes[n].lock ();
+	} else {
+		openssl_mutexes[n].unlock ();
+	}
+}
+
+static unsigned long
+openssl_thread_id ()
+{
+	return boost::hash<boost::thread::id>() (boost::this_thread::get_id ());
+}
+#endif
+
+/** Make it safe for several threads to use OpenSSL (and so xmlsec, which signs with it)
+ *  at the same time.  OpenSSL 1.1 and later look after this themselves; before that we
+ *  must give it some locks.  This must be called before any threads use OpenSSL.
+ */
+void
+dcpomatic::setup_openssl_threads ()
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	if (openssl_mutexes) {
+		return;
+	}
+
+	openssl_mutexes = new boost::mutex[CRYPTO_num_locks()];
+	CRYPTO_set_id_callback (openssl_thread_id);
+	CRYPTO_set_locking_callback (openssl_locking);
+#endif
+}
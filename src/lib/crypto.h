@@ -26,6 +26,7 @@ dcp::Data random_iv ();
 dcp::Data encrypt (std::string plaintext, dcp::Data key, dcp::Data iv);
 std::string decrypt (dcp::Data ciphertext, dcp::Data key, dcp::Data iv);
 int crypto_key_length ();	
+void setup_openssl_threads ();
 
 }
 
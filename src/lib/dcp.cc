@@ -25,6 +25,7 @@
 #include "dcpomatic_log.h"
 #include "compose.hpp"
 #include "dcp_content.h"
+#include "digester.h"
 #include <dcp/dcp.h>
 #include <dcp/decrypted_kdm.h>
 #include <dcp/exceptions.h>
@@ -37,9 +38,87 @@ using std::string;
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 
-/** Find all the CPLs in our directories, cross-add assets and return the CPLs */
+boost::mutex DCP::_cache_mutex;
+list<DCP::CacheEntry> DCP::_cache;
+int const DCP::_cache_size = 16;
+
+/** @return The CPLs in our directories, with assets cross-added and any KDM applied.  These are
+ *  shared with anything else in this process which reads the same DCPs (so that the DCPs do not
+ *  have to be read and parsed again every time a decoder is made) and must not be modified.
+ */
 list<shared_ptr<dcp::CPL> >
 DCP::cpls () const
+{
+	string const key = cache_key ();
+
+	{
+		boost::mutex::scoped_lock lm (_cache_mutex);
+		for (list<CacheEntry>::iterator i = _cache.begin(); i != _cache.end(); ++i) {
+			if (i->key == key) {
+				_cache.splice (_cache.begin(), _cache, i);
+				return _cache.front().cpls;
+			}
+		}
+	}
+
+	/* We read without the lock held so that other DCPs can be found in the
+	   cache meanwhile; if two threads read the same DCP at once the second
+	   one just replaces the first one's entry.
+	*/
+	CacheEntry entry;
+	entry.key = key;
+	entry.cpls = read_cpls ();
+
+	boost::mutex::scoped_lock lm (_cache_mutex);
+	for (list<CacheEntry>::iterator i = _cache.begin(); i != _cache.end(); ++i) {
+		if (i->key == key) {
+			_cache.erase (i);
+			break;
+		}
+	}
+	_cache.push_front (entry);
+	while (int (_cache.size()) > _cache_size) {
+		_cache.pop_back ();
+	}
+
+	return entry.cpls;
+}
+
+/** @return A digest of everything which affects what read_cpls() would return: our directories,
+ *  the paths, sizes and modification times of the files anywhere underneath them (as the ASSETMAP
+ *  may refer to assets in subdirectories), our KDM and the key used to decrypt it.
+ */
+string
+DCP::cache_key () const
+{
+	Digester digester;
+
+	BOOST_FOREACH (boost::filesystem::path i, _dcp_content->directories()) {
+		digester.add (i.string ());
+		boost::system::error_code ec;
+		for (boost::filesystem::recursive_directory_iterator j = boost::filesystem::recursive_directory_iterator(i, ec); !ec && j != boost::filesystem::recursive_directory_iterator(); j.increment(ec)) {
+			boost::system::error_code file_ec;
+			digester.add (j->path().string());
+			digester.add (boost::filesystem::last_write_time (j->path(), file_ec));
+			if (boost::filesystem::is_regular_file (j->status())) {
+				digester.add (boost::filesystem::file_size (j->path(), file_ec));
+			}
+		}
+	}
+
+	if (_dcp_content->kdm ()) {
+		digester.add (_dcp_content->kdm()->as_xml ());
+		digester.add (Config::instance()->decryption_chain()->key().get_value_or (""));
+	}
+
+	return digester.get ();
+}
+
+/** Find all the CPLs in our directories, cross-add assets and return the CPLs.  This reads
+ *  and parses the DCPs each time it is called, so the CPLs that it returns are our own.
+ */
+list<shared_ptr<dcp::CPL> >
+DCP::read_cpls () const
 {
 	list<shared_ptr<dcp::DCP> > dcps;
 	list<shared_ptr<dcp::CPL> > cpls;
@@ -23,7 +23,9 @@
 
 #include <dcp/cpl.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <list>
+#include <string>
 
 class DCPContent;
 
@@ -37,7 +39,27 @@ protected:
 		: _dcp_content (content)
 	{}
 
+	std::list<boost::shared_ptr<dcp::CPL> > read_cpls () const;
+
 	boost::shared_ptr<const DCPContent> _dcp_content;
+
+private:
+	std::string cache_key () const;
+
+	struct CacheEntry
+	{
+		std::string key;
+		std::list<boost::shared_ptr<dcp::CPL> > cpls;
+	};
+
+	/** mutex to protect _cache */
+	static boost::mutex _cache_mutex;
+	/** CPLs that have been read recently by any DCP in this process, most recently used first.
+	 *  Nothing in these CPLs (or their reels and assets) may be modified.
+	 */
+	static std::list<CacheEntry> _cache;
+	/** maximum number of entries in _cache */
+	static int const _cache_size;
 };
 
 #endif
@@ -382,6 +382,31 @@ DCPContent::identifier () const
 	return s;
 }
 
+string
+DCPContent::image_identifier () const
+{
+	string s = Content::image_identifier ();
+
+	/* The CPL and KDM decide which picture assets we get (and whether we can decrypt them),
+	   and referenced video is not decoded at all.
+	*/
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (_cpl) {
+		s += "_" + _cpl.get();
+	}
+	if (_kdm) {
+		s += "_" + _kdm->id();
+	}
+
+	s += string (_reference_video ? "_1" : "_0");
+	s += string (_reference_audio ? "1" : "0");
+	for (int i = 0; i < TEXT_COUNT; ++i) {
+		s += string (_reference_text[i] ? "1" : "0");
+	}
+	return s;
+}
+
 void
 DCPContent::add_kdm (dcp::EncryptedKDM k)
 {
@@ -69,6 +69,7 @@ public:
 	std::string technical_summary () const;
 	void as_xml (xmlpp::Node *, bool with_paths) const;
 	std::string identifier () const;
+	std::string image_identifier () const;
 	void take_settings_from (boost::shared_ptr<const Content> c);
 
 	void set_default_colour_conversion ();
@@ -56,7 +56,10 @@ using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 using boost::optional;
 
-DCPDecoder::DCPDecoder (shared_ptr<const Film> film, shared_ptr<const DCPContent> c, bool fast)
+/** @param shared true to use the CPLs that are shared by everything in this process which reads the same DCP,
+ *  false to read our own copy of the DCP; the reels that reels() returns may only be modified in the latter case.
+ */
+DCPDecoder::DCPDecoder (shared_ptr<const Film> film, shared_ptr<const DCPContent> c, bool fast, bool shared)
 	: DCP (c)
 	, Decoder (film)
 	, _decode_referenced (false)
@@ -74,7 +77,7 @@ DCPDecoder::DCPDecoder (shared_ptr<const Film> film, shared_ptr<const DCPContent
 		}
 	}
 
-	list<shared_ptr<dcp::CPL> > cpl_list = cpls ();
+	list<shared_ptr<dcp::CPL> > cpl_list = shared ? cpls() : read_cpls();
 
 	if (cpl_list.empty()) {
 		throw DCPError (_("No CPLs found in DCP."));
@@ -91,7 +94,7 @@ DCPDecoder::DCPDecoder (shared_ptr<const Film> film, shared_ptr<const DCPContent
 		/* No CPL found; probably an old file that doesn't specify it;
 		   just use the first one.
 		*/
-		cpl = cpls().front ();
+		cpl = cpl_list.front ();
 	}
 
 	set_decode_referenced (false);
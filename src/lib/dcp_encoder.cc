@@ -170,3 +170,15 @@ DCPEncoder::frames_done () const
 
 	return _j2k_encoder->video_frames_enqueued ();
 }
+
+void
+DCPEncoder::metrics (Metrics& metrics) const
+{
+	Encoder::metrics (metrics);
+	if (_j2k_encoder) {
+		_j2k_encoder->metrics (metrics);
+	}
+	if (_writer) {
+		_writer->metrics (metrics);
+	}
+}
@@ -43,6 +43,7 @@ public:
 
 	float current_rate () const;
 	Frame frames_done () const;
+	void metrics (Metrics& metrics) const;
 
 	/** @return true if we are in the process of calling Encoder::process_end */
 	bool finishing () const {
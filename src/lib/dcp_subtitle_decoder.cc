@@ -20,46 +20,64 @@
 
 #include "dcp_subtitle_decoder.h"
 #include "dcp_subtitle_content.h"
+#include "parsed_file_cache.h"
 #include <dcp/interop_subtitle_asset.h>
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <iostream>
 
 using std::list;
+using std::vector;
 using std::cout;
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 using boost::bind;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
+
+/** Cache of the subtitles in files that have been read recently, so that they are
+ *  parsed once rather than every time a decoder is made.
+ */
+static ParsedFileCache<vector<shared_ptr<dcp::Subtitle> > > cache (16);
 
 DCPSubtitleDecoder::DCPSubtitleDecoder (shared_ptr<const Film> film, shared_ptr<const DCPSubtitleContent> content)
 	: Decoder (film)
 {
-	shared_ptr<dcp::SubtitleAsset> c (load (content->path (0)));
-	c->fix_empty_font_ids ();
-	_subtitles = c->subtitles ();
-	_next = _subtitles.begin ();
+	_subtitles = cache.get (content->path(0), bind(&DCPSubtitleDecoder::read_subtitles, this, _1));
+	_next = _subtitles->begin ();
 
 	ContentTime first;
-	if (_next != _subtitles.end()) {
+	if (_next != _subtitles->end()) {
 		first = content_time_period(*_next).from;
 	}
 	text.push_back (shared_ptr<TextDecoder> (new TextDecoder (this, content->only_text(), first)));
 }
 
+static bool
+earlier (shared_ptr<dcp::Subtitle> a, shared_ptr<dcp::Subtitle> b)
+{
+	return a->in() < b->in();
+}
+
+static bool
+starts_before (shared_ptr<dcp::Subtitle> s, ContentTime t)
+{
+	return ContentTime::from_seconds (s->in().as_seconds()) < t;
+}
+
 void
 DCPSubtitleDecoder::seek (ContentTime time, bool accurate)
 {
 	Decoder::seek (time, accurate);
 
-	_next = _subtitles.begin ();
-	list<shared_ptr<dcp::Subtitle> >::const_iterator i = _subtitles.begin ();
-	while (i != _subtitles.end() && ContentTime::from_seconds ((*_next)->in().as_seconds()) < time) {
-		++i;
-	}
+	_next = std::lower_bound (_subtitles->begin(), _subtitles->end(), time, starts_before);
 }
 
 bool
 DCPSubtitleDecoder::pass ()
 {
-	if (_next == _subtitles.end ()) {
+	if (_next == _subtitles->end ()) {
 		return true;
 	}
 
@@ -74,7 +92,7 @@ DCPSubtitleDecoder::pass ()
 	list<dcp::SubtitleImage> i;
 	ContentTimePeriod const p = content_time_period (*_next);
 
-	while (_next != _subtitles.end () && content_time_period (*_next) == p) {
+	while (_next != _subtitles->end () && content_time_period (*_next) == p) {
 		shared_ptr<dcp::SubtitleString> ns = dynamic_pointer_cast<dcp::SubtitleString>(*_next);
 		if (ns) {
 			s.push_back (*ns);
@@ -104,3 +122,19 @@ DCPSubtitleDecoder::content_time_period (shared_ptr<dcp::Subtitle> s) const
 		ContentTime::from_seconds (s->out().as_seconds ())
 		);
 }
+
+/** Read the subtitles from a file.
+ *  @return The subtitles, sorted by start time.
+ */
+shared_ptr<const vector<shared_ptr<dcp::Subtitle> > >
+DCPSubtitleDecoder::read_subtitles (boost::filesystem::path file) const
+{
+	shared_ptr<dcp::SubtitleAsset> c (load (file));
+	c->fix_empty_font_ids ();
+	list<shared_ptr<dcp::Subtitle> > subs = c->subtitles ();
+
+	shared_ptr<vector<shared_ptr<dcp::Subtitle> > > sorted (new vector<shared_ptr<dcp::Subtitle> > (subs.begin(), subs.end()));
+	/* seek() finds where to start by binary search */
+	std::stable_sort (sorted->begin(), sorted->end(), earlier);
+	return sorted;
+}
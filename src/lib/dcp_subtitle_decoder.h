@@ -33,7 +33,11 @@ public:
 
 private:
 	ContentTimePeriod content_time_period (boost::shared_ptr<dcp::Subtitle> s) const;
+	boost::shared_ptr<const std::vector<boost::shared_ptr<dcp::Subtitle> > > read_subtitles (boost::filesystem::path file) const;
 
-	std::list<boost::shared_ptr<dcp::Subtitle> > _subtitles;
-	std::list<boost::shared_ptr<dcp::Subtitle> >::const_iterator _next;
+	/** our subtitles, sorted by start time; these may be shared with other DCPSubtitleDecoders
+	 *  for the same file, so neither the vector nor the subtitles may be modified.
+	 */
+	boost::shared_ptr<const std::vector<boost::shared_ptr<dcp::Subtitle> > > _subtitles;
+	std::vector<boost::shared_ptr<dcp::Subtitle> >::const_iterator _next;
 };
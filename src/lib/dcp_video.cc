@@ -38,7 +38,9 @@
 #include "dcpomatic_log.h"
 #include "cross.h"
 #include "player_video.h"
+#include "digester.h"
 #include "compose.hpp"
+#include "trace.h"
 #include <libcxml/cxml.h>
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
@@ -56,6 +58,7 @@
 using std::string;
 using std::cout;
 using boost::shared_ptr;
+using boost::optional;
 using dcp::Size;
 using dcp::Data;
 using dcp::raw_convert;
@@ -174,17 +177,25 @@ DCPVideo::encode_remotely (EncodeServerDescription serv, int timeout)
 	socket->write ((uint8_t *) xml.c_str(), xml.length() + 1);
 
 	/* Send binary data */
-	LOG_TIMING("start-remote-send thread=%1", thread_id ());
-	_frame->send_binary (socket);
+	{
+		TRACE_SCOPE (TRACE_ENCODER, "remote-send", _index);
+		_frame->send_binary (socket);
+	}
 
 	/* Read the response (JPEG2000-encoded data); this blocks until the data
 	   is ready and sent back.
 	*/
-	LOG_TIMING("start-remote-encode thread=%1", thread_id ());
-	Data e (socket->read_uint32 ());
-	LOG_TIMING("start-remote-receive thread=%1", thread_id ());
-	socket->read (e.data().get(), e.size());
-	LOG_TIMING("finish-remote-receive thread=%1", thread_id ());
+	uint32_t size;
+	{
+		TRACE_SCOPE (TRACE_ENCODER, "remote-wait", _index);
+		size = socket->read_uint32 ();
+	}
+
+	Data e (size);
+	{
+		TRACE_SCOPE (TRACE_ENCODER, "remote-receive", _index);
+		socket->read (e.data().get(), e.size());
+	}
 
 	LOG_DEBUG_ENCODE (N_("Finished remotely-encoded frame %1"), _index);
 
@@ -221,3 +232,25 @@ DCPVideo::same (shared_ptr<const DCPVideo> other) const
 
 	return _frame->same (other->_frame);
 }
+
+/** @return A digest of everything that determines the J2K data that encoding this frame
+ *  will give, or none if we don't know enough to make one.
+ */
+optional<string>
+DCPVideo::digest () const
+{
+	/* The pixel format that convert_to_xyz() uses depends only on the content, which is
+	   already accounted for by PlayerVideo::digest, so we can pass any one here.
+	*/
+	optional<string> image = _frame->digest (AV_PIX_FMT_RGB48LE, true, false);
+	if (!image) {
+		return optional<string>();
+	}
+
+	Digester digester;
+	digester.add (image.get());
+	digester.add (_frames_per_second);
+	digester.add (_j2k_bandwidth);
+	digester.add (static_cast<int>(_resolution));
+	return digester.get ();
+}
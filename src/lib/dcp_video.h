@@ -22,6 +22,7 @@
 #include "encode_server_description.h"
 #include <libcxml/cxml.h>
 #include <dcp/data.h>
+#include <boost/optional.hpp>
 
 /** @file  src/dcp_video_frame.h
  *  @brief A single frame of video destined for a DCP.
@@ -55,6 +56,7 @@ public:
 	Eyes eyes () const;
 
 	bool same (boost::shared_ptr<const DCPVideo> other) const;
+	boost::optional<std::string> digest () const;
 
 	static boost::shared_ptr<dcp::OpenJPEGImage> convert_to_xyz (boost::shared_ptr<const PlayerVideo> frame, dcp::NoteHandler note);
 
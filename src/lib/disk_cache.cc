@@ -0,0 +1,233 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "disk_cache.h"
+#include "cross.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include "compose.hpp"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <vector>
+#include <ctime>
+
+using std::string;
+using std::pair;
+using std::make_pair;
+using std::vector;
+using std::sort;
+
+/** @param directory Directory to keep files in.
+ *  @param limit Maximum total size of files to keep, in bytes.
+ *  @param spread true to spread files over sub-directories so that no one directory gets too big.
+ */
+DiskCache::DiskCache (boost::filesystem::path directory, size_t limit, bool spread)
+	: _directory (directory)
+	, _spread (spread)
+	, _used (0)
+	, _limit (limit)
+	, _writes (0)
+{
+	boost::system::error_code ec;
+	boost::filesystem::create_directories (_directory, ec);
+
+	/* Find out what is already there, so that we can carry on using (and evicting)
+	   files that were written by earlier instances.
+	*/
+	vector<pair<std::time_t, boost::filesystem::path> > existing;
+	for (boost::filesystem::recursive_directory_iterator i = boost::filesystem::recursive_directory_iterator(_directory, ec); i != boost::filesystem::recursive_directory_iterator(); ++i) {
+		if (boost::filesystem::is_directory(i->path(), ec)) {
+			continue;
+		}
+		if (i->path().extension() == ".tmp") {
+			/* Left over from an interrupted write */
+			boost::filesystem::remove (i->path(), ec);
+			continue;
+		}
+		existing.push_back (make_pair(boost::filesystem::last_write_time(i->path(), ec), i->path()));
+	}
+
+	/* Most recent first */
+	sort (existing.begin(), existing.end());
+	std::reverse (existing.begin(), existing.end());
+
+	for (vector<pair<std::time_t, boost::filesystem::path> >::const_iterator i = existing.begin(); i != existing.end(); ++i) {
+		size_t const size = boost::filesystem::file_size (i->second, ec);
+		if (ec) {
+			continue;
+		}
+		string const key = i->second.filename().string();
+		if (_index.find(key) != _index.end()) {
+			continue;
+		}
+		_files.push_back (make_pair(key, size));
+		_index[key] = --_files.end();
+		_used += size;
+	}
+
+	evict ();
+}
+
+/** @return true if we have a file for the given key.  The file may still be evicted
+ *  before the caller gets to read it, so reads must cope with it having gone.
+ */
+bool
+DiskCache::has (string key) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _index.find(key) != _index.end();
+}
+
+/** @return File to use for a key */
+boost::filesystem::path
+DiskCache::file (string key) const
+{
+	if (!_spread) {
+		return _directory / key;
+	}
+
+	DCPOMATIC_ASSERT (key.length() > 2);
+	return _directory / key.substr(0, 2) / key;
+}
+
+/** Write a file for a key, if we don't already have one.  The file is written to a temporary
+ *  name and then renamed so that there is never a partially-written file with the proper name.
+ *  No lock is held during the write, so other threads can use the cache meanwhile.
+ *
+ *  @param key Key.
+ *  @param writer Function to write the file's contents; it is passed the open file and its name.
+ *  If it throws it must close the file first, as checked_fwrite() does.
+ */
+void
+DiskCache::write (string key, boost::function<void (FILE *, boost::filesystem::path)> writer)
+{
+	boost::filesystem::path const f = file (key);
+	boost::filesystem::path tmp = f;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		if (_index.find(key) != _index.end()) {
+			return;
+		}
+		/* Another thread may be writing the same key, so use a name that is only ours */
+		tmp += String::compose (".%1.tmp", _writes++);
+	}
+
+	size_t size = 0;
+	try {
+		boost::filesystem::create_directories (f.parent_path());
+		FILE* file = fopen_boost (tmp, "wb");
+		if (!file) {
+			throw OpenFileError (tmp, errno, OpenFileError::WRITE);
+		}
+		writer (file, tmp);
+		size = ftell (file);
+		if (fclose (file) != 0) {
+			throw WriteFileError (tmp, errno);
+		}
+		boost::filesystem::rename (tmp, f);
+	} catch (...) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (tmp, ec);
+		throw;
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (_index.find(key) != _index.end()) {
+		/* Someone else wrote the same file while we were unlocked */
+		return;
+	}
+
+	_files.push_front (make_pair(key, size));
+	_index[key] = _files.begin();
+	_used += size;
+	evict ();
+}
+
+/** Mark a key's file as having just been used, so that it will be the last to be evicted */
+void
+DiskCache::touch (string key)
+{
+	boost::system::error_code ec;
+	boost::filesystem::last_write_time (file(key), time(0), ec);
+
+	boost::mutex::scoped_lock lm (_mutex);
+	std::map<string, List::iterator>::iterator i = _index.find (key);
+	if (i != _index.end()) {
+		_files.splice (_files.begin(), _files, i->second);
+	}
+}
+
+/** Forget about a key and remove its file, if we have one; this is for files that turn
+ *  out to be unreadable.
+ */
+void
+DiskCache::forget (string key)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	std::map<string, List::iterator>::iterator i = _index.find (key);
+	if (i == _index.end()) {
+		return;
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::remove (file(key), ec);
+	_used -= i->second->second;
+	_files.erase (i->second);
+	_index.erase (i);
+}
+
+/** Remove all our files */
+void
+DiskCache::clear ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	BOOST_FOREACH (List::value_type const& i, _files) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (file(i.first), ec);
+	}
+
+	_files.clear ();
+	_index.clear ();
+	_used = 0;
+}
+
+/** Caller must hold a lock on _mutex */
+void
+DiskCache::evict ()
+{
+	while (_used > _limit && !_files.empty()) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (file(_files.back().first), ec);
+		_used -= _files.back().second;
+		_index.erase (_files.back().first);
+		_files.pop_back ();
+	}
+}
+
+/** @return Total size of our files, in bytes */
+size_t
+DiskCache::used () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _used;
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_DISK_CACHE_H
+#define DCPOMATIC_DISK_CACHE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+
+/** @class DiskCache
+ *  @brief A directory of files named after keys, from which the least-recently used
+ *  files are removed when their total size goes over a limit.
+ *
+ *  This does the book-keeping for the disk parts of FrameCache and J2KFrameCache; they
+ *  decide what goes in the files.  Files left by earlier instances using the same
+ *  directory are picked up, oldest-modified being evicted first.
+ */
+class DiskCache : public boost::noncopyable
+{
+public:
+	DiskCache (boost::filesystem::path directory, size_t limit, bool spread);
+
+	bool has (std::string key) const;
+	boost::filesystem::path file (std::string key) const;
+
+	void write (std::string key, boost::function<void (FILE *, boost::filesystem::path)> writer);
+	void touch (std::string key);
+	void forget (std::string key);
+	void clear ();
+
+	size_t used () const;
+
+private:
+	void evict ();
+
+	boost::filesystem::path _directory;
+	/** true to spread files over sub-directories named after the first two characters of their keys */
+	bool _spread;
+
+	/** Mutex to protect everything below */
+	mutable boost::mutex _mutex;
+
+	typedef std::list<std::pair<std::string, size_t> > List;
+	/** Keys and sizes of files, most recently used first */
+	List _files;
+	std::map<std::string, List::iterator> _index;
+	size_t _used;
+	size_t _limit;
+	/** Number of writes that have been started, used to give each its own temporary file */
+	int _writes;
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "dkdm_database.h"
+#include "dkdm_wrapper.h"
+#include "util.h"
+#include <libcxml/cxml.h>
+#include <libxml++/libxml++.h>
+#include <boost/foreach.hpp>
+
+using std::string;
+using std::set;
+using boost::shared_ptr;
+using boost::dynamic_pointer_cast;
+
+/** @param directory Directory to keep the DKDMs in; it will be created if it does not exist */
+DKDMDatabase::DKDMDatabase (boost::filesystem::path directory)
+	: _directory (directory)
+{
+	boost::filesystem::create_directories (_directory);
+}
+
+static shared_ptr<DKDMGroup>
+read_group (cxml::ConstNodePtr node, boost::filesystem::path directory, set<string>& ids)
+{
+	shared_ptr<DKDMGroup> group (new DKDMGroup (node->string_attribute ("Name")));
+	BOOST_FOREACH (cxml::ConstNodePtr i, node->node_children()) {
+		if (i->name() == "DKDMGroup") {
+			group->add (read_group (i, directory, ids));
+		} else if (i->name() == "DKDM") {
+			string const id = i->string_child ("Id");
+			group->add (
+				shared_ptr<DKDM> (
+					new DKDM (id, i->string_child("CPLId"), i->string_child("ContentTitleText"), directory / (id + ".xml"))
+					)
+				);
+			ids.insert (id);
+		}
+	}
+	return group;
+}
+
+/** @return The tree of DKDMs in the database; the DKDMs themselves will not be read
+ *  from disk until they are needed.
+ */
+shared_ptr<DKDMGroup>
+DKDMDatabase::read ()
+{
+	_on_disk.clear ();
+	_index = "";
+
+	if (!boost::filesystem::exists (index_file ())) {
+		return shared_ptr<DKDMGroup> (new DKDMGroup ("root"));
+	}
+
+	cxml::Document f ("DKDMs");
+	f.read_file (index_file ());
+	return read_group (f.node_child ("DKDMGroup"), _directory, _on_disk);
+}
+
+void
+DKDMDatabase::write_group (shared_ptr<const DKDMGroup> group, xmlpp::Element* node, set<string>& ids)
+{
+	xmlpp::Element* g = node->add_child ("DKDMGroup");
+	g->set_attribute ("Name", group->name ());
+	BOOST_FOREACH (shared_ptr<DKDMBase> i, group->children ()) {
+		shared_ptr<DKDMGroup> sub = dynamic_pointer_cast<DKDMGroup> (i);
+		if (sub) {
+			write_group (sub, g, ids);
+			continue;
+		}
+
+		shared_ptr<DKDM> dkdm = dynamic_pointer_cast<DKDM> (i);
+		if (!dkdm) {
+			continue;
+		}
+
+		if (_on_disk.find (dkdm->id()) == _on_disk.end()) {
+			/* This DKDM is new to us */
+			write_file_atomically (dkdm->dkdm().as_xml(), file (dkdm->id()));
+			_on_disk.insert (dkdm->id ());
+		}
+
+		ids.insert (dkdm->id ());
+		xmlpp::Element* d = g->add_child ("DKDM");
+		d->add_child("Id")->add_child_text (dkdm->id ());
+		d->add_child("CPLId")->add_child_text (dkdm->cpl_id ());
+		d->add_child("ContentTitleText")->add_child_text (dkdm->content_title_text ());
+	}
+}
+
+/** Write a tree of DKDMs to the database, touching only the files that need it */
+void
+DKDMDatabase::write (shared_ptr<const DKDMGroup> root)
+{
+	xmlpp::Document doc;
+	xmlpp::Element* node = doc.create_root_node ("DKDMs");
+	node->add_child("Version")->add_child_text ("1");
+
+	set<string> ids;
+	write_group (root, node, ids);
+
+	string const index = doc.write_to_string_formatted ();
+	if (index != _index) {
+		write_file_atomically (index, index_file ());
+		_index = index;
+	}
+
+	/* Remove the files of any DKDMs that are no longer in the tree; we do this
+	   after writing the index so that the index never refers to a missing file.
+	*/
+	set<string>::iterator i = _on_disk.begin ();
+	while (i != _on_disk.end()) {
+		set<string>::iterator tmp = i;
+		++tmp;
+		if (ids.find (*i) == ids.end()) {
+			boost::system::error_code ec;
+			boost::filesystem::remove (file (*i), ec);
+			_on_disk.erase (i);
+		}
+		i = tmp;
+	}
+}
+
+boost::filesystem::path
+DKDMDatabase::file (string id) const
+{
+	return _directory / (id + ".xml");
+}
+
+boost::filesystem::path
+DKDMDatabase::index_file () const
+{
+	return _directory / "index.xml";
+}
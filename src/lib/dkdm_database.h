@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_DKDM_DATABASE_H
+#define DCPOMATIC_DKDM_DATABASE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <set>
+#include <string>
+
+namespace xmlpp {
+	class Element;
+}
+
+class DKDMGroup;
+
+/** @class DKDMDatabase
+ *  @brief A store for a tree of DKDMs on disk.
+ *
+ *  Each DKDM is kept in its own file, named after its ID, and never changes once it has been
+ *  written.  A small index file holds the tree of groups along with the ID, CPL ID and title
+ *  of each DKDM, so that the tree can be read (and shown) without reading or parsing any of
+ *  the DKDMs themselves; they are read when something needs them.
+ *
+ *  Writing the tree only writes files for DKDMs that are new, removes the files of those that
+ *  have gone, and re-writes the index if it has changed.
+ */
+class DKDMDatabase : public boost::noncopyable
+{
+public:
+	explicit DKDMDatabase (boost::filesystem::path directory);
+
+	boost::shared_ptr<DKDMGroup> read ();
+	void write (boost::shared_ptr<const DKDMGroup> root);
+
+	boost::filesystem::path directory () const {
+		return _directory;
+	}
+
+private:
+	boost::filesystem::path file (std::string id) const;
+	boost::filesystem::path index_file () const;
+	void write_group (boost::shared_ptr<const DKDMGroup> group, xmlpp::Element* node, std::set<std::string>& ids);
+
+	boost::filesystem::path _directory;
+	/** IDs of the DKDMs that we know to be on disk */
+	std::set<std::string> _on_disk;
+	/** Index as we last wrote it */
+	std::string _index;
+};
+
+#endif
@@ -21,6 +21,8 @@
 #include "compose.hpp"
 #include "dkdm_wrapper.h"
 #include "dcpomatic_assert.h"
+#include "util.h"
+#include <dcp/util.h>
 #include <libxml++/libxml++.h>
 #include <boost/foreach.hpp>
 
@@ -48,16 +50,51 @@ DKDMBase::read (cxml::ConstNodePtr node)
 	return shared_ptr<DKDMBase> ();
 }
 
+DKDM::DKDM (dcp::EncryptedKDM k)
+	: _id (k.id ())
+	, _cpl_id (k.cpl_id ())
+	, _content_title_text (k.content_title_text ())
+	, _dkdm (k)
+{
+
+}
+
+/** Make a DKDM which will be read from a file when it is first needed.
+ *  @param id The DKDM's ID.
+ *  @param cpl_id ID of the CPL that the DKDM is for.
+ *  @param content_title_text Content title text from the DKDM.
+ *  @param file File containing the DKDM's XML.
+ */
+DKDM::DKDM (string id, string cpl_id, string content_title_text, boost::filesystem::path file)
+	: _id (id)
+	, _cpl_id (cpl_id)
+	, _content_title_text (content_title_text)
+	, _file (file)
+{
+
+}
+
 string
 DKDM::name () const
 {
-	return String::compose ("%1 (%2)", _dkdm.content_title_text(), _dkdm.cpl_id());
+	return String::compose ("%1 (%2)", _content_title_text, _cpl_id);
+}
+
+dcp::EncryptedKDM
+DKDM::dkdm () const
+{
+	if (!_dkdm) {
+		DCPOMATIC_ASSERT (_file);
+		_dkdm = dcp::EncryptedKDM (dcp::file_to_string (*_file, MAX_KDM_SIZE));
+	}
+
+	return *_dkdm;
 }
 
 void
 DKDM::as_xml (xmlpp::Element* node) const
 {
-	node->add_child("DKDM")->add_child_text (_dkdm.as_xml ());
+	node->add_child("DKDM")->add_child_text (dkdm().as_xml ());
 }
 
 void
@@ -21,6 +21,8 @@
 #include <dcp/encrypted_kdm.h>
 #include <libcxml/cxml.h>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
 
 namespace xmlpp {
 	class Element;
@@ -52,19 +54,39 @@ private:
 class DKDM : public DKDMBase
 {
 public:
-	explicit DKDM (dcp::EncryptedKDM k)
-		: _dkdm (k)
-	{}
+	explicit DKDM (dcp::EncryptedKDM k);
+	DKDM (std::string id, std::string cpl_id, std::string content_title_text, boost::filesystem::path file);
 
 	std::string name () const;
 	void as_xml (xmlpp::Element *) const;
 
-	dcp::EncryptedKDM dkdm () const {
-		return _dkdm;
+	dcp::EncryptedKDM dkdm () const;
+
+	/** @return the DKDM's own ID */
+	std::string id () const {
+		return _id;
+	}
+
+	std::string cpl_id () const {
+		return _cpl_id;
+	}
+
+	std::string content_title_text () const {
+		return _content_title_text;
+	}
+
+	/** @return file that this DKDM can be read from, if it was not given to us already parsed */
+	boost::optional<boost::filesystem::path> file () const {
+		return _file;
 	}
 
 private:
-	dcp::EncryptedKDM _dkdm;
+	std::string _id;
+	std::string _cpl_id;
+	std::string _content_title_text;
+	boost::optional<boost::filesystem::path> _file;
+	/** The DKDM, parsed from _file when it is first needed if we were not given it */
+	mutable boost::optional<dcp::EncryptedKDM> _dkdm;
 };
 
 class DKDMGroup : public DKDMBase
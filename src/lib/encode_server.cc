@@ -36,6 +36,7 @@
 #include "dcpomatic_log.h"
 #include "encoded_log_entry.h"
 #include "version.h"
+#include "trace.h"
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <libxml++/libxml++.h>
@@ -124,32 +125,44 @@ EncodeServer::~EncodeServer ()
 int
 EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, struct timeval& after_encode)
 {
-	uint32_t length = socket->read_uint32 ();
-	scoped_array<char> buffer (new char[length]);
-	socket->read (reinterpret_cast<uint8_t*> (buffer.get()), length);
-
-	string s (buffer.get());
 	shared_ptr<cxml::Document> xml (new cxml::Document ("EncodingRequest"));
-	xml->read_string (s);
-	/* This is a double-check; the server shouldn't even be on the candidate list
-	   if it is the wrong version, but it doesn't hurt to make sure here.
-	*/
-	if (xml->number_child<int> ("Version") != SERVER_LINK_VERSION) {
-		cerr << "Mismatched server/client versions\n";
-		LOG_ERROR_NC ("Mismatched server/client versions");
-		return -1;
-	}
+	shared_ptr<PlayerVideo> pvf;
+
+	{
+		TRACE_SCOPE (TRACE_SERVER, "read");
+
+		uint32_t length = socket->read_uint32 ();
+		scoped_array<char> buffer (new char[length]);
+		socket->read (reinterpret_cast<uint8_t*> (buffer.get()), length);
+
+		string s (buffer.get());
+		xml->read_string (s);
+		/* This is a double-check; the server shouldn't even be on the candidate list
+		   if it is the wrong version, but it doesn't hurt to make sure here.
+		*/
+		if (xml->number_child<int> ("Version") != SERVER_LINK_VERSION) {
+			cerr << "Mismatched server/client versions\n";
+			LOG_ERROR_NC ("Mismatched server/client versions");
+			return -1;
+		}
 
-	shared_ptr<PlayerVideo> pvf (new PlayerVideo (xml, socket));
+		pvf.reset (new PlayerVideo (xml, socket));
+	}
 
 	DCPVideo dcp_video_frame (pvf, xml);
 
 	gettimeofday (&after_read, 0);
 
-	Data encoded = dcp_video_frame.encode_locally ();
+	Data encoded;
+	{
+		TRACE_SCOPE (TRACE_SERVER, "encode", dcp_video_frame.index());
+		encoded = dcp_video_frame.encode_locally ();
+	}
 
 	gettimeofday (&after_encode, 0);
 
+	TRACE_SCOPE (TRACE_SERVER, "send", dcp_video_frame.index());
+
 	try {
 		socket->write (encoded.size());
 		socket->write (encoded.data().get(), encoded.size());
@@ -28,6 +28,7 @@
 
 #include "encoder.h"
 #include "player.h"
+#include "metrics.h"
 
 #include "i18n.h"
 
@@ -45,3 +46,14 @@ Encoder::Encoder (shared_ptr<const Film> film, weak_ptr<Job> job)
 {
 
 }
+
+/** Add the current state of the encode to a Metrics snapshot.  This may be
+ *  called from any thread while the encode is running.
+ */
+void
+Encoder::metrics (Metrics& metrics) const
+{
+	metrics.add ("dcpomatic_encode_frames_done", Metrics::GAUGE, "Video frames done in the current encode", frames_done());
+	metrics.add ("dcpomatic_encode_frames_per_second", Metrics::GAUGE, "Recent rate of the current encode", current_rate());
+	_player->metrics (metrics);
+}
@@ -32,6 +32,7 @@ class Player;
 class Job;
 class PlayerVideo;
 class AudioBuffers;
+class Metrics;
 
 /** @class Encoder */
 class Encoder : public boost::noncopyable
@@ -48,6 +49,8 @@ public:
 	virtual Frame frames_done () const = 0;
 	virtual bool finishing () const = 0;
 
+	virtual void metrics (Metrics& metrics) const;
+
 protected:
 	boost::shared_ptr<const Film> _film;
 	boost::weak_ptr<Job> _job;
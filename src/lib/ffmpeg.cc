@@ -29,6 +29,7 @@
 #include "ffmpeg_audio_stream.h"
 #include "digester.h"
 #include "compose.hpp"
+#include "dcpomatic_assert.h"
 #include <dcp/raw_convert.h>
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -187,6 +188,30 @@ FFmpeg::setup_general ()
 	}
 }
 
+/** Open a decoder with the options that we always use.  Caller must hold a lock on FFmpeg::_mutex */
+static void
+open_decoder (AVCodecContext* context, AVCodec* codec)
+{
+	AVDictionary* options = 0;
+	/* This option disables decoding of DCA frame footers in our patched version
+	   of FFmpeg.  I believe these footers are of no use to us, and they can cause
+	   problems when FFmpeg fails to decode them (mantis #352).
+	*/
+	av_dict_set (&options, "disable_footer", "1", 0);
+	/* This allows decoding of some DNxHR 444 and HQX files; see
+	   https://trac.ffmpeg.org/ticket/5681
+	*/
+	av_dict_set_int (&options, "strict", FF_COMPLIANCE_EXPERIMENTAL, 0);
+	/* Enable following of links in files */
+	av_dict_set_int (&options, "enable_drefs", 1, 0);
+
+	int const r = avcodec_open2 (context, codec, &options);
+	av_dict_free (&options);
+	if (r < 0) {
+		throw DecodeError (N_("could not open decoder"));
+	}
+}
+
 void
 FFmpeg::setup_decoders ()
 {
@@ -197,29 +222,55 @@ FFmpeg::setup_decoders ()
 
 		AVCodec* codec = avcodec_find_decoder (context->codec_id);
 		if (codec) {
-
-			AVDictionary* options = 0;
-			/* This option disables decoding of DCA frame footers in our patched version
-			   of FFmpeg.  I believe these footers are of no use to us, and they can cause
-			   problems when FFmpeg fails to decode them (mantis #352).
-			*/
-			av_dict_set (&options, "disable_footer", "1", 0);
-			/* This allows decoding of some DNxHR 444 and HQX files; see
-			   https://trac.ffmpeg.org/ticket/5681
-			*/
-			av_dict_set_int (&options, "strict", FF_COMPLIANCE_EXPERIMENTAL, 0);
-			/* Enable following of links in files */
-			av_dict_set_int (&options, "enable_drefs", 1, 0);
-
-			if (avcodec_open2 (context, codec, &options) < 0) {
-				throw DecodeError (N_("could not open decoder"));
-			}
+			open_decoder (context, codec);
 		} else {
 			dcpomatic_log->log (String::compose ("No codec found for stream %1", i), LogEntry::TYPE_WARNING);
 		}
 	}
 }
 
+/** Close and re-open our video decoder, setting it up either for normal decoding or for
+ *  faster, lower-quality decoding for previews.  Any decoder state is lost, so the caller
+ *  must seek before decoding any more video.
+ *
+ *  @param reduction none for normal decoding, otherwise log2 of the factor by which the decoded
+ *  images may be smaller than full size.
+ *  @return log2 of the factor by which the decoder will actually reduce the size of its images;
+ *  this may be less than reduction, as not all codecs can decode at lower resolutions.
+ */
+int
+FFmpeg::reopen_video_decoder (optional<int> reduction)
+{
+	AVCodecContext* context = video_codec_context ();
+	DCPOMATIC_ASSERT (context);
+
+	AVCodec* codec = avcodec_find_decoder (context->codec_id);
+	if (!codec) {
+		return 0;
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	avcodec_close (context);
+
+	if (reduction) {
+		context->lowres = std::min (*reduction, static_cast<int> (codec->max_lowres));
+		/* These are all ignored by codecs that don't support them */
+		context->skip_loop_filter = AVDISCARD_ALL;
+		context->flags2 |= AV_CODEC_FLAG2_FAST;
+		/* Let FFmpeg choose how many threads to use */
+		context->thread_count = 0;
+	} else {
+		context->lowres = 0;
+		context->skip_loop_filter = AVDISCARD_DEFAULT;
+		context->flags2 &= ~AV_CODEC_FLAG2_FAST;
+		context->thread_count = 1;
+	}
+
+	open_decoder (context, codec);
+	return context->lowres;
+}
+
 AVCodecContext *
 FFmpeg::video_codec_context () const
 {
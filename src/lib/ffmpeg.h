@@ -28,6 +28,7 @@ extern "C" {
 }
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/optional.hpp>
 
 struct AVFormatContext;
 struct AVFrame;
@@ -53,6 +54,7 @@ public:
 protected:
 	AVCodecContext* video_codec_context () const;
 	AVCodecContext* subtitle_codec_context () const;
+	int reopen_video_decoder (boost::optional<int> reduction);
 	ContentTime pts_offset (
 		std::vector<boost::shared_ptr<FFmpegAudioStream> > audio_streams, boost::optional<ContentTime> first_video, double video_frame_rate
 		) const;
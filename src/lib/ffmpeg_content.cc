@@ -484,6 +484,20 @@ FFmpegContent::identifier () const
 	return s;
 }
 
+string
+FFmpegContent::image_identifier () const
+{
+	string s = Content::image_identifier ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	for (vector<Filter const *>::const_iterator i = _filters.begin(); i != _filters.end(); ++i) {
+		s += "_" + (*i)->id ();
+	}
+
+	return s;
+}
+
 void
 FFmpegContent::set_default_colour_conversion ()
 {
@@ -67,6 +67,7 @@ public:
 	DCPTime approximate_length () const;
 
 	std::string identifier () const;
+	std::string image_identifier () const;
 
 	void set_default_colour_conversion ();
 
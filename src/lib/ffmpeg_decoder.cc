@@ -80,6 +80,8 @@ FFmpegDecoder::FFmpegDecoder (shared_ptr<const Film> film, shared_ptr<const FFmp
 	: FFmpeg (c)
 	, Decoder (film)
 	, _have_current_subtitle (false)
+	, _lowres (0)
+	, _can_skip_video_packets (false)
 {
 	if (c->video) {
 		video.reset (new VideoDecoder (this, c));
@@ -87,6 +89,7 @@ FFmpegDecoder::FFmpegDecoder (shared_ptr<const Film> film, shared_ptr<const FFmp
 		/* It doesn't matter what size or pixel format this is, it just needs to be black */
 		_black_image.reset (new Image (AV_PIX_FMT_RGB24, dcp::Size (128, 128), true));
 		_black_image->make_black ();
+		_can_skip_video_packets = can_skip_video_packets ();
 	} else {
 		_pts_offset = ContentTime ();
 	}
@@ -103,6 +106,29 @@ FFmpegDecoder::FFmpegDecoder (shared_ptr<const Film> film, shared_ptr<const FFmp
 	_next_time.resize (_format_context->nb_streams);
 }
 
+/** Set up to decode video at a reduced resolution, for previews.  This uses whatever shortcuts
+ *  the codec offers, so the output will be of lower quality.  The caller must seek after
+ *  changing the reduction of a decoder which has already been used.
+ *
+ *  @param reduction log2 of the factor by which decoded images may be smaller than full size,
+ *  or none to decode normally.
+ */
+void
+FFmpegDecoder::set_decode_reduction (optional<int> reduction)
+{
+	if (!video || reduction == _decode_reduction) {
+		return;
+	}
+
+	_decode_reduction = reduction;
+	_lowres = reopen_video_decoder (reduction);
+	_can_skip_video_packets = can_skip_video_packets ();
+
+	/* Any existing filter graphs were set up for the old image size */
+	boost::mutex::scoped_lock lm (_filter_graphs_mutex);
+	_filter_graphs.clear ();
+}
+
 void
 FFmpegDecoder::flush ()
 {
@@ -494,16 +520,72 @@ FFmpegDecoder::decode_audio_packet ()
 	}
 }
 
+/** @return true if we can avoid decoding video packets for frames that will not be used, which is
+ *  only the case if each packet gives one frame, in order, straight away, and we don't need the
+ *  frames for any filters.
+ */
+bool
+FFmpegDecoder::can_skip_video_packets () const
+{
+	AVCodecContext* context = video_codec_context ();
+	AVCodecDescriptor const * descriptor = avcodec_descriptor_get (context->codec_id);
+	return descriptor && (descriptor->props & AV_CODEC_PROP_INTRA_ONLY) && !(context->active_thread_type & FF_THREAD_FRAME) && _ffmpeg_content->filters().empty();
+}
+
+/** @return Index of the video frame with a given PTS, as VideoDecoder::emit would want it */
+Frame
+FFmpegDecoder::video_frame_index (int64_t pts) const
+{
+	double const t = pts * av_q2d (_format_context->streams[_video_stream.get()]->time_base) + _pts_offset.seconds ();
+	return llrint (t * _ffmpeg_content->active_video_frame_rate(film()));
+}
+
+/** Skip the video packet in _packet without decoding it, if we can and our VideoDecoder will
+ *  not want its frame (because the content's frame rate is being halved).
+ *  @return true if the packet was skipped.
+ */
+bool
+FFmpegDecoder::skip_video_packet ()
+{
+	if (!_can_skip_video_packets || _packet.size == 0 || _packet.pts == AV_NOPTS_VALUE) {
+		return false;
+	}
+
+	Frame const frame = video_frame_index (_packet.pts);
+	if (!video->will_skip (film(), frame)) {
+		return false;
+	}
+
+	video->emit (film(), shared_ptr<const ImageProxy>(), frame);
+	return true;
+}
+
 bool
 FFmpegDecoder::decode_video_packet ()
 {
 	DCPOMATIC_ASSERT (_video_stream);
 
+	if (skip_video_packet ()) {
+		return true;
+	}
+
 	int frame_finished;
 	if (avcodec_decode_video2 (video_codec_context(), _frame, &frame_finished, &_packet) < 0 || !frame_finished) {
 		return false;
 	}
 
+	if (_ffmpeg_content->filters().empty()) {
+		/* We can throw the frame away before it is copied into an Image if it isn't wanted */
+		int64_t const pts = av_frame_get_best_effort_timestamp (_frame);
+		if (pts != AV_NOPTS_VALUE) {
+			Frame const frame = video_frame_index (pts);
+			if (video->will_skip (film(), frame)) {
+				video->emit (film(), shared_ptr<const ImageProxy>(), frame);
+				return true;
+			}
+		}
+	}
+
 	boost::mutex::scoped_lock lm (_filter_graphs_mutex);
 
 	shared_ptr<VideoFilterGraph> graph;
@@ -530,13 +612,13 @@ FFmpegDecoder::decode_video_packet ()
 		shared_ptr<Image> image = i->first;
 
 		if (i->second != AV_NOPTS_VALUE) {
-			double const pts = i->second * av_q2d (_format_context->streams[_video_stream.get()]->time_base) + _pts_offset.seconds ();
-
-			video->emit (
-				film(),
-				shared_ptr<ImageProxy> (new RawImageProxy (image)),
-				llrint(pts * _ffmpeg_content->active_video_frame_rate(film()))
-				);
+			Frame const frame = video_frame_index (i->second);
+			if (video->will_skip (film(), frame)) {
+				/* Don't bother making a proxy for a frame that will be thrown away */
+				video->emit (film(), shared_ptr<const ImageProxy>(), frame);
+			} else {
+				video->emit (film(), shared_ptr<ImageProxy> (new RawImageProxy (image, _lowres)), frame);
+			}
 		} else {
 			LOG_WARNING_NC ("Dropping frame without PTS");
 		}
@@ -671,16 +753,18 @@ FFmpegDecoder::decode_bitmap_subtitle (AVSubtitleRect const * rect, ContentTime
 		out_p += image->stride()[0];
 	}
 
+	/* subtitle_codec_context()->width == 0 has been seen in the wild but I don't
+	   know if it's supposed to mean something from FFmpeg's point of view.  In that
+	   case use the video size; not the video codec context's, as that will have been
+	   reduced if we are decoding at low resolution, but the content's full size.
+	*/
 	int target_width = subtitle_codec_context()->width;
 	if (target_width == 0 && video_codec_context()) {
-		/* subtitle_codec_context()->width == 0 has been seen in the wild but I don't
-		   know if it's supposed to mean something from FFmpeg's point of view.
-		*/
-		target_width = video_codec_context()->width;
+		target_width = _ffmpeg_content->video->size().width;
 	}
 	int target_height = subtitle_codec_context()->height;
 	if (target_height == 0 && video_codec_context()) {
-		target_height = video_codec_context()->height;
+		target_height = _ffmpeg_content->video->size().height;
 	}
 	DCPOMATIC_ASSERT (target_width);
 	DCPOMATIC_ASSERT (target_height);
@@ -50,6 +50,8 @@ public:
 	bool pass ();
 	void seek (ContentTime time, bool);
 
+	void set_decode_reduction (boost::optional<int> reduction);
+
 private:
 	friend struct ::ffmpeg_pts_offset_test;
 
@@ -59,6 +61,9 @@ private:
 	int bytes_per_audio_sample (boost::shared_ptr<FFmpegAudioStream> stream) const;
 
 	bool decode_video_packet ();
+	bool skip_video_packet ();
+	bool can_skip_video_packets () const;
+	Frame video_frame_index (int64_t pts) const;
 	void decode_audio_packet ();
 	void decode_subtitle_packet ();
 
@@ -79,4 +84,10 @@ private:
 	boost::shared_ptr<Image> _black_image;
 
 	std::vector<boost::optional<ContentTime> > _next_time;
+
+	boost::optional<int> _decode_reduction;
+	/** log2 of the factor by which our video decoder is actually reducing the size of its images */
+	int _lowres;
+	/** true if we can skip decoding of video packets that our VideoDecoder does not want */
+	bool _can_skip_video_packets;
 };
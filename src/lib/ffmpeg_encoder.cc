@@ -27,7 +27,14 @@
 #include "image.h"
 #include "cross.h"
 #include "butler.h"
+#include "config.h"
+#include "audio_buffers.h"
+#include "exceptions.h"
+#include "util.h"
 #include "compose.hpp"
+#include <boost/foreach.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 
 #include "i18n.h"
@@ -38,7 +45,11 @@ using std::cout;
 using std::pair;
 using std::list;
 using std::map;
+using std::vector;
+using std::min;
+using std::max;
 using boost::shared_ptr;
+using boost::scoped_array;
 using boost::bind;
 using boost::weak_ptr;
 #if BOOST_VERSION >= 106100
@@ -55,6 +66,11 @@ FFmpegEncoder::FFmpegEncoder (
 	int x264_crf
 	)
 	: Encoder (film, job)
+	, _output (output)
+	, _format (format)
+	, _x264_crf (x264_crf)
+	, _frames_done (0)
+	, _next_part (0)
 	, _history (1000)
 {
 	_player->set_always_burn_open_subtitles ();
@@ -93,7 +109,7 @@ FFmpegEncoder::FFmpegEncoder (
 		}
 	}
 
-	_butler.reset (new Butler(_player, map, _output_audio_channels, bind(&PlayerVideo::force, _1, FFmpegFileEncoder::pixel_format(format)), true, false));
+	_audio_mapping = map;
 
 	int const files = split_reels ? film->reels().size() : 1;
 	for (int i = 0; i < files; ++i) {
@@ -108,22 +124,27 @@ FFmpegEncoder::FFmpegEncoder (
 			filename = filename.string() + String::compose(_("_reel%1"), i + 1);
 		}
 
-		_file_encoders.push_back (
-			FileEncoderSet (
-				_film->frame_size(),
-				_film->video_frame_rate(),
-				_film->audio_frame_rate(),
-				_output_audio_channels,
-				format,
-				x264_crf,
-				_film->three_d(),
-				filename,
-				extension
-				)
-			);
+		_file_encoders.push_back (make_file_encoder_set (filename, extension, _output_audio_channels, false));
 	}
 }
 
+FFmpegEncoder::FileEncoderSet
+FFmpegEncoder::make_file_encoder_set (boost::filesystem::path filename, string extension, int channels, bool segment) const
+{
+	return FileEncoderSet (
+		_film->frame_size(),
+		_film->video_frame_rate(),
+		_film->audio_frame_rate(),
+		channels,
+		_format,
+		_x264_crf,
+		_film->three_d(),
+		filename,
+		extension,
+		segment
+		);
+}
+
 void
 FFmpegEncoder::go ()
 {
@@ -135,68 +156,368 @@ FFmpegEncoder::go ()
 
 	Waker waker;
 
-	list<DCPTimePeriod> reel_periods = _film->reels ();
-	list<DCPTimePeriod>::const_iterator reel = reel_periods.begin ();
-	list<FileEncoderSet>::iterator encoder = _file_encoders.begin ();
+	list<DCPTimePeriod> const reel_periods = _film->reels ();
+	vector<DCPTimePeriod> const reels (reel_periods.begin(), reel_periods.end());
+
+	int const reel_threads = min (Config::instance()->export_reel_threads(), int (_file_encoders.size()));
+	int const segment_threads = Config::instance()->export_segment_threads ();
+
+	if (reel_threads > 1) {
+		/* Encode each reel to its file with its own player and butler, a few at a time */
+		encode_parts (reels.size(), reel_threads, bind (&FFmpegEncoder::encode_reel, this, boost::cref(reels), _1, boost::ref(waker)));
+	} else if (_file_encoders.size() == 1 && segment_threads > 1) {
+		encode_segments (segment_threads, waker);
+	} else {
+		shared_ptr<Butler> butler = make_butler (_player);
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			_butlers[0] = butler;
+		}
+
+		encode (butler, DCPTimePeriod(DCPTime(), _film->length()), reels, 0, waker);
+
+		BOOST_FOREACH (FileEncoderSet& i, _file_encoders) {
+			i.flush ();
+		}
+
+		butler->rethrow ();
+	}
+}
+
+shared_ptr<Player>
+FFmpegEncoder::make_player () const
+{
+	shared_ptr<Player> player (new Player (_film, _film->playlist ()));
+	player->set_always_burn_open_subtitles ();
+	player->set_play_referenced ();
+	return player;
+}
+
+shared_ptr<Butler>
+FFmpegEncoder::make_butler (shared_ptr<Player> player) const
+{
+	return shared_ptr<Butler> (
+		new Butler(player, _audio_mapping, _output_audio_channels, bind(&PlayerVideo::force, _1, FFmpegFileEncoder::pixel_format(_format)), true, false)
+		);
+}
+
+/** Encode some parts (reels or segments) of the film using a number of threads, and wait for them to finish.
+ *  @param parts Number of parts.
+ *  @param threads Number of threads to use.
+ *  @param encode_part Function to encode a part, given its index; this will be called from the threads.
+ */
+void
+FFmpegEncoder::encode_parts (size_t parts, int threads, boost::function<void (size_t)> encode_part)
+{
+	_next_part = 0;
+
+	boost::thread_group pool;
+	for (int i = 0; i < threads; ++i) {
+		pool.create_thread (bind (&FFmpegEncoder::part_thread, this, parts, encode_part));
+	}
+
+	try {
+		pool.join_all ();
+	} catch (boost::thread_interrupted &) {
+		/* Our job has been cancelled so stop the pool too */
+		pool.interrupt_all ();
+		pool.join_all ();
+		throw;
+	}
+
+	rethrow ();
+}
+
+/** Encode parts, one at a time, until there are none left; several of these run at once */
+void
+FFmpegEncoder::part_thread (size_t parts, boost::function<void (size_t)> encode_part)
+try
+{
+	while (true) {
+		size_t part;
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_next_part >= parts) {
+				return;
+			}
+			part = _next_part++;
+		}
+
+		encode_part (part);
+	}
+}
+catch (boost::thread_interrupted &)
+{
+	/* encode_parts() has been interrupted and is stopping us */
+}
+catch (...)
+{
+	store_current ();
+	/* Make the other threads stop once they have finished their current parts */
+	boost::mutex::scoped_lock lm (_mutex);
+	_next_part = parts;
+}
+
+/** Encode one reel to its file with its own player and butler */
+void
+FFmpegEncoder::encode_reel (vector<DCPTimePeriod> const & reels, size_t reel, Waker& waker)
+{
+	shared_ptr<Butler> butler = make_butler (make_player ());
+	butler->seek (reels[reel].from, true);
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_butlers[reel] = butler;
+	}
+
+	encode (butler, reels[reel], reels, reel, waker);
+	_file_encoders[reel].flush ();
+	butler->rethrow ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_butlers.erase (reel);
+}
+
+/** @return Periods to split the film into for encode_segments().  Each segment is written by a new
+ *  encoder, so its first frame can always be decoded on its own wherever it starts.
+ */
+vector<DCPTimePeriod>
+FFmpegEncoder::segment_periods (int threads) const
+{
+	int const vfr = _film->video_frame_rate ();
+	Frame const length = _film->length().frames_ceil (vfr);
+
+	/* Make a few segments for each thread so that the threads finish at about the same time,
+	   but don't make them so short that most of the time goes on setting up players.
+	*/
+	Frame const segment = max (Frame (vfr) * 10, length / (threads * 4));
+
+	vector<DCPTimePeriod> periods;
+	for (Frame i = 0; i < length; i += segment) {
+		periods.push_back (DCPTimePeriod (DCPTime::from_frames (i, vfr), DCPTime::from_frames (min (i + segment, length), vfr)));
+	}
+
+	return periods;
+}
+
+/** Encode the video of the film as a number of segments, several at once, each with its own player and butler.
+ *  Then write our output file with the video copied from the segments and the audio from a single pass
+ *  through the film, so that it is continuous.
+ */
+void
+FFmpegEncoder::encode_segments (int threads, Waker& waker)
+{
+	vector<DCPTimePeriod> const segments = segment_periods (threads);
+
+	boost::filesystem::path filename = boost::filesystem::change_extension (_output, "");
+	string const extension = boost::filesystem::extension (_output);
+
+	vector<FileEncoderSet> encoders;
+	for (size_t i = 0; i < segments.size(); ++i) {
+		encoders.push_back (make_file_encoder_set (String::compose("%1.segment%2", filename.string(), i + 1), extension, 0, true));
+	}
+
+	encode_parts (segments.size(), min (threads, int (segments.size())), bind (&FFmpegEncoder::encode_segment, this, boost::cref(segments), boost::ref(encoders), _1, boost::ref(waker)));
+
+	{
+		shared_ptr<Job> job = _job.lock ();
+		if (job) {
+			job->sub (_("Joining segments"));
+		}
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_frames_done = 0;
+	}
+
+	join_segments (segments, encoders, waker);
+
+	BOOST_FOREACH (FileEncoderSet const & i, encoders) {
+		map<Eyes, shared_ptr<FFmpegFileEncoder> > e = i.encoders ();
+		for (map<Eyes, shared_ptr<FFmpegFileEncoder> >::const_iterator j = e.begin(); j != e.end(); ++j) {
+			boost::system::error_code ec;
+			boost::filesystem::remove (j->second->output(), ec);
+		}
+	}
+}
+
+/** Encode the video of one segment of the film to its own file(s), with its own player and butler */
+void
+FFmpegEncoder::encode_segment (vector<DCPTimePeriod> const & segments, vector<FileEncoderSet>& encoders, size_t segment, Waker& waker)
+{
+	shared_ptr<Butler> butler = make_butler (make_player ());
+	butler->disable_audio ();
+	butler->seek (segments[segment].from, true);
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_butlers[segment] = butler;
+	}
+
+	DCPTime const video_frame = DCPTime::from_frames (1, _film->video_frame_rate ());
+	int const gets_per_frame = _film->three_d() ? 2 : 1;
+	for (DCPTime i = segments[segment].from; i < segments[segment].to; i += video_frame) {
+		for (int j = 0; j < gets_per_frame; ++j) {
+			Butler::Error e;
+			pair<shared_ptr<PlayerVideo>, DCPTime> v = butler->get_video (&e);
+			if (!v.first) {
+				throw ProgrammingError(__FILE__, __LINE__, String::compose("butler returned no video; error was %1", static_cast<int>(e)));
+			}
+			shared_ptr<FFmpegFileEncoder> fe = encoders[segment].get (v.first->eyes());
+			if (fe) {
+				/* Segments start at time 0; join_segments() puts them back in the right place */
+				fe->video(v.first, v.second - segments[segment].from);
+			}
+		}
+
+		frame_done (waker);
+	}
+
+	encoders[segment].flush ();
+	butler->rethrow ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_butlers.erase (segment);
+}
+
+/** Write our output file(s) using the encoded video from some segments and audio from the film */
+void
+FFmpegEncoder::join_segments (vector<DCPTimePeriod> const & segments, vector<FileEncoderSet> const & encoders, Waker& waker)
+{
+	FileEncoderSet& output = _file_encoders.front ();
+
+	shared_ptr<Player> player = make_player ();
+	player->set_ignore_video ();
+	player->set_ignore_text ();
+	shared_ptr<AudioBuffers> pending (new AudioBuffers (_output_audio_channels, 0));
+	boost::signals2::scoped_connection connection = player->Audio.connect (bind (&FFmpegEncoder::join_audio, this, pending, _1));
+	bool player_done = false;
 
 	DCPTime const video_frame = DCPTime::from_frames (1, _film->video_frame_rate ());
 	int const audio_frames = video_frame.frames_round(_film->audio_frame_rate());
-	float* interleaved = new float[_output_audio_channels * audio_frames];
+	shared_ptr<AudioBuffers> audio (new AudioBuffers (_output_audio_channels, audio_frames));
+	AVPacket packet;
+
+	for (size_t i = 0; i < segments.size(); ++i) {
+		map<Eyes, shared_ptr<FFmpegFileEncoder> > const inputs = encoders[i].encoders ();
+
+		map<Eyes, shared_ptr<SegmentReader> > readers;
+		for (map<Eyes, shared_ptr<FFmpegFileEncoder> >::const_iterator j = inputs.begin(); j != inputs.end(); ++j) {
+			readers[j->first].reset (new SegmentReader (j->second->output ()));
+		}
+
+		for (DCPTime j = segments[i].from; j < segments[i].to; j += video_frame) {
+			/* Copy the next packet from each segment file; they are written one per frame, so this
+			   keeps the video and audio in our output roughly interleaved.
+			*/
+			for (map<Eyes, shared_ptr<SegmentReader> >::const_iterator k = readers.begin(); k != readers.end(); ++k) {
+				if (k->second->read (&packet)) {
+					output.get(k->first)->video_packet (&packet, k->second->time_base(), segments[i].from);
+					av_packet_unref (&packet);
+				}
+			}
+
+			while (pending->frames() < audio_frames && !player_done) {
+				player_done = player->pass ();
+			}
+
+			int const this_time = min (audio_frames, pending->frames ());
+			audio->make_silent ();
+			audio->copy_from (pending.get(), this_time, 0, 0);
+			pending->trim_start (this_time);
+			output.audio (audio);
+
+			frame_done (waker);
+		}
+
+		/* Copy anything that the encoders left until the end of the segment */
+		for (map<Eyes, shared_ptr<SegmentReader> >::const_iterator k = readers.begin(); k != readers.end(); ++k) {
+			while (k->second->read (&packet)) {
+				output.get(k->first)->video_packet (&packet, k->second->time_base(), segments[i].from);
+				av_packet_unref (&packet);
+			}
+		}
+	}
+
+	output.flush ();
+}
+
+/** Handler for audio from the player in join_segments() */
+void
+FFmpegEncoder::join_audio (shared_ptr<AudioBuffers> pending, shared_ptr<AudioBuffers> audio)
+{
+	pending->append (remap (audio, _output_audio_channels, _audio_mapping));
+}
+
+/** Note that a video frame has been encoded */
+void
+FFmpegEncoder::frame_done (Waker& waker)
+{
+	_history.event ();
+
+	Frame done;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		done = ++_frames_done;
+	}
+
+	shared_ptr<Job> job = _job.lock ();
+	if (job) {
+		job->set_progress (float(done) / _film->length().frames_ceil(_film->video_frame_rate()));
+	}
+
+	waker.nudge ();
+}
+
+/** Encode part of the film.
+ *  @param butler Butler to get video and audio from; it must be (or be seeking to) the start of period.
+ *  @param period Part of the film to encode.
+ *  @param reels The film's reels.
+ *  @param reel Index of the reel which period starts in.  If each reel goes to its own file we write
+ *  to that reel's file, and move on to the next file whenever period goes into the next reel.
+ *  @param waker Waker to nudge as we go.
+ */
+void
+FFmpegEncoder::encode (shared_ptr<Butler> butler, DCPTimePeriod period, vector<DCPTimePeriod> const & reels, size_t reel, Waker& waker)
+{
+	DCPTime const video_frame = DCPTime::from_frames (1, _film->video_frame_rate ());
+	int const audio_frames = video_frame.frames_round(_film->audio_frame_rate());
+	scoped_array<float> interleaved (new float[_output_audio_channels * audio_frames]);
 	shared_ptr<AudioBuffers> deinterleaved (new AudioBuffers (_output_audio_channels, audio_frames));
 	int const gets_per_frame = _film->three_d() ? 2 : 1;
-	for (DCPTime i; i < _film->length(); i += video_frame) {
+	for (DCPTime i = period.from; i < period.to; i += video_frame) {
 
-		if (_file_encoders.size() > 1 && !reel->contains(i)) {
+		if (_file_encoders.size() > 1 && !reels[reel].contains(i)) {
 			/* Next reel and file */
 			++reel;
-			++encoder;
-			DCPOMATIC_ASSERT (reel != reel_periods.end());
-			DCPOMATIC_ASSERT (encoder != _file_encoders.end());
+			DCPOMATIC_ASSERT (reel < reels.size());
 		}
 
+		FileEncoderSet& encoder = _file_encoders[_file_encoders.size() > 1 ? reel : 0];
+
 		for (int j = 0; j < gets_per_frame; ++j) {
 			Butler::Error e;
-			pair<shared_ptr<PlayerVideo>, DCPTime> v = _butler->get_video (&e);
+			pair<shared_ptr<PlayerVideo>, DCPTime> v = butler->get_video (&e);
 			if (!v.first) {
 				throw ProgrammingError(__FILE__, __LINE__, String::compose("butler returned no video; error was %1", static_cast<int>(e)));
 			}
-			shared_ptr<FFmpegFileEncoder> fe = encoder->get (v.first->eyes());
+			shared_ptr<FFmpegFileEncoder> fe = encoder.get (v.first->eyes());
 			if (fe) {
 				fe->video(v.first, v.second);
 			}
 		}
 
-		_history.event ();
-
-		{
-			boost::mutex::scoped_lock lm (_mutex);
-			_last_time = i;
-		}
-
-		shared_ptr<Job> job = _job.lock ();
-		if (job) {
-			job->set_progress (float(i.get()) / _film->length().get());
-		}
-
-		waker.nudge ();
+		frame_done (waker);
 
-		_butler->get_audio (interleaved, audio_frames);
+		butler->get_audio (interleaved.get(), audio_frames);
 		/* XXX: inefficient; butler interleaves and we deinterleave again */
-		float* p = interleaved;
+		float* p = interleaved.get();
 		for (int j = 0; j < audio_frames; ++j) {
 			for (int k = 0; k < _output_audio_channels; ++k) {
 				deinterleaved->data(k)[j] = *p++;
 			}
 		}
-		encoder->audio (deinterleaved);
-	}
-	delete[] interleaved;
-
-	BOOST_FOREACH (FileEncoderSet i, _file_encoders) {
-		i.flush ();
+		encoder.audio (deinterleaved);
 	}
-
-	_butler->rethrow ();
 }
 
 float
@@ -205,11 +526,30 @@ FFmpegEncoder::current_rate () const
 	return _history.rate ();
 }
 
+void
+FFmpegEncoder::metrics (Metrics& metrics) const
+{
+	Encoder::metrics (metrics);
+
+	/* Give the metrics of the butler for the earliest reel that is being encoded */
+	shared_ptr<Butler> butler;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		if (!_butlers.empty ()) {
+			butler = _butlers.begin()->second;
+		}
+	}
+
+	if (butler) {
+		butler->metrics (metrics);
+	}
+}
+
 Frame
 FFmpegEncoder::frames_done () const
 {
 	boost::mutex::scoped_lock lm (_mutex);
-	return _last_time.frames_round (_film->video_frame_rate ());
+	return _frames_done;
 }
 
 FFmpegEncoder::FileEncoderSet::FileEncoderSet (
@@ -221,21 +561,22 @@ FFmpegEncoder::FileEncoderSet::FileEncoderSet (
 	int x264_crf,
 	bool three_d,
 	boost::filesystem::path output,
-	string extension
+	string extension,
+	bool segment
 	)
 {
 	if (three_d) {
 		/// TRANSLATORS: L here is an abbreviation for "left", to indicate the left-eye part of a 3D export
 		_encoders[EYES_LEFT] = shared_ptr<FFmpegFileEncoder>(
-			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1_%2%3", output.string(), _("L"), extension))
+			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1_%2%3", output.string(), _("L"), extension), segment)
 			);
 		/// TRANSLATORS: R here is an abbreviation for "left", to indicate the left-eye part of a 3D export
 		_encoders[EYES_RIGHT] = shared_ptr<FFmpegFileEncoder>(
-			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1_%2%3", output.string(), _("R"), extension))
+			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1_%2%3", output.string(), _("R"), extension), segment)
 			);
 	} else {
 		_encoders[EYES_BOTH]  = shared_ptr<FFmpegFileEncoder>(
-			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1%2", output.string(), extension))
+			new FFmpegFileEncoder(video_frame_size, video_frame_rate, audio_frame_rate, channels, format, x264_crf, String::compose("%1%2", output.string(), extension), segment)
 			);
 	}
 }
@@ -274,3 +615,58 @@ FFmpegEncoder::FileEncoderSet::audio (shared_ptr<AudioBuffers> a)
 		i->second->audio (a);
 	}
 }
+
+FFmpegEncoder::SegmentReader::SegmentReader (boost::filesystem::path file)
+	: _format_context (0)
+	, _stream_index (-1)
+{
+	int e = avformat_open_input (&_format_context, file.string().c_str(), 0, 0);
+	if (e < 0) {
+		throw OpenFileError (file, e, OpenFileError::READ);
+	}
+
+	if (avformat_find_stream_info (_format_context, 0) < 0) {
+		avformat_close_input (&_format_context);
+		throw DecodeError (_("could not find stream information"));
+	}
+
+	for (uint32_t i = 0; i < _format_context->nb_streams; ++i) {
+		if (_format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+			_stream_index = i;
+			break;
+		}
+	}
+
+	if (_stream_index == -1) {
+		avformat_close_input (&_format_context);
+		throw DecodeError (_("could not find video stream"));
+	}
+}
+
+FFmpegEncoder::SegmentReader::~SegmentReader ()
+{
+	avformat_close_input (&_format_context);
+}
+
+/** Read the next video packet from the segment.
+ *  @param packet Packet to fill in; the caller must av_packet_unref() it after use.
+ *  @return true if a packet was read, false if there are no more.
+ */
+bool
+FFmpegEncoder::SegmentReader::read (AVPacket* packet)
+{
+	while (av_read_frame (_format_context, packet) >= 0) {
+		if (packet->stream_index == _stream_index) {
+			return true;
+		}
+		av_packet_unref (packet);
+	}
+
+	return false;
+}
+
+AVRational
+FFmpegEncoder::SegmentReader::time_base () const
+{
+	return _format_context->streams[_stream_index]->time_base;
+}
@@ -25,10 +25,23 @@
 #include "event_history.h"
 #include "audio_mapping.h"
 #include "ffmpeg_file_encoder.h"
+#include "exception_store.h"
+#include "dcpomatic_time.h"
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
 
 class Butler;
-
-class FFmpegEncoder : public Encoder
+class Waker;
+
+/** @class FFmpegEncoder
+ *  @brief An Encoder which exports a film to one or more files (e.g. ProRes or H.264) using FFmpeg.
+ *
+ *  When each reel is exported to its own file, several reels can be encoded at once, each with
+ *  its own Player and Butler.  When exporting to a single file the video can instead be encoded
+ *  as a number of segments at once, which are then joined with the audio.
+ */
+class FFmpegEncoder : public Encoder, public ExceptionStore
 {
 public:
 	FFmpegEncoder (
@@ -45,6 +58,7 @@ public:
 
 	float current_rate () const;
 	Frame frames_done () const;
+	void metrics (Metrics& metrics) const;
 	bool finishing () const {
 		return false;
 	}
@@ -63,26 +77,74 @@ private:
 			int x264_crf,
 			bool three_d,
 			boost::filesystem::path output,
-			std::string extension
+			std::string extension,
+			bool segment
 			);
 
 		boost::shared_ptr<FFmpegFileEncoder> get (Eyes eyes) const;
 		void flush ();
 		void audio (boost::shared_ptr<AudioBuffers>);
 
+		std::map<Eyes, boost::shared_ptr<FFmpegFileEncoder> > encoders () const {
+			return _encoders;
+		}
+
 	private:
 		std::map<Eyes, boost::shared_ptr<FFmpegFileEncoder> > _encoders;
 	};
 
-	std::list<FileEncoderSet> _file_encoders;
+	/** @class SegmentReader
+	 *  @brief Reader of the video packets from a file written by encode_segment().
+	 */
+	class SegmentReader : public boost::noncopyable
+	{
+	public:
+		explicit SegmentReader (boost::filesystem::path file);
+		~SegmentReader ();
+
+		bool read (AVPacket* packet);
+
+		AVRational time_base () const;
+
+	private:
+		AVFormatContext* _format_context;
+		int _stream_index;
+	};
+
+	FileEncoderSet make_file_encoder_set (boost::filesystem::path filename, std::string extension, int channels, bool segment) const;
+	boost::shared_ptr<Player> make_player () const;
+	boost::shared_ptr<Butler> make_butler (boost::shared_ptr<Player> player) const;
+	void encode (
+		boost::shared_ptr<Butler> butler, DCPTimePeriod period, std::vector<DCPTimePeriod> const & reels, size_t reel, Waker& waker
+		);
+	void encode_parts (size_t parts, int threads, boost::function<void (size_t)> encode_part);
+	void part_thread (size_t parts, boost::function<void (size_t)> encode_part);
+	void encode_reel (std::vector<DCPTimePeriod> const & reels, size_t reel, Waker& waker);
+	std::vector<DCPTimePeriod> segment_periods (int threads) const;
+	void encode_segments (int threads, Waker& waker);
+	void encode_segment (std::vector<DCPTimePeriod> const & segments, std::vector<FileEncoderSet>& encoders, size_t segment, Waker& waker);
+	void join_segments (std::vector<DCPTimePeriod> const & segments, std::vector<FileEncoderSet> const & encoders, Waker& waker);
+	void join_audio (boost::shared_ptr<AudioBuffers> pending, boost::shared_ptr<AudioBuffers> audio);
+	void frame_done (Waker& waker);
+
+	/** one set of encoders for each file that we are writing */
+	std::vector<FileEncoderSet> _file_encoders;
+	boost::filesystem::path _output;
 	int _output_audio_channels;
+	AudioMapping _audio_mapping;
+	ExportFormat _format;
+	int _x264_crf;
 
+	/** mutex to protect _frames_done, _butlers and _next_part */
 	mutable boost::mutex _mutex;
-	DCPTime _last_time;
+	/** number of video frames that have been encoded (or joined) */
+	Frame _frames_done;
+	/** butlers that are in use, keyed by the index of the reel or segment that they are playing */
+	std::map<size_t, boost::shared_ptr<Butler> > _butlers;
+	/** index of the next reel or segment for part_thread() to encode */
+	size_t _next_part;
 
 	EventHistory _history;
-
-	boost::shared_ptr<Butler> _butler;
 };
 
 #endif
@@ -45,6 +45,10 @@ using namespace boost::placeholders;
 int FFmpegFileEncoder::_video_stream_index = 0;
 int FFmpegFileEncoder::_audio_stream_index = 1;
 
+/** @param channels Number of audio channels, or 0 to write no audio.
+ *  @param segment true if this file is a segment whose video packets will be copied into another file
+ *  by video_packet().
+ */
 FFmpegFileEncoder::FFmpegFileEncoder (
 	dcp::Size video_frame_size,
 	int video_frame_rate,
@@ -52,9 +56,13 @@ FFmpegFileEncoder::FFmpegFileEncoder (
 	int channels,
 	ExportFormat format,
 	int x264_crf,
-	boost::filesystem::path output
+	boost::filesystem::path output,
+	bool segment
 	)
-	: _video_options (0)
+	: _audio_codec (0)
+	, _audio_codec_context (0)
+	, _audio_stream (0)
+	, _video_options (0)
 	, _audio_channels (channels)
 	, _output (output)
 	, _video_frame_size (video_frame_size)
@@ -76,11 +84,19 @@ FFmpegFileEncoder::FFmpegFileEncoder (
 		_video_codec_name = "libx264";
 		_audio_codec_name = "aac";
 		av_dict_set_int (&_video_options, "crf", x264_crf, 0);
+		if (segment) {
+			/* Without B-frames the DTS of each packet is the same as its PTS, so the DTS of
+			   the segments' packets still go up when the segments are joined together.
+			*/
+			av_dict_set (&_video_options, "bf", "0", 0);
+		}
 		break;
 	}
 
 	setup_video ();
-	setup_audio ();
+	if (_audio_channels) {
+		setup_audio ();
+	}
 
 	int r = avformat_alloc_output_context2 (&_format_context, 0, 0, _output.string().c_str());
 	if (!_format_context) {
@@ -92,26 +108,30 @@ FFmpegFileEncoder::FFmpegFileEncoder (
 		throw runtime_error ("could not create FFmpeg output video stream");
 	}
 
-	_audio_stream = avformat_new_stream (_format_context, _audio_codec);
-	if (!_audio_stream) {
-		throw runtime_error ("could not create FFmpeg output audio stream");
-	}
-
 	_video_stream->id = _video_stream_index;
 	_video_stream->codec = _video_codec_context;
 
-	_audio_stream->id = _audio_stream_index;
-	_audio_stream->codec = _audio_codec_context;
+	if (_audio_channels) {
+		_audio_stream = avformat_new_stream (_format_context, _audio_codec);
+		if (!_audio_stream) {
+			throw runtime_error ("could not create FFmpeg output audio stream");
+		}
+
+		_audio_stream->id = _audio_stream_index;
+		_audio_stream->codec = _audio_codec_context;
+	}
 
 	if (avcodec_open2 (_video_codec_context, _video_codec, &_video_options) < 0) {
 		throw runtime_error ("could not open FFmpeg video codec");
 	}
 
-	r = avcodec_open2 (_audio_codec_context, _audio_codec, 0);
-	if (r < 0) {
-		char buffer[256];
-		av_strerror (r, buffer, sizeof(buffer));
-		throw runtime_error (String::compose ("could not open FFmpeg audio codec (%1)", buffer));
+	if (_audio_channels) {
+		r = avcodec_open2 (_audio_codec_context, _audio_codec, 0);
+		if (r < 0) {
+			char buffer[256];
+			av_strerror (r, buffer, sizeof(buffer));
+			throw runtime_error (String::compose ("could not open FFmpeg audio codec (%1)", buffer));
+		}
 	}
 
 	if (avio_open_boost (&_format_context->pb, _output, AVIO_FLAG_WRITE) < 0) {
@@ -122,7 +142,9 @@ FFmpegFileEncoder::FFmpegFileEncoder (
 		throw runtime_error ("could not write header to FFmpeg output file");
 	}
 
-	_pending_audio.reset (new AudioBuffers(channels, 0));
+	if (_audio_channels) {
+		_pending_audio.reset (new AudioBuffers(channels, 0));
+	}
 }
 
 AVPixelFormat
@@ -190,12 +212,12 @@ FFmpegFileEncoder::setup_audio ()
 void
 FFmpegFileEncoder::flush ()
 {
-	if (_pending_audio->frames() > 0) {
+	if (_pending_audio && _pending_audio->frames() > 0) {
 		audio_frame (_pending_audio->frames ());
 	}
 
 	bool flushed_video = false;
-	bool flushed_audio = false;
+	bool flushed_audio = !_audio_channels;
 
 	while (!flushed_video || !flushed_audio) {
 		AVPacket packet;
@@ -213,6 +235,10 @@ FFmpegFileEncoder::flush ()
 		}
 		av_packet_unref (&packet);
 
+		if (flushed_audio) {
+			continue;
+		}
+
 		av_init_packet (&packet);
 		packet.data = 0;
 		packet.size = 0;
@@ -230,7 +256,9 @@ FFmpegFileEncoder::flush ()
 	av_write_trailer (_format_context);
 
 	avcodec_close (_video_codec_context);
-	avcodec_close (_audio_codec_context);
+	if (_audio_codec_context) {
+		avcodec_close (_audio_codec_context);
+	}
 	avio_close (_format_context->pb);
 	avformat_free_context (_format_context);
 }
@@ -286,10 +314,37 @@ FFmpegFileEncoder::video (shared_ptr<PlayerVideo> video, DCPTime time)
 
 }
 
+/** Write some video which has already been encoded by another FFmpegFileEncoder with the same settings.
+ *  @param packet Packet to write; its timestamps will be changed.
+ *  @param time_base Time base of the packet's timestamps.
+ *  @param offset Time to add to the packet's timestamps.
+ */
+void
+FFmpegFileEncoder::video_packet (AVPacket* packet, AVRational time_base, DCPTime offset)
+{
+	int64_t const offset_in_stream = av_rescale (offset.get(), _video_stream->time_base.den, int64_t (DCPTime::HZ) * _video_stream->time_base.num);
+
+	if (packet->pts != AV_NOPTS_VALUE) {
+		packet->pts = av_rescale_q (packet->pts, time_base, _video_stream->time_base) + offset_in_stream;
+	}
+	if (packet->dts != AV_NOPTS_VALUE) {
+		packet->dts = av_rescale_q (packet->dts, time_base, _video_stream->time_base) + offset_in_stream;
+	}
+	packet->duration = av_rescale_q (packet->duration, time_base, _video_stream->time_base);
+	packet->pos = -1;
+	packet->stream_index = _video_stream_index;
+
+	if (av_interleaved_write_frame (_format_context, packet) < 0) {
+		throw EncodeError ("FFmpeg video packet write failed");
+	}
+}
+
 /** Called when the player gives us some audio */
 void
 FFmpegFileEncoder::audio (shared_ptr<AudioBuffers> audio)
 {
+	DCPOMATIC_ASSERT (_audio_channels);
+
 	_pending_audio->append (audio);
 
 	int frame_size = _audio_codec_context->frame_size;
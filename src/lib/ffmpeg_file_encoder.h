@@ -40,15 +40,21 @@ public:
 		int channels,
 		ExportFormat,
 		int x264_crf,
-		boost::filesystem::path output
+		boost::filesystem::path output,
+		bool segment = false
 		);
 
 	void video (boost::shared_ptr<PlayerVideo>, DCPTime);
+	void video_packet (AVPacket* packet, AVRational time_base, DCPTime offset);
 	void audio (boost::shared_ptr<AudioBuffers>);
 	void subtitle (PlayerText, DCPTimePeriod);
 
 	void flush ();
 
+	boost::filesystem::path output () const {
+		return _output;
+	}
+
 	static AVPixelFormat pixel_format (ExportFormat format);
 
 private:
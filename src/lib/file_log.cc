@@ -21,39 +21,198 @@
 #include "file_log.h"
 #include "cross.h"
 #include "config.h"
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 #include <cstdio>
 #include <iostream>
 
 using std::cout;
 using std::string;
+using std::vector;
 using std::max;
+using std::map;
 using boost::shared_ptr;
+using boost::weak_ptr;
 
-/** @param file Filename to write log to */
-FileLog::FileLog (boost::filesystem::path file)
+boost::mutex FileLog::_shared_mutex;
+map<boost::filesystem::path, weak_ptr<FileLog::Shared> > FileLog::_all_shared;
+
+/** @param file Filename to write log to.
+ *  @param max_size Size at which to move the log to a backup file and start a new one, in bytes.
+ */
+FileLog::FileLog (boost::filesystem::path file, uintmax_t max_size)
 	: _file (file)
+	, _max_size (max_size)
+	, _shared (shared (file))
+	, _handle (0)
+	, _rotations (0)
+	, _queued (0)
+	, _written (0)
+	, _stop (false)
 {
 	set_types (Config::instance()->log_types());
+
+	_thread = new boost::thread (boost::bind (&FileLog::thread, this));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (_thread->native_handle(), "file-log");
+#endif
+}
+
+FileLog::~FileLog ()
+{
+	{
+		boost::mutex::scoped_lock lm (_queue_mutex);
+		_stop = true;
+		_summon.notify_all ();
+	}
+
+	/* The thread writes anything that is left before it finishes */
+	_thread->join ();
+	delete _thread;
 }
 
 void
 FileLog::do_log (shared_ptr<const LogEntry> entry)
 {
-	FILE* f = fopen_boost (_file, "a");
-	if (!f) {
-		cout << "(could not log to " << _file.string() << "): " << entry.get() << "\n";
-		return;
+	boost::mutex::scoped_lock lm (_queue_mutex);
+	_queue.push_back (entry);
+	++_queued;
+	_summon.notify_all ();
+
+	if (entry->type() == LogEntry::TYPE_ERROR) {
+		/* Make sure that errors get to disk in case we are about to crash */
+		uint64_t const target = _queued;
+		while (_written < target && !_stop) {
+			_written_condition.wait (lm);
+		}
 	}
+}
 
-	fprintf (f, "%s\n", entry->get().c_str ());
-	fclose (f);
+/** Wait until everything that has been logged so far has been written to the file */
+void
+FileLog::flush ()
+{
+	wait_until_written ();
+}
+
+void
+FileLog::wait_until_written () const
+{
+	boost::mutex::scoped_lock lm (_queue_mutex);
+	uint64_t const target = _queued;
+	while (_written < target && !_stop) {
+		_written_condition.wait (lm);
+	}
+}
+
+void
+FileLog::thread ()
+{
+	while (true) {
+		vector<shared_ptr<const LogEntry> > entries;
+
+		{
+			boost::mutex::scoped_lock lm (_queue_mutex);
+			while (_queue.empty() && !_stop) {
+				_summon.wait (lm);
+			}
+			if (_queue.empty()) {
+				/* We've been asked to stop and there's nothing left to write */
+				break;
+			}
+			entries.swap (_queue);
+		}
+
+		write (entries);
+
+		boost::mutex::scoped_lock lm (_queue_mutex);
+		_written += entries.size ();
+		_written_condition.notify_all ();
+	}
+
+	if (_handle) {
+		fclose (_handle);
+		_handle = 0;
+	}
+}
+
+/** @return State for FileLogs which write to `file', shared with any others that exist */
+shared_ptr<FileLog::Shared>
+FileLog::shared (boost::filesystem::path file)
+{
+	boost::system::error_code ec;
+	boost::filesystem::path key = boost::filesystem::absolute (file, boost::filesystem::current_path (ec));
+
+	boost::mutex::scoped_lock lm (_shared_mutex);
+	shared_ptr<Shared> s = _all_shared[key].lock ();
+	if (!s) {
+		s.reset (new Shared);
+		_all_shared[key] = s;
+	}
+	return s;
+}
+
+/** Write some entries to the file, opening it or starting a new one if required.
+ *  Only called from our thread.
+ */
+void
+FileLog::write (vector<shared_ptr<const LogEntry> > const & entries)
+{
+	string text;
+	BOOST_FOREACH (shared_ptr<const LogEntry> i, entries) {
+		text += i->get() + "\n";
+	}
+
+	/* Other FileLogs may be writing to the same file, so we take the size from the
+	   file itself and rotate it with the shared lock held.
+	*/
+	boost::mutex::scoped_lock lm (_shared->mutex);
+
+	if (_handle && _rotations != _shared->rotations) {
+		/* Someone else has moved our file aside */
+		fclose (_handle);
+		_handle = 0;
+	}
+
+	boost::system::error_code ec;
+	uintmax_t size = boost::filesystem::file_size (_file, ec);
+	if (ec) {
+		size = 0;
+	}
+
+	if (size > 0 && (size + text.length()) > _max_size) {
+		/* Keep the old log as a backup and start again */
+		if (_handle) {
+			fclose (_handle);
+			_handle = 0;
+		}
+		boost::filesystem::path backup = _file;
+		backup += ".1";
+		boost::filesystem::remove (backup, ec);
+		boost::filesystem::rename (_file, backup, ec);
+		++_shared->rotations;
+	}
+
+	if (!_handle) {
+		_handle = fopen_boost (_file, "a");
+		if (!_handle) {
+			cout << "(could not log to " << _file.string() << "): " << text;
+			return;
+		}
+		_rotations = _shared->rotations;
+	}
+
+	fwrite (text.c_str(), 1, text.length(), _handle);
+	/* Flush so that someone reading the log (or a crash) sees it all */
+	fflush (_handle);
 }
 
 string
 FileLog::head_and_tail (int amount) const
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	wait_until_written ();
 
+	boost::mutex::scoped_lock lm (_mutex);
 	uintmax_t head_amount = amount;
 	uintmax_t tail_amount = amount;
 	uintmax_t size = boost::filesystem::file_size (_file);
@@ -19,17 +19,79 @@
 */
 
 #include "log.h"
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/weak_ptr.hpp>
+#include <stdint.h>
+#include <map>
+#include <vector>
 
+/** @class FileLog
+ *  @brief A Log which writes to a file.
+ *
+ *  Entries are queued by log() and written to the file by a separate thread, which keeps the
+ *  file open and writes whatever has been queued since its last write in one go; this means
+ *  that threads which log a lot do not have to wait for the disk.  Errors are written before
+ *  log() returns, and everything else is written by flush() or when the FileLog is destroyed;
+ *  if the program crashes, anything else which has not yet been written is lost.
+ *  When the file gets bigger than a given size it is renamed with a .1 suffix and a new file
+ *  is started; FileLogs which share a file take turns to do this.
+ */
 class FileLog : public Log
 {
 public:
-	explicit FileLog (boost::filesystem::path file);
+	explicit FileLog (boost::filesystem::path file, uintmax_t max_size = 64 * 1024 * 1024);
+	~FileLog ();
 
 	std::string head_and_tail (int amount = 1024) const;
+	void flush ();
 
 private:
+	/** State shared by all the FileLogs which write to a particular file */
+	struct Shared
+	{
+		Shared ()
+			: rotations (0)
+		{}
+
+		/** mutex which must be held to write to or rotate the file */
+		boost::mutex mutex;
+		/** number of times that the file has been moved aside */
+		int rotations;
+	};
+
+	static boost::shared_ptr<Shared> shared (boost::filesystem::path file);
+
 	void do_log (boost::shared_ptr<const LogEntry> entry);
+	void thread ();
+	void write (std::vector<boost::shared_ptr<const LogEntry> > const & entries);
+	void wait_until_written () const;
 
 	/** filename to write to */
 	boost::filesystem::path _file;
+	/** size at which to start a new file, in bytes */
+	uintmax_t _max_size;
+	boost::shared_ptr<Shared> _shared;
+	/** file that the thread is writing to, or 0; only used by the thread */
+	FILE* _handle;
+	/** value of _shared->rotations when _handle was opened; only used by the thread */
+	int _rotations;
+
+	/** mutex to protect _queue, _queued, _written and _stop */
+	mutable boost::mutex _queue_mutex;
+	/** condition to wake the thread when there is something to do */
+	boost::condition _summon;
+	/** condition to tell waiters when some entries have been written */
+	mutable boost::condition _written_condition;
+	std::vector<boost::shared_ptr<const LogEntry> > _queue;
+	/** number of entries that have ever been queued */
+	uint64_t _queued;
+	/** number of entries that have ever been written */
+	uint64_t _written;
+	bool _stop;
+
+	boost::thread* _thread;
+
+	static boost::mutex _shared_mutex;
+	static std::map<boost::filesystem::path, boost::weak_ptr<Shared> > _all_shared;
 };
@@ -51,6 +51,7 @@
 #include "ffmpeg_content.h"
 #include "dcp_content.h"
 #include "screen_kdm.h"
+#include "kdm_batch.h"
 #include "cinema.h"
 #include "change_signaller.h"
 #include "check_content_change_job.h"
@@ -297,6 +298,28 @@ Film::audio_analysis_path (shared_ptr<const Playlist> playlist) const
 	return p;
 }
 
+/** @return Path of the analysis of a piece of content's audio on its own (see ContentAudioAnalysis).
+ *  This does not depend on the content's gain, mapping or position, as those are applied when the
+ *  analysis is used.
+ */
+boost::filesystem::path
+Film::content_audio_analysis_path (shared_ptr<const Content> content) const
+{
+	DCPOMATIC_ASSERT (content->audio);
+
+	Digester digester;
+	digester.add (content->digest ());
+	digester.add (content->audio->delay ());
+	digester.add (content->audio->resampled_frame_rate (shared_from_this ()));
+	digester.add (audio_frame_rate ());
+	BOOST_FOREACH (AudioStreamPtr i, content->audio->streams ()) {
+		digester.add (i->frame_rate ());
+		digester.add (i->channels ());
+	}
+
+	return dir (boost::filesystem::path ("analysis") / "content") / digester.get ();
+}
+
 /** Add suitable Jobs to the JobManager to create a DCP for this Film */
 void
 Film::make_dcp ()
@@ -1360,55 +1383,9 @@ Film::make_kdm (
 	optional<int> disable_forensic_marking_audio
 	) const
 {
-	if (!_encrypted) {
-		throw runtime_error (_("Cannot make a KDM as this project is not encrypted."));
-	}
-
-	shared_ptr<const dcp::CPL> cpl (new dcp::CPL (cpl_file));
-	shared_ptr<const dcp::CertificateChain> signer = Config::instance()->signer_chain ();
-	if (!signer->valid ()) {
-		throw InvalidSignerError ();
-	}
-
-	/* Find keys that have been added to imported, encrypted DCP content */
-	list<dcp::DecryptedKDMKey> imported_keys;
-	BOOST_FOREACH (shared_ptr<Content> i, content()) {
-		shared_ptr<DCPContent> d = dynamic_pointer_cast<DCPContent> (i);
-		if (d && d->kdm()) {
-			dcp::DecryptedKDM kdm (d->kdm().get(), Config::instance()->decryption_chain()->key().get());
-			list<dcp::DecryptedKDMKey> keys = kdm.keys ();
-			copy (keys.begin(), keys.end(), back_inserter (imported_keys));
-		}
-	}
-
-	map<shared_ptr<const dcp::ReelMXF>, dcp::Key> keys;
-
-	BOOST_FOREACH(shared_ptr<const dcp::ReelAsset> i, cpl->reel_assets ()) {
-		shared_ptr<const dcp::ReelMXF> mxf = boost::dynamic_pointer_cast<const dcp::ReelMXF> (i);
-		if (!mxf || !mxf->key_id()) {
-			continue;
-		}
-
-		/* Get any imported key for this ID */
-		bool done = false;
-		BOOST_FOREACH (dcp::DecryptedKDMKey j, imported_keys) {
-			if (j.id() == mxf->key_id().get()) {
-				LOG_GENERAL ("Using imported key for %1", mxf->key_id().get());
-				keys[mxf] = j.key();
-				done = true;
-			}
-		}
-
-		if (!done) {
-			/* No imported key; it must be an asset that we encrypted */
-			LOG_GENERAL ("Using our own key for %1", mxf->key_id().get());
-			keys[mxf] = key();
-		}
-	}
-
-	return dcp::DecryptedKDM (
-		cpl->id(), keys, from, until, cpl->content_title_text(), cpl->content_title_text(), dcp::LocalTime().as_string()
-		).encrypt (signer, recipient, trusted_devices, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio);
+	return KDMBatch(shared_from_this(), cpl_file).make (
+		recipient, trusted_devices, from, until, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio
+		);
 }
 
 /** @param screens Screens to make KDMs for.
@@ -1431,26 +1408,10 @@ Film::make_kdms (
 	optional<int> disable_forensic_marking_audio
 	) const
 {
-	list<ScreenKDM> kdms;
-
-	BOOST_FOREACH (shared_ptr<Screen> i, screens) {
-		if (i->recipient) {
-			dcp::EncryptedKDM const kdm = make_kdm (
-				i->recipient.get(),
-				i->trusted_device_thumbprints(),
-				cpl_file,
-				dcp::LocalTime (from,  i->cinema ? i->cinema->utc_offset_hour() : 0, i->cinema ? i->cinema->utc_offset_minute() : 0),
-				dcp::LocalTime (until, i->cinema ? i->cinema->utc_offset_hour() : 0, i->cinema ? i->cinema->utc_offset_minute() : 0),
-				formulation,
-				disable_forensic_marking_picture,
-				disable_forensic_marking_audio
-				);
-
-			kdms.push_back (ScreenKDM (i, kdm));
-		}
-	}
-
-	return kdms;
+	return KDMBatch(shared_from_this(), cpl_file).make (
+		screens, from, until, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio,
+		boost::thread::hardware_concurrency()
+		);
 }
 
 /** @return The approximate disk space required to encode a DCP of this film with the
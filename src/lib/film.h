@@ -103,6 +103,7 @@ public:
 	boost::filesystem::path internal_video_asset_filename (DCPTimePeriod p) const;
 
 	boost::filesystem::path audio_analysis_path (boost::shared_ptr<const Playlist>) const;
+	boost::filesystem::path content_audio_analysis_path (boost::shared_ptr<const Content>) const;
 
 	void send_dcp_to_tms ();
 	void make_dcp ();
@@ -0,0 +1,307 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "frame_cache.h"
+#include "disk_cache.h"
+#include "image.h"
+#include "cross.h"
+#include "util.h"
+#include "exceptions.h"
+#include "dcpomatic_log.h"
+#include "dcpomatic_assert.h"
+#include <boost/bind.hpp>
+
+using std::string;
+using std::make_pair;
+using boost::shared_ptr;
+using boost::optional;
+using boost::bind;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
+
+/** Identifier at the start of each cache file; change this if the file format changes */
+#define FRAME_CACHE_MAGIC 0x44434601
+
+/** @param pixel_format Pixel format of all the frames that will be stored in this cache.
+ *  @param memory_limit Maximum size of frames to keep in memory, in bytes.
+ *  @param directory Directory to keep frames in on disk, or none to use only memory.
+ *  @param disk_limit Maximum size of frames to keep on disk, in bytes.
+ */
+FrameCache::FrameCache (AVPixelFormat pixel_format, size_t memory_limit, optional<boost::filesystem::path> directory, size_t disk_limit)
+	: _pixel_format (pixel_format)
+	, _memory_used (0)
+	, _memory_limit (memory_limit)
+	, _hits (0)
+	, _misses (0)
+{
+	if (directory) {
+		_disk.reset (new DiskCache(*directory, disk_limit, false));
+	}
+}
+
+FrameCache::~FrameCache ()
+{
+
+}
+
+/** @return Cached frame with the given key, or 0 if there is none.  The returned Image
+ *  may be shared with other users of the cache, so it must not be modified.
+ */
+shared_ptr<Image>
+FrameCache::get (string key)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	std::map<string, MemoryList::iterator>::iterator i = _memory_index.find (key);
+	if (i != _memory_index.end()) {
+		/* Move to the front of the list */
+		_memory.splice (_memory.begin(), _memory, i->second);
+		++_hits;
+		return _memory.front().second;
+	}
+
+	if (!_disk || !_disk->has(key)) {
+		++_misses;
+		return shared_ptr<Image> ();
+	}
+
+	/* Don't hold the lock while we read, as other threads may want to get at other frames;
+	   the file may be evicted meanwhile, in which case the read will fail.
+	*/
+	lm.unlock ();
+
+	shared_ptr<Image> image;
+	try {
+		image = read (_disk->file(key));
+	} catch (std::exception& e) {
+		LOG_WARNING ("Could not read cached frame %1 (%2)", key, e.what());
+	}
+
+	if (image) {
+		_disk->touch (key);
+	} else {
+		_disk->forget (key);
+	}
+
+	lm.lock ();
+
+	if (!image) {
+		++_misses;
+		return image;
+	}
+
+	++_hits;
+
+	i = _memory_index.find (key);
+	if (i != _memory_index.end()) {
+		/* Someone else read the same frame while we were unlocked */
+		_memory.splice (_memory.begin(), _memory, i->second);
+		return _memory.front().second;
+	}
+
+	add_to_memory (key, image);
+	return image;
+}
+
+/** @return Cached frame with the given key if it is in memory, otherwise 0.  This never
+ *  reads from disk, so it is suitable for threads (like the GUI's) which must not wait.
+ *  The returned Image must not be modified.
+ */
+shared_ptr<Image>
+FrameCache::get_from_memory (string key)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	std::map<string, MemoryList::iterator>::iterator i = _memory_index.find (key);
+	if (i == _memory_index.end()) {
+		return shared_ptr<Image> ();
+	}
+
+	_memory.splice (_memory.begin(), _memory, i->second);
+	++_hits;
+	return _memory.front().second;
+}
+
+/** @return true if we have a frame with the given key, either in memory or on disk */
+bool
+FrameCache::has (string key) const
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		if (_memory_index.find(key) != _memory_index.end()) {
+			return true;
+		}
+	}
+
+	return _disk && _disk->has(key);
+}
+
+/** Add a frame to the cache.  The cache will keep a reference to image, so it must
+ *  not be modified after this call.
+ */
+void
+FrameCache::put (string key, shared_ptr<Image> image)
+{
+	DCPOMATIC_ASSERT (image);
+
+	if (image->pixel_format() != _pixel_format) {
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+
+		if (_memory_index.find(key) != _memory_index.end()) {
+			return;
+		}
+
+		add_to_memory (key, image);
+	}
+
+	if (!_disk) {
+		return;
+	}
+
+	/* We don't hold the lock while we write, as other threads may want to get at frames in memory */
+	try {
+		_disk->write (key, bind(&FrameCache::write, image, _1, _2));
+	} catch (std::exception& e) {
+		LOG_WARNING ("Could not write cached frame %1 (%2)", key, e.what());
+	}
+}
+
+/** Remove everything from the cache, including anything on disk */
+void
+FrameCache::clear ()
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_memory.clear ();
+		_memory_index.clear ();
+		_memory_used = 0;
+	}
+
+	if (_disk) {
+		_disk->clear ();
+	}
+}
+
+/** Caller must hold a lock on _mutex */
+void
+FrameCache::add_to_memory (string key, shared_ptr<Image> image)
+{
+	_memory.push_front (make_pair(key, image));
+	_memory_index[key] = _memory.begin();
+	_memory_used += image->memory_used();
+	evict_memory ();
+}
+
+/** Caller must hold a lock on _mutex */
+void
+FrameCache::evict_memory ()
+{
+	/* Always keep the most recent frame, even if it's too big on its own */
+	while (_memory_used > _memory_limit && _memory.size() > 1) {
+		_memory_used -= _memory.back().second->memory_used();
+		_memory_index.erase (_memory.back().first);
+		_memory.pop_back ();
+	}
+}
+
+/** Write an image's header and data to a cache file */
+void
+FrameCache::write (shared_ptr<const Image> image, FILE* file, boost::filesystem::path path)
+{
+	int32_t header[5] = {
+		FRAME_CACHE_MAGIC,
+		image->pixel_format(),
+		image->size().width,
+		image->size().height,
+		image->aligned() ? 1 : 0
+	};
+
+	checked_fwrite (header, sizeof(header), file, path);
+
+	for (int i = 0; i < image->planes(); ++i) {
+		uint8_t* p = image->data()[i];
+		for (int y = 0; y < image->sample_size(i).height; ++y) {
+			checked_fwrite (p, image->line_size()[i], file, path);
+			p += image->stride()[i];
+		}
+	}
+}
+
+/** @return Image read from file, or 0 if the file is not one of ours */
+shared_ptr<Image>
+FrameCache::read (boost::filesystem::path file) const
+{
+	FILE* f = fopen_boost (file, "rb");
+	if (!f) {
+		throw OpenFileError (file, errno, OpenFileError::READ);
+	}
+
+	int32_t header[5];
+	checked_fread (header, sizeof(header), f, file);
+	if (header[0] != FRAME_CACHE_MAGIC || header[1] != _pixel_format) {
+		fclose (f);
+		return shared_ptr<Image> ();
+	}
+
+	shared_ptr<Image> image (new Image(static_cast<AVPixelFormat>(header[1]), dcp::Size(header[2], header[3]), header[4]));
+
+	for (int i = 0; i < image->planes(); ++i) {
+		uint8_t* p = image->data()[i];
+		for (int y = 0; y < image->sample_size(i).height; ++y) {
+			checked_fread (p, image->line_size()[i], f, file);
+			p += image->stride()[i];
+		}
+	}
+
+	fclose (f);
+	return image;
+}
+
+size_t
+FrameCache::memory_used () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _memory_used;
+}
+
+size_t
+FrameCache::disk_used () const
+{
+	return _disk ? _disk->used() : 0;
+}
+
+int
+FrameCache::hits () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _hits;
+}
+
+int
+FrameCache::misses () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _misses;
+}
@@ -0,0 +1,98 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_FRAME_CACHE_H
+#define DCPOMATIC_FRAME_CACHE_H
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+
+class Image;
+class DiskCache;
+
+/** @class FrameCache
+ *  @brief A cache of prepared video frames, keyed by a digest of everything that went into making them
+ *  (see PlayerVideo::digest).
+ *
+ *  There are two levels: a least-recently-used list of Images in memory and, optionally, a directory
+ *  of files on disk.  Frames evicted from the memory level stay on disk (if we have a directory) until
+ *  that is full too.  Each level has a size limit in bytes.
+ *
+ *  All frames in a cache have the same pixel format, and the cache should only be used by something
+ *  (e.g. a Butler) whose output frames are always in that format.
+ */
+class FrameCache : public boost::noncopyable
+{
+public:
+	FrameCache (AVPixelFormat pixel_format, size_t memory_limit, boost::optional<boost::filesystem::path> directory, size_t disk_limit);
+	~FrameCache ();
+
+	boost::shared_ptr<Image> get (std::string key);
+	boost::shared_ptr<Image> get_from_memory (std::string key);
+	bool has (std::string key) const;
+	void put (std::string key, boost::shared_ptr<Image> image);
+	void clear ();
+
+	AVPixelFormat pixel_format () const {
+		return _pixel_format;
+	}
+
+	size_t memory_used () const;
+	size_t disk_used () const;
+
+	int hits () const;
+	int misses () const;
+
+private:
+	void add_to_memory (std::string key, boost::shared_ptr<Image> image);
+	void evict_memory ();
+	static void write (boost::shared_ptr<const Image> image, FILE* file, boost::filesystem::path path);
+	boost::shared_ptr<Image> read (boost::filesystem::path file) const;
+
+	AVPixelFormat _pixel_format;
+	/** Frames on disk, or 0 if we are only using memory */
+	boost::scoped_ptr<DiskCache> _disk;
+
+	/** Mutex to protect everything below */
+	mutable boost::mutex _mutex;
+
+	typedef std::list<std::pair<std::string, boost::shared_ptr<Image> > > MemoryList;
+	/** Frames in memory, most recently used first */
+	MemoryList _memory;
+	std::map<std::string, MemoryList::iterator> _memory_index;
+	size_t _memory_used;
+	size_t _memory_limit;
+
+	int _hits;
+	int _misses;
+};
+
+#endif
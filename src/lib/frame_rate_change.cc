@@ -118,3 +118,16 @@ FrameRateChange::description () const
 
 	return description;
 }
+
+bool
+operator== (FrameRateChange const & a, FrameRateChange const & b)
+{
+	/* The other members are derived from these */
+	return a.source == b.source && a.dcp == b.dcp;
+}
+
+bool
+operator!= (FrameRateChange const & a, FrameRateChange const & b)
+{
+	return !(a == b);
+}
@@ -75,4 +75,7 @@ private:
 	void construct (double source_, int dcp_);
 };
 
+bool operator== (FrameRateChange const & a, FrameRateChange const & b);
+bool operator!= (FrameRateChange const & a, FrameRateChange const & b);
+
 #endif
@@ -29,6 +29,8 @@
 #include "util.h"
 #include "compose.hpp"
 #include "dcpomatic_socket.h"
+#include "digester.h"
+#include "buffer_pool.h"
 #include <dcp/rgb_xyz.h>
 #include <dcp/transfer_function.h>
 extern "C" {
@@ -42,6 +44,7 @@ extern "C" {
 #include <valgrind/memcheck.h>
 #endif
 #include <iostream>
+#include <new>
 
 #include "i18n.h"
 
@@ -331,6 +334,8 @@ Image::swap_16 (uint16_t v)
 void
 Image::make_part_black (int x, int w)
 {
+	make_writable ();
+
 	switch (_pixel_format) {
 	case AV_PIX_FMT_RGB24:
 	case AV_PIX_FMT_ARGB:
@@ -361,6 +366,8 @@ Image::make_part_black (int x, int w)
 void
 Image::make_black ()
 {
+	make_writable ();
+
 	/* U/V black value for 8-bit colour */
 	static uint8_t const eight_bit_uv =	(1 << 7) - 1;
 	/* U/V black value for 9-bit colour */
@@ -485,6 +492,8 @@ Image::make_black ()
 void
 Image::make_transparent ()
 {
+	make_writable ();
+
 	if (_pixel_format != AV_PIX_FMT_BGRA && _pixel_format != AV_PIX_FMT_RGBA) {
 		throw PixelFormatError ("make_transparent()", _pixel_format);
 	}
@@ -495,6 +504,8 @@ Image::make_transparent ()
 void
 Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
 {
+	make_writable ();
+
 	/* We're blending RGBA or BGRA images */
 	DCPOMATIC_ASSERT (other->pixel_format() == AV_PIX_FMT_BGRA || other->pixel_format() == AV_PIX_FMT_RGBA);
 	int const blue = other->pixel_format() == AV_PIX_FMT_BGRA ? 0 : 2;
@@ -741,6 +752,8 @@ Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
 void
 Image::copy (shared_ptr<const Image> other, Position<int> position)
 {
+	make_writable ();
+
 	/* Only implemented for RGB24 onto RGB24 so far */
 	DCPOMATIC_ASSERT (_pixel_format == AV_PIX_FMT_RGB24 && other->pixel_format() == AV_PIX_FMT_RGB24);
 	DCPOMATIC_ASSERT (position.x >= 0 && position.y >= 0);
@@ -756,6 +769,8 @@ Image::copy (shared_ptr<const Image> other, Position<int> position)
 void
 Image::read_from_socket (shared_ptr<Socket> socket)
 {
+	make_writable ();
+
 	for (int i = 0; i < planes(); ++i) {
 		uint8_t* p = data()[i];
 		int const lines = sample_size(i).height;
@@ -835,13 +850,14 @@ Image::bytes_per_pixel (int c) const
 Image::Image (AVPixelFormat p, dcp::Size s, bool aligned)
 	: _size (s)
 	, _pixel_format (p)
+	, _frame (0)
 	, _aligned (aligned)
 {
 	allocate ();
 }
 
 void
-Image::allocate ()
+Image::allocate_arrays ()
 {
 	_data = (uint8_t **) wrapped_av_malloc (4 * sizeof (uint8_t *));
 	_data[0] = _data[1] = _data[2] = _data[3] = 0;
@@ -851,6 +867,12 @@ Image::allocate ()
 
 	_stride = (int *) wrapped_av_malloc (4 * sizeof (int));
 	_stride[0] = _stride[1] = _stride[2] = _stride[3] = 0;
+}
+
+void
+Image::allocate ()
+{
+	allocate_arrays ();
 
 	for (int i = 0; i < planes(); ++i) {
 		_line_size[i] = ceil (_size.width * bytes_per_pixel(i));
@@ -893,7 +915,7 @@ Image::allocate ()
 		   |XXXwrittenXXX|<------line-size------------->|XXXwrittenXXXXXXwrittenXXX
 		                                                               ^^^^ out of bounds
 		*/
-		_data[i] = (uint8_t *) wrapped_av_malloc (_stride[i] * (sample_size(i).height + 1) + 32);
+		_data[i] = static_cast<uint8_t *> (BufferPool::instance()->allocate (_stride[i] * (sample_size(i).height + 1) + 32));
 #if HAVE_VALGRIND_MEMCHECK_H
 		/* The data between the end of the line size and the stride is undefined but processed by
 		   libswscale, causing lots of valgrind errors.  Mark it all defined to quell these errors.
@@ -907,45 +929,115 @@ Image::Image (Image const & other)
 	: boost::enable_shared_from_this<Image>(other)
 	, _size (other._size)
 	, _pixel_format (other._pixel_format)
+	, _frame (0)
 	, _aligned (other._aligned)
 {
 	allocate ();
-
-	for (int i = 0; i < planes(); ++i) {
-		uint8_t* p = _data[i];
-		uint8_t* q = other._data[i];
-		int const lines = sample_size(i).height;
-		for (int j = 0; j < lines; ++j) {
-			memcpy (p, q, _line_size[i]);
-			p += stride()[i];
-			q += other.stride()[i];
-		}
-	}
+	copy_planes (other._data, other._stride);
 }
 
 Image::Image (AVFrame* frame)
 	: _size (frame->width, frame->height)
 	, _pixel_format (static_cast<AVPixelFormat> (frame->format))
+	, _frame (0)
 	, _aligned (true)
 {
+	if (can_share (frame)) {
+		/* Take our own reference to the frame's data and use it in place */
+		_frame = av_frame_alloc ();
+		if (!_frame || av_frame_ref (_frame, frame) < 0) {
+			av_frame_free (&_frame);
+			throw std::bad_alloc ();
+		}
+
+		allocate_arrays ();
+		for (int i = 0; i < planes(); ++i) {
+			_data[i] = _frame->data[i];
+			_line_size[i] = ceil (_size.width * bytes_per_pixel(i));
+			/* AVFrame's linesize is what we call `stride' */
+			_stride[i] = _frame->linesize[i];
+		}
+		return;
+	}
+
 	allocate ();
+	copy_planes (frame->data, frame->linesize);
+}
+
+/** @return true if we can use the data in an AVFrame without copying it; this needs
+ *  the data to be reference-counted, aligned as we would align it, and followed by enough
+ *  of its buffer for libswscale to over-read safely (see the comment in allocate()).
+ */
+bool
+Image::can_share (AVFrame* frame) const
+{
+	if (!frame->buf[0]) {
+		return false;
+	}
+
+	for (int i = 0; i < planes(); ++i) {
+		int const line_size = ceil (_size.width * bytes_per_pixel(i));
+		int const stride = frame->linesize[i];
+		if (stride <= 0 || stride < line_size || (stride % 32) != 0 || (reinterpret_cast<uintptr_t>(frame->data[i]) % 32) != 0) {
+			return false;
+		}
+
+		AVBufferRef* buffer = av_frame_get_plane_buffer (frame, i);
+		if (!buffer) {
+			return false;
+		}
+
+		int64_t const needed = int64_t (stride) * sample_size(i).height + 32;
+		if (frame->data[i] < buffer->data || (frame->data[i] - buffer->data) + needed > buffer->size) {
+			return false;
+		}
+	}
 
+	return true;
+}
+
+/** Copy the picture in some planes into our own data, which must already be allocated.
+ *  @param data Planes to copy from.
+ *  @param stride Stride of each plane in bytes.
+ */
+void
+Image::copy_planes (uint8_t const * const * data, int const * stride)
+{
 	for (int i = 0; i < planes(); ++i) {
 		uint8_t* p = _data[i];
-		uint8_t* q = frame->data[i];
+		uint8_t const * q = data[i];
 		int const lines = sample_size(i).height;
 		for (int j = 0; j < lines; ++j) {
 			memcpy (p, q, _line_size[i]);
-			p += stride()[i];
-			/* AVFrame's linesize is what we call `stride' */
-			q += frame->linesize[i];
+			p += _stride[i];
+			q += stride[i];
 		}
 	}
 }
 
+/** Make sure that our data is not shared with an AVFrame, copying it if necessary,
+ *  so that it can be modified.
+ */
+void
+Image::make_writable ()
+{
+	if (!_frame) {
+		return;
+	}
+
+	av_free (_data);
+	av_free (_line_size);
+	av_free (_stride);
+	allocate ();
+
+	copy_planes (_frame->data, _frame->linesize);
+	av_frame_free (&_frame);
+}
+
 Image::Image (shared_ptr<const Image> other, bool aligned)
 	: _size (other->_size)
 	, _pixel_format (other->_pixel_format)
+	, _frame (0)
 	, _aligned (aligned)
 {
 	allocate ();
@@ -987,14 +1079,20 @@ Image::swap (Image & other)
 		std::swap (_stride[i], other._stride[i]);
 	}
 
+	std::swap (_frame, other._frame);
 	std::swap (_aligned, other._aligned);
 }
 
 /** Destroy a Image */
 Image::~Image ()
 {
-	for (int i = 0; i < planes(); ++i) {
-		av_free (_data[i]);
+	if (_frame) {
+		/* Our data belongs to the frame */
+		av_frame_free (&_frame);
+	} else {
+		for (int i = 0; i < planes(); ++i) {
+			BufferPool::instance()->release (_data[i]);
+		}
 	}
 
 	av_free (_data);
@@ -1091,6 +1189,8 @@ operator== (Image const & a, Image const & b)
 void
 Image::fade (float f)
 {
+	make_writable ();
+
 	/* U/V black value for 8-bit colour */
 	static int const eight_bit_uv =    (1 << 7) - 1;
 	/* U/V black value for 10-bit colour */
@@ -1225,6 +1325,26 @@ Image::memory_used () const
 	return m;
 }
 
+/** @return MD5 digest of the pixel format, size and image data (not including any padding) */
+string
+Image::digest () const
+{
+	Digester digester;
+	digester.add (_pixel_format);
+	digester.add (_size.width);
+	digester.add (_size.height);
+
+	for (int i = 0; i < planes(); ++i) {
+		uint8_t* p = _data[i];
+		for (int y = 0; y < sample_size(i).height; ++y) {
+			digester.add (p, _line_size[i]);
+			p += _stride[i];
+		}
+	}
+
+	return digester.get ();
+}
+
 class Memory
 {
 public:
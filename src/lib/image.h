@@ -48,6 +48,10 @@ public:
 	Image& operator= (Image const &);
 	~Image ();
 
+	/** @return Pointers to the data of each plane.  If this Image was made from an AVFrame
+	 *  the data may be shared with the decoder, so it must only be modified by the methods
+	 *  here (which take a private copy first) and not directly.
+	 */
 	uint8_t * const * data () const;
 	int const * line_size () const;
 	int const * stride () const;
@@ -80,6 +84,7 @@ public:
 	}
 
 	size_t memory_used () const;
+	std::string digest () const;
 
 	dcp::Data as_png () const;
 
@@ -91,6 +96,10 @@ private:
 	friend struct pixel_formats_test;
 
 	void allocate ();
+	void allocate_arrays ();
+	bool can_share (AVFrame* frame) const;
+	void copy_planes (uint8_t const * const * data, int const * stride);
+	void make_writable ();
 	void swap (Image &);
 	void make_part_black (int x, int w);
 	void yuv_16_black (uint16_t, bool);
@@ -101,6 +110,10 @@ private:
 	uint8_t** _data; ///< array of pointers to components
 	int* _line_size; ///< array of sizes of the data in each line, in bytes (without any alignment padding bytes)
 	int* _stride; ///< array of strides for each line, in bytes (including any alignment padding bytes)
+	/** frame whose data we are using, or 0 if our data is our own; we make our own copy
+	 *  before modifying anything so as not to disturb the decoder that made the frame.
+	 */
+	AVFrame* _frame;
 	bool _aligned;
 };
 
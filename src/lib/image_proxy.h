@@ -81,6 +81,11 @@ public:
 	 */
 	virtual int prepare (boost::optional<dcp::Size> = boost::optional<dcp::Size>()) const { return 0; }
 	virtual size_t memory_used () const = 0;
+	/** @return Anything about how we will make our image, other than the content and frame
+	 *  that it comes from, which can change what image() returns (e.g. a reduction that a
+	 *  decoder has been told to use).  This is used in keys for caches of images.
+	 */
+	virtual std::string identifier () const { return ""; }
 };
 
 boost::shared_ptr<ImageProxy> image_proxy_factory (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
@@ -35,7 +35,10 @@
 #include "player.h"
 #include "player_video.h"
 #include "encode_server_description.h"
+#include "j2k_frame_cache.h"
 #include "compose.hpp"
+#include "trace.h"
+#include "metrics.h"
 #include <libcxml/cxml.h>
 #include <boost/foreach.hpp>
 #include <iostream>
@@ -45,6 +48,9 @@
 using std::list;
 using std::cout;
 using std::exception;
+using std::string;
+using std::map;
+using std::make_pair;
 using boost::shared_ptr;
 using boost::weak_ptr;
 using boost::optional;
@@ -56,8 +62,17 @@ using dcp::Data;
 J2KEncoder::J2KEncoder (shared_ptr<const Film> film, shared_ptr<Writer> writer)
 	: _film (film)
 	, _history (200)
+	, _threads_started (0)
+	, _threads_stopped (0)
+	, _initial_threads (0)
+	, _pool_created (false)
 	, _writer (writer)
 {
+	Config* config = Config::instance ();
+	if (config->j2k_cache_disk() > 0) {
+		_cache.reset (new J2KFrameCache(config->j2k_cache_directory(), size_t(config->j2k_cache_disk()) * 1024 * 1024));
+	}
+
 	servers_list_changed ();
 }
 
@@ -115,6 +130,8 @@ J2KEncoder::end ()
 
 	terminate_threads ();
 
+	LOG_GENERAL (N_("Encoder pool churn was %1 threads"), pool_churn ());
+
 	LOG_GENERAL (N_("Mopping up %1"), _queue.size());
 
 	/* The following sequence of events can occur in the above code:
@@ -129,16 +146,21 @@ J2KEncoder::end ()
 	for (list<shared_ptr<DCPVideo> >::iterator i = _queue.begin(); i != _queue.end(); ++i) {
 		LOG_GENERAL (N_("Encode left-over frame %1"), (*i)->index ());
 		try {
-			_writer->write (
-				(*i)->encode_locally(),
-				(*i)->index(),
-				(*i)->eyes()
-				);
+			optional<Data> encoded = from_cache (*i);
+			if (!encoded) {
+				encoded = (*i)->encode_locally ();
+				add_to_cache (*i, encoded.get());
+			}
+			_writer->write (encoded.get(), (*i)->index(), (*i)->eyes());
 			frame_done ();
 		} catch (std::exception& e) {
 			LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
 		}
 	}
+
+	if (_cache) {
+		LOG_GENERAL (N_("J2K frame cache: %1 hits, %2 misses"), _cache->hits(), _cache->misses());
+	}
 }
 
 /** @return an estimate of the current number of frames we are encoding per second,
@@ -168,6 +190,85 @@ J2KEncoder::frame_done ()
 	_history.event ();
 }
 
+/** Should be called when an encoder thread has tried to encode a frame.
+ *  @param server Host name of the server that was used, or localhost.
+ *  @param ok true if the frame was encoded.
+ *  @param backoff Time that the thread will now wait between attempts, in seconds.
+ */
+void
+J2KEncoder::note_server_result (string server, bool ok, int backoff)
+{
+	boost::mutex::scoped_lock lm (_server_statistics_mutex);
+	ServerStatistics& s = _server_statistics[server];
+	if (ok) {
+		++s.frames;
+	} else {
+		++s.errors;
+	}
+	s.backoff = backoff;
+}
+
+/** Add the current state of the encoder to a Metrics snapshot */
+void
+J2KEncoder::metrics (Metrics& metrics) const
+{
+	{
+		boost::mutex::scoped_lock lm (_queue_mutex);
+		metrics.add ("dcpomatic_encoder_queue_frames", Metrics::GAUGE, "Frames waiting to be encoded", _queue.size());
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_threads_mutex);
+		metrics.add ("dcpomatic_encoder_threads", Metrics::GAUGE, "Encoder threads, local and remote", threads_unlocked());
+	}
+
+	metrics.add ("dcpomatic_encoder_frames_per_second", Metrics::GAUGE, "Recent rate of encoding", current_encoding_rate());
+
+	boost::mutex::scoped_lock lm (_server_statistics_mutex);
+	for (map<string, ServerStatistics>::const_iterator i = _server_statistics.begin(); i != _server_statistics.end(); ++i) {
+		Metrics::Label const server = make_pair (string ("server"), i->first);
+		metrics.add ("dcpomatic_encode_server_frames_total", Metrics::COUNTER, "Frames encoded by each server", i->second.frames, server);
+		metrics.add ("dcpomatic_encode_server_errors_total", Metrics::COUNTER, "Failed attempts to encode a frame on each server", i->second.errors, server);
+		metrics.add ("dcpomatic_encode_server_backoff_seconds", Metrics::GAUGE, "Time that each server's threads wait between attempts", i->second.backoff, server);
+	}
+}
+
+/** @return J2K data for a frame from our cache, or none if we have no cache or it
+ *  does not have the frame.
+ */
+optional<Data>
+J2KEncoder::from_cache (shared_ptr<const DCPVideo> frame)
+{
+	if (!_cache) {
+		return optional<Data>();
+	}
+
+	TRACE_SCOPE (TRACE_ENCODER, "cache-get", frame->index());
+	optional<string> digest = frame->digest ();
+	if (!digest) {
+		return optional<Data>();
+	}
+
+	return _cache->get (digest.get());
+}
+
+/** Add some encoded data to our cache, if we have one.
+ *  @param frame Frame that was encoded.
+ *  @param data J2K data for the frame.
+ */
+void
+J2KEncoder::add_to_cache (shared_ptr<const DCPVideo> frame, Data data)
+{
+	if (!_cache) {
+		return;
+	}
+
+	optional<string> digest = frame->digest ();
+	if (digest) {
+		_cache->put (digest.get(), data);
+	}
+}
+
 /** Called to request encoding of the next video frame in the DCP.  This is called in order,
  *  so each time the supplied frame is the one after the previous one.
  *  pv represents one video frame, and could be empty if there is nothing to encode
@@ -184,7 +285,7 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	size_t threads = 0;
 	{
 		boost::mutex::scoped_lock threads_lock (_threads_mutex);
-		threads = _threads.size ();
+		threads = threads_unlocked ();
 	}
 
 	boost::mutex::scoped_lock queue_lock (_queue_mutex);
@@ -193,9 +294,8 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	   when there are no threads.
 	*/
 	while (_queue.size() >= (threads * 2) + 1) {
-		LOG_TIMING ("decoder-sleep queue=%1 threads=%2", _queue.size(), threads);
+		TRACE_SCOPE (TRACE_ENCODER, "queue-full");
 		_full_condition.wait (queue_lock);
-		LOG_TIMING ("decoder-wake queue=%1 threads=%2", _queue.size(), threads);
 	}
 
 	_writer->rethrow ();
@@ -221,8 +321,9 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 		_writer->repeat (position, pv->eyes ());
 	} else {
 		LOG_DEBUG_ENCODE("Frame @ %1 ENCODE", to_string(time));
-		/* Queue this new frame for encoding */
-		LOG_TIMING ("add-frame-to-queue queue=%1", _queue.size ());
+		/* Queue this new frame for encoding; the encoder threads will look for it in
+		   our cache first.
+		*/
 		_queue.push_back (shared_ptr<DCPVideo> (
 					  new DCPVideo (
 						  pv,
@@ -232,6 +333,7 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 						  _film->resolution()
 						  )
 					  ));
+		TRACE_COUNTER (TRACE_ENCODER, "queue", _queue.size());
 
 		/* The queue might not be empty any more, so notify anything which is
 		   waiting on that.
@@ -243,21 +345,49 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	_last_player_video_time = time;
 }
 
+/** Stop and delete all our encoder threads */
 void
 J2KEncoder::terminate_threads ()
 {
 	boost::mutex::scoped_lock threads_lock (_threads_mutex);
 
+	terminate_threads (_local_threads, _local_threads.size());
+
+	for (std::map<string, list<boost::thread *> >::iterator i = _remote_threads.begin(); i != _remote_threads.end(); ++i) {
+		terminate_threads (i->second, i->second.size());
+	}
+
+	_remote_threads.clear ();
+}
+
+/** Stop and delete some threads from the end of a list.  Caller must hold a lock on _threads_mutex.
+ *  @param threads List of threads.
+ *  @param count Number of threads to remove from the end of the list.
+ *  @return Number of threads that were stopped.
+ */
+int
+J2KEncoder::terminate_threads (list<boost::thread *>& threads, int count)
+{
+	list<boost::thread *> doomed;
+	for (int i = 0; i < count && !threads.empty(); ++i) {
+		doomed.push_front (threads.back ());
+		threads.pop_back ();
+	}
+
+	/* Interrupt them all first so that they can stop in parallel */
+	BOOST_FOREACH (boost::thread* i, doomed) {
+		i->interrupt ();
+	}
+
 	int n = 0;
-	for (list<boost::thread *>::iterator i = _threads.begin(); i != _threads.end(); ++i) {
-		/* Be careful not to throw in here otherwise _threads will not be clear()ed */
-		LOG_GENERAL ("Terminating thread %1 of %2", n + 1, _threads.size ());
-		(*i)->interrupt ();
-		if (!(*i)->joinable()) {
+	BOOST_FOREACH (boost::thread* i, doomed) {
+		/* Be careful not to throw in here otherwise we will leak threads */
+		LOG_GENERAL ("Terminating thread %1 of %2", n + 1, doomed.size ());
+		if (!i->joinable()) {
 			LOG_ERROR_NC ("About to join() a non-joinable thread");
 		}
 		try {
-			(*i)->join ();
+			i->join ();
 		} catch (boost::thread_interrupted& e) {
 			/* This is to be expected (I think?) */
 		} catch (exception& e) {
@@ -265,12 +395,33 @@ J2KEncoder::terminate_threads ()
 		} catch (...) {
 			LOG_ERROR_NC ("join() threw an exception");
 		}
-		delete *i;
+		delete i;
 		LOG_GENERAL_NC ("Thread terminated");
 		++n;
 	}
 
-	_threads.clear ();
+	return n;
+}
+
+/** @return Total number of encoder threads.  Caller must hold a lock on _threads_mutex */
+int
+J2KEncoder::threads_unlocked () const
+{
+	int n = _local_threads.size ();
+	for (std::map<string, list<boost::thread *> >::const_iterator i = _remote_threads.begin(); i != _remote_threads.end(); ++i) {
+		n += i->second.size ();
+	}
+	return n;
+}
+
+/** @return Number of encoder threads that have been started or stopped since the pool was
+ *  first set up; a high number suggests that encode servers keep coming and going.
+ */
+int
+J2KEncoder::pool_churn () const
+{
+	boost::mutex::scoped_lock lm (_threads_mutex);
+	return _threads_started + _threads_stopped - _initial_threads;
 }
 
 void
@@ -291,13 +442,12 @@ try
 
 	while (true) {
 
-		LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
 		boost::mutex::scoped_lock lock (_queue_mutex);
 		while (_queue.empty ()) {
+			TRACE_SCOPE (TRACE_ENCODER, "sleep");
 			_empty_condition.wait (lock);
 		}
 
-		LOG_TIMING ("encoder-wake thread=%1 queue=%2", thread_id(), _queue.size());
 		shared_ptr<DCPVideo> vf = _queue.front ();
 
 		/* We're about to commit to either encoding this frame or putting it back onto the queue,
@@ -307,16 +457,23 @@ try
 		{
 			boost::this_thread::disable_interruption dis;
 
-			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), (int) vf->eyes ());
 			_queue.pop_front ();
+			TRACE_COUNTER (TRACE_ENCODER, "queue", _queue.size());
 
 			lock.unlock ();
 
-			optional<Data> encoded;
+			/* See if an identical frame was encoded previously (perhaps for a different
+			   version of this film); this may read from disk, so it is done here rather
+			   than holding up encode().
+			*/
+			optional<Data> encoded = from_cache (vf);
+			bool const cached = static_cast<bool> (encoded);
 
-			/* We need to encode this input */
-			if (server) {
+			if (cached) {
+				LOG_DEBUG_ENCODE("Frame %1 CACHED", vf->index());
+			} else if (server) {
 				try {
+					TRACE_SCOPE (TRACE_ENCODER, "remote-encode", vf->index());
 					encoded = vf->encode_remotely (server.get ());
 
 					if (remote_backoff > 0) {
@@ -325,6 +482,7 @@ try
 
 					/* This job succeeded, so remove any backoff */
 					remote_backoff = 0;
+					note_server_result (server->host_name(), true, remote_backoff);
 
 				} catch (std::exception& e) {
 					if (remote_backoff < 60) {
@@ -335,13 +493,14 @@ try
 						N_("Remote encode of %1 on %2 failed (%3); thread sleeping for %4s"),
 						vf->index(), server->host_name(), e.what(), remote_backoff
 						);
+					note_server_result (server->host_name(), false, remote_backoff);
 				}
 
 			} else {
 				try {
-					LOG_TIMING ("start-local-encode thread=%1 frame=%2", thread_id(), vf->index());
+					TRACE_SCOPE (TRACE_ENCODER, "local-encode", vf->index());
 					encoded = vf->encode_locally ();
-					LOG_TIMING ("finish-local-encode thread=%1 frame=%2", thread_id(), vf->index());
+					note_server_result ("localhost", true, 0);
 				} catch (std::exception& e) {
 					/* This is very bad, so don't cope with it, just pass it on */
 					LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
@@ -352,6 +511,9 @@ try
 			if (encoded) {
 				_writer->write (encoded.get(), vf->index (), vf->eyes ());
 				frame_done ();
+				if (!cached) {
+					add_to_cache (vf, encoded.get());
+				}
 			} else {
 				lock.lock ();
 				LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), vf->index());
@@ -380,32 +542,39 @@ catch (...)
 	_full_condition.notify_all ();
 }
 
+/** Make our set of encoder threads match the current configuration and list of encode servers,
+ *  starting or stopping only those threads that need it.
+ */
 void
 J2KEncoder::servers_list_changed ()
 {
-	terminate_threads ();
-
-	/* XXX: could re-use threads */
-
 	boost::mutex::scoped_lock lm (_threads_mutex);
 
+	int const started = _threads_started;
+	int const stopped = _threads_stopped;
+
+	int const local = Config::instance()->only_servers_encode() ? 0 : Config::instance()->master_encoding_threads();
+	int const current_local = _local_threads.size ();
+	if (local < current_local) {
+		LOG_GENERAL (N_("Removing %1 local worker threads"), current_local - local);
+		_threads_stopped += terminate_threads (_local_threads, current_local - local);
+	} else if (local > current_local) {
 #ifdef BOOST_THREAD_PLATFORM_WIN32
-	OSVERSIONINFO info;
-	info.dwOSVersionInfoSize = sizeof (OSVERSIONINFO);
-	GetVersionEx (&info);
-	bool const windows_xp = (info.dwMajorVersion == 5 && info.dwMinorVersion == 1);
-	if (windows_xp) {
-		LOG_GENERAL_NC (N_("Setting thread affinity for Windows XP"));
-	}
+		OSVERSIONINFO info;
+		info.dwOSVersionInfoSize = sizeof (OSVERSIONINFO);
+		GetVersionEx (&info);
+		bool const windows_xp = (info.dwMajorVersion == 5 && info.dwMinorVersion == 1);
+		if (windows_xp) {
+			LOG_GENERAL_NC (N_("Setting thread affinity for Windows XP"));
+		}
 #endif
-
-	if (!Config::instance()->only_servers_encode ()) {
-		for (int i = 0; i < Config::instance()->master_encoding_threads (); ++i) {
+		for (int i = current_local; i < local; ++i) {
 			boost::thread* t = new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription> ()));
 #ifdef DCPOMATIC_LINUX
 			pthread_setname_np (t->native_handle(), "encode-worker");
 #endif
-			_threads.push_back (t);
+			_local_threads.push_back (t);
+			++_threads_started;
 #ifdef BOOST_THREAD_PLATFORM_WIN32
 			if (windows_xp) {
 				SetThreadAffinityMask (t->native_handle(), 1 << i);
@@ -414,16 +583,53 @@ J2KEncoder::servers_list_changed ()
 		}
 	}
 
+	/* Servers that we can use, keyed by host name */
+	std::map<string, EncodeServerDescription> wanted;
 	BOOST_FOREACH (EncodeServerDescription i, EncodeServerFinder::instance()->servers()) {
-		if (!i.current_link_version()) {
-			continue;
+		if (i.current_link_version()) {
+			wanted[i.host_name()] = i;
+		}
+	}
+
+	/* Stop threads for servers that have gone away */
+	std::map<string, list<boost::thread *> >::iterator r = _remote_threads.begin ();
+	while (r != _remote_threads.end()) {
+		std::map<string, list<boost::thread *> >::iterator tmp = r;
+		++tmp;
+		if (wanted.find(r->first) == wanted.end()) {
+			LOG_GENERAL (N_("Removing %1 worker threads for remote %2"), r->second.size(), r->first);
+			_threads_stopped += terminate_threads (r->second, r->second.size());
+			_remote_threads.erase (r);
 		}
+		r = tmp;
+	}
 
-		LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), i.threads(), i.host_name ());
-		for (int j = 0; j < i.threads(); ++j) {
-			_threads.push_back (new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, i)));
+	/* Add or remove threads for servers that are new or have changed */
+	for (std::map<string, EncodeServerDescription>::const_iterator i = wanted.begin(); i != wanted.end(); ++i) {
+		list<boost::thread *>& threads = _remote_threads[i->first];
+		int const current = threads.size ();
+		if (i->second.threads() < current) {
+			LOG_GENERAL (N_("Removing %1 worker threads for remote %2"), current - i->second.threads(), i->first);
+			_threads_stopped += terminate_threads (threads, current - i->second.threads());
+		} else if (i->second.threads() > current) {
+			LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), i->second.threads() - current, i->first);
+			for (int j = current; j < i->second.threads(); ++j) {
+				threads.push_back (new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, i->second)));
+				++_threads_started;
+			}
 		}
 	}
 
-	_writer->set_encoder_threads (_threads.size ());
+	if (!_pool_created) {
+		_initial_threads = _threads_started;
+		_pool_created = true;
+	} else if (_threads_started != started || _threads_stopped != stopped) {
+		LOG_GENERAL (
+			N_("Encoder pool changed: %1 threads started, %2 stopped; %3 local threads and %4 remote servers; churn now %5"),
+			_threads_started - started, _threads_stopped - stopped, _local_threads.size(), _remote_threads.size(),
+			_threads_started + _threads_stopped - _initial_threads
+			);
+	}
+
+	_writer->set_encoder_threads (threads_unlocked ());
 }
@@ -37,6 +37,7 @@
 #include <boost/signals2.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <list>
+#include <map>
 #include <stdint.h>
 
 class Film;
@@ -45,6 +46,12 @@ class DCPVideo;
 class Writer;
 class Job;
 class PlayerVideo;
+class J2KFrameCache;
+class Metrics;
+
+namespace dcp {
+	class Data;
+}
 
 /** @class J2KEncoder
  *  @brief Class to manage encoding to J2K.
@@ -72,24 +79,42 @@ public:
 	int video_frames_enqueued () const;
 
 	void servers_list_changed ();
+	int pool_churn () const;
+
+	void metrics (Metrics& metrics) const;
 
 private:
 
 	static void call_servers_list_changed (boost::weak_ptr<J2KEncoder> encoder);
 
 	void frame_done ();
+	void note_server_result (std::string server, bool ok, int backoff);
+	boost::optional<dcp::Data> from_cache (boost::shared_ptr<const DCPVideo> frame);
+	void add_to_cache (boost::shared_ptr<const DCPVideo> frame, dcp::Data data);
 
 	void encoder_thread (boost::optional<EncodeServerDescription>);
 	void terminate_threads ();
+	int terminate_threads (std::list<boost::thread *>& threads, int count);
+	int threads_unlocked () const;
 
 	/** Film that we are encoding */
 	boost::shared_ptr<const Film> _film;
 
 	EventHistory _history;
 
-	/** Mutex for _threads */
+	/** Mutex for _local_threads, _remote_threads and the counts of threads that have been started and stopped */
 	mutable boost::mutex _threads_mutex;
-	std::list<boost::thread *> _threads;
+	/** Threads which encode on this machine */
+	std::list<boost::thread *> _local_threads;
+	/** Threads which send frames to remote servers, keyed by the server's host name */
+	std::map<std::string, std::list<boost::thread *> > _remote_threads;
+	/** Total number of encoder threads that we have started */
+	int _threads_started;
+	/** Total number of encoder threads that we have stopped because of a configuration or server change */
+	int _threads_stopped;
+	/** Number of threads that were started when the pool was first set up */
+	int _initial_threads;
+	bool _pool_created;
 	mutable boost::mutex _queue_mutex;
 	std::list<boost::shared_ptr<DCPVideo> > _queue;
 	/** condition to manage thread wakeups when we have nothing to do */
@@ -99,11 +124,34 @@ private:
 
 	boost::shared_ptr<Writer> _writer;
 	Waker _waker;
+	/** Cache of encoded frames from previous encodes, or 0 */
+	boost::shared_ptr<J2KFrameCache> _cache;
 
 	boost::shared_ptr<PlayerVideo> _last_player_video[EYES_COUNT];
 	boost::optional<DCPTime> _last_player_video_time;
 
 	boost::signals2::scoped_connection _server_found_connection;
+
+	struct ServerStatistics
+	{
+		ServerStatistics ()
+			: frames (0)
+			, errors (0)
+			, backoff (0)
+		{}
+
+		/** number of frames encoded */
+		int64_t frames;
+		/** number of failed attempts to encode a frame */
+		int64_t errors;
+		/** current time that threads wait between attempts, in seconds */
+		int backoff;
+	};
+
+	/** mutex to protect _server_statistics */
+	mutable boost::mutex _server_statistics_mutex;
+	/** statistics for each server that we have used, keyed by host name (localhost for this machine) */
+	std::map<std::string, ServerStatistics> _server_statistics;
 };
 
 #endif
@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "j2k_frame_cache.h"
+#include "cross.h"
+#include "util.h"
+#include "exceptions.h"
+#include "dcpomatic_log.h"
+#include <boost/bind.hpp>
+
+using std::string;
+using boost::optional;
+using boost::bind;
+using dcp::Data;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
+
+/** @param directory Directory to keep frames in.
+ *  @param limit Maximum total size of frames to keep, in bytes.
+ */
+J2KFrameCache::J2KFrameCache (boost::filesystem::path directory, size_t limit)
+	: _disk (directory, limit, true)
+	, _hits (0)
+	, _misses (0)
+{
+
+}
+
+/** @return Cached J2K data with the given key, or none if there is none.  This may read
+ *  from disk so it should not be called from anywhere that must not wait.
+ */
+optional<Data>
+J2KFrameCache::get (string key)
+{
+	optional<Data> data;
+
+	if (_disk.has(key)) {
+		/* The file may be evicted before we read it, in which case the read will fail */
+		boost::filesystem::path const f = _disk.file (key);
+		try {
+			FILE* file = fopen_boost (f, "rb");
+			if (!file) {
+				throw OpenFileError (f, errno, OpenFileError::READ);
+			}
+			Data d (boost::filesystem::file_size(f));
+			/* checked_fread closes the file if it fails */
+			checked_fread (d.data().get(), d.size(), file, f);
+			fclose (file);
+			/* Check for the start-of-codestream marker */
+			if (d.size() >= 2 && d.data()[0] == 0xff && d.data()[1] == 0x4f) {
+				data = d;
+			}
+		} catch (std::exception& e) {
+			LOG_WARNING ("Could not read cached J2K frame %1 (%2)", key, e.what());
+		}
+
+		if (data) {
+			_disk.touch (key);
+		} else {
+			_disk.forget (key);
+		}
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	if (data) {
+		++_hits;
+	} else {
+		++_misses;
+	}
+	return data;
+}
+
+static void
+write_data (Data data, FILE* file, boost::filesystem::path path)
+{
+	checked_fwrite (data.data().get(), data.size(), file, path);
+}
+
+/** Add some J2K data to the cache */
+void
+J2KFrameCache::put (string key, Data data)
+{
+	try {
+		_disk.write (key, bind(&write_data, data, _1, _2));
+	} catch (std::exception& e) {
+		LOG_WARNING ("Could not write cached J2K frame %1 (%2)", key, e.what());
+	}
+}
+
+/** Remove everything from the cache */
+void
+J2KFrameCache::clear ()
+{
+	_disk.clear ();
+}
+
+size_t
+J2KFrameCache::disk_used () const
+{
+	return _disk.used ();
+}
+
+int
+J2KFrameCache::hits () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _hits;
+}
+
+int
+J2KFrameCache::misses () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _misses;
+}
@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_J2K_FRAME_CACHE_H
+#define DCPOMATIC_J2K_FRAME_CACHE_H
+
+#include "disk_cache.h"
+#include <dcp/data.h>
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <string>
+
+/** @class J2KFrameCache
+ *  @brief An on-disk cache of encoded JPEG2000 frames, keyed by a digest of everything that
+ *  went into making them (see DCPVideo::digest).
+ *
+ *  This lets a DCP be re-made without re-encoding frames that have not changed, even if the
+ *  changes that were made (e.g. to trim or position) mean that the previous encode can no longer
+ *  be re-used as a whole.  Frames are kept as plain J2K codestreams, with the least-recently used
+ *  ones being removed when the cache's size limit is reached.
+ */
+class J2KFrameCache : public boost::noncopyable
+{
+public:
+	J2KFrameCache (boost::filesystem::path directory, size_t limit);
+
+	boost::optional<dcp::Data> get (std::string key);
+	void put (std::string key, dcp::Data data);
+	void clear ();
+
+	size_t disk_used () const;
+
+	int hits () const;
+	int misses () const;
+
+private:
+	DiskCache _disk;
+
+	/** Mutex to protect _hits and _misses */
+	mutable boost::mutex _mutex;
+	int _hits;
+	int _misses;
+};
+
+#endif
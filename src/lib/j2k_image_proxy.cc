@@ -31,6 +31,9 @@
 #include <dcp/j2k.h>
 #include <libcxml/cxml.h>
 #include <libxml++/libxml++.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <iostream>
 
 #include "i18n.h"
@@ -113,6 +116,78 @@ J2KImageProxy::J2KImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 	socket->read (_data.data().get (), _data.size ());
 }
 
+#ifdef __SSE2__
+/** Shift 8 samples left and keep the bottom 16 bits of each, as a cast to uint16_t would */
+static inline __m128i
+shift_and_pack (int const * p, __m128i count)
+{
+	/* Sign-extend the bottom 16 bits of each sample so that the signed saturation in
+	   _mm_packs_epi32 never changes anything.
+	*/
+	__m128i const a = _mm_srai_epi32 (_mm_slli_epi32 (_mm_sll_epi32 (_mm_loadu_si128 ((__m128i const *) p), count), 16), 16);
+	__m128i const b = _mm_srai_epi32 (_mm_slli_epi32 (_mm_sll_epi32 (_mm_loadu_si128 ((__m128i const *) (p + 4)), count), 16), 16);
+	return _mm_packs_epi32 (a, b);
+}
+#endif
+
+/** Shift three planes of decoded JPEG2000 samples and interleave them into a line of 16-bit pixels.
+ *  Any bits which are shifted beyond 16 are lost.
+ *  @param n Number of pixels.
+ *  @param shift Left-shift to apply to each sample.
+ */
+void
+J2KImageProxy::interleave_planes (int const * p0, int const * p1, int const * p2, uint16_t* out, int n, int shift)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	/* Do 8 pixels at a time */
+	__m128i const zero = _mm_setzero_si128 ();
+	__m128i const count = _mm_cvtsi32_si128 (shift);
+
+	for (; x <= n - 8; x += 8) {
+		__m128i const r = shift_and_pack (p0 + x, count);
+		__m128i const g = shift_and_pack (p1 + x, count);
+		__m128i const b = shift_and_pack (p2 + x, count);
+
+		/* Make 64-bit pixels of R, G, B, 0; two to each register */
+		__m128i const rg_lo = _mm_unpacklo_epi16 (r, g);
+		__m128i const rg_hi = _mm_unpackhi_epi16 (r, g);
+		__m128i const b_lo = _mm_unpacklo_epi16 (b, zero);
+		__m128i const b_hi = _mm_unpackhi_epi16 (b, zero);
+		__m128i const q0 = _mm_unpacklo_epi32 (rg_lo, b_lo);
+		__m128i const q1 = _mm_unpackhi_epi32 (rg_lo, b_lo);
+		__m128i const q2 = _mm_unpacklo_epi32 (rg_hi, b_hi);
+		__m128i const q3 = _mm_unpackhi_epi32 (rg_hi, b_hi);
+
+		/* Squeeze out the padding to make 48-bit pixels */
+		__m128i const o0 = _mm_or_si128 (
+			_mm_or_si128 (_mm_move_epi64 (q0), _mm_slli_si128 (_mm_srli_si128 (q0, 8), 6)),
+			_mm_slli_si128 (q1, 12)
+			);
+		__m128i const o1 = _mm_or_si128 (
+			_mm_or_si128 (_mm_srli_si128 (_mm_move_epi64 (q1), 4), _mm_slli_si128 (_mm_srli_si128 (q1, 8), 2)),
+			_mm_or_si128 (_mm_slli_si128 (_mm_move_epi64 (q2), 8), _mm_slli_si128 (_mm_srli_si128 (q2, 8), 14))
+			);
+		__m128i const o2 = _mm_or_si128 (
+			_mm_or_si128 (_mm_srli_si128 (q2, 10), _mm_slli_si128 (_mm_move_epi64 (q3), 4)),
+			_mm_slli_si128 (_mm_srli_si128 (q3, 8), 10)
+			);
+
+		_mm_storeu_si128 ((__m128i *) out, o0);
+		_mm_storeu_si128 ((__m128i *) (out + 8), o1);
+		_mm_storeu_si128 ((__m128i *) (out + 16), o2);
+		out += 24;
+	}
+#endif
+
+	for (; x < n; ++x) {
+		*out++ = p0[x] << shift;
+		*out++ = p1[x] << shift;
+		*out++ = p2[x] << shift;
+	}
+}
+
 int
 J2KImageProxy::prepare (optional<dcp::Size> target_size) const
 {
@@ -147,18 +222,13 @@ J2KImageProxy::prepare (optional<dcp::Size> target_size) const
 
 	int const width = decompressed->size().width;
 
-	int p = 0;
 	int* decomp_0 = decompressed->data (0);
 	int* decomp_1 = decompressed->data (1);
 	int* decomp_2 = decompressed->data (2);
 	for (int y = 0; y < decompressed->size().height; ++y) {
+		int const p = y * width;
 		uint16_t* q = (uint16_t *) (_image->data()[0] + y * _image->stride()[0]);
-		for (int x = 0; x < width; ++x) {
-			*q++ = decomp_0[p] << shift;
-			*q++ = decomp_1[p] << shift;
-			*q++ = decomp_2[p] << shift;
-			++p;
-		}
+		interleave_planes (decomp_0 + p, decomp_1 + p, decomp_2 + p, q, width, shift);
 	}
 
 	_target_size = target_size;
@@ -219,6 +289,16 @@ J2KImageProxy::J2KImageProxy (Data data, dcp::Size size, AVPixelFormat pixel_for
 	DCPOMATIC_ASSERT (_pixel_format == AV_PIX_FMT_RGB48 || _pixel_format == AV_PIX_FMT_XYZ12LE);
 }
 
+string
+J2KImageProxy::identifier () const
+{
+	if (!_forced_reduction) {
+		return "";
+	}
+
+	return "reduction_" + raw_convert<string> (_forced_reduction.get());
+}
+
 size_t
 J2KImageProxy::memory_used () const
 {
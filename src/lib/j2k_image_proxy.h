@@ -69,13 +69,17 @@ public:
 	}
 
 	size_t memory_used () const;
+	std::string identifier () const;
 
 private:
 	friend struct client_server_test_j2k;
+	friend struct j2k_image_proxy_interleave_test;
 
 	/* For tests */
 	J2KImageProxy (dcp::Data data, dcp::Size size, AVPixelFormat pixel_format);
 
+	static void interleave_planes (int const * p0, int const * p1, int const * p2, uint16_t* out, int n, int shift);
+
 	dcp::Data _data;
 	dcp::Size _size;
 	boost::optional<dcp::Eye> _eye;
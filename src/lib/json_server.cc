@@ -24,16 +24,23 @@
 #include "util.h"
 #include "film.h"
 #include "transcode_job.h"
+#include "trace.h"
+#include "metrics.h"
+#include "cross.h"
+#include "buffer_pool.h"
 #include <dcp/raw_convert.h>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 
 using std::string;
 using std::cout;
 using std::map;
 using std::list;
+using std::make_pair;
+using boost::optional;
 using boost::thread;
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
@@ -157,7 +164,14 @@ JSONServer::request (string url, shared_ptr<tcp::socket> socket)
 	}
 
 	string json;
-	if (action == "status") {
+	string content_type = "application/json";
+	if (url == "/metrics" || url.substr(0, 9) == "/metrics?") {
+		/* This is where Prometheus looks by default */
+		json = metrics().prometheus ();
+		content_type = "text/plain; version=0.0.4";
+	} else if (action == "metrics") {
+		json = metrics().json ();
+	} else if (action == "status") {
 
 		list<shared_ptr<Job> > jobs = JobManager::instance()->get ();
 
@@ -186,13 +200,59 @@ JSONServer::request (string url, shared_ptr<tcp::socket> socket)
 			}
 		}
 		json += "] }";
+	} else if (action == "trace-start") {
+		Trace::instance()->clear ();
+		Trace::instance()->set_enabled (true);
+		json = "{ \"tracing\": true }";
+	} else if (action == "trace-stop") {
+		Trace::instance()->set_enabled (false);
+		json = "{ \"tracing\": false }";
+	} else if (action == "trace") {
+		/* Events so far in a format that chrome://tracing or Perfetto can load */
+		json = Trace::instance()->chrome_json ();
 	}
 
 	string reply = "HTTP/1.1 200 OK\r\n"
 		"Content-Length: " + raw_convert<string>(json.length()) + "\r\n"
-		"Content-Type: application/json\r\n"
+		"Content-Type: " + content_type + "\r\n"
 		"\r\n"
 		+ json + "\r\n";
 	cout << "reply: " << json << "\n";
 	boost::asio::write (*socket, boost::asio::buffer (reply.c_str(), reply.length()));
 }
+
+/** @return Snapshot of what this process is doing; this is cheap enough to be taken every few seconds
+ *  during an encode.
+ */
+Metrics
+JSONServer::metrics () const
+{
+	Metrics m;
+
+	optional<size_t> memory = resident_memory ();
+	if (memory) {
+		m.add ("dcpomatic_resident_memory_bytes", Metrics::GAUGE, "Physical memory used by this process", *memory);
+	}
+
+	BufferPool::instance()->metrics (m);
+
+	int waiting = 0;
+	int running = 0;
+	list<shared_ptr<Job> > jobs = JobManager::instance()->get ();
+	BOOST_FOREACH (shared_ptr<Job> i, jobs) {
+		if (i->is_new ()) {
+			++waiting;
+		} else if (i->running ()) {
+			++running;
+			shared_ptr<TranscodeJob> t = dynamic_pointer_cast<TranscodeJob> (i);
+			if (t) {
+				t->metrics (m);
+			}
+		}
+	}
+
+	m.add ("dcpomatic_jobs", Metrics::GAUGE, "Jobs in each state", waiting, make_pair (string ("state"), string ("waiting")));
+	m.add ("dcpomatic_jobs", Metrics::GAUGE, "Jobs in each state", running, make_pair (string ("state"), string ("running")));
+
+	return m;
+}
@@ -20,6 +20,8 @@
 
 #include <boost/asio.hpp>
 
+class Metrics;
+
 class JSONServer
 {
 public:
@@ -29,4 +31,5 @@ private:
 	void run (int port);
 	void handle (boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
 	void request (std::string url, boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
+	Metrics metrics () const;
 };
@@ -0,0 +1,299 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "kdm_batch.h"
+#include "film.h"
+#include "config.h"
+#include "cinema.h"
+#include "screen.h"
+#include "dcp_content.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include "dcpomatic_log.h"
+#include <dcp/cpl.h>
+#include <dcp/certificate_chain.h>
+#include <dcp/decrypted_kdm.h>
+#include <dcp/reel_mxf.h>
+#include <dcp/reel_asset.h>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+#include "i18n.h"
+
+using std::string;
+using std::list;
+using std::vector;
+using std::map;
+using std::runtime_error;
+using boost::shared_ptr;
+using boost::optional;
+using boost::dynamic_pointer_cast;
+
+/** Prepare to make KDMs for a CPL that a film has made.
+ *  @param film Film.
+ *  @param cpl_file Path to CPL to make KDMs for.
+ */
+KDMBatch::KDMBatch (shared_ptr<const Film> film, boost::filesystem::path cpl_file)
+	: _signer (Config::instance()->signer_chain ())
+	, _next (0)
+	, _done (0)
+{
+	if (!film->encrypted ()) {
+		throw runtime_error (_("Cannot make a KDM as this project is not encrypted."));
+	}
+
+	if (!_signer->valid ()) {
+		throw InvalidSignerError ();
+	}
+
+	shared_ptr<const dcp::CPL> cpl (new dcp::CPL (cpl_file));
+
+	/* Find keys that have been added to imported, encrypted DCP content */
+	list<dcp::DecryptedKDMKey> imported_keys;
+	BOOST_FOREACH (shared_ptr<Content> i, film->content()) {
+		shared_ptr<DCPContent> d = dynamic_pointer_cast<DCPContent> (i);
+		if (d && d->kdm()) {
+			dcp::DecryptedKDM kdm (d->kdm().get(), Config::instance()->decryption_chain()->key().get());
+			list<dcp::DecryptedKDMKey> keys = kdm.keys ();
+			copy (keys.begin(), keys.end(), back_inserter (imported_keys));
+		}
+	}
+
+	map<shared_ptr<const dcp::ReelMXF>, dcp::Key> keys;
+
+	BOOST_FOREACH(shared_ptr<const dcp::ReelAsset> i, cpl->reel_assets ()) {
+		shared_ptr<const dcp::ReelMXF> mxf = boost::dynamic_pointer_cast<const dcp::ReelMXF> (i);
+		if (!mxf || !mxf->key_id()) {
+			continue;
+		}
+
+		/* Get any imported key for this ID */
+		bool done = false;
+		BOOST_FOREACH (dcp::DecryptedKDMKey j, imported_keys) {
+			if (j.id() == mxf->key_id().get()) {
+				LOG_GENERAL ("Using imported key for %1", mxf->key_id().get());
+				keys[mxf] = j.key();
+				done = true;
+			}
+		}
+
+		if (!done) {
+			/* No imported key; it must be an asset that we encrypted */
+			LOG_GENERAL ("Using our own key for %1", mxf->key_id().get());
+			keys[mxf] = film->key();
+		}
+	}
+
+	/* Make a KDM just to turn our keys into DecryptedKDMKeys with the right types and CPL ID */
+	dcp::DecryptedKDM kdm (cpl->id(), keys, dcp::LocalTime(), dcp::LocalTime(), "", "", "");
+	_keys = kdm.keys ();
+	_annotation_text = _content_title_text = cpl->content_title_text ();
+}
+
+/** Prepare to make KDMs from the keys in a DKDM */
+KDMBatch::KDMBatch (dcp::DecryptedKDM dkdm)
+	: _annotation_text (dkdm.annotation_text().get_value_or(""))
+	, _content_title_text (dkdm.content_title_text())
+	, _keys (dkdm.keys())
+	, _signer (Config::instance()->signer_chain ())
+	, _next (0)
+	, _done (0)
+{
+	if (!_signer->valid ()) {
+		throw InvalidSignerError ();
+	}
+}
+
+/** Make a KDM for one recipient.  This may be called from several threads at once.
+ *  @param from KDM from time.
+ *  @param until KDM to time.
+ *  @param formulation KDM formulation to use.
+ *  @param disable_forensic_marking_picture true to disable forensic marking of picture.
+ *  @param disable_forensic_marking_audio if not set, don't disable forensic marking of audio.  If set to 0,
+ *  disable all forensic marking; if set above 0, disable forensic marking above that channel.
+ */
+dcp::EncryptedKDM
+KDMBatch::make (
+	dcp::Certificate recipient,
+	vector<string> trusted_devices,
+	dcp::LocalTime from,
+	dcp::LocalTime until,
+	dcp::Formulation formulation,
+	bool disable_forensic_marking_picture,
+	optional<int> disable_forensic_marking_audio
+	) const
+{
+	return make (_signer, recipient, trusted_devices, from, until, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio);
+}
+
+/** Make a KDM for one recipient, signing it with a given chain */
+dcp::EncryptedKDM
+KDMBatch::make (
+	shared_ptr<const dcp::CertificateChain> signer,
+	dcp::Certificate recipient,
+	vector<string> trusted_devices,
+	dcp::LocalTime from,
+	dcp::LocalTime until,
+	dcp::Formulation formulation,
+	bool disable_forensic_marking_picture,
+	optional<int> disable_forensic_marking_audio
+	) const
+{
+	dcp::DecryptedKDM kdm (from, until, _annotation_text, _content_title_text, dcp::LocalTime().as_string());
+	BOOST_FOREACH (dcp::DecryptedKDMKey const & i, _keys) {
+		kdm.add_key (i);
+	}
+
+	return kdm.encrypt (signer, recipient, trusted_devices, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio);
+}
+
+/** Make KDMs for some screens, using a number of threads.  Screens without a recipient are skipped.
+ *  @param screens Screens to make KDMs for.
+ *  @param from KDM from time expressed as a local time in the time zone of the Screen's Cinema.
+ *  @param until KDM to time expressed as a local time in the time zone of the Screen's Cinema.
+ *  @param threads Number of threads to use.
+ *  @param progress Function to call with the proportion of KDMs that have been made; this will be
+ *  called from the threads, but never from more than one at a time.
+ *  @return KDMs in the same order as the screens.
+ */
+list<ScreenKDM>
+KDMBatch::make (
+	list<shared_ptr<Screen> > screens,
+	boost::posix_time::ptime from,
+	boost::posix_time::ptime until,
+	dcp::Formulation formulation,
+	bool disable_forensic_marking_picture,
+	optional<int> disable_forensic_marking_audio,
+	int threads,
+	boost::function<void (float)> progress
+	)
+{
+	vector<shared_ptr<Screen> > with_recipients;
+	BOOST_FOREACH (shared_ptr<Screen> i, screens) {
+		if (i->has_recipient ()) {
+			with_recipients.push_back (i);
+		}
+	}
+
+	vector<shared_ptr<dcp::EncryptedKDM> > kdms (with_recipients.size());
+
+	_next = 0;
+	_done = 0;
+
+	boost::thread_group pool;
+	for (int i = 0; i < std::max (1, std::min (threads, int (with_recipients.size()))); ++i) {
+		pool.create_thread (
+			boost::bind (
+				&KDMBatch::thread, this, boost::cref(with_recipients), boost::ref(kdms), from, until, formulation,
+				disable_forensic_marking_picture, disable_forensic_marking_audio, progress
+				)
+			);
+	}
+
+	try {
+		pool.join_all ();
+	} catch (boost::thread_interrupted &) {
+		/* We have been interrupted (e.g. our job has been cancelled) so stop the pool too */
+		pool.interrupt_all ();
+		pool.join_all ();
+		throw;
+	}
+
+	rethrow ();
+
+	list<ScreenKDM> out;
+	for (size_t i = 0; i < with_recipients.size(); ++i) {
+		DCPOMATIC_ASSERT (kdms[i]);
+		out.push_back (ScreenKDM (with_recipients[i], *kdms[i]));
+	}
+
+	return out;
+}
+
+void
+KDMBatch::thread (
+	vector<shared_ptr<Screen> > const & screens,
+	vector<shared_ptr<dcp::EncryptedKDM> >& kdms,
+	boost::posix_time::ptime from,
+	boost::posix_time::ptime until,
+	dcp::Formulation formulation,
+	bool disable_forensic_marking_picture,
+	optional<int> disable_forensic_marking_audio,
+	boost::function<void (float)> progress
+	)
+try
+{
+	/* Each thread signs with its own copy of the chain so that nothing is shared while signing */
+	shared_ptr<const dcp::CertificateChain> signer (new dcp::CertificateChain (*_signer));
+
+	while (true) {
+		boost::this_thread::interruption_point ();
+
+		size_t index;
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_next == screens.size()) {
+				return;
+			}
+			index = _next++;
+		}
+
+		shared_ptr<Screen> screen = screens[index];
+		int const hour = screen->cinema ? screen->cinema->utc_offset_hour() : 0;
+		int const minute = screen->cinema ? screen->cinema->utc_offset_minute() : 0;
+
+		shared_ptr<dcp::EncryptedKDM> kdm (
+			new dcp::EncryptedKDM (
+				make (
+					signer,
+					screen->recipient().get(),
+					screen->trusted_device_thumbprints(),
+					dcp::LocalTime (from, hour, minute),
+					dcp::LocalTime (until, hour, minute),
+					formulation,
+					disable_forensic_marking_picture,
+					disable_forensic_marking_audio
+					)
+				)
+			);
+
+		boost::mutex::scoped_lock lm (_mutex);
+		kdms[index] = kdm;
+		++_done;
+		if (progress) {
+			progress (float (_done) / screens.size());
+		}
+	}
+}
+catch (boost::thread_interrupted &)
+{
+	/* The caller has been interrupted and is stopping us */
+}
+catch (...)
+{
+	store_current ();
+	/* Make the other threads stop */
+	boost::mutex::scoped_lock lm (_mutex);
+	_next = screens.size ();
+}
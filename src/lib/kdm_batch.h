@@ -0,0 +1,119 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_KDM_BATCH_H
+#define DCPOMATIC_KDM_BATCH_H
+
+#include "screen_kdm.h"
+#include "exception_store.h"
+#include <dcp/certificate.h>
+#include <dcp/decrypted_kdm_key.h>
+#include <dcp/encrypted_kdm.h>
+#include <dcp/local_time.h>
+#include <dcp/types.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace dcp {
+	class CertificateChain;
+	class DecryptedKDM;
+}
+
+class Film;
+class Screen;
+
+/** @class KDMBatch
+ *  @brief Maker of KDMs for one CPL.
+ *
+ *  The things which are the same for every KDM (the CPL's details, the keys and
+ *  the signer) are found once when the KDMBatch is created; after that KDMs for
+ *  many screens can be made, encrypted and signed in parallel.
+ */
+class KDMBatch : public ExceptionStore, public boost::noncopyable
+{
+public:
+	KDMBatch (boost::shared_ptr<const Film> film, boost::filesystem::path cpl_file);
+	explicit KDMBatch (dcp::DecryptedKDM dkdm);
+
+	dcp::EncryptedKDM make (
+		dcp::Certificate recipient,
+		std::vector<std::string> trusted_devices,
+		dcp::LocalTime from,
+		dcp::LocalTime until,
+		dcp::Formulation formulation,
+		bool disable_forensic_marking_picture,
+		boost::optional<int> disable_forensic_marking_audio
+		) const;
+
+	std::list<ScreenKDM> make (
+		std::list<boost::shared_ptr<Screen> > screens,
+		boost::posix_time::ptime from,
+		boost::posix_time::ptime until,
+		dcp::Formulation formulation,
+		bool disable_forensic_marking_picture,
+		boost::optional<int> disable_forensic_marking_audio,
+		int threads,
+		boost::function<void (float)> progress = boost::function<void (float)> ()
+		);
+
+private:
+	dcp::EncryptedKDM make (
+		boost::shared_ptr<const dcp::CertificateChain> signer,
+		dcp::Certificate recipient,
+		std::vector<std::string> trusted_devices,
+		dcp::LocalTime from,
+		dcp::LocalTime until,
+		dcp::Formulation formulation,
+		bool disable_forensic_marking_picture,
+		boost::optional<int> disable_forensic_marking_audio
+		) const;
+
+	void thread (
+		std::vector<boost::shared_ptr<Screen> > const & screens,
+		std::vector<boost::shared_ptr<dcp::EncryptedKDM> >& kdms,
+		boost::posix_time::ptime from,
+		boost::posix_time::ptime until,
+		dcp::Formulation formulation,
+		bool disable_forensic_marking_picture,
+		boost::optional<int> disable_forensic_marking_audio,
+		boost::function<void (float)> progress
+		);
+
+	std::string _annotation_text;
+	std::string _content_title_text;
+	std::list<dcp::DecryptedKDMKey> _keys;
+	boost::shared_ptr<const dcp::CertificateChain> _signer;
+
+	/** mutex for _next and _done while make() is running */
+	boost::mutex _mutex;
+	/** index of the next screen to make a KDM for */
+	size_t _next;
+	/** number of KDMs that have been made */
+	size_t _done;
+};
+
+#endif
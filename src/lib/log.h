@@ -47,6 +47,9 @@ public:
 
 	void set_types (int types);
 
+	/** Wait until everything that has been logged so far has been written out */
+	virtual void flush () {}
+
 	/** @param amount Approximate number of bytes to return; the returned value
 	 *  may be shorter or longer than this.
 	 */
@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "make_kdms_job.h"
+#include "kdm_batch.h"
+#include "film.h"
+#include "compose.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "i18n.h"
+
+using std::string;
+using std::list;
+using boost::shared_ptr;
+using boost::optional;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
+
+/** @param screens Screens to make KDMs for.
+ *  @param cpl_file Path to CPL to make KDMs for.
+ *  @param from KDM from time expressed as a local time in the time zone of the Screen's Cinema.
+ *  @param until KDM to time expressed as a local time in the time zone of the Screen's Cinema.
+ *  @param formulation KDM formulation to use.
+ *  @param disable_forensic_marking_picture true to disable forensic marking of picture.
+ *  @param disable_forensic_marking_audio if not set, don't disable forensic marking of audio.  If set to 0,
+ *  disable all forensic marking; if set above 0, disable forensic marking above that channel.
+ */
+MakeKDMsJob::MakeKDMsJob (
+	shared_ptr<const Film> film,
+	list<shared_ptr<Screen> > screens,
+	boost::filesystem::path cpl_file,
+	boost::posix_time::ptime from,
+	boost::posix_time::ptime until,
+	dcp::Formulation formulation,
+	bool disable_forensic_marking_picture,
+	optional<int> disable_forensic_marking_audio
+	)
+	: Job (film)
+	, _screens (screens)
+	, _cpl_file (cpl_file)
+	, _from (from)
+	, _until (until)
+	, _formulation (formulation)
+	, _disable_forensic_marking_picture (disable_forensic_marking_picture)
+	, _disable_forensic_marking_audio (disable_forensic_marking_audio)
+{
+
+}
+
+MakeKDMsJob::~MakeKDMsJob ()
+{
+	stop_thread ();
+}
+
+string
+MakeKDMsJob::name () const
+{
+	return String::compose (_("Make KDMs for %1"), _film->name());
+}
+
+string
+MakeKDMsJob::json_name () const
+{
+	return N_("make_kdms");
+}
+
+void
+MakeKDMsJob::run ()
+{
+	set_progress_unknown ();
+
+	/* Things which are the same for every KDM are done once here */
+	KDMBatch batch (_film, _cpl_file);
+
+	set_progress (0);
+
+	_screen_kdms = batch.make (
+		_screens, _from, _until, _formulation, _disable_forensic_marking_picture, _disable_forensic_marking_audio,
+		boost::thread::hardware_concurrency(), boost::bind (&Job::set_progress, this, _1, false)
+		);
+
+	set_progress (1);
+	set_state (FINISHED_OK);
+}
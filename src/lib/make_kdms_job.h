@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "job.h"
+#include "screen_kdm.h"
+#include <dcp/types.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <list>
+
+class Screen;
+
+/** @class MakeKDMsJob
+ *  @brief A job to make KDMs for a film's CPL for a list of screens, using all our cores.
+ */
+class MakeKDMsJob : public Job
+{
+public:
+	MakeKDMsJob (
+		boost::shared_ptr<const Film> film,
+		std::list<boost::shared_ptr<Screen> > screens,
+		boost::filesystem::path cpl_file,
+		boost::posix_time::ptime from,
+		boost::posix_time::ptime until,
+		dcp::Formulation formulation,
+		bool disable_forensic_marking_picture,
+		boost::optional<int> disable_forensic_marking_audio
+		);
+
+	~MakeKDMsJob ();
+
+	std::string name () const;
+	std::string json_name () const;
+	void run ();
+
+	/** @return KDMs that were made; only valid once the job has finished successfully */
+	std::list<ScreenKDM> screen_kdms () const {
+		return _screen_kdms;
+	}
+
+private:
+	std::list<boost::shared_ptr<Screen> > _screens;
+	boost::filesystem::path _cpl_file;
+	boost::posix_time::ptime _from;
+	boost::posix_time::ptime _until;
+	dcp::Formulation _formulation;
+	bool _disable_forensic_marking_picture;
+	boost::optional<int> _disable_forensic_marking_audio;
+
+	std::list<ScreenKDM> _screen_kdms;
+};
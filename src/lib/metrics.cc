@@ -0,0 +1,146 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "metrics.h"
+#include <dcp/raw_convert.h>
+#include <boost/foreach.hpp>
+
+using std::string;
+using std::list;
+using boost::optional;
+using dcp::raw_convert;
+
+/** Add a value to the snapshot.
+ *  @param name Name of the metric, which should start with dcpomatic_ and, for counters, end with _total.
+ *  @param type Type of the metric.
+ *  @param help Description of the metric; only the first description given for a name is used.
+ *  @param value Current value.
+ *  @param label Optional label name and value to distinguish this value from others with the same name.
+ */
+void
+Metrics::add (string name, Type type, string help, double value, optional<Label> label)
+{
+	list<Label> labels;
+	if (label) {
+		labels.push_back (*label);
+	}
+	add (name, type, help, value, labels);
+}
+
+void
+Metrics::add (string name, Type type, string help, double value, list<Label> labels)
+{
+	Sample sample;
+	sample.labels = labels;
+	sample.value = value;
+
+	BOOST_FOREACH (Family& i, _families) {
+		if (i.name == name) {
+			i.samples.push_back (sample);
+			return;
+		}
+	}
+
+	Family family;
+	family.name = name;
+	family.type = type;
+	family.help = help;
+	family.samples.push_back (sample);
+	_families.push_back (family);
+}
+
+/** @return s with any backslashes, double quotes and newlines escaped, as required
+ *  for both Prometheus label values and JSON strings.
+ */
+static string
+escape (string s)
+{
+	string e;
+	BOOST_FOREACH (char i, s) {
+		switch (i) {
+		case '\\':
+			e += "\\\\";
+			break;
+		case '"':
+			e += "\\\"";
+			break;
+		case '\n':
+			e += "\\n";
+			break;
+		default:
+			e += i;
+		}
+	}
+	return e;
+}
+
+/** @return Snapshot in the Prometheus text exposition format (version 0.0.4) */
+string
+Metrics::prometheus () const
+{
+	string out;
+	BOOST_FOREACH (Family const & i, _families) {
+		out += "# HELP " + i.name + " " + i.help + "\n";
+		out += "# TYPE " + i.name + " " + (i.type == COUNTER ? "counter" : "gauge") + "\n";
+		BOOST_FOREACH (Sample const & j, i.samples) {
+			out += i.name;
+			if (!j.labels.empty ()) {
+				out += "{";
+				for (list<Label>::const_iterator k = j.labels.begin(); k != j.labels.end(); ++k) {
+					if (k != j.labels.begin ()) {
+						out += ",";
+					}
+					out += k->first + "=\"" + escape (k->second) + "\"";
+				}
+				out += "}";
+			}
+			out += " " + raw_convert<string> (j.value) + "\n";
+		}
+	}
+	return out;
+}
+
+/** @return Snapshot as a JSON object with one member per metric, each of which is a list of
+ *  objects containing the labels (if any) and the value.
+ */
+string
+Metrics::json () const
+{
+	string out = "{ ";
+	for (list<Family>::const_iterator i = _families.begin(); i != _families.end(); ++i) {
+		if (i != _families.begin ()) {
+			out += ", ";
+		}
+		out += "\"" + i->name + "\": [";
+		for (list<Sample>::const_iterator j = i->samples.begin(); j != i->samples.end(); ++j) {
+			if (j != i->samples.begin ()) {
+				out += ", ";
+			}
+			out += "{ ";
+			BOOST_FOREACH (Label const & k, j->labels) {
+				out += "\"" + k.first + "\": \"" + escape (k.second) + "\", ";
+			}
+			out += "\"value\": " + raw_convert<string> (j->value) + " }";
+		}
+		out += "]";
+	}
+	out += " }";
+	return out;
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/metrics.h
+ *  @brief Metrics class.
+ */
+
+#ifndef DCPOMATIC_METRICS_H
+#define DCPOMATIC_METRICS_H
+
+#include <boost/optional.hpp>
+#include <list>
+#include <string>
+#include <utility>
+
+/** @class Metrics
+ *  @brief A snapshot of some numbers describing what DCP-o-matic is doing, for monitoring.
+ *
+ *  Parts of the encode pipeline add their current state to a Metrics when asked;
+ *  nothing is recorded in between, so the only cost is when a snapshot is taken.
+ *  The snapshot can be written in the Prometheus text exposition format or as JSON.
+ */
+class Metrics
+{
+public:
+	enum Type {
+		/** a value which can go up and down, e.g. a queue length */
+		GAUGE,
+		/** a value which only ever increases, e.g. a number of frames written */
+		COUNTER
+	};
+
+	typedef std::pair<std::string, std::string> Label;
+
+	void add (std::string name, Type type, std::string help, double value, boost::optional<Label> label = boost::optional<Label> ());
+	void add (std::string name, Type type, std::string help, double value, std::list<Label> labels);
+
+	std::string prometheus () const;
+	std::string json () const;
+
+private:
+	struct Sample
+	{
+		std::list<Label> labels;
+		double value;
+	};
+
+	struct Family
+	{
+		std::string name;
+		Type type;
+		std::string help;
+		std::list<Sample> samples;
+	};
+
+	/** families in the order that they were first added */
+	std::list<Family> _families;
+};
+
+#endif
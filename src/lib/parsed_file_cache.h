@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_PARSED_FILE_CACHE_H
+#define DCPOMATIC_PARSED_FILE_CACHE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdint.h>
+#include <ctime>
+#include <list>
+
+/** @class ParsedFileCache
+ *  @brief A thread-safe cache of the results of parsing some files.
+ *
+ *  Results are kept for the most recently used files, and are thrown away when
+ *  their file's modification time or size changes.  A result may be in use by
+ *  several threads at once, so it must not be modified once it has been cached.
+ */
+template <class T>
+class ParsedFileCache : public boost::noncopyable
+{
+public:
+	/** @param size Maximum number of files to keep results for */
+	explicit ParsedFileCache (int size)
+		: _size (size)
+	{}
+
+	/** @param file File to get the parsed form of.
+	 *  @param parse Function to parse the file if we do not have a current result for it.
+	 *  @return Parsed form of the file.
+	 */
+	boost::shared_ptr<const T> get (boost::filesystem::path file, boost::function<boost::shared_ptr<const T> (boost::filesystem::path)> parse)
+	{
+		/* Look at the file before parsing it so that if it changes while we are
+		   parsing we store a result which will not be used again.
+		*/
+		Entry entry;
+		entry.file = file;
+		boost::system::error_code ec;
+		entry.modified = boost::filesystem::last_write_time (file, ec);
+		entry.size = boost::filesystem::file_size (file, ec);
+
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			for (typename std::list<Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i) {
+				if (i->file == file) {
+					if (i->modified == entry.modified && i->size == entry.size) {
+						_entries.splice (_entries.begin(), _entries, i);
+						return _entries.front().value;
+					}
+					_entries.erase (i);
+					break;
+				}
+			}
+		}
+
+		/* Parse without the lock held so that other files can be found in the
+		   cache meanwhile; if two threads parse the same file at once the second
+		   one just replaces the first one's entry.
+		*/
+		entry.value = parse (file);
+
+		boost::mutex::scoped_lock lm (_mutex);
+		for (typename std::list<Entry>::iterator i = _entries.begin(); i != _entries.end(); ++i) {
+			if (i->file == file) {
+				_entries.erase (i);
+				break;
+			}
+		}
+		_entries.push_front (entry);
+		while (int (_entries.size()) > _size) {
+			_entries.pop_back ();
+		}
+
+		return entry.value;
+	}
+
+	void clear ()
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_entries.clear ();
+	}
+
+private:
+	struct Entry
+	{
+		boost::filesystem::path file;
+		std::time_t modified;
+		uintmax_t size;
+		boost::shared_ptr<const T> value;
+	};
+
+	int _size;
+	/** mutex to protect _entries */
+	boost::mutex _mutex;
+	/** most recently used first */
+	std::list<Entry> _entries;
+};
+
+#endif
@@ -35,12 +35,15 @@ public:
 		, decoder (d)
 		, frc (f)
 		, done (false)
+		, video_frames (0)
 	{}
 
 	boost::shared_ptr<Content> content;
 	boost::shared_ptr<Decoder> decoder;
 	FrameRateChange frc;
 	bool done;
+	/** number of video frames that decoder has given us; only changed with Player::_mutex held */
+	Frame video_frames;
 };
 
 #endif
@@ -44,15 +44,20 @@
 #include "text_decoder.h"
 #include "ffmpeg_content.h"
 #include "audio_content.h"
+#include "video_content.h"
 #include "dcp_decoder.h"
+#include "ffmpeg_decoder.h"
 #include "image_decoder.h"
 #include "compose.hpp"
 #include "shuffler.h"
+#include "trace.h"
+#include "metrics.h"
 #include <dcp/reel.h>
 #include <dcp/reel_sound_asset.h>
 #include <dcp/reel_subtitle_asset.h>
 #include <dcp/reel_picture_asset.h>
 #include <dcp/reel_closed_caption_asset.h>
+#include <dcp/raw_convert.h>
 #include <boost/foreach.hpp>
 #include <stdint.h>
 #include <algorithm>
@@ -70,11 +75,13 @@ using std::pair;
 using std::map;
 using std::make_pair;
 using std::copy;
+using std::string;
 using boost::shared_ptr;
 using boost::weak_ptr;
 using boost::dynamic_pointer_cast;
 using boost::optional;
 using boost::scoped_ptr;
+using dcp::raw_convert;
 
 int const PlayerProperty::VIDEO_CONTAINER_SIZE = 700;
 int const PlayerProperty::PLAYLIST = 701;
@@ -100,7 +107,7 @@ Player::Player (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist
 	   be first.
 	*/
 	_playlist_change_connection = _playlist->Change.connect (bind (&Player::playlist_change, this, _1), boost::signals2::at_front);
-	_playlist_content_change_connection = _playlist->ContentChange.connect (bind(&Player::playlist_content_change, this, _1, _3, _4));
+	_playlist_content_change_connection = _playlist->ContentChange.connect (bind(&Player::playlist_content_change, this, _1, _2, _3, _4));
 	set_video_container_size (_film->frame_size ());
 
 	film_change (CHANGE_TYPE_DONE, Film::AUDIO_PROCESSOR);
@@ -133,14 +140,32 @@ have_audio (shared_ptr<Piece> piece)
 	return piece->decoder && piece->decoder->audio;
 }
 
+/** Remake all our pieces, with new decoders.  Caller must hold a lock on _mutex */
 void
 Player::setup_pieces_unlocked ()
 {
 	_pieces.clear ();
+	update_pieces_unlocked (shared_ptr<const Content>());
+}
 
-	delete _shuffler;
-	_shuffler = new Shuffler();
-	_shuffler->Video.connect(bind(&Player::video, this, _1, _2));
+/** Make our pieces match the content in the playlist.  Pieces for content which we already have
+ *  (apart from `remake') keep their decoders, which are sent back to the start of their content
+ *  as a new decoder would be; new pieces are made for the rest.  Caller must hold a lock on _mutex.
+ *  @param remake Content whose decoder must be remade even if we already have one, or 0.
+ */
+void
+Player::update_pieces_unlocked (shared_ptr<const Content> remake)
+{
+	list<shared_ptr<Piece> > old = _pieces;
+	_pieces.clear ();
+
+	if (_shuffler) {
+		/* The shuffler may have video from pieces that are about to go */
+		_shuffler->clear ();
+	} else {
+		_shuffler = new Shuffler();
+		_shuffler->Video.connect(bind(&Player::video, this, _1, _2));
+	}
 
 	BOOST_FOREACH (shared_ptr<Content> i, _playlist->content ()) {
 
@@ -153,67 +178,43 @@ Player::setup_pieces_unlocked ()
 			continue;
 		}
 
-		shared_ptr<Decoder> decoder = decoder_factory (_film, i, _fast);
-		FrameRateChange frc (_film, i);
-
-		if (!decoder) {
-			/* Not something that we can decode; e.g. Atmos content */
-			continue;
-		}
-
-		if (decoder->video && _ignore_video) {
-			decoder->video->set_ignore (true);
+		shared_ptr<Piece> piece;
+		if (i != remake) {
+			BOOST_FOREACH (shared_ptr<Piece> j, old) {
+				if (j->content == i) {
+					piece = j;
+					break;
+				}
+			}
 		}
 
-		if (decoder->audio && _ignore_audio) {
-			decoder->audio->set_ignore (true);
+		if (piece && piece->frc != FrameRateChange (_film, i)) {
+			/* Content without a video frame rate of its own takes one from the video
+			   it is over (see Content::active_video_frame_rate) so moving it can change
+			   the rate that this piece and its decoder were set up for.
+			*/
+			piece.reset ();
 		}
 
-		if (_ignore_text) {
-			BOOST_FOREACH (shared_ptr<TextDecoder> i, decoder->text) {
-				i->set_ignore (true);
+		if (piece) {
+			/* Things like the crop can change without us needing a new decoder, but they can
+			   change the reduction that FFmpeg should use.
+			*/
+			shared_ptr<FFmpegDecoder> ffmpeg = dynamic_pointer_cast<FFmpegDecoder> (piece->decoder);
+			if (ffmpeg) {
+				ffmpeg->set_decode_reduction (ffmpeg_decode_reduction(i));
 			}
-		}
-
-		shared_ptr<DCPDecoder> dcp = dynamic_pointer_cast<DCPDecoder> (decoder);
-		if (dcp) {
-			dcp->set_decode_referenced (_play_referenced);
-			if (_play_referenced) {
-				dcp->set_forced_reduction (_dcp_decode_reduction);
+			piece->decoder->seek (dcp_to_content_time (piece, i->position()), true);
+			piece->done = false;
+		} else {
+			piece = make_piece (i);
+			if (!piece) {
+				/* Not something that we can decode; e.g. Atmos content */
+				continue;
 			}
 		}
 
-		shared_ptr<Piece> piece (new Piece (i, decoder, frc));
 		_pieces.push_back (piece);
-
-		if (decoder->video) {
-			if (i->video->frame_type() == VIDEO_FRAME_TYPE_3D_LEFT || i->video->frame_type() == VIDEO_FRAME_TYPE_3D_RIGHT) {
-				/* We need a Shuffler to cope with 3D L/R video data arriving out of sequence */
-				decoder->video->Data.connect (bind (&Shuffler::video, _shuffler, weak_ptr<Piece>(piece), _1));
-			} else {
-				decoder->video->Data.connect (bind (&Player::video, this, weak_ptr<Piece>(piece), _1));
-			}
-		}
-
-		if (decoder->audio) {
-			decoder->audio->Data.connect (bind (&Player::audio, this, weak_ptr<Piece> (piece), _1, _2));
-		}
-
-		list<shared_ptr<TextDecoder> >::const_iterator j = decoder->text.begin();
-
-		while (j != decoder->text.end()) {
-			(*j)->BitmapStart.connect (
-				bind(&Player::bitmap_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
-				);
-			(*j)->PlainStart.connect (
-				bind(&Player::plain_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
-				);
-			(*j)->Stop.connect (
-				bind(&Player::subtitle_stop, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
-				);
-
-			++j;
-		}
 	}
 
 	_stream_states.clear ();
@@ -233,8 +234,128 @@ Player::setup_pieces_unlocked ()
 	_last_audio_time = DCPTime ();
 }
 
+/** @return New Piece, with a new decoder, for some content, or 0 if we can't decode it.
+ *  Caller must hold a lock on _mutex.
+ */
+shared_ptr<Piece>
+Player::make_piece (shared_ptr<Content> content)
+{
+	shared_ptr<Decoder> decoder = decoder_factory (_film, content, _fast);
+	FrameRateChange frc (_film, content);
+
+	if (!decoder) {
+		return shared_ptr<Piece> ();
+	}
+
+	if (decoder->video && _ignore_video) {
+		decoder->video->set_ignore (true);
+	}
+
+	if (decoder->video && frc.skip) {
+		/* Let the decoder throw away the frames that we don't want (see Player::video)
+		   before it does the work of decoding them.
+		*/
+		decoder->video->set_skip (true);
+	}
+
+	if (decoder->audio && _ignore_audio) {
+		decoder->audio->set_ignore (true);
+	}
+
+	if (_ignore_text) {
+		BOOST_FOREACH (shared_ptr<TextDecoder> i, decoder->text) {
+			i->set_ignore (true);
+		}
+	}
+
+	shared_ptr<DCPDecoder> dcp = dynamic_pointer_cast<DCPDecoder> (decoder);
+	if (dcp) {
+		dcp->set_decode_referenced (_play_referenced);
+		if (_play_referenced) {
+			dcp->set_forced_reduction (_dcp_decode_reduction);
+		}
+	}
+
+	shared_ptr<FFmpegDecoder> ffmpeg = dynamic_pointer_cast<FFmpegDecoder> (decoder);
+	if (ffmpeg) {
+		ffmpeg->set_decode_reduction (ffmpeg_decode_reduction(content));
+	}
+
+	shared_ptr<Piece> piece (new Piece (content, decoder, frc));
+
+	if (decoder->video) {
+		if (content->video->frame_type() == VIDEO_FRAME_TYPE_3D_LEFT || content->video->frame_type() == VIDEO_FRAME_TYPE_3D_RIGHT) {
+			/* We need a Shuffler to cope with 3D L/R video data arriving out of sequence */
+			decoder->video->Data.connect (bind (&Shuffler::video, _shuffler, weak_ptr<Piece>(piece), _1));
+		} else {
+			decoder->video->Data.connect (bind (&Player::video, this, weak_ptr<Piece>(piece), _1));
+		}
+	}
+
+	if (decoder->audio) {
+		decoder->audio->Data.connect (bind (&Player::audio, this, weak_ptr<Piece> (piece), _1, _2));
+	}
+
+	list<shared_ptr<TextDecoder> >::const_iterator j = decoder->text.begin();
+
+	while (j != decoder->text.end()) {
+		(*j)->BitmapStart.connect (
+			bind(&Player::bitmap_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			);
+		(*j)->PlainStart.connect (
+			bind(&Player::plain_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			);
+		(*j)->Stop.connect (
+			bind(&Player::subtitle_stop, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			);
+
+		++j;
+	}
+
+	return piece;
+}
+
+/** @return true if decoders for some content must be remade after a change to one of its properties,
+ *  false if existing decoders will cope (e.g. because the property is applied by the player, or
+ *  only looked at by the decoder when it seeks).
+ */
+static bool
+decoder_depends_on (int property)
+{
+	return !(
+		property == ContentProperty::POSITION ||
+		property == ContentProperty::LENGTH ||
+		property == ContentProperty::TRIM_START ||
+		property == ContentProperty::TRIM_END ||
+		property == VideoContentProperty::CROP ||
+		property == VideoContentProperty::SCALE ||
+		property == VideoContentProperty::COLOUR_CONVERSION ||
+		property == VideoContentProperty::FADE_IN ||
+		property == VideoContentProperty::FADE_OUT ||
+		property == AudioContentProperty::GAIN ||
+		property == AudioContentProperty::DELAY ||
+		property == TextContentProperty::X_OFFSET ||
+		property == TextContentProperty::Y_OFFSET ||
+		property == TextContentProperty::X_SCALE ||
+		property == TextContentProperty::Y_SCALE ||
+		property == TextContentProperty::USE ||
+		property == TextContentProperty::BURN ||
+		property == TextContentProperty::LANGUAGE ||
+		property == TextContentProperty::FONTS ||
+		property == TextContentProperty::COLOUR ||
+		property == TextContentProperty::EFFECT ||
+		property == TextContentProperty::EFFECT_COLOUR ||
+		property == TextContentProperty::LINE_SPACING ||
+		property == TextContentProperty::FADE_IN ||
+		property == TextContentProperty::FADE_OUT ||
+		property == TextContentProperty::OUTLINE_WIDTH ||
+		property == TextContentProperty::TYPE ||
+		property == TextContentProperty::DCP_TRACK
+		);
+}
+
 void
-Player::playlist_content_change (ChangeType type, int property, bool frequent)
+Player::playlist_content_change (ChangeType type, weak_ptr<Content> content, int property, bool frequent)
 {
 	if (type == CHANGE_TYPE_PENDING) {
 		/* The player content is probably about to change, so we can't carry on
@@ -243,8 +364,14 @@ Player::playlist_content_change (ChangeType type, int property, bool frequent)
 		*/
 		++_suspended;
 	} else if (type == CHANGE_TYPE_DONE) {
-		/* A change in our content has gone through.  Re-build our pieces. */
-		setup_pieces ();
+		/* A change in our content has gone through.  Bring our pieces up to date, only
+		   making a new decoder for the changed content if the change could affect it.
+		*/
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			shared_ptr<Content> c = content.lock ();
+			update_pieces_unlocked (c && decoder_depends_on(property) ? c : shared_ptr<Content>());
+		}
 		--_suspended;
 	} else if (type == CHANGE_TYPE_CANCELLED) {
 		--_suspended;
@@ -271,6 +398,16 @@ Player::set_video_container_size (dcp::Size s)
 
 		_black_image.reset (new Image (AV_PIX_FMT_RGB24, _video_container_size, true));
 		_black_image->make_black ();
+
+		/* The Butler will seek after this change, which is what FFmpegDecoder
+		   needs if its reduction changes.
+		*/
+		BOOST_FOREACH (shared_ptr<Piece> i, _pieces) {
+			shared_ptr<FFmpegDecoder> ffmpeg = dynamic_pointer_cast<FFmpegDecoder> (i->decoder);
+			if (ffmpeg) {
+				ffmpeg->set_decode_reduction (ffmpeg_decode_reduction(i->content));
+			}
+		}
 	}
 
 	Change (CHANGE_TYPE_DONE, PlayerProperty::VIDEO_CONTAINER_SIZE, false);
@@ -280,7 +417,9 @@ void
 Player::playlist_change (ChangeType type)
 {
 	if (type == CHANGE_TYPE_DONE) {
-		setup_pieces ();
+		/* Content has been added, removed or re-ordered; anything that is still there can keep its decoder */
+		boost::mutex::scoped_lock lm (_mutex);
+		update_pieces_unlocked (shared_ptr<const Content>());
 	}
 	Change (type, PlayerProperty::PLAYLIST, false);
 }
@@ -489,7 +628,8 @@ Player::get_reel_assets ()
 
 		scoped_ptr<DCPDecoder> decoder;
 		try {
-			decoder.reset (new DCPDecoder (_film, j, false));
+			/* We modify the reel assets below, so we need our own copy of them */
+			decoder.reset (new DCPDecoder (_film, j, false, false));
 		} catch (...) {
 			return a;
 		}
@@ -548,6 +688,8 @@ Player::get_reel_assets ()
 bool
 Player::pass ()
 {
+	TRACE_SCOPE (TRACE_PLAYER, "pass");
+
 	boost::mutex::scoped_lock lm (_mutex);
 
 	if (_suspended) {
@@ -753,6 +895,8 @@ Player::video (weak_ptr<Piece> wp, ContentVideo video)
 		return;
 	}
 
+	++piece->video_frames;
+
 	FrameRateChange frc (_film, piece->content);
 	if (frc.skip && (video.frame % 2) == 1) {
 		return;
@@ -865,7 +1009,9 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 	/* And the end of this block in the DCP */
 	DCPTime end = time + DCPTime::from_frames(content_audio.audio->frames(), rfr);
 
-	/* Remove anything that comes before the start or after the end of the content */
+	/* Remove anything that comes before the start or after the end of the content;
+	   what is left uses the decoder's data rather than a copy of it.
+	*/
 	if (time < piece->content->position()) {
 		pair<shared_ptr<AudioBuffers>, DCPTime> cut = discard_audio (content_audio.audio, time, piece->content->position());
 		if (!cut.first) {
@@ -882,24 +1028,14 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 		if (remaining_frames == 0) {
 			return;
 		}
-		shared_ptr<AudioBuffers> cut (new AudioBuffers (content_audio.audio->channels(), remaining_frames));
-		cut->copy_from (content_audio.audio.get(), remaining_frames, 0, 0);
-		content_audio.audio = cut;
+		content_audio.audio.reset (new AudioBuffers (content_audio.audio, 0, remaining_frames));
 	}
 
 	DCPOMATIC_ASSERT (content_audio.audio->frames() > 0);
 
-	/* Gain */
-
-	if (content->gain() != 0) {
-		shared_ptr<AudioBuffers> gain (new AudioBuffers (content_audio.audio));
-		gain->apply_gain (content->gain ());
-		content_audio.audio = gain;
-	}
-
-	/* Remap */
+	/* Gain and remap; if neither changes anything the data is still not copied */
 
-	content_audio.audio = remap (content_audio.audio, _film->audio_channels(), stream->mapping());
+	content_audio.audio = remap (content_audio.audio, _film->audio_channels(), stream->mapping(), content->gain());
 
 	/* Process */
 
@@ -1030,6 +1166,8 @@ Player::subtitle_stop (weak_ptr<Piece> wp, weak_ptr<const TextContent> wc, Conte
 void
 Player::seek (DCPTime time, bool accurate)
 {
+	TRACE_SCOPE (TRACE_PLAYER, "seek");
+
 	boost::mutex::scoped_lock lm (_mutex);
 
 	if (_suspended) {
@@ -1119,6 +1257,7 @@ Player::do_emit_video (shared_ptr<PlayerVideo> pv, DCPTime time)
 		pv->set_text (subtitles.get ());
 	}
 
+	TRACE_INSTANT (TRACE_PLAYER, "video", time.frames_round(_film->video_frame_rate()));
 	Video (pv, time);
 }
 
@@ -1173,11 +1312,37 @@ Player::discard_audio (shared_ptr<const AudioBuffers> audio, DCPTime time, DCPTi
 	if (remaining_frames <= 0) {
 		return make_pair(shared_ptr<AudioBuffers>(), DCPTime());
 	}
-	shared_ptr<AudioBuffers> cut (new AudioBuffers (audio->channels(), remaining_frames));
-	cut->copy_from (audio.get(), remaining_frames, discard_frames, 0);
+	shared_ptr<AudioBuffers> cut (new AudioBuffers (audio, discard_frames, remaining_frames));
 	return make_pair(cut, time + discard_time);
 }
 
+/** Add the number of video frames decoded from each piece of content to a Metrics snapshot.
+ *  The rate of decoding can be found from the change in these numbers.
+ */
+void
+Player::metrics (Metrics& metrics) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	int index = 0;
+	BOOST_FOREACH (shared_ptr<const Piece> i, _pieces) {
+		if (i->content->video) {
+			/* Different pieces may have files with the same name, or even the same content, so
+			   identify each by its index and give the file name as well to help a human.
+			*/
+			list<Metrics::Label> labels;
+			labels.push_back (make_pair (string ("piece"), raw_convert<string> (index)));
+			if (i->content->number_of_paths() > 0) {
+				labels.push_back (make_pair (string ("file"), i->content->path(0).filename().string()));
+			}
+			metrics.add (
+				"dcpomatic_player_decoded_video_frames_total", Metrics::COUNTER, "Video frames decoded from each piece of content",
+				i->video_frames, labels
+				);
+		}
+		++index;
+	}
+}
+
 void
 Player::set_dcp_decode_reduction (optional<int> reduction)
 {
@@ -1199,6 +1364,40 @@ Player::set_dcp_decode_reduction (optional<int> reduction)
 	Change (CHANGE_TYPE_DONE, PlayerProperty::DCP_DECODE_REDUCTION, false);
 }
 
+/** @return log2 of the factor by which we can reduce the size of the video decoded from some
+ *  FFmpeg content while still having enough pixels to fill our video container, or none
+ *  if we should decode at full size.  Caller must hold a lock on _mutex.
+ */
+optional<int>
+Player::ffmpeg_decode_reduction (shared_ptr<const Content> content) const
+{
+	if (!_fast || !content->video || _video_container_size.width <= 0 || _video_container_size.height <= 0) {
+		return optional<int>();
+	}
+
+	dcp::Size size = content->video->size_after_crop ();
+	switch (content->video->frame_type()) {
+	case VIDEO_FRAME_TYPE_3D_LEFT_RIGHT:
+		size.width /= 2;
+		break;
+	case VIDEO_FRAME_TYPE_3D_TOP_BOTTOM:
+		size.height /= 2;
+		break;
+	default:
+		break;
+	}
+
+	int reduction = 0;
+	while (
+		(size.width >> (reduction + 1)) >= _video_container_size.width &&
+		(size.height >> (reduction + 1)) >= _video_container_size.height
+		) {
+		++reduction;
+	}
+
+	return reduction;
+}
+
 optional<DCPTime>
 Player::content_time_to_dcp (shared_ptr<Content> content, ContentTime t)
 {
@@ -48,6 +48,7 @@ class Font;
 class AudioBuffers;
 class ReferencedReelAsset;
 class Shuffler;
+class Metrics;
 
 class PlayerProperty
 {
@@ -89,6 +90,8 @@ public:
 
 	boost::optional<DCPTime> content_time_to_dcp (boost::shared_ptr<Content> content, ContentTime t);
 
+	void metrics (Metrics& metrics) const;
+
 	boost::signals2::signal<void (ChangeType, int, bool)> Change;
 
 	/** Emitted when a video frame is ready.  These emissions happen in the correct order. */
@@ -108,13 +111,17 @@ private:
 	friend struct player_subframe_test;
 	friend struct empty_test1;
 	friend struct empty_test2;
+	friend struct player_keeps_decoders_test;
+	friend struct player_remakes_pieces_for_new_frame_rate_test;
 
 	void setup_pieces ();
 	void setup_pieces_unlocked ();
+	void update_pieces_unlocked (boost::shared_ptr<const Content> remake);
+	boost::shared_ptr<Piece> make_piece (boost::shared_ptr<Content> content);
 	void flush ();
 	void film_change (ChangeType, Film::Property);
 	void playlist_change (ChangeType);
-	void playlist_content_change (ChangeType, int, bool);
+	void playlist_content_change (ChangeType, boost::weak_ptr<Content>, int, bool);
 	Frame dcp_to_content_video (boost::shared_ptr<const Piece> piece, DCPTime t) const;
 	DCPTime content_video_to_dcp (boost::shared_ptr<const Piece> piece, Frame f) const;
 	Frame dcp_to_resampled_audio (boost::shared_ptr<const Piece> piece, DCPTime t) const;
@@ -122,6 +129,7 @@ private:
 	ContentTime dcp_to_content_time (boost::shared_ptr<const Piece> piece, DCPTime t) const;
 	DCPTime content_time_to_dcp (boost::shared_ptr<const Piece> piece, ContentTime t) const;
 	boost::shared_ptr<PlayerVideo> black_player_video_frame (Eyes eyes) const;
+	boost::optional<int> ffmpeg_decode_reduction (boost::shared_ptr<const Content> content) const;
 	void video (boost::weak_ptr<Piece>, ContentVideo);
 	void audio (boost::weak_ptr<Piece>, AudioStreamPtr, ContentAudio);
 	void bitmap_text_start (boost::weak_ptr<Piece>, boost::weak_ptr<const TextContent>, ContentBitmapText);
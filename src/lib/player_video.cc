@@ -25,6 +25,7 @@
 #include "image_proxy.h"
 #include "j2k_image_proxy.h"
 #include "film.h"
+#include "digester.h"
 #include <dcp/raw_convert.h>
 extern "C" {
 #include <libavutil/pixfmt.h>
@@ -134,6 +135,17 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, b
 	int const reduce = prox.second;
 
 	Crop total_crop = _crop;
+
+	if (reduce > 0) {
+		/* Scale the crop down to account for the scaling that has already happened in ImageProxy::image */
+		int const r = pow(2, reduce);
+		total_crop.left /= r;
+		total_crop.right /= r;
+		total_crop.top /= r;
+		total_crop.bottom /= r;
+	}
+
+	/* im has already been reduced, so this part of the crop needs no scaling */
 	switch (_part) {
 	case PART_LEFT_HALF:
 		total_crop.right += im->size().width / 2;
@@ -151,15 +163,6 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, b
 		break;
 	}
 
-	if (reduce > 0) {
-		/* Scale the crop down to account for the scaling that has already happened in ImageProxy::image */
-		int const r = pow(2, reduce);
-		total_crop.left /= r;
-		total_crop.right /= r;
-		total_crop.top /= r;
-		total_crop.bottom /= r;
-	}
-
 	dcp::YUVToRGB yuv_to_rgb = dcp::YUV_TO_RGB_REC601;
 	if (_colour_conversion) {
 		yuv_to_rgb = _colour_conversion.get().yuv_to_rgb();
@@ -268,6 +271,62 @@ PlayerVideo::same (shared_ptr<const PlayerVideo> other) const
 	return _in->same (other->_in);
 }
 
+/** @return A digest of everything that determines the image that image() would return
+ *  given these parameters, or none if we don't know enough to make one (e.g. if we
+ *  are a black filler frame that did not come from any content).
+ */
+optional<string>
+PlayerVideo::digest (AVPixelFormat pixel_format, bool aligned, bool fast) const
+{
+	shared_ptr<Content> content = _content.lock ();
+	if (!content || !_video_frame) {
+		return optional<string>();
+	}
+
+	Digester digester;
+	digester.add (content->image_identifier());
+	digester.add (_in->identifier());
+	digester.add (_video_frame.get());
+	digester.add (_crop.left);
+	digester.add (_crop.right);
+	digester.add (_crop.top);
+	digester.add (_crop.bottom);
+	digester.add (_fade.get_value_or(1));
+	digester.add (_inter_size.width);
+	digester.add (_inter_size.height);
+	digester.add (_out_size.width);
+	digester.add (_out_size.height);
+	digester.add (static_cast<int>(_eyes));
+	digester.add (static_cast<int>(_part));
+	if (_colour_conversion) {
+		digester.add (_colour_conversion->identifier());
+	}
+	if (_text) {
+		digester.add (_text->image->digest());
+		digester.add (_text->position.x);
+		digester.add (_text->position.y);
+	}
+	digester.add (static_cast<int>(pixel_format));
+	digester.add (aligned);
+	digester.add (fast);
+
+	return digester.get ();
+}
+
+/** Set our image to one that has already been made (e.g. by an earlier PlayerVideo which
+ *  had the same digest), so that image() need not make it again.
+ */
+void
+PlayerVideo::set_image (shared_ptr<Image> image)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_image = image;
+	_image_crop = _crop;
+	_image_inter_size = _inter_size;
+	_image_out_size = _out_size;
+	_image_fade = _fade;
+}
+
 AVPixelFormat
 PlayerVideo::force (AVPixelFormat, AVPixelFormat force_to)
 {
@@ -293,7 +352,14 @@ PlayerVideo::prepare (function<AVPixelFormat (AVPixelFormat)> pixel_format, bool
 size_t
 PlayerVideo::memory_used () const
 {
-	return _in->memory_used();
+	size_t m = _in->memory_used();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_image) {
+		m += _image->memory_used();
+	}
+
+	return m;
 }
 
 /** @return Shallow copy of this; _in and _text are shared between the original and the copy */
@@ -99,6 +99,8 @@ public:
 	}
 
 	bool same (boost::shared_ptr<const PlayerVideo> other) const;
+	boost::optional<std::string> digest (AVPixelFormat pixel_format, bool aligned, bool fast) const;
+	void set_image (boost::shared_ptr<Image> image);
 
 	size_t memory_used () const;
 
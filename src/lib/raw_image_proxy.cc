@@ -38,13 +38,18 @@ using boost::dynamic_pointer_cast;
 using boost::optional;
 using dcp::raw_convert;
 
-RawImageProxy::RawImageProxy (shared_ptr<Image> image)
+/** @param image Image.
+ *  @param reduce log2 of the factor by which image has already been scaled down from its full size.
+ */
+RawImageProxy::RawImageProxy (shared_ptr<Image> image, int reduce)
 	: _image (image)
+	, _reduce (reduce)
 {
 
 }
 
 RawImageProxy::RawImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> socket)
+	: _reduce (0)
 {
 	dcp::Size size (
 		xml->number_child<int> ("Width"), xml->number_child<int> ("Height")
@@ -57,7 +62,7 @@ RawImageProxy::RawImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 pair<shared_ptr<Image>, int>
 RawImageProxy::image (optional<dcp::Size>) const
 {
-	return make_pair (_image, 0);
+	return make_pair (_image, _reduce);
 }
 
 void
@@ -83,7 +88,7 @@ RawImageProxy::same (shared_ptr<const ImageProxy> other) const
 		return false;
 	}
 
-	return (*_image.get()) == (*rp->image().first.get());
+	return _reduce == rp->_reduce && (*_image.get()) == (*rp->image().first.get());
 }
 
 size_t
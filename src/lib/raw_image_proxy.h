@@ -26,7 +26,7 @@
 class RawImageProxy : public ImageProxy
 {
 public:
-	explicit RawImageProxy (boost::shared_ptr<Image>);
+	explicit RawImageProxy (boost::shared_ptr<Image>, int reduce = 0);
 	RawImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
 
 	std::pair<boost::shared_ptr<Image>, int> image (
@@ -40,6 +40,8 @@ public:
 
 private:
 	boost::shared_ptr<Image> _image;
+	/** log2 of the factor by which _image has already been scaled down from its full size */
+	int _reduce;
 };
 
 #endif
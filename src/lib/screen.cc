@@ -25,23 +25,20 @@
 
 using std::string;
 using std::vector;
+using boost::optional;
 
+/** Read a Screen from XML; certificates are not parsed until they are needed */
 Screen::Screen (cxml::ConstNodePtr node)
 	: name (node->string_child("Name"))
 	, notes (node->optional_string_child("Notes").get_value_or (""))
 {
-	if (node->optional_string_child ("Certificate")) {
-		recipient = dcp::Certificate (node->string_child ("Certificate"));
-	} else if (node->optional_string_child ("Recipient")) {
-		recipient = dcp::Certificate (node->string_child ("Recipient"));
+	_recipient_string = node->optional_string_child ("Certificate");
+	if (!_recipient_string) {
+		_recipient_string = node->optional_string_child ("Recipient");
 	}
 
 	BOOST_FOREACH (cxml::ConstNodePtr i, node->node_children ("TrustedDevice")) {
-		if (boost::algorithm::starts_with(i->content(), "-----BEGIN CERTIFICATE-----")) {
-			trusted_devices.push_back (TrustedDevice(dcp::Certificate(i->content())));
-		} else {
-			trusted_devices.push_back (TrustedDevice(i->content()));
-		}
+		trusted_devices.push_back (TrustedDevice(i->content()));
 	}
 }
 
@@ -49,8 +46,8 @@ void
 Screen::as_xml (xmlpp::Element* parent) const
 {
 	parent->add_child("Name")->add_child_text (name);
-	if (recipient) {
-		parent->add_child("Recipient")->add_child_text (recipient->certificate (true));
+	if (_recipient_string) {
+		parent->add_child("Recipient")->add_child_text (*_recipient_string);
 	}
 
 	parent->add_child("Notes")->add_child_text (notes);
@@ -70,23 +67,59 @@ Screen::trusted_device_thumbprints () const
 	return t;
 }
 
-TrustedDevice::TrustedDevice (string thumbprint)
-	: _thumbprint (thumbprint)
+optional<dcp::Certificate>
+Screen::recipient () const
 {
+	if (_recipient_string && !_recipient) {
+		_recipient = dcp::Certificate (*_recipient_string);
+	}
+
+	return _recipient;
+}
 
+void
+Screen::set_recipient (optional<dcp::Certificate> r)
+{
+	_recipient = r;
+	if (r) {
+		_recipient_string = r->certificate (true);
+	} else {
+		_recipient_string = optional<string> ();
+	}
+}
+
+/** @param s Either a certificate in PEM form or a thumbprint */
+TrustedDevice::TrustedDevice (string s)
+{
+	if (boost::algorithm::starts_with(s, "-----BEGIN CERTIFICATE-----")) {
+		_certificate_string = s;
+	} else {
+		_thumbprint = s;
+	}
 }
 
 TrustedDevice::TrustedDevice (dcp::Certificate certificate)
-	: _certificate (certificate)
+	: _certificate_string (certificate.certificate (true))
+	, _certificate (certificate)
 {
 
 }
 
+optional<dcp::Certificate>
+TrustedDevice::certificate () const
+{
+	if (_certificate_string && !_certificate) {
+		_certificate = dcp::Certificate (*_certificate_string);
+	}
+
+	return _certificate;
+}
+
 string
 TrustedDevice::as_string () const
 {
-	if (_certificate) {
-		return _certificate->certificate(true);
+	if (_certificate_string) {
+		return *_certificate_string;
 	}
 
 	return *_thumbprint;
@@ -95,8 +128,8 @@ TrustedDevice::as_string () const
 string
 TrustedDevice::thumbprint () const
 {
-	if (_certificate) {
-		return _certificate->thumbprint ();
+	if (_certificate_string) {
+		return certificate()->thumbprint ();
 	}
 
 	return *_thumbprint;
@@ -34,15 +34,16 @@ public:
 	explicit TrustedDevice (std::string);
 	explicit TrustedDevice (dcp::Certificate);
 
-	boost::optional<dcp::Certificate> certificate () const {
-		return _certificate;
-	}
-
+	boost::optional<dcp::Certificate> certificate () const;
 	std::string thumbprint () const;
 	std::string as_string () const;
 
 private:
-	boost::optional<dcp::Certificate> _certificate;
+	/** Certificate in PEM form, if we have one; it is only parsed into
+	 *  _certificate when someone needs it.
+	 */
+	boost::optional<std::string> _certificate_string;
+	mutable boost::optional<dcp::Certificate> _certificate;
 	boost::optional<std::string> _thumbprint;
 };
 
@@ -59,20 +60,34 @@ public:
 	Screen (std::string const & na, std::string const & no, boost::optional<dcp::Certificate> rec, std::vector<TrustedDevice> td)
 		: name (na)
 		, notes (no)
-		, recipient (rec)
 		, trusted_devices (td)
-	{}
+	{
+		set_recipient (rec);
+	}
 
 	explicit Screen (cxml::ConstNodePtr);
 
 	void as_xml (xmlpp::Element *) const;
 	std::vector<std::string> trusted_device_thumbprints () const;
 
+	boost::optional<dcp::Certificate> recipient () const;
+	void set_recipient (boost::optional<dcp::Certificate> r);
+
+	bool has_recipient () const {
+		return static_cast<bool> (_recipient_string);
+	}
+
 	boost::shared_ptr<Cinema> cinema;
 	std::string name;
 	std::string notes;
-	boost::optional<dcp::Certificate> recipient;
 	std::vector<TrustedDevice> trusted_devices;
+
+private:
+	/** Recipient certificate in PEM form; parsing certificates is slow so we
+	 *  only do it (into _recipient) when the certificate is asked for.
+	 */
+	boost::optional<std::string> _recipient_string;
+	mutable boost::optional<dcp::Certificate> _recipient;
 };
 
 #endif
@@ -22,12 +22,14 @@
 #include "cross.h"
 #include "exceptions.h"
 #include "string_text_file_content.h"
+#include "parsed_file_cache.h"
 #include <sub/subrip_reader.h>
 #include <sub/ssa_reader.h>
 #include <sub/stl_binary_reader.h>
 #include <sub/collect.h>
 #include <unicode/ucsdet.h>
 #include <unicode/ucnv.h>
+#include <algorithm>
 #include <iostream>
 
 #include "i18n.h"
@@ -40,17 +42,27 @@ using boost::scoped_array;
 using boost::optional;
 using dcp::Data;
 
-StringTextFile::StringTextFile (shared_ptr<const StringTextFileContent> content)
+static bool
+earlier (sub::Subtitle const & a, sub::Subtitle const & b)
+{
+	return a.from.all_as_seconds() < b.from.all_as_seconds();
+}
+
+/** Parse a subtitle file.
+ *  @return Its subtitles, sorted by start time.
+ */
+static shared_ptr<const vector<sub::Subtitle> >
+read_subtitles (boost::filesystem::path file)
 {
-	string ext = content->path(0).extension().string();
+	string ext = file.extension().string();
 	transform (ext.begin(), ext.end(), ext.begin(), ::tolower);
 
 	sub::Reader* reader = 0;
 
 	if (ext == ".stl") {
-		FILE* f = fopen_boost (content->path(0), "rb");
+		FILE* f = fopen_boost (file, "rb");
 		if (!f) {
-			throw OpenFileError (content->path(0), errno, OpenFileError::READ);
+			throw OpenFileError (file, errno, OpenFileError::READ);
 		}
 		try {
 			reader = new sub::STLBinaryReader (f);
@@ -63,7 +75,7 @@ StringTextFile::StringTextFile (shared_ptr<const StringTextFileContent> content)
 	} else {
 		/* Text-based file; sort out its character encoding before we try to parse it */
 
-		Data in (content->path (0));
+		Data in (file);
 
 		UErrorCode status = U_ZERO_ERROR;
 		UCharsetDetector* detector = ucsdet_open (&status);
@@ -105,30 +117,46 @@ StringTextFile::StringTextFile (shared_ptr<const StringTextFileContent> content)
 		}
 	}
 
+	shared_ptr<vector<sub::Subtitle> > subtitles (new vector<sub::Subtitle> ());
 	if (reader) {
-		_subtitles = sub::collect<vector<sub::Subtitle> > (reader->subtitles ());
+		*subtitles = sub::collect<vector<sub::Subtitle> > (reader->subtitles ());
 	}
 
 	delete reader;
+
+	/* Our decoders find where to start after a seek by binary search */
+	std::stable_sort (subtitles->begin(), subtitles->end(), earlier);
+	return subtitles;
+}
+
+/** Cache of the subtitles in files that have been read recently, so that they are
+ *  parsed once rather than every time a decoder is made.
+ */
+static ParsedFileCache<vector<sub::Subtitle> > cache (16);
+
+StringTextFile::StringTextFile (shared_ptr<const StringTextFileContent> content)
+	: _subtitles (cache.get (content->path(0), &read_subtitles))
+{
+
 }
 
 /** @return time of first subtitle, if there is one */
 optional<ContentTime>
 StringTextFile::first () const
 {
-	if (_subtitles.empty()) {
+	if (_subtitles->empty()) {
 		return optional<ContentTime>();
 	}
 
-	return ContentTime::from_seconds(_subtitles[0].from.all_as_seconds());
+	return ContentTime::from_seconds((*_subtitles)[0].from.all_as_seconds());
 }
 
 ContentTime
 StringTextFile::length () const
 {
-	if (_subtitles.empty ()) {
+	if (_subtitles->empty ()) {
 		return ContentTime ();
 	}
 
-	return ContentTime::from_seconds (_subtitles.back().to.all_as_seconds ());
+	return ContentTime::from_seconds (_subtitles->back().to.all_as_seconds ());
 }
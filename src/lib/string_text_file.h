@@ -47,7 +47,10 @@ public:
 	ContentTime length () const;
 
 protected:
-	std::vector<sub::Subtitle> _subtitles;
+	/** our subtitles, sorted by start time; these may be shared with other StringTextFiles
+	 *  for the same file.
+	 */
+	boost::shared_ptr<const std::vector<sub::Subtitle> > _subtitles;
 };
 
 #endif
@@ -24,6 +24,7 @@
 #include "text_decoder.h"
 #include <dcp/subtitle_string.h>
 #include <boost/foreach.hpp>
+#include <algorithm>
 #include <iostream>
 
 using std::list;
@@ -41,12 +42,18 @@ StringTextFileDecoder::StringTextFileDecoder (shared_ptr<const Film> film, share
 	, _next (0)
 {
 	ContentTime first;
-	if (!_subtitles.empty()) {
-		first = content_time_period(_subtitles[0]).from;
+	if (!_subtitles->empty()) {
+		first = content_time_period((*_subtitles)[0]).from;
 	}
 	text.push_back (shared_ptr<TextDecoder> (new TextDecoder (this, content->only_text(), first)));
 }
 
+static bool
+starts_before (sub::Subtitle const & s, ContentTime t)
+{
+	return ContentTime::from_seconds (s.from.all_as_seconds ()) < t;
+}
+
 void
 StringTextFileDecoder::seek (ContentTime time, bool accurate)
 {
@@ -60,21 +67,18 @@ StringTextFileDecoder::seek (ContentTime time, bool accurate)
 
 	Decoder::seek (time, accurate);
 
-	_next = 0;
-	while (_next < _subtitles.size() && ContentTime::from_seconds (_subtitles[_next].from.all_as_seconds ()) < time) {
-		++_next;
-	}
+	_next = std::lower_bound (_subtitles->begin(), _subtitles->end(), time, starts_before) - _subtitles->begin();
 }
 
 bool
 StringTextFileDecoder::pass ()
 {
-	if (_next >= _subtitles.size ()) {
+	if (_next >= _subtitles->size ()) {
 		return true;
 	}
 
-	ContentTimePeriod const p = content_time_period (_subtitles[_next]);
-	only_text()->emit_plain (p, _subtitles[_next]);
+	ContentTimePeriod const p = content_time_period ((*_subtitles)[_next]);
+	only_text()->emit_plain (p, (*_subtitles)[_next]);
 
 	++_next;
 	return false;
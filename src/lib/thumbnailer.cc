@@ -0,0 +1,445 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "thumbnailer.h"
+#include "film.h"
+#include "content.h"
+#include "video_content.h"
+#include "decoder.h"
+#include "decoder_factory.h"
+#include "video_decoder.h"
+#include "audio_decoder.h"
+#include "text_decoder.h"
+#include "ffmpeg_decoder.h"
+#include "image_proxy.h"
+#include "image.h"
+#include "job_manager.h"
+#include "digester.h"
+#include "cross.h"
+#include "dcpomatic_log.h"
+#include "dcpomatic_assert.h"
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+
+using std::string;
+using std::pair;
+using std::make_pair;
+using std::max;
+using boost::shared_ptr;
+using boost::weak_ptr;
+using boost::optional;
+using boost::dynamic_pointer_cast;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
+
+/** @param height Height of thumbnails in pixels.
+ *  @param interval Approximate time between thumbnails, in seconds.
+ *  @param memory_limit Maximum size of thumbnails to keep in memory, in bytes.
+ *  @param directory Directory to keep thumbnails in on disk, or none to use only memory.
+ *  @param disk_limit Maximum size of thumbnails to keep on disk, in bytes.
+ */
+Thumbnailer::Thumbnailer (int height, double interval, size_t memory_limit, optional<boost::filesystem::path> directory, size_t disk_limit)
+	: _height (height)
+	, _interval (interval)
+	, _cache (AV_PIX_FMT_RGB24, memory_limit, directory, disk_limit)
+	, _busy (false)
+	, _cancel (false)
+	, _wanted (0)
+{
+	_thread = new boost::thread (boost::bind (&Thumbnailer::thread, this));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (_thread->native_handle(), "thumbnailer");
+#endif
+}
+
+Thumbnailer::~Thumbnailer ()
+{
+	_thread->interrupt ();
+	try {
+		_thread->join ();
+	} catch (boost::thread_interrupted& e) {
+		/* No problem */
+	}
+	delete _thread;
+}
+
+/** Ask for thumbnails of some content to be made (or found in the cache).  Thumbnails for
+ *  content are made in the order that it is added.
+ */
+void
+Thumbnailer::add (shared_ptr<const Film> film, shared_ptr<const Content> content)
+{
+	if (!content->video) {
+		return;
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_pending.push_back (make_pair (weak_ptr<const Film> (film), weak_ptr<const Content> (content)));
+	_summon.notify_all ();
+}
+
+/** Forget about any content that has been added, and stop work on the content that
+ *  thumbnails are being made for as soon as possible.  Thumbnails which have already
+ *  been made will still be returned by get().
+ */
+void
+Thumbnailer::cancel ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_pending.clear ();
+	_cancel = true;
+}
+
+/** @return true if there is nothing waiting to be made */
+bool
+Thumbnailer::idle () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _pending.empty() && !_busy;
+}
+
+/** @return Thumbnail of the nearest frame at or before some time in some content,
+ *  or 0 if that thumbnail is not in memory.  This does not wait for the disk, so it can be
+ *  called from the UI thread; if the thumbnail is on disk Ready will be emitted once it has
+ *  been read.  The returned Image must not be modified.
+ */
+shared_ptr<Image>
+Thumbnailer::get (shared_ptr<const Content> content, ContentTime time)
+{
+	if (!content->video) {
+		return shared_ptr<Image> ();
+	}
+
+	Frame const s = step (content);
+	Frame const frame = max (ContentTime(), time).frames_floor (content->video_frame_rate().get_value_or(24));
+	string const k = key (content, frame - frame % s);
+
+	shared_ptr<Image> image = _cache.get_from_memory (k);
+	if (!image) {
+		boost::mutex::scoped_lock lm (_mutex);
+		_load[k] = content;
+		_summon.notify_all ();
+	}
+
+	return image;
+}
+
+void
+Thumbnailer::thread ()
+try
+{
+	/* Thumbnails are nice to have, so we never want to slow anything else down */
+	set_background_priority ();
+
+	while (true) {
+		load ();
+
+		Request request;
+
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			_busy = false;
+			while (_pending.empty () && _load.empty ()) {
+				_summon.wait (lm);
+			}
+			if (_pending.empty ()) {
+				/* There are only thumbnails to load */
+				continue;
+			}
+			request = _pending.front ();
+			_pending.pop_front ();
+			_busy = true;
+			_cancel = false;
+		}
+
+		shared_ptr<const Film> film = request.first.lock ();
+		shared_ptr<const Content> content = request.second.lock ();
+		if (!film || !content) {
+			continue;
+		}
+
+		try {
+			make (film, content);
+		} catch (boost::thread_interrupted &) {
+			throw;
+		} catch (std::exception& e) {
+			LOG_WARNING ("Could not make thumbnails for %1 (%2)", content->path(0).string(), e.what());
+		}
+	}
+}
+catch (boost::thread_interrupted &)
+{
+	/* The thumbnailer is being destroyed */
+}
+
+void
+Thumbnailer::make (shared_ptr<const Film> film, shared_ptr<const Content> content)
+{
+	double const vfr = content->video_frame_rate().get_value_or(24);
+	Frame const s = step (content);
+	Frame const first = content->trim_start().frames_floor(vfr) / s * s;
+	Frame const last = content->video->length_after_3d_combine() - content->trim_end().frames_floor(vfr);
+
+	if (first >= last) {
+		return;
+	}
+
+	shared_ptr<Decoder> decoder;
+	/* last frame that decoder gave us */
+	optional<Frame> last_found;
+
+	/* Make every eighth thumbnail first so that the whole of a long piece of content is
+	   quickly covered, then fill in the gaps.
+	*/
+	for (int pass = 0; pass < 2; ++pass) {
+		for (Frame i = first; i < last; i += s) {
+			if ((((i / s) % 8) == 0) != (pass == 0)) {
+				continue;
+			}
+
+			boost::this_thread::interruption_point ();
+			load ();
+			wait_for_jobs ();
+
+			{
+				boost::mutex::scoped_lock lm (_mutex);
+				if (_cancel) {
+					return;
+				}
+			}
+
+			string const k = key (content, i);
+			if (_cache.has (k)) {
+				continue;
+			}
+
+			if (!decoder) {
+				/* Only make a decoder once we know that there is some decoding to do */
+				decoder = decoder_factory (film, content, true);
+				if (!decoder || !decoder->video) {
+					return;
+				}
+				if (decoder->audio) {
+					decoder->audio->set_ignore (true);
+				}
+				BOOST_FOREACH (shared_ptr<TextDecoder> j, decoder->text) {
+					j->set_ignore (true);
+				}
+				shared_ptr<FFmpegDecoder> ffmpeg = dynamic_pointer_cast<FFmpegDecoder> (decoder);
+				if (ffmpeg) {
+					ffmpeg->set_decode_reduction (reduction (content));
+				}
+				decoder->video->Data.connect (boost::bind (&Thumbnailer::video, this, _1));
+			}
+
+			_wanted = i;
+			_found = optional<ContentVideo> ();
+			if (!last_found || *last_found >= i || (i - *last_found) > (vfr * 2)) {
+				/* It is probably quicker to seek than to decode our way to the next frame */
+				decoder->seek (ContentTime::from_frames (i, vfr), true);
+			}
+			while (!_found) {
+				boost::this_thread::interruption_point ();
+				if (decoder->pass ()) {
+					break;
+				}
+			}
+
+			if (!_found) {
+				/* The content is shorter than we thought */
+				break;
+			}
+
+			last_found = _found->frame;
+			_cache.put (k, make_one (content, *_found));
+			emit (boost::bind (boost::ref (Ready), weak_ptr<const Content> (content)));
+		}
+	}
+}
+
+void
+Thumbnailer::video (ContentVideo video)
+{
+	if (!_found && video.frame >= _wanted && video.eyes != EYES_RIGHT) {
+		_found = video;
+	}
+}
+
+/** Make a thumbnail from a decoded frame, cropping it in the same way as the player would */
+shared_ptr<Image>
+Thumbnailer::make_one (shared_ptr<const Content> content, ContentVideo video) const
+{
+	dcp::Size const size = thumbnail_size (content);
+
+	pair<shared_ptr<Image>, int> prox = video.image->image (size);
+	shared_ptr<Image> im = prox.first;
+	int const reduce = prox.second;
+
+	Crop crop = content->video->crop ();
+	if (reduce > 0) {
+		/* Scale the crop down to account for the scaling that has already happened in ImageProxy::image */
+		crop.left >>= reduce;
+		crop.right >>= reduce;
+		crop.top >>= reduce;
+		crop.bottom >>= reduce;
+	}
+
+	switch (video.part) {
+	case PART_LEFT_HALF:
+		crop.right += im->size().width / 2;
+		break;
+	case PART_RIGHT_HALF:
+		crop.left += im->size().width / 2;
+		break;
+	case PART_TOP_HALF:
+		crop.bottom += im->size().height / 2;
+		break;
+	case PART_BOTTOM_HALF:
+		crop.top += im->size().height / 2;
+		break;
+	default:
+		break;
+	}
+
+	dcp::YUVToRGB yuv_to_rgb = dcp::YUV_TO_RGB_REC601;
+	if (content->video->colour_conversion()) {
+		yuv_to_rgb = content->video->colour_conversion()->yuv_to_rgb();
+	}
+
+	/* Unaligned so that the GUI can use the image data directly */
+	return im->crop_scale_window (crop, size, size, yuv_to_rgb, AV_PIX_FMT_RGB24, false, true);
+}
+
+/** Read thumbnails that get() has asked for from disk, if we have them there, and tell
+ *  the UI about them.
+ */
+void
+Thumbnailer::load ()
+{
+	while (true) {
+		pair<string, weak_ptr<const Content> > request;
+
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_load.empty ()) {
+				return;
+			}
+			request = *_load.begin ();
+			_load.erase (_load.begin ());
+		}
+
+		if (_cache.get (request.first)) {
+			emit (boost::bind (boost::ref (Ready), request.second));
+		}
+	}
+}
+
+/** Wait until there are no jobs (which might be using all our CPU) running.  Thumbnails
+ *  can still be read from disk meanwhile, as that takes little CPU.
+ */
+void
+Thumbnailer::wait_for_jobs ()
+{
+	while (JobManager::instance()->work_to_do ()) {
+		load ();
+		boost::this_thread::sleep (boost::posix_time::seconds (1));
+	}
+}
+
+/** @return Number of video frames between thumbnails of some content */
+Frame
+Thumbnailer::step (shared_ptr<const Content> content) const
+{
+	return max (int64_t (1), int64_t (llrint (_interval * content->video_frame_rate().get_value_or(24))));
+}
+
+/** @return Key to use in our cache for a thumbnail of a frame of some content; this
+ *  includes everything that affects what the thumbnail looks like.
+ */
+string
+Thumbnailer::key (shared_ptr<const Content> content, Frame frame) const
+{
+	Digester digester;
+	/* This includes any frame rate override, as FFmpegDecoder uses the rate to number frames */
+	digester.add (content->image_identifier ());
+	digester.add (content->video->frame_type ());
+	Crop const crop = content->video->crop ();
+	digester.add (crop.left);
+	digester.add (crop.right);
+	digester.add (crop.top);
+	digester.add (crop.bottom);
+	digester.add (content->video->sample_aspect_ratio().get_value_or(1));
+	if (content->video->colour_conversion()) {
+		digester.add (content->video->colour_conversion()->yuv_to_rgb());
+	}
+	digester.add (_height);
+	digester.add (frame);
+	return digester.get ();
+}
+
+/** @return Size of the picture of one eye of some content after cropping, in pixels */
+static dcp::Size
+eye_size_after_crop (shared_ptr<const Content> content)
+{
+	dcp::Size size = content->video->size_after_crop ();
+	switch (content->video->frame_type()) {
+	case VIDEO_FRAME_TYPE_3D_LEFT_RIGHT:
+		size.width /= 2;
+		break;
+	case VIDEO_FRAME_TYPE_3D_TOP_BOTTOM:
+		size.height /= 2;
+		break;
+	default:
+		break;
+	}
+	return size;
+}
+
+/** @return Size of the thumbnails of some content; they are _height pixels high, with the
+ *  width set to give the content's display aspect ratio.
+ */
+dcp::Size
+Thumbnailer::thumbnail_size (shared_ptr<const Content> content) const
+{
+	dcp::Size const size = eye_size_after_crop (content);
+	if (size.width <= 0 || size.height <= 0) {
+		return dcp::Size (_height, _height);
+	}
+
+	double const ratio = size.ratio() * content->video->sample_aspect_ratio().get_value_or(1);
+	return dcp::Size (max (1L, lrint (_height * ratio)), _height);
+}
+
+/** @return log2 of the factor by which FFmpeg can reduce the size of the video it decodes from
+ *  some content while still giving enough pixels for our thumbnails.
+ */
+int
+Thumbnailer::reduction (shared_ptr<const Content> content) const
+{
+	dcp::Size const size = eye_size_after_crop (content);
+
+	int reduction = 0;
+	while ((size.height >> (reduction + 1)) >= _height) {
+		++reduction;
+	}
+
+	return reduction;
+}
@@ -0,0 +1,110 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_THUMBNAILER_H
+#define DCPOMATIC_THUMBNAILER_H
+
+#include "frame_cache.h"
+#include "signaller.h"
+#include "content_video.h"
+#include "dcpomatic_time.h"
+#include "types.h"
+#include <boost/signals2.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/weak_ptr.hpp>
+#include <list>
+#include <map>
+
+class Film;
+class Content;
+class Image;
+
+/** @class Thumbnailer
+ *  @brief Maker of small pictures of video content, for things like the timeline.
+ *
+ *  A thread decodes one frame every `interval' seconds of each content it is given, at a reduced
+ *  resolution where the decoder allows it, and keeps the resulting RGB24 images in a FrameCache;
+ *  if the cache has a directory the thumbnails are kept there between sessions, keyed by
+ *  content digest.  The thread runs at low priority and waits whenever there are jobs (e.g. a
+ *  DCP encode) to run.  get() only looks in memory, leaving the thread to bring thumbnails in
+ *  from disk.  Ready is emitted in the UI thread whenever a new thumbnail is available.
+ */
+class Thumbnailer : public Signaller, public boost::noncopyable
+{
+public:
+	Thumbnailer (int height, double interval, size_t memory_limit, boost::optional<boost::filesystem::path> directory, size_t disk_limit);
+	~Thumbnailer ();
+
+	void add (boost::shared_ptr<const Film> film, boost::shared_ptr<const Content> content);
+	void cancel ();
+	bool idle () const;
+
+	boost::shared_ptr<Image> get (boost::shared_ptr<const Content> content, ContentTime time);
+	dcp::Size thumbnail_size (boost::shared_ptr<const Content> content) const;
+
+	int height () const {
+		return _height;
+	}
+
+	/** Emitted with the content which has a new thumbnail */
+	boost::signals2::signal<void (boost::weak_ptr<const Content>)> Ready;
+
+private:
+	void thread ();
+	void make (boost::shared_ptr<const Film> film, boost::shared_ptr<const Content> content);
+	boost::shared_ptr<Image> make_one (boost::shared_ptr<const Content> content, ContentVideo video) const;
+	void video (ContentVideo video);
+	void load ();
+	void wait_for_jobs ();
+	Frame step (boost::shared_ptr<const Content> content) const;
+	std::string key (boost::shared_ptr<const Content> content, Frame frame) const;
+	int reduction (boost::shared_ptr<const Content> content) const;
+
+	/** height of thumbnails in pixels */
+	int _height;
+	/** approximate time between thumbnails in seconds */
+	double _interval;
+	FrameCache _cache;
+
+	typedef std::pair<boost::weak_ptr<const Film>, boost::weak_ptr<const Content> > Request;
+
+	/** mutex to protect _pending, _load, _busy and _cancel */
+	mutable boost::mutex _mutex;
+	boost::condition _summon;
+	std::list<Request> _pending;
+	/** keys of thumbnails that get() did not find in memory, which the thread should look for
+	 *  on disk, with the content that each is for.
+	 */
+	std::map<std::string, boost::weak_ptr<const Content> > _load;
+	/** true if the thread is making thumbnails for some content */
+	bool _busy;
+	/** true if the thread should stop work on its current content */
+	bool _cancel;
+
+	/** frame that the thread is looking for; only used by the thread */
+	Frame _wanted;
+	/** frame that the thread has found; only used by the thread */
+	boost::optional<ContentVideo> _found;
+
+	boost::thread* _thread;
+};
+
+#endif
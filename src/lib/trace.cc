@@ -0,0 +1,271 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "trace.h"
+#include "cross.h"
+#include "exceptions.h"
+#include "util.h"
+#include "dcpomatic_assert.h"
+#include <dcp/raw_convert.h>
+#include <boost/foreach.hpp>
+#include <sys/time.h>
+#include <set>
+
+using std::string;
+using std::vector;
+using std::list;
+using std::set;
+using std::max;
+using boost::shared_ptr;
+using dcp::raw_convert;
+
+/* About 40 bytes per event, so this is a little under 1MB per thread */
+int const Trace::events_per_thread = 24576;
+
+Trace::Buffer::Buffer (int id_)
+	: id (id_)
+	, events (Trace::events_per_thread)
+	, written (0)
+	, first (0)
+	, in_use (true)
+{
+
+}
+
+Trace::Trace ()
+	: _enabled (false)
+	, _buffer (&Trace::release)
+{
+
+}
+
+Trace*
+Trace::instance ()
+{
+	/* This is thread-safe in C++11, and tracing can be started from any thread */
+	static Trace trace;
+	return &trace;
+}
+
+void
+Trace::set_enabled (bool e)
+{
+	_enabled = e;
+}
+
+void
+Trace::begin (TraceStage stage, char const * name, int64_t frame)
+{
+	add ('B', stage, name, frame);
+}
+
+void
+Trace::end (TraceStage stage, char const * name, int64_t frame)
+{
+	add ('E', stage, name, frame);
+}
+
+void
+Trace::instant (TraceStage stage, char const * name, int64_t frame)
+{
+	add ('i', stage, name, frame);
+}
+
+void
+Trace::counter (TraceStage stage, char const * name, int64_t value)
+{
+	add ('C', stage, name, value);
+}
+
+void
+Trace::add (char phase, TraceStage stage, char const * name, int64_t value)
+{
+	Buffer* buffer = _buffer.get ();
+	if (!buffer) {
+		/* This is the only time that a thread has to take a lock */
+		boost::mutex::scoped_lock lm (_mutex);
+		BOOST_FOREACH (shared_ptr<Buffer> i, _buffers) {
+			if (!i->in_use) {
+				/* Re-use the buffer of a thread that has finished, dropping its events */
+				i->in_use = true;
+				i->first = i->written.load ();
+				buffer = i.get ();
+				break;
+			}
+		}
+		if (!buffer) {
+			shared_ptr<Buffer> b (new Buffer (_buffers.size() + 1));
+			_buffers.push_back (b);
+			buffer = b.get ();
+		}
+		_buffer.reset (buffer);
+	}
+
+	struct timeval tv;
+	gettimeofday (&tv, 0);
+
+	uint64_t const n = buffer->written.load (boost::memory_order_relaxed);
+	Event& e = buffer->events[n % buffer->events.size()];
+	e.phase = phase;
+	e.stage = stage;
+	e.name = name;
+	e.time = int64_t (tv.tv_sec) * 1000000 + tv.tv_usec;
+	e.value = value;
+	buffer->written.store (n + 1, boost::memory_order_release);
+}
+
+/** Forget about all the events that have been recorded so far */
+void
+Trace::clear ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	BOOST_FOREACH (shared_ptr<Buffer> i, _buffers) {
+		i->first = i->written.load ();
+	}
+}
+
+/** @return Copy of the events in a buffer that have not been overwritten, oldest first */
+vector<Trace::Event>
+Trace::events (shared_ptr<Buffer> buffer) const
+{
+	uint64_t const size = buffer->events.size ();
+	uint64_t const end = buffer->written.load (boost::memory_order_acquire);
+	uint64_t start = max (buffer->first.load(), end > size ? end - size : 0);
+
+	vector<Event> copy;
+	for (uint64_t i = start; i < end; ++i) {
+		copy.push_back (buffer->events[i % size]);
+	}
+
+	/* The thread may have carried on while we were copying; anything that it
+	   might have overwritten (or be overwriting) has to go.
+	*/
+	uint64_t const after = buffer->written.load (boost::memory_order_acquire);
+	if (after + 1 > size + start) {
+		uint64_t const overwritten = std::min (uint64_t (copy.size()), after + 1 - size - start);
+		copy.erase (copy.begin(), copy.begin() + overwritten);
+	}
+
+	return copy;
+}
+
+static char const *
+stage_name (TraceStage stage)
+{
+	switch (stage) {
+	case TRACE_PLAYER:
+		return "player";
+	case TRACE_BUTLER:
+		return "butler";
+	case TRACE_ENCODER:
+		return "encoder";
+	case TRACE_SERVER:
+		return "server";
+	case TRACE_WRITER:
+		return "writer";
+	}
+
+	DCPOMATIC_ASSERT (false);
+	return "";
+}
+
+/** @return Events in the Trace Event Format used by chrome://tracing and Perfetto.
+ *  Each thread's events appear on their own track, named after the stages that
+ *  they came from.
+ */
+string
+Trace::chrome_json () const
+{
+	list<shared_ptr<Buffer> > buffers;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		buffers = _buffers;
+	}
+
+	string json = "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first = true;
+
+	BOOST_FOREACH (shared_ptr<Buffer> i, buffers) {
+		vector<Event> ev = events (i);
+		if (ev.empty ()) {
+			continue;
+		}
+
+		string const tid = raw_convert<string> (i->id);
+
+		set<string> stages;
+		BOOST_FOREACH (Event const & j, ev) {
+			stages.insert (stage_name (j.stage));
+		}
+
+		string name;
+		BOOST_FOREACH (string const & j, stages) {
+			if (!name.empty ()) {
+				name += "/";
+			}
+			name += j;
+		}
+
+		if (!first) {
+			json += ",\n";
+		}
+		first = false;
+
+		json += "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + tid + ", \"args\": { \"name\": \"" + name + " " + tid + "\" } }";
+
+		BOOST_FOREACH (Event const & j, ev) {
+			json += ",\n{ \"name\": \"" + string (j.name) + "\", \"cat\": \"" + stage_name (j.stage) + "\", \"ph\": \"" + j.phase + "\", "
+				"\"ts\": " + raw_convert<string> (j.time) + ", \"pid\": 1, \"tid\": " + tid;
+
+			switch (j.phase) {
+			case 'C':
+				json += ", \"args\": { \"" + string (j.name) + "\": " + raw_convert<string> (j.value) + " }";
+				break;
+			case 'i':
+				json += ", \"s\": \"t\"";
+				/* Fall through */
+			default:
+				if (j.value >= 0) {
+					json += ", \"args\": { \"frame\": " + raw_convert<string> (j.value) + " }";
+				}
+				break;
+			}
+
+			json += " }";
+		}
+	}
+
+	json += "\n] }\n";
+	return json;
+}
+
+void
+Trace::write_chrome_json (boost::filesystem::path file) const
+{
+	string const json = chrome_json ();
+
+	FILE* f = fopen_boost (file, "w");
+	if (!f) {
+		throw OpenFileError (file, errno, OpenFileError::WRITE);
+	}
+
+	checked_fwrite (json.c_str(), json.length(), f, file);
+	fclose (f);
+}
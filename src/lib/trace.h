@@ -0,0 +1,180 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/trace.h
+ *  @brief Trace class and TRACE_* macros for recording what the encode pipeline is doing.
+ */
+
+#ifndef DCPOMATIC_TRACE_H
+#define DCPOMATIC_TRACE_H
+
+#include <boost/atomic.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <vector>
+
+/** Parts of the pipeline that trace events can come from */
+enum TraceStage
+{
+	TRACE_PLAYER,
+	TRACE_BUTLER,
+	TRACE_ENCODER,
+	TRACE_SERVER,
+	TRACE_WRITER
+};
+
+/** @class Trace
+ *  @brief A record of timestamped events from the threads of the encode pipeline.
+ *
+ *  Each thread which records events gets its own fixed-size ring buffer, so recording
+ *  an event takes no locks and does no formatting; when a buffer is full its oldest events
+ *  are overwritten.  The buffer of a thread that has finished keeps its events until a new
+ *  thread needs a buffer, when it is re-used, so there are never more buffers than there
+ *  have been threads recording at the same time.  Nothing is recorded unless tracing has been enabled, and checking that
+ *  is just a read of an atomic flag.  The events can be written out at any time as JSON
+ *  which can be loaded into chrome://tracing or Perfetto.
+ *
+ *  Event names must be string literals (or otherwise live for ever) as only the pointer
+ *  is stored.
+ */
+class Trace : public boost::noncopyable
+{
+public:
+	static Trace* instance ();
+
+	void set_enabled (bool e);
+
+	bool enabled () const {
+		return _enabled.load (boost::memory_order_relaxed);
+	}
+
+	void begin (TraceStage stage, char const * name, int64_t frame = -1);
+	void end (TraceStage stage, char const * name, int64_t frame = -1);
+	void instant (TraceStage stage, char const * name, int64_t frame = -1);
+	void counter (TraceStage stage, char const * name, int64_t value);
+
+	void clear ();
+	std::string chrome_json () const;
+	void write_chrome_json (boost::filesystem::path file) const;
+
+	/** number of events that are kept for each thread */
+	static int const events_per_thread;
+
+private:
+	Trace ();
+
+	struct Event
+	{
+		/** Chrome trace phase: B(egin), E(nd), i(nstant) or C(ounter) */
+		char phase;
+		TraceStage stage;
+		char const * name;
+		/** time in microseconds */
+		int64_t time;
+		/** video frame index for B, E and i; value for C; -1 for none */
+		int64_t value;
+	};
+
+	/** Ring buffer of events from one thread.  Only that thread writes to it,
+	 *  and it only ever increases `written'.
+	 */
+	struct Buffer
+	{
+		explicit Buffer (int id_);
+
+		int const id;
+		std::vector<Event> events;
+		/** number of events that have ever been written */
+		boost::atomic<uint64_t> written;
+		/** index of the first event that we are interested in (set by clear()) */
+		boost::atomic<uint64_t> first;
+		/** true if a thread is using this buffer; false once it has finished */
+		boost::atomic<bool> in_use;
+	};
+
+	void add (char phase, TraceStage stage, char const * name, int64_t value);
+	/** Called when a thread finishes; buffers are owned by _buffers, so this just marks
+	 *  the thread's buffer as free for re-use.
+	 */
+	static void release (Buffer* buffer) {
+		buffer->in_use = false;
+	}
+	std::vector<Event> events (boost::shared_ptr<Buffer> buffer) const;
+
+	boost::atomic<bool> _enabled;
+
+	/** the calling thread's buffer; not owned by the thread_specific_ptr as the
+	 *  events should outlive their thread (until the buffer is re-used).
+	 */
+	boost::thread_specific_ptr<Buffer> _buffer;
+
+	/** mutex to protect _buffers */
+	mutable boost::mutex _mutex;
+	std::list<boost::shared_ptr<Buffer> > _buffers;
+};
+
+/** @class TraceScope
+ *  @brief Helper to record the begin and end of a block of code.
+ */
+class TraceScope : public boost::noncopyable
+{
+public:
+	TraceScope (TraceStage stage, char const * name, int64_t frame = -1)
+		: _stage (stage)
+		, _name (name)
+		, _frame (frame)
+		, _enabled (Trace::instance()->enabled())
+	{
+		if (_enabled) {
+			Trace::instance()->begin (_stage, _name, _frame);
+		}
+	}
+
+	~TraceScope ()
+	{
+		if (_enabled) {
+			Trace::instance()->end (_stage, _name, _frame);
+		}
+	}
+
+private:
+	TraceStage _stage;
+	char const * _name;
+	int64_t _frame;
+	bool _enabled;
+};
+
+#define DCPOMATIC_TRACE_CONCAT2(a, b) a##b
+#define DCPOMATIC_TRACE_CONCAT(a, b)  DCPOMATIC_TRACE_CONCAT2(a, b)
+
+/** Record the time spent in the rest of the enclosing block; takes a stage, name and optional frame index */
+#define TRACE_SCOPE(...)   TraceScope DCPOMATIC_TRACE_CONCAT(trace_scope_, __LINE__) (__VA_ARGS__)
+/** Record that something happened; takes a stage, name and optional frame index */
+#define TRACE_INSTANT(...) do { if (Trace::instance()->enabled()) { Trace::instance()->instant(__VA_ARGS__); } } while (0)
+/** Record the value of something (e.g. a queue length); takes a stage, name and value */
+#define TRACE_COUNTER(...) do { if (Trace::instance()->enabled()) { Trace::instance()->counter(__VA_ARGS__); } } while (0)
+
+#endif
@@ -71,9 +71,18 @@ TranscodeJob::json_name () const
 void
 TranscodeJob::set_encoder (shared_ptr<Encoder> e)
 {
+	boost::mutex::scoped_lock lm (_encoder_mutex);
 	_encoder = e;
 }
 
+/** @return Our encoder, or 0 if it has not been set or has finished */
+shared_ptr<Encoder>
+TranscodeJob::encoder () const
+{
+	boost::mutex::scoped_lock lm (_encoder_mutex);
+	return _encoder;
+}
+
 void
 TranscodeJob::run ()
 {
@@ -82,8 +91,9 @@ TranscodeJob::run ()
 		gettimeofday (&start, 0);
 		LOG_GENERAL_NC (N_("Transcode job starting"));
 
-		DCPOMATIC_ASSERT (_encoder);
-		_encoder->go ();
+		shared_ptr<Encoder> encoder = this->encoder ();
+		DCPOMATIC_ASSERT (encoder);
+		encoder->go ();
 		set_progress (1);
 		set_state (FINISHED_OK);
 
@@ -92,25 +102,25 @@ TranscodeJob::run ()
 
 		float fps = 0;
 		if (finish.tv_sec != start.tv_sec) {
-			fps = _encoder->frames_done() / (finish.tv_sec - start.tv_sec);
+			fps = encoder->frames_done() / (finish.tv_sec - start.tv_sec);
 		}
 
 		LOG_GENERAL (N_("Transcode job completed successfully: %1 fps"), fps);
 
-		if (dynamic_pointer_cast<DCPEncoder>(_encoder)) {
+		if (dynamic_pointer_cast<DCPEncoder>(encoder)) {
 			Analytics::instance()->successful_dcp_encode();
 		}
 
 		/* XXX: this shouldn't be here */
-		if (_film->upload_after_make_dcp() && dynamic_pointer_cast<DCPEncoder>(_encoder)) {
+		if (_film->upload_after_make_dcp() && dynamic_pointer_cast<DCPEncoder>(encoder)) {
 			shared_ptr<Job> job (new UploadJob (_film));
 			JobManager::instance()->add (job);
 		}
 
-		_encoder.reset ();
+		set_encoder (shared_ptr<Encoder> ());
 
 	} catch (...) {
-		_encoder.reset ();
+		set_encoder (shared_ptr<Encoder> ());
 		throw;
 	}
 }
@@ -118,23 +128,25 @@ TranscodeJob::run ()
 string
 TranscodeJob::status () const
 {
-	if (!_encoder) {
+	/* _encoder might be reset by the job's thread */
+	shared_ptr<Encoder> e = encoder ();
+	if (!e) {
 		return Job::status ();
 	}
 
 
 	char buffer[256];
-	if (finished() || _encoder->finishing()) {
+	if (finished() || e->finishing()) {
 		strncpy (buffer, Job::status().c_str(), 256);
 	} else {
 		snprintf (
 			buffer, sizeof(buffer), "%s; %" PRId64 "/%" PRId64 " frames",
 			Job::status().c_str(),
-			_encoder->frames_done(),
+			e->frames_done(),
 			_film->length().frames_round (_film->video_frame_rate ())
 			);
 
-		float const fps = _encoder->current_rate ();
+		float const fps = e->current_rate ();
 		if (fps) {
 			char fps_buffer[64];
 			/// TRANSLATORS: fps here is an abbreviation for frames per second
@@ -146,12 +158,23 @@ TranscodeJob::status () const
 	return buffer;
 }
 
+/** Add the current state of our encode, if there is one running, to a Metrics snapshot */
+void
+TranscodeJob::metrics (Metrics& metrics) const
+{
+	/* _encoder might be reset by the job's thread */
+	shared_ptr<Encoder> e = encoder ();
+	if (e) {
+		e->metrics (metrics);
+	}
+}
+
 /** @return Approximate remaining time in seconds */
 int
 TranscodeJob::remaining_time () const
 {
-	/* _encoder might be destroyed by the job-runner thread */
-	shared_ptr<Encoder> e = _encoder;
+	/* _encoder might be reset by the job's thread */
+	shared_ptr<Encoder> e = encoder ();
 
 	if (!e || e->finishing()) {
 		/* We aren't doing any actual encoding so just use the job's guess */
@@ -24,8 +24,10 @@
 
 #include "job.h"
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 class Encoder;
+class Metrics;
 
 /** @class TranscodeJob
  *  @brief A job which transcodes a Film to another format.
@@ -42,9 +44,15 @@ public:
 	std::string status () const;
 
 	void set_encoder (boost::shared_ptr<Encoder> t);
+	void metrics (Metrics& metrics) const;
 
 private:
 	int remaining_time () const;
+	boost::shared_ptr<Encoder> encoder () const;
 
+	/** mutex to protect _encoder, which is reset by the job's thread while
+	 *  other threads may be looking at it.
+	 */
+	mutable boost::mutex _encoder_mutex;
 	boost::shared_ptr<Encoder> _encoder;
 };
@@ -45,6 +45,9 @@
 #include "image.h"
 #include "text_decoder.h"
 #include "job_manager.h"
+#include "log.h"
+#include "dcpomatic_log.h"
+#include "crypto.h"
 #include <dcp/locale_convert.h>
 #include <dcp/util.h>
 #include <dcp/raw_convert.h>
@@ -73,6 +76,7 @@ extern "C" {
 #include <iostream>
 #include <fstream>
 #include <climits>
+#include <cmath>
 #include <stdexcept>
 #ifdef DCPOMATIC_POSIX
 #include <execinfo.h>
@@ -316,6 +320,11 @@ terminate ()
 			  << std::endl;
 	}
 
+	if (dcpomatic_log) {
+		/* Get anything that the log has queued onto disk before we go */
+		dcpomatic_log->flush ();
+	}
+
 	abort();
 }
 
@@ -378,6 +387,7 @@ dcpomatic_setup ()
 #endif
 
 	Pango::init ();
+	dcpomatic::setup_openssl_threads ();
 	dcp::init ();
 
 #if defined(DCPOMATIC_WINDOWS) || defined(DCPOMATIC_OSX)
@@ -816,21 +826,63 @@ audio_channel_types (list<int> mapped, int channels)
 	return make_pair (non_lfe, lfe);
 }
 
-shared_ptr<AudioBuffers>
-remap (shared_ptr<const AudioBuffers> input, int output_channels, AudioMapping map)
+/** @return true if remapping some audio with a mapping would leave it as it is */
+static bool
+is_identity (shared_ptr<const AudioBuffers> input, int output_channels, AudioMapping const & map)
 {
+	if (input->channels() != output_channels || map.input_channels() != output_channels || map.output_channels() < output_channels) {
+		return false;
+	}
+
+	for (int i = 0; i < map.input_channels(); ++i) {
+		for (int j = 0; j < output_channels; ++j) {
+			if (map.get(i, j) != (i == j ? 1 : 0)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/** Remap some audio to a different set of channels, applying some gain at the same time.
+ *  @param input Audio to remap.
+ *  @param output_channels Number of channels in the result.
+ *  @param map Mapping from the channels of `input' to those of the result.
+ *  @param gain Gain to apply in dB.
+ *  @return Remapped audio.  If the mapping and gain would make no difference this
+ *  shares the data of `input' rather than copying it, which is why it is const.
+ */
+shared_ptr<const AudioBuffers>
+remap (shared_ptr<const AudioBuffers> input, int output_channels, AudioMapping map, float gain)
+{
+	if (gain == 0 && is_identity (input, output_channels, map)) {
+		return shared_ptr<const AudioBuffers> (new AudioBuffers (input, 0, input->frames()));
+	}
+
 	shared_ptr<AudioBuffers> mapped (new AudioBuffers (output_channels, input->frames()));
 	mapped->make_silent ();
 
+	float const linear = pow (10, gain / 20);
+	int const frames = input->frames ();
+
 	for (int i = 0; i < map.input_channels(); ++i) {
 		for (int j = 0; j < mapped->channels(); ++j) {
-			if (map.get (i, static_cast<dcp::Channel> (j)) > 0) {
-				mapped->accumulate_channel (
-					input.get(),
-					i,
-					static_cast<dcp::Channel> (j),
-					map.get (i, static_cast<dcp::Channel> (j))
-					);
+			float const m = map.get (i, static_cast<dcp::Channel> (j));
+			if (m <= 0) {
+				continue;
+			}
+			if (gain == 0) {
+				mapped->accumulate_channel (input.get(), i, static_cast<dcp::Channel> (j), m);
+			} else {
+				/* Apply the gain and then the mapping, in that order, so that we get
+				   the same result as AudioBuffers::apply_gain followed by a remap.
+				*/
+				float const * s = input->data (i);
+				float* d = mapped->data (j);
+				for (int k = 0; k < frames; ++k) {
+					*d++ += ((*s++) * linear) * m;
+				}
 			}
 		}
 	}
@@ -863,6 +915,32 @@ checked_fwrite (void const * ptr, size_t size, FILE* stream, boost::filesystem::
 	}
 }
 
+/** Write a string to a file via a temporary file, so that there is never a partially-written
+ *  file with the final name.
+ */
+void
+write_file_atomically (string contents, boost::filesystem::path path)
+{
+	boost::filesystem::path tmp = path;
+	tmp += ".tmp";
+
+	FILE* f = fopen_boost (tmp, "wb");
+	if (!f) {
+		throw OpenFileError (tmp, errno, OpenFileError::WRITE);
+	}
+
+	checked_fwrite (contents.c_str(), contents.length(), f, tmp);
+	if (fclose (f) != 0) {
+		/* Some of what we wrote may still have been buffered, and not made it to the disk */
+		int const e = errno;
+		boost::system::error_code ec;
+		boost::filesystem::remove (tmp, ec);
+		throw WriteFileError (tmp, e);
+	}
+
+	boost::filesystem::rename (tmp, path);
+}
+
 void
 checked_fread (void* ptr, size_t size, FILE* stream, boost::filesystem::path path)
 {
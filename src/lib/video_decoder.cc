@@ -41,6 +41,7 @@ VideoDecoder::VideoDecoder (Decoder* parent, shared_ptr<const Content> c)
 	: DecoderPart (parent)
 	, _content (c)
 	, _frame_interval_checker (new FrameIntervalChecker())
+	, _skip (false)
 {
 
 }
@@ -53,6 +54,8 @@ VideoDecoder::VideoDecoder (Decoder* parent, shared_ptr<const Content> c)
  *     2: frame 1 left
  *     3: frame 1 right
  *  and so on.
+ *  @param image Image of the frame; this may be 0 if will_skip() returned true for the frame,
+ *  so that the decoder did not bother to decode it.
  */
 void
 VideoDecoder::emit (shared_ptr<const Film> film, shared_ptr<const ImageProxy> image, Frame decoder_frame)
@@ -122,6 +125,20 @@ VideoDecoder::emit (shared_ptr<const Film> film, shared_ptr<const ImageProxy> im
 		}
 	}
 
+	if (_skip && (frame % 2) == 1) {
+		/* Nobody wants this frame, so don't pass it on */
+		if (vft == VIDEO_FRAME_TYPE_3D) {
+			_last_emitted_frame = frame;
+		}
+		if (vft == VIDEO_FRAME_TYPE_3D || vft == VIDEO_FRAME_TYPE_3D_ALTERNATE) {
+			_last_emitted_eyes = eyes;
+		}
+		_position = ContentTime::from_frames (frame, afr);
+		return;
+	}
+
+	DCPOMATIC_ASSERT (image);
+
 	switch (vft) {
 	case VIDEO_FRAME_TYPE_2D:
 		Data (ContentVideo (image, frame, EYES_BOTH, PART_WHOLE));
@@ -160,6 +177,28 @@ VideoDecoder::emit (shared_ptr<const Film> film, shared_ptr<const ImageProxy> im
 	_position = ContentTime::from_frames (frame, afr);
 }
 
+/** @param decoder_frame Frame index of the next frame that the decoder will pass to emit(), as it would be
+ *  given to emit().
+ *  @return true if we will throw the frame away, so the decoder need not do the work of decoding it.
+ */
+bool
+VideoDecoder::will_skip (shared_ptr<const Film> film, Frame decoder_frame) const
+{
+	if (!_skip || ignore()) {
+		return false;
+	}
+
+	VideoFrameType const vft = _content->video->frame_type();
+	if (vft == VIDEO_FRAME_TYPE_3D || vft == VIDEO_FRAME_TYPE_3D_ALTERNATE) {
+		/* The frame index depends on which eye is next, which is not worth working out here */
+		return false;
+	}
+
+	/* This must give the same frame index as emit() */
+	Frame const frame = _position ? (_position->frames_round(_content->active_video_frame_rate(film)) + 1) : decoder_frame;
+	return (frame % 2) == 1;
+}
+
 void
 VideoDecoder::seek ()
 {
@@ -59,6 +59,15 @@ public:
 	void seek ();
 	void emit (boost::shared_ptr<const Film> film, boost::shared_ptr<const ImageProxy>, Frame frame);
 
+	/** Set whether every other frame (those with odd indices) should be thrown away rather than
+	 *  emitted, as is needed when the frame rate of the content is being halved.
+	 */
+	void set_skip (bool s) {
+		_skip = s;
+	}
+
+	bool will_skip (boost::shared_ptr<const Film> film, Frame decoder_frame) const;
+
 	boost::signals2::signal<void (ContentVideo)> Data;
 
 private:
@@ -68,6 +77,7 @@ private:
 	boost::optional<Eyes> _last_emitted_eyes;
 	boost::optional<ContentTime> _position;
 	boost::scoped_ptr<FrameIntervalChecker> _frame_interval_checker;
+	bool _skip;
 };
 
 #endif
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2017 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2020 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -20,65 +20,149 @@
 
 #include "video_ring_buffers.h"
 #include "player_video.h"
+#include "exceptions.h"
 #include "compose.hpp"
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include <list>
 #include <iostream>
 
 using std::list;
 using std::make_pair;
 using std::cout;
+using std::max;
 using std::pair;
 using std::string;
 using boost::shared_ptr;
 using boost::optional;
 
+/** @param capacity Maximum number of frames that can be held; put() will throw if this is exceeded */
+VideoRingBuffers::VideoRingBuffers (Frame capacity)
+	: _capacity (capacity)
+	, _data (new Slot[capacity])
+	, _write (0)
+	, _read (0)
+	, _underruns (0)
+{
+	for (Frame i = 0; i < _capacity; ++i) {
+		_data[i].time.store (0, boost::memory_order_relaxed);
+		_data[i].sequence.store (i, boost::memory_order_relaxed);
+	}
+}
+
 void
 VideoRingBuffers::put (shared_ptr<PlayerVideo> frame, DCPTime time)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_data.push_back (make_pair (frame, time));
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	Frame const write = _write.load (boost::memory_order_relaxed);
+	if (write - _read.load(boost::memory_order_acquire) >= _capacity) {
+		throw ProgrammingError (__FILE__, __LINE__, String::compose ("Video ring buffer overflow (%1 frames)", _capacity));
+	}
+
+	/* The frame that was last in this slot has been taken, but get() may not quite have finished with it */
+	Slot& slot = _data[write % _capacity];
+	while (slot.sequence.load(boost::memory_order_acquire) != write) {
+		boost::this_thread::yield ();
+	}
+
+	slot.frame = frame;
+	slot.time.store (time.get(), boost::memory_order_relaxed);
+	slot.sequence.store (write + 1, boost::memory_order_release);
+	_write.store (write + 1, boost::memory_order_release);
 }
 
+/** Get the next frame, without ever blocking.  This must only be called from one thread.
+ *  @return Frame and its time, or a null frame if there is none.
+ */
 pair<shared_ptr<PlayerVideo>, DCPTime>
 VideoRingBuffers::get ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	if (_data.empty ()) {
-		return make_pair(shared_ptr<PlayerVideo>(), DCPTime());
-	}
-	pair<shared_ptr<PlayerVideo>, DCPTime> const r = _data.front ();
-	_data.pop_front ();
+	Frame read = _read.load (boost::memory_order_acquire);
+	do {
+		if (read == _write.load(boost::memory_order_acquire)) {
+			++_underruns;
+			return make_pair(shared_ptr<PlayerVideo>(), DCPTime());
+		}
+		/* If this fails clear() has just taken the frame, and read is updated to say what it left */
+	} while (!_read.compare_exchange_weak (read, read + 1, boost::memory_order_acq_rel));
+
+	Slot& slot = _data[read % _capacity];
+	pair<shared_ptr<PlayerVideo>, DCPTime> r = make_pair (slot.frame, DCPTime (slot.time.load (boost::memory_order_relaxed)));
+	release (read);
 	return r;
 }
 
+/** Let go of the frame at some index, which the caller has taken, so that its slot can be used again */
+void
+VideoRingBuffers::release (Frame index)
+{
+	Slot& slot = _data[index % _capacity];
+	slot.frame.reset ();
+	slot.sequence.store (index + _capacity, boost::memory_order_release);
+}
+
+/** @return Time of the next frame that get() will return, or none if there is none.
+ *  get() may be taking that frame while this is running.
+ */
+optional<DCPTime>
+VideoRingBuffers::next_time () const
+{
+	/* With the lock held put() cannot overwrite the time that we look at */
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	Frame const read = _read.load (boost::memory_order_acquire);
+	if (read == _write.load (boost::memory_order_relaxed)) {
+		return optional<DCPTime> ();
+	}
+
+	return DCPTime (_data[read % _capacity].time.load (boost::memory_order_relaxed));
+}
+
 Frame
 VideoRingBuffers::size () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	return _data.size ();
+	Frame const read = _read.load (boost::memory_order_acquire);
+	return max (Frame (0), _write.load (boost::memory_order_acquire) - read);
 }
 
 bool
 VideoRingBuffers::empty () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	return _data.empty ();
+	return size() == 0;
 }
 
 void
 VideoRingBuffers::clear ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_data.clear ();
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	/* Take and let go of everything that has been written.  get() may be taking frames at
+	   the same time, so take them one at a time in the same way that it does.
+	*/
+	Frame const write = _write.load (boost::memory_order_relaxed);
+	Frame read = _read.load (boost::memory_order_acquire);
+	while (read < write) {
+		if (_read.compare_exchange_weak (read, read + 1, boost::memory_order_acq_rel)) {
+			release (read);
+			++read;
+		}
+	}
 }
 
+/** This must only be called from the same thread as get() */
 pair<size_t, string>
 VideoRingBuffers::memory_used () const
 {
+	/* With the lock held clear() cannot take the frames that we look at */
+	boost::mutex::scoped_lock lm (_producer_mutex);
+
+	Frame const read = _read.load (boost::memory_order_acquire);
+	Frame const write = _write.load (boost::memory_order_relaxed);
+
 	size_t m = 0;
-	for (list<pair<shared_ptr<PlayerVideo>, DCPTime> >::const_iterator i = _data.begin(); i != _data.end(); ++i) {
-		m += i->first->memory_used();
+	for (Frame i = read; i < write; ++i) {
+		m += _data[i % _capacity].frame->memory_used();
 	}
-	return make_pair(m, String::compose("%1 frames", _data.size()));
+	return make_pair(m, String::compose("%1 frames", write - read));
 }
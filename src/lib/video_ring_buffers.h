@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2017 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2020 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -24,15 +24,32 @@
 #include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/optional.hpp>
 #include <utility>
 
 class PlayerVideo;
 
+/** @class VideoRingBuffers
+ *  @brief A fixed-size ring buffer of video for one producer and one consumer.
+ *
+ *  put(), clear() and next_time() may be called from any thread (they are serialised
+ *  with a mutex) but get() and memory_used() must only be called from one thread.
+ *  get() never takes a lock.
+ *
+ *  get() and clear() both take frames by moving the read index with a compare-and-swap,
+ *  so each frame is taken by exactly one of them.  Each slot records when the frame that
+ *  was in it has been finished with, so that put() does not overwrite it too soon.
+ */
 class VideoRingBuffers : public boost::noncopyable
 {
 public:
+	explicit VideoRingBuffers (Frame capacity = 480);
+
 	void put (boost::shared_ptr<PlayerVideo> frame, DCPTime time);
 	std::pair<boost::shared_ptr<PlayerVideo>, DCPTime> get ();
+	boost::optional<DCPTime> next_time () const;
 
 	void clear ();
 	Frame size () const;
@@ -40,7 +57,33 @@ public:
 
 	std::pair<size_t, std::string> memory_used () const;
 
+	/** @return Number of calls to get() which found nothing to return */
+	int underruns () const {
+		return _underruns;
+	}
+
 private:
-	mutable boost::mutex _mutex;
-	std::list<std::pair<boost::shared_ptr<PlayerVideo>, DCPTime> > _data;
+	struct Slot
+	{
+		boost::shared_ptr<PlayerVideo> frame;
+		/** time of frame; next_time() may read this while get() is taking the frame */
+		boost::atomic<DCPTime::Type> time;
+		/** i if this slot is ready for frame i to be put into it, or i + 1 if frame i is in it */
+		boost::atomic<Frame> sequence;
+	};
+
+	void release (Frame index);
+
+	/** Number of slots in _data */
+	Frame const _capacity;
+	boost::scoped_array<Slot> _data;
+
+	/** Mutex to serialise calls to put(), clear(), next_time() and memory_used() */
+	mutable boost::mutex _producer_mutex;
+	/** Number of frames that have ever been written */
+	boost::atomic<Frame> _write;
+	/** Number of frames that have ever been taken by get() or clear() */
+	boost::atomic<Frame> _read;
+
+	boost::atomic<int> _underruns;
 };
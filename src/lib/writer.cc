@@ -36,6 +36,8 @@
 #include "util.h"
 #include "reel_writer.h"
 #include "text_content.h"
+#include "trace.h"
+#include "metrics.h"
 #include <dcp/cpl.h>
 #include <dcp/locale_convert.h>
 #include <boost/foreach.hpp>
@@ -131,6 +133,7 @@ Writer::write (Data encoded, Frame frame, Eyes eyes)
 	while (_queued_full_in_memory > _maximum_frames_in_memory) {
 		/* There are too many full frames in memory; wake the main writer thread and
 		   wait until it sorts everything out */
+		TRACE_SCOPE (TRACE_WRITER, "full", frame);
 		_empty_condition.notify_all ();
 		_full_condition.wait (lock);
 	}
@@ -352,9 +355,9 @@ try
 			}
 
 			/* Nothing to do: wait until something happens which may indicate that we do */
-			LOG_TIMING (N_("writer-sleep queue=%1"), _queue.size());
+			TRACE_COUNTER (TRACE_WRITER, "queue", _queue.size());
+			TRACE_SCOPE (TRACE_WRITER, "sleep");
 			_empty_condition.wait (lock);
-			LOG_TIMING (N_("writer-wake queue=%1"), _queue.size());
 		}
 
 		if (_finish && _queue.empty()) {
@@ -395,26 +398,41 @@ try
 
 			switch (qi.type) {
 			case QueueItem::FULL:
+			{
+				TRACE_SCOPE (TRACE_WRITER, "write", qi.frame);
 				LOG_DEBUG_ENCODE (N_("Writer FULL-writes %1 (%2)"), qi.frame, (int) qi.eyes);
 				if (!qi.encoded) {
 					qi.encoded = Data (_film->j2c_path (qi.reel, qi.frame, qi.eyes, false));
 				}
 				reel.write (qi.encoded, qi.frame, qi.eyes);
-				++_full_written;
 				break;
+			}
 			case QueueItem::FAKE:
+				TRACE_INSTANT (TRACE_WRITER, "fake-write", qi.frame);
 				LOG_DEBUG_ENCODE (N_("Writer FAKE-writes %1"), qi.frame);
 				reel.fake_write (qi.frame, qi.eyes, qi.size);
-				++_fake_written;
 				break;
 			case QueueItem::REPEAT:
+				TRACE_INSTANT (TRACE_WRITER, "repeat-write", qi.frame);
 				LOG_DEBUG_ENCODE (N_("Writer REPEAT-writes %1"), qi.frame);
 				reel.repeat_write (qi.frame, qi.eyes);
-				++_repeat_written;
 				break;
 			}
 
 			lock.lock ();
+
+			switch (qi.type) {
+			case QueueItem::FULL:
+				++_full_written;
+				break;
+			case QueueItem::FAKE:
+				++_fake_written;
+				break;
+			case QueueItem::REPEAT:
+				++_repeat_written;
+				break;
+			}
+
 			_full_condition.notify_all ();
 		}
 
@@ -443,10 +461,13 @@ try
 
 			LOG_GENERAL ("Writer full; pushes %1 to disk while awaiting %2", i->frame, awaiting);
 
-			i->encoded->write_via_temp (
-				_film->j2c_path (i->reel, i->frame, i->eyes, true),
-				_film->j2c_path (i->reel, i->frame, i->eyes, false)
-				);
+			{
+				TRACE_SCOPE (TRACE_WRITER, "push-to-disk", i->frame);
+				i->encoded->write_via_temp (
+					_film->j2c_path (i->reel, i->frame, i->eyes, true),
+					_film->j2c_path (i->reel, i->frame, i->eyes, false)
+					);
+			}
 
 			lock.lock ();
 			i->encoded.reset ();
@@ -746,6 +767,20 @@ Writer::set_encoder_threads (int threads)
 	_maximum_queue_size = threads * 16;
 }
 
+/** Add the current state of the writer to a Metrics snapshot */
+void
+Writer::metrics (Metrics& metrics) const
+{
+	boost::mutex::scoped_lock lm (_state_mutex);
+	metrics.add ("dcpomatic_writer_queue_frames", Metrics::GAUGE, "Frames waiting to be written", _queue.size());
+	metrics.add ("dcpomatic_writer_queued_in_memory_frames", Metrics::GAUGE, "Frames waiting to be written whose data is in memory", _queued_full_in_memory);
+	metrics.add ("dcpomatic_writer_maximum_in_memory_frames", Metrics::GAUGE, "Frames that can be held in memory before some are pushed to disk", _maximum_frames_in_memory);
+	metrics.add ("dcpomatic_writer_pushed_to_disk_total", Metrics::COUNTER, "Frames pushed to disk because too many were held in memory", _pushed_to_disk);
+	metrics.add ("dcpomatic_writer_frames_total", Metrics::COUNTER, "Frames written", _full_written, make_pair (string ("type"), string ("full")));
+	metrics.add ("dcpomatic_writer_frames_total", Metrics::COUNTER, "Frames written", _fake_written, make_pair (string ("type"), string ("fake")));
+	metrics.add ("dcpomatic_writer_frames_total", Metrics::COUNTER, "Frames written", _repeat_written, make_pair (string ("type"), string ("repeat")));
+}
+
 void
 Writer::write (ReferencedReelAsset asset)
 {
@@ -42,6 +42,7 @@ class Job;
 class Font;
 class ReferencedReelAsset;
 class ReelWriter;
+class Metrics;
 
 struct QueueItem
 {
@@ -112,6 +113,8 @@ public:
 
 	void set_encoder_threads (int threads);
 
+	void metrics (Metrics& metrics) const;
+
 private:
 	void thread ();
 	void terminate_thread (bool);
@@ -30,6 +30,7 @@
 #include "lib/signal_manager.h"
 #include "lib/encode_server_finder.h"
 #include "lib/json_server.h"
+#include "lib/trace.h"
 #include "lib/ratio.h"
 #include "lib/video_content.h"
 #include "lib/audio_content.h"
@@ -68,6 +69,7 @@ help (string n)
 	     << "  -d, --dcp-path       echo DCP's path to stdout on successful completion (implies -n)\n"
 	     << "  -c, --config <dir>   directory containing config.xml and cinemas.xml\n"
 	     << "      --dump           just dump a summary of the film's settings; don't encode\n"
+	     << "      --trace <file>   record what the encoder is doing and write it to a Chrome trace (JSON) file\n"
 	     << "\n"
 	     << "<FILM> is the film directory.\n";
 }
@@ -198,6 +200,7 @@ main (int argc, char* argv[])
 	bool list_servers_ = false;
 	bool dcp_path = false;
 	optional<boost::filesystem::path> config;
+	optional<boost::filesystem::path> trace;
 
 	int option_index = 0;
 	while (true) {
@@ -216,10 +219,11 @@ main (int argc, char* argv[])
 			{ "config", required_argument, 0, 'c' },
 			/* Just using A, B, C ... from here on */
 			{ "dump", no_argument, 0, 'A' },
+			{ "trace", required_argument, 0, 'B' },
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "vhfnrt:j:kAs:ldc:", long_options, &option_index);
+		int c = getopt_long (argc, argv, "vhfnrt:j:kAB:s:ldc:", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -253,6 +257,9 @@ main (int argc, char* argv[])
 		case 'A':
 			dump = true;
 			break;
+		case 'B':
+			trace = optarg;
+			break;
 		case 's':
 			servers = optarg;
 			break;
@@ -349,6 +356,10 @@ main (int argc, char* argv[])
 		cout << "\nMaking DCP for " << film->name() << "\n";
 	}
 
+	if (trace) {
+		Trace::instance()->set_enabled (true);
+	}
+
 	film->make_dcp ();
 
 	bool should_stop = false;
@@ -415,6 +426,15 @@ main (int argc, char* argv[])
 		}
 	}
 
+	if (trace) {
+		Trace::instance()->set_enabled (false);
+		try {
+			Trace::instance()->write_chrome_json (*trace);
+		} catch (std::exception& e) {
+			cerr << argv[0] << ": could not write trace (" << e.what() << ")\n";
+		}
+	}
+
 	/* This is just to stop valgrind reporting leaks due to JobManager
 	   indirectly holding onto codecs.
 	*/
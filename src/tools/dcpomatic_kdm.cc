@@ -311,7 +311,7 @@ private:
 			list<ScreenKDM> screen_kdms;
 			BOOST_FOREACH (shared_ptr<Screen> i, _screens->screens()) {
 
-				if (!i->recipient) {
+				if (!i->has_recipient ()) {
 					continue;
 				}
 
@@ -334,7 +334,7 @@ private:
 					ScreenKDM (
 						i,
 						kdm.encrypt (
-							signer, i->recipient.get(), i->trusted_device_thumbprints(), _output->formulation(),
+							signer, i->recipient().get(), i->trusted_device_thumbprints(), _output->formulation(),
 							!_output->forensic_mark_video(), _output->forensic_mark_audio() ? boost::optional<int>() : 0
 							)
 						)
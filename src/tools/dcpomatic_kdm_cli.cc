@@ -31,15 +31,18 @@
 #include "lib/emailer.h"
 #include "lib/dkdm_wrapper.h"
 #include "lib/screen.h"
+#include "lib/kdm_batch.h"
 #include <dcp/certificate.h>
 #include <dcp/decrypted_kdm.h>
 #include <dcp/encrypted_kdm.h>
+#include <boost/thread.hpp>
 #include <getopt.h>
 #include <iostream>
 
 using std::string;
 using std::cout;
 using std::cerr;
+using std::flush;
 using std::list;
 using std::vector;
 using std::runtime_error;
@@ -68,6 +71,7 @@ help ()
 		"  -S, --screen                             screen description\n"
 		"  -C, --certificate                        file containing projector certificate\n"
 		"  -T, --trusted-device                     file containing a trusted device's certificate\n"
+		"  -j, --threads                            number of threads to make KDMs with [default number of cores]\n"
 		"      --list-cinemas                       list known cinemas from the DCP-o-matic settings\n"
 		"      --list-dkdm-cpls                     list CPLs for which DCP-o-matic has DKDMs\n\n"
 		"CPL-ID must be the ID of a CPL that is mentioned in DCP-o-matic's DKDM list.\n\n"
@@ -127,6 +131,12 @@ always_overwrite ()
 	return true;
 }
 
+static void
+show_progress (float progress)
+{
+	cout << "Made " << lrintf (progress * 100) << "% of KDMs\r" << flush;
+}
+
 void
 write_files (
 	list<ScreenKDM> screen_kdms,
@@ -166,7 +176,13 @@ write_files (
 shared_ptr<Cinema>
 find_cinema (string cinema_name)
 {
-	list<shared_ptr<Cinema> > cinemas = Config::instance()->cinemas ();
+	/* Look it up by name first, as that way we only need to read the cinemas that match */
+	list<shared_ptr<Cinema> > cinemas = Config::instance()->find_cinemas (cinema_name);
+	if (!cinemas.empty ()) {
+		return cinemas.front ();
+	}
+
+	cinemas = Config::instance()->cinemas ();
 	list<shared_ptr<Cinema> >::const_iterator i = cinemas.begin();
 	while (
 		i != cinemas.end() &&
@@ -197,7 +213,8 @@ from_film (
 	dcp::Formulation formulation,
 	bool disable_forensic_marking_picture,
 	optional<int> disable_forensic_marking_audio,
-	bool zip
+	bool zip,
+	int threads
 	)
 {
 	shared_ptr<Film> film;
@@ -228,9 +245,19 @@ from_film (
 	values['e'] = dcp::LocalTime(valid_to).date() + " " + dcp::LocalTime(valid_to).time_of_day(true, false);
 
 	try {
-		list<ScreenKDM> screen_kdms = film->make_kdms (
-			screens, cpl, valid_from, valid_to, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio
+		boost::function<void (float)> progress;
+		if (verbose) {
+			progress = &show_progress;
+		}
+
+		KDMBatch batch (film, cpl);
+		list<ScreenKDM> screen_kdms = batch.make (
+			screens, valid_from, valid_to, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio,
+			threads, progress
 			);
+		if (verbose) {
+			cout << "\n";
+		}
 
 		write_files (screen_kdms, zip, output, container_name_format, filename_format, values, verbose);
 	} catch (FileError& e) {
@@ -258,7 +285,7 @@ sub_find_dkdm (shared_ptr<DKDMGroup> group, string cpl_id)
 		} else {
 			shared_ptr<DKDM> d = dynamic_pointer_cast<DKDM>(i);
 			assert (d);
-			if (d->dkdm().cpl_id() == cpl_id) {
+			if (d->cpl_id() == cpl_id) {
 				return d->dkdm();
 			}
 		}
@@ -273,40 +300,6 @@ find_dkdm (string cpl_id)
 	return sub_find_dkdm (Config::instance()->dkdms(), cpl_id);
 }
 
-dcp::EncryptedKDM
-kdm_from_dkdm (
-	dcp::DecryptedKDM dkdm,
-	dcp::Certificate target,
-	vector<string> trusted_devices,
-	dcp::LocalTime valid_from,
-	dcp::LocalTime valid_to,
-	dcp::Formulation formulation,
-	bool disable_forensic_marking_picture,
-	optional<int> disable_forensic_marking_audio
-	)
-{
-	/* Signer for new KDM */
-	shared_ptr<const dcp::CertificateChain> signer = Config::instance()->signer_chain ();
-	if (!signer->valid ()) {
-		error ("signing certificate chain is invalid.");
-	}
-
-	/* Make a new empty KDM and add the keys from the DKDM to it */
-	dcp::DecryptedKDM kdm (
-		valid_from,
-		valid_to,
-		dkdm.annotation_text().get_value_or(""),
-		dkdm.content_title_text(),
-		dcp::LocalTime().as_string()
-		);
-
-	BOOST_FOREACH (dcp::DecryptedKDMKey const & j, dkdm.keys()) {
-		kdm.add_key(j);
-	}
-
-	return kdm.encrypt (signer, target, trusted_devices, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio);
-}
-
 void
 from_dkdm (
 	list<shared_ptr<Screen> > screens,
@@ -320,7 +313,8 @@ from_dkdm (
 	dcp::Formulation formulation,
 	bool disable_forensic_marking_picture,
 	optional<int> disable_forensic_marking_audio,
-	bool zip
+	bool zip,
+	int threads
 	)
 {
 	dcp::NameFormat::Map values;
@@ -329,28 +323,20 @@ from_dkdm (
 	values['e'] = dcp::LocalTime(valid_to).date() + " " + dcp::LocalTime(valid_to).time_of_day(true, false);
 
 	try {
-		list<ScreenKDM> screen_kdms;
-		BOOST_FOREACH (shared_ptr<Screen> i, screens) {
-			if (!i->recipient) {
-				continue;
-			}
+		boost::function<void (float)> progress;
+		if (verbose) {
+			progress = &show_progress;
+		}
 
-			screen_kdms.push_back (
-				ScreenKDM (
-					i,
-					kdm_from_dkdm (
-						dkdm,
-						i->recipient.get(),
-						i->trusted_device_thumbprints(),
-						dcp::LocalTime(valid_from, i->cinema->utc_offset_hour(), i->cinema->utc_offset_minute()),
-						dcp::LocalTime(valid_to, i->cinema->utc_offset_hour(), i->cinema->utc_offset_minute()),
-						formulation,
-						disable_forensic_marking_picture,
-						disable_forensic_marking_audio
-						)
-					)
-				);
+		KDMBatch batch (dkdm);
+		list<ScreenKDM> screen_kdms = batch.make (
+			screens, valid_from, valid_to, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio,
+			threads, progress
+			);
+		if (verbose) {
+			cout << "\n";
 		}
+
 		write_files (screen_kdms, zip, output, container_name_format, filename_format, values, verbose);
 	} catch (FileError& e) {
 		cerr << program_name << ": " << e.what() << " (" << e.file().string() << ")\n";
@@ -358,6 +344,8 @@ from_dkdm (
 	} catch (KDMError& e) {
 		cerr << program_name << ": " << e.what() << "\n";
 		exit (EXIT_FAILURE);
+	} catch (InvalidSignerError& e) {
+		error ("signing certificate chain is invalid.");
 	}
 }
 
@@ -380,7 +368,7 @@ dump_dkdm_group (shared_ptr<DKDMGroup> group, int indent)
 			}
 			shared_ptr<DKDM> d = dynamic_pointer_cast<DKDM>(i);
 			assert(d);
-			cout << d->dkdm().cpl_id() << "\n";
+			cout << d->cpl_id() << "\n";
 		}
 	}
 }
@@ -405,6 +393,7 @@ int main (int argc, char* argv[])
 	dcp::Formulation formulation = dcp::MODIFIED_TRANSITIONAL_1;
 	bool disable_forensic_marking_picture = false;
 	optional<int> disable_forensic_marking_audio;
+	int threads = std::max (1U, boost::thread::hardware_concurrency ());
 
 	program_name = argv[0];
 
@@ -429,10 +418,11 @@ int main (int argc, char* argv[])
 			{ "trusted-device", required_argument, 0, 'T' },
 			{ "list-cinemas", no_argument, 0, 'B' },
 			{ "list-dkdm-cpls", no_argument, 0, 'D' },
+			{ "threads", required_argument, 0, 'j' },
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "ho:K:Z:f:t:d:F:pa::zvc:S:C:T:BD", long_options, &option_index);
+		int c = getopt_long (argc, argv, "ho:K:Z:f:t:d:F:pa::zvc:S:C:T:BDj:", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -524,6 +514,9 @@ int main (int argc, char* argv[])
 		case 'D':
 			list_dkdm_cpls = true;
 			break;
+		case 'j':
+			threads = std::max (1, atoi (optarg));
+			break;
 		}
 	}
 
@@ -587,7 +580,8 @@ int main (int argc, char* argv[])
 			formulation,
 			disable_forensic_marking_picture,
 			disable_forensic_marking_audio,
-			zip
+			zip,
+			threads
 			);
 	} else {
 		if (boost::filesystem::is_regular_file(thing)) {
@@ -612,7 +606,8 @@ int main (int argc, char* argv[])
 			formulation,
 			disable_forensic_marking_picture,
 			disable_forensic_marking_audio,
-			zip
+			zip,
+			threads
 			);
 	}
 
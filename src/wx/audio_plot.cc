@@ -46,6 +46,10 @@ AudioPlot::AudioPlot (wxWindow* parent)
 	: wxPanel (parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE)
 	, _smoothing (max_smoothing / 2)
 	, _gain_correction (0)
+	, _zoom (1)
+	, _zoom_start (0)
+	, _data_left (0)
+	, _data_width (0)
 {
 #ifndef __WXOSX__
 	SetDoubleBuffered (true);
@@ -86,6 +90,7 @@ AudioPlot::AudioPlot (wxWindow* parent)
 	Bind (wxEVT_PAINT, boost::bind (&AudioPlot::paint, this));
 	Bind (wxEVT_MOTION, boost::bind (&AudioPlot::mouse_moved, this, _1));
 	Bind (wxEVT_LEAVE_WINDOW, boost::bind (&AudioPlot::mouse_leave, this, _1));
+	Bind (wxEVT_MOUSEWHEEL, boost::bind (&AudioPlot::mouse_wheel, this, _1));
 
 	SetMinSize (wxSize (640, 512));
 }
@@ -94,6 +99,8 @@ void
 AudioPlot::set_analysis (shared_ptr<AudioAnalysis> a)
 {
 	_analysis = a;
+	_zoom = 1;
+	_zoom_start = 0;
 
 	if (!a) {
 		_message = _("Please wait; audio is being analysed...");
@@ -130,6 +137,10 @@ struct Metrics
 	int y_origin;
 	float x_scale; ///< pixels per data point
 	float y_scale;
+	double x_offset; ///< x position of point 0 (which may be off the left of the plot)
+	int level; ///< level of the analysis to plot
+	int first; ///< first point to plot
+	int last; ///< point after the last one to plot
 };
 
 void
@@ -160,8 +171,25 @@ AudioPlot::paint ()
 	metrics.db_label_width += 8;
 
 	int const data_width = GetSize().GetWidth() - metrics.db_label_width;
+	_data_left = metrics.db_label_width;
+	_data_width = data_width;
+
+	/* Use a level which gives us about as many points across the plot as the coarsest level
+	   has across the whole analysis.
+	*/
+	metrics.level = _analysis->levels() - 1;
+	for (double z = _zoom; z >= AudioAnalysis::level_factor && metrics.level > 0; z /= AudioAnalysis::level_factor) {
+		--metrics.level;
+	}
+
 	/* Assume all channels have the same number of points */
-	metrics.x_scale = data_width / float (_analysis->points (0));
+	int64_t const spp = _analysis->samples_per_point (metrics.level);
+	double const total = double (_analysis->points(0)) * _analysis->samples_per_point ();
+	int const points = _analysis->points (0, metrics.level);
+	metrics.x_scale = data_width * _zoom * spp / total;
+	metrics.x_offset = metrics.db_label_width - _zoom_start * _zoom * data_width;
+	metrics.first = max (0, int (floor (_zoom_start * total / spp)));
+	metrics.last = min (points, int (ceil ((_zoom_start + 1 / _zoom) * total / spp)) + 1);
 	metrics.height = GetSize().GetHeight ();
 	metrics.y_origin = 32;
 	metrics.y_scale = (metrics.height - metrics.y_origin) / -_minimum;
@@ -180,15 +208,16 @@ AudioPlot::paint ()
 
 	wxGraphicsPath v_grid = gc->CreatePath ();
 
-	DCPOMATIC_ASSERT (_analysis->samples_per_point() != 0.0);
-	double const pps = _analysis->sample_rate() * metrics.x_scale / _analysis->samples_per_point();
+	DCPOMATIC_ASSERT (spp != 0);
+	double const pps = _analysis->sample_rate() * metrics.x_scale / spp;
+	double const start = _zoom_start * total / _analysis->sample_rate();
 
 	gc->SetPen (*wxThePenList->FindOrCreatePen (wxColour (0, 0, 0), 1, wxPENSTYLE_SOLID));
 
 	double const mark_interval = calculate_mark_interval (rint (128 / pps));
 
-	DCPTime t = DCPTime::from_seconds (mark_interval);
-	while ((t.seconds() * pps) < data_width) {
+	DCPTime t = DCPTime::from_seconds ((floor (start / mark_interval) + 1) * mark_interval);
+	while (((t.seconds() - start) * pps) < data_width) {
 		double tc = t.seconds ();
 		int const h = tc / 3600;
 		tc -= h * 3600;
@@ -203,7 +232,7 @@ AudioPlot::paint ()
 		wxDouble str_leading;
 		gc->GetTextExtent (str, &str_width, &str_height, &str_descent, &str_leading);
 
-		int const tx = llrintf (metrics.db_label_width + t.seconds() * pps);
+		int const tx = llrintf (metrics.db_label_width + (t.seconds() - start) * pps);
 		gc->DrawText (str, tx - str_width / 2, metrics.height - metrics.y_origin + db_label_height);
 
 		v_grid.MoveToPoint (tx, metrics.height - metrics.y_origin + 4);
@@ -215,6 +244,9 @@ AudioPlot::paint ()
 	gc->SetPen (wxPen (wxColour (200, 200, 200)));
 	gc->StrokePath (v_grid);
 
+	/* Points either side of the visible ones should not be drawn over the labels */
+	gc->Clip (metrics.db_label_width, 0, data_width, metrics.height);
+
 	if (_type_visible[AudioPoint::PEAK]) {
 		for (int c = 0; c < MAX_DCP_AUDIO_CHANNELS; ++c) {
 			wxGraphicsPath p = gc->CreatePath ();
@@ -239,6 +271,8 @@ AudioPlot::paint ()
 		}
 	}
 
+	gc->ResetClip ();
+
 	wxGraphicsPath axes = gc->CreatePath ();
 	axes.MoveToPoint (metrics.db_label_width, 0);
 	axes.AddLineToPoint (metrics.db_label_width, metrics.height - metrics.y_origin);
@@ -273,16 +307,17 @@ AudioPlot::y_for_linear (float p, Metrics const & metrics) const
 void
 AudioPlot::plot_peak (wxGraphicsPath& path, int channel, Metrics const & metrics) const
 {
-	if (_analysis->points (channel) == 0) {
+	if (metrics.first >= metrics.last) {
 		return;
 	}
 
 	_peak[channel] = PointList ();
 
+	int64_t const spp = _analysis->samples_per_point (metrics.level);
+
 	float peak = 0;
-	int const N = _analysis->points(channel);
-	for (int i = 0; i < N; ++i) {
-		float const p = get_point(channel, i)[AudioPoint::PEAK];
+	for (int i = metrics.first; i < metrics.last; ++i) {
+		float const p = get_point(channel, i, metrics.level)[AudioPoint::PEAK];
 		peak -= 0.01f * (1 - log10 (_smoothing) / log10 (max_smoothing));
 		if (p > peak) {
 			peak = p;
@@ -292,8 +327,8 @@ AudioPlot::plot_peak (wxGraphicsPath& path, int channel, Metrics const & metrics
 
 		_peak[channel].push_back (
 			Point (
-				wxPoint (metrics.db_label_width + i * metrics.x_scale, y_for_linear (peak, metrics)),
-				DCPTime::from_frames (i * _analysis->samples_per_point(), _analysis->sample_rate()),
+				wxPoint (metrics.x_offset + i * metrics.x_scale, y_for_linear (peak, metrics)),
+				DCPTime::from_frames (i * spp, _analysis->sample_rate()),
 				20 * log10(peak)
 				)
 			);
@@ -310,44 +345,30 @@ AudioPlot::plot_peak (wxGraphicsPath& path, int channel, Metrics const & metrics
 void
 AudioPlot::plot_rms (wxGraphicsPath& path, int channel, Metrics const & metrics) const
 {
-	if (_analysis->points (channel) == 0) {
+	if (metrics.first >= metrics.last) {
 		return;
 	}
 
 	_rms[channel] = PointList();
 
-	list<float> smoothing;
-
-	int const N = _analysis->points(channel);
-
-	float const first = get_point(channel, 0)[AudioPoint::RMS];
-	float const last = get_point(channel, N - 1)[AudioPoint::RMS];
+	int64_t const spp = _analysis->samples_per_point (metrics.level);
+	int const N = _analysis->points (channel, metrics.level);
 
 	int const before = _smoothing / 2;
 	int const after = _smoothing - before;
 
-	/* Pre-load the smoothing list */
-	for (int i = 0; i < before; ++i) {
-		smoothing.push_back (first);
-	}
-	for (int i = 0; i < after; ++i) {
-		if (i < N) {
-			smoothing.push_back (get_point(channel, i)[AudioPoint::RMS]);
-		} else {
-			smoothing.push_back (last);
-		}
-	}
-
-	for (int i = 0; i < N; ++i) {
+	list<float> smoothing;
 
-		int const next_for_window = i + after;
+	/* Pre-load the smoothing list with the points before the first one that we will plot;
+	   points off the start or end of the analysis are taken as copies of the first or last.
+	*/
+	for (int i = metrics.first - before; i < metrics.first + after; ++i) {
+		smoothing.push_back (get_point(channel, max (0, min (N - 1, i)), metrics.level)[AudioPoint::RMS]);
+	}
 
-		if (next_for_window < N) {
-			smoothing.push_back (get_point(channel, i)[AudioPoint::RMS]);
-		} else {
-			smoothing.push_back (last);
-		}
+	for (int i = metrics.first; i < metrics.last; ++i) {
 
+		smoothing.push_back (get_point(channel, min (N - 1, i + after), metrics.level)[AudioPoint::RMS]);
 		smoothing.pop_front ();
 
 		float p = 0;
@@ -361,8 +382,8 @@ AudioPlot::plot_rms (wxGraphicsPath& path, int channel, Metrics const & metrics)
 
 		_rms[channel].push_back (
 			Point (
-				wxPoint (metrics.db_label_width + i * metrics.x_scale, y_for_linear (p, metrics)),
-				DCPTime::from_frames (i * _analysis->samples_per_point(), _analysis->sample_rate()),
+				wxPoint (metrics.x_offset + i * metrics.x_scale, y_for_linear (p, metrics)),
+				DCPTime::from_frames (i * spp, _analysis->sample_rate()),
 				20 * log10(p)
 				)
 			);
@@ -393,9 +414,9 @@ AudioPlot::set_gain_correction (double gain)
 }
 
 AudioPoint
-AudioPlot::get_point (int channel, int point) const
+AudioPlot::get_point (int channel, int point, int level) const
 {
-	AudioPoint p = _analysis->get_point (channel, point);
+	AudioPoint p = _analysis->get_point (channel, point, level);
 	for (int i = 0; i < AudioPoint::COUNT; ++i) {
 		p[i] *= pow (10, _gain_correction / 20);
 	}
@@ -455,3 +476,34 @@ AudioPlot::mouse_leave (wxMouseEvent &)
 	Refresh ();
 	Cursor (optional<DCPTime>(), optional<float>());
 }
+
+/** Zoom in or out around the mouse pointer, or scroll sideways if shift is held down
+ *  or the wheel is horizontal.
+ */
+void
+AudioPlot::mouse_wheel (wxMouseEvent& ev)
+{
+	if (!_analysis || _analysis->channels() == 0 || _data_width <= 0 || ev.GetWheelRotation() == 0) {
+		return;
+	}
+
+	double const x = max (0.0, min (1.0, (ev.GetX() - _data_left) / _data_width));
+
+	if (ev.ShiftDown() || ev.GetWheelAxis() == wxMOUSE_WHEEL_HORIZONTAL) {
+		_zoom_start += (ev.GetWheelRotation() > 0 ? -0.1 : 0.1) / _zoom;
+	} else {
+		/* Proportion of the analysis which is under the mouse */
+		double const centre = _zoom_start + x / _zoom;
+		/* Don't zoom in so far that there are fewer than 64 points of our finest level across the plot */
+		double const max_zoom = max (1.0, _analysis->points(0) / 64.0);
+		_zoom = max (1.0, min (max_zoom, ev.GetWheelRotation() > 0 ? _zoom * 2 : _zoom / 2));
+		_zoom_start = centre - x / _zoom;
+	}
+
+	_zoom_start = max (0.0, min (1 - 1 / _zoom, _zoom_start));
+
+	_rms.clear ();
+	_peak.clear ();
+	_cursor = optional<Point> ();
+	Refresh ();
+}
@@ -69,9 +69,10 @@ private:
 	void plot_peak (wxGraphicsPath &, int, Metrics const &) const;
 	void plot_rms (wxGraphicsPath &, int, Metrics const &) const;
 	float y_for_linear (float, Metrics const &) const;
-	AudioPoint get_point (int channel, int point) const;
+	AudioPoint get_point (int channel, int point, int level) const;
 	void mouse_moved (wxMouseEvent& ev);
 	void mouse_leave (wxMouseEvent& ev);
+	void mouse_wheel (wxMouseEvent& ev);
 	void search (std::map<int, PointList> const & search, wxMouseEvent const & ev, double& min_dist, Point& min_point) const;
 
 	boost::shared_ptr<AudioAnalysis> _analysis;
@@ -81,6 +82,14 @@ private:
 	std::vector<wxColour> _colours;
 	wxString _message;
 	float _gain_correction;
+	/** Factor by which we are zoomed in; 1 to show the whole analysis */
+	double _zoom;
+	/** Proportion of the whole analysis which is off the left-hand side of the plot */
+	double _zoom_start;
+	/** x position of the left-hand side of the data area when we last painted */
+	double _data_left;
+	/** width of the data area when we last painted */
+	int _data_width;
 
 	mutable std::map<int, PointList> _peak;
 	mutable std::map<int, PointList> _rms;
@@ -41,6 +41,7 @@
 #include "lib/video_decoder.h"
 #include "lib/timer.h"
 #include "lib/butler.h"
+#include "lib/frame_cache.h"
 #include "lib/log.h"
 #include "lib/config.h"
 #include "lib/compose.hpp"
@@ -220,6 +221,8 @@ FilmViewer::recreate_butler ()
 		_butler->disable_audio ();
 	}
 
+	setup_frame_cache ();
+
 	_closed_captions_dialog->set_butler (_butler);
 
 	if (was_running) {
@@ -227,6 +230,34 @@ FilmViewer::recreate_butler ()
 	}
 }
 
+/** Create or remove our frame cache according to the configuration, and give it to the butler */
+void
+FilmViewer::setup_frame_cache ()
+{
+	Config* config = Config::instance ();
+
+	if (config->frame_cache_memory() == 0) {
+		_frame_cache.reset ();
+	} else if (!_frame_cache) {
+		optional<boost::filesystem::path> dir;
+		if (config->frame_cache_disk() > 0) {
+			dir = config->frame_cache_directory ();
+		}
+		_frame_cache.reset (
+			new FrameCache (
+				AV_PIX_FMT_RGB24,
+				size_t(config->frame_cache_memory()) * 1024 * 1024,
+				dir,
+				size_t(config->frame_cache_disk()) * 1024 * 1024
+				)
+			);
+	}
+
+	if (_butler) {
+		_butler->set_frame_cache (_frame_cache);
+	}
+}
+
 void
 FilmViewer::refresh_panel ()
 {
@@ -652,6 +683,12 @@ FilmViewer::config_changed (Config::Property p)
 	}
 #endif
 
+	if (p == Config::FRAME_CACHE) {
+		_frame_cache.reset ();
+		setup_frame_cache ();
+		return;
+	}
+
 	if (p != Config::SOUND && p != Config::SOUND_OUTPUT) {
 		return;
 	}
@@ -777,6 +814,28 @@ FilmViewer::dcp_decode_reduction () const
 	return _dcp_decode_reduction;
 }
 
+/** @return Rate at which frames are being decoded and prepared for display, in frames per second */
+float
+FilmViewer::decode_rate () const
+{
+	if (!_butler) {
+		return 0;
+	}
+
+	return _butler->prepare_rate ();
+}
+
+/** @return Number of frames that the butler is currently trying to keep ready */
+int
+FilmViewer::readahead () const
+{
+	if (!_butler) {
+		return 0;
+	}
+
+	return _butler->video_readahead ();
+}
+
 DCPTime
 FilmViewer::one_video_frame () const
 {
@@ -36,6 +36,7 @@ class PlayerVideo;
 class Player;
 class Butler;
 class ClosedCaptionsDialog;
+class FrameCache;
 
 /** @class FilmViewer
  *  @brief A wx widget to view a Film.
@@ -76,6 +77,8 @@ public:
 	void set_coalesce_player_changes (bool c);
 	void set_dcp_decode_reduction (boost::optional<int> reduction);
 	boost::optional<int> dcp_decode_reduction () const;
+	float decode_rate () const;
+	int readahead () const;
 	void set_outline_content (bool o);
 	void set_eyes (Eyes e);
 	void set_pad_black (bool p);
@@ -115,6 +118,7 @@ private:
 	void film_change (ChangeType, Film::Property);
 	void content_change (ChangeType, int property);
 	void recreate_butler ();
+	void setup_frame_cache ();
 	void config_changed (Config::Property);
 	bool maybe_draw_background_image (wxPaintDC& dc);
 
@@ -150,6 +154,8 @@ private:
 	unsigned int _audio_block_size;
 	bool _playing;
 	boost::shared_ptr<Butler> _butler;
+	/** Cache of frames that we have already prepared, or 0 */
+	boost::shared_ptr<FrameCache> _frame_cache;
 
 	std::list<Frame> _latency_history;
 	/** Mutex to protect _latency_history */
@@ -66,6 +66,7 @@ using std::cout;
 using std::pair;
 using std::make_pair;
 using std::map;
+using std::exception;
 using boost::bind;
 using boost::shared_ptr;
 using boost::function;
@@ -202,7 +203,11 @@ private:
                 );
 
 		if (d->ShowModal () == wxID_OK) {
-			boost::filesystem::copy_file (Config::instance()->cinemas_file(), wx_to_std(d->GetPath()));
+			try {
+				Config::instance()->export_cinemas (wx_to_std (d->GetPath ()));
+			} catch (exception& e) {
+				error_dialog (_panel, _("Could not export cinemas."), std_to_wx (e.what ()));
+			}
 		}
 		d->Destroy ();
 	}
@@ -31,6 +31,7 @@
 #include "lib/screen.h"
 #include "lib/screen_kdm.h"
 #include "lib/job_manager.h"
+#include "lib/make_kdms_job.h"
 #include "lib/cinema_kdms.h"
 #include "lib/config.h"
 #include "lib/cinema.h"
@@ -38,6 +39,7 @@
 #include <dcp/exceptions.h>
 #include <wx/treectrl.h>
 #include <wx/listctrl.h>
+#include <wx/progdlg.h>
 #include <iostream>
 
 using std::string;
@@ -58,6 +60,7 @@ using namespace boost::placeholders;
 KDMDialog::KDMDialog (wxWindow* parent, shared_ptr<const Film> film)
 	: wxDialog (parent, wxID_ANY, _("Make KDMs"))
 	, _film (film)
+	, _progress (0)
 {
 	/* Main sizers */
 	wxBoxSizer* horizontal = new wxBoxSizer (wxHORIZONTAL);
@@ -129,12 +132,21 @@ KDMDialog::KDMDialog (wxWindow* parent, shared_ptr<const Film> film)
 	overall_sizer->SetSizeHints (this);
 }
 
+KDMDialog::~KDMDialog ()
+{
+	if (_job) {
+		_job_progress_connection.disconnect ();
+		_job_finished_connection.disconnect ();
+		_job->cancel ();
+	}
+}
+
 void
 KDMDialog::setup_sensitivity ()
 {
 	_screens->setup_sensitivity ();
 	_output->setup_sensitivity ();
-	_make->Enable (!_screens->screens().empty() && _timing->valid() && _cpl->has_selected());
+	_make->Enable (!_job && !_screens->screens().empty() && _timing->valid() && _cpl->has_selected());
 }
 
 bool
@@ -152,19 +164,64 @@ KDMDialog::make_clicked ()
 	shared_ptr<const Film> film = _film.lock ();
 	DCPOMATIC_ASSERT (film);
 
-	list<ScreenKDM> screen_kdms;
-	try {
-
-		screen_kdms = film->make_kdms (
-			_screens->screens(), _cpl->cpl(), _timing->from(), _timing->until(), _output->formulation(),
+	/* Run this job ourselves, rather than through the JobManager, so that it is not
+	   held up by (for example) a DCP being made.
+	*/
+	_job.reset (
+		new MakeKDMsJob (
+			film, _screens->screens(), _cpl->cpl(), _timing->from(), _timing->until(), _output->formulation(),
 			!_output->forensic_mark_video(), _output->forensic_mark_audio() ? boost::optional<int>() : 0
-			);
+			)
+		);
+
+	_progress = new wxProgressDialog (_("DCP-o-matic"), _("Making KDMs"), 1000, this, wxPD_CAN_ABORT | wxPD_APP_MODAL);
+	_job_progress_connection = _job->Progress.connect (bind (&KDMDialog::make_progress, this));
+	_job_finished_connection = _job->Finished.connect (bind (&KDMDialog::make_finished, this));
+	setup_sensitivity ();
+
+	_job->start ();
+}
+
+/** Called in the GUI thread when our MakeKDMsJob reports some progress */
+void
+KDMDialog::make_progress ()
+{
+	if (!_job || !_progress) {
+		return;
+	}
+
+	boost::optional<float> const p = _job->progress ();
+	bool const carry_on = p ? _progress->Update (lrintf (*p * 1000)) : _progress->Pulse ();
+	if (!carry_on) {
+		/* This will make the job finish, and we will hear about it in make_finished() */
+		_job->cancel ();
+	}
+}
+
+/** Called in the GUI thread when our MakeKDMsJob has finished */
+void
+KDMDialog::make_finished ()
+{
+	_job_progress_connection.disconnect ();
+	_job_finished_connection.disconnect ();
+
+	_progress->Destroy ();
+	_progress = 0;
+
+	shared_ptr<MakeKDMsJob> job = _job;
+	_job.reset ();
+	setup_sensitivity ();
 
-	} catch (runtime_error& e) {
-		error_dialog (this, std_to_wx(e.what()));
+	shared_ptr<const Film> film = _film.lock ();
+	if (!film || job->finished_cancelled ()) {
+		return;
+	} else if (job->finished_in_error ()) {
+		error_dialog (this, std_to_wx(job->error_summary()), std_to_wx(job->error_details()));
 		return;
 	}
 
+	list<ScreenKDM> screen_kdms = job->screen_kdms ();
+
 	pair<shared_ptr<Job>, int> result = _output->make (screen_kdms, film->name(), _timing, bind (&KDMDialog::confirm_overwrite, this, _1));
 	if (result.first) {
 		JobManager::instance()->add (result.first);
@@ -22,6 +22,7 @@
 #include <dcp/types.h>
 #include <wx/wx.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/signals2.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <map>
 
@@ -33,15 +34,20 @@ class KDMTimingPanel;
 class KDMOutputPanel;
 class KDMCPLPanel;
 struct CPLSummary;
+class MakeKDMsJob;
+class wxProgressDialog;
 
 class KDMDialog : public wxDialog
 {
 public:
 	KDMDialog (wxWindow *, boost::shared_ptr<const Film> film);
+	~KDMDialog ();
 
 private:
 	void setup_sensitivity ();
 	void make_clicked ();
+	void make_progress ();
+	void make_finished ();
 	bool confirm_overwrite (boost::filesystem::path path);
 
 	boost::weak_ptr<const Film> _film;
@@ -50,4 +56,11 @@ private:
 	KDMCPLPanel* _cpl;
 	KDMOutputPanel* _output;
 	wxButton* _make;
+
+	/** Job that is making KDMs, or 0 */
+	boost::shared_ptr<MakeKDMsJob> _job;
+	/** Dialog showing the progress of _job, or 0 */
+	wxProgressDialog* _progress;
+	boost::signals2::scoped_connection _job_progress_connection;
+	boost::signals2::scoped_connection _job_finished_connection;
 };
@@ -72,6 +72,8 @@ PlayerInformation::PlayerInformation (wxWindow* parent, weak_ptr<FilmViewer> vie
 		wxSizer* s = new wxBoxSizer (wxVERTICAL);
 		add_label_to_sizer(s, this, _("Performance"), false, 0)->SetFont(title_font);
 		_dropped = add_label_to_sizer(s, this, wxT(""), false, 0);
+		_decode_rate = add_label_to_sizer(s, this, wxT(""), false, 0);
+		_readahead = add_label_to_sizer(s, this, wxT(""), false, 0);
 		_decode_resolution = add_label_to_sizer(s, this, wxT(""), false, 0);
 		_sizer->Add (s, 2, wxEXPAND | wxALL, 6);
 	}
@@ -91,6 +93,8 @@ PlayerInformation::periodic_update ()
 	shared_ptr<FilmViewer> fv = _viewer.lock ();
 	if (fv) {
 		checked_set (_dropped, wxString::Format(_("Dropped frames: %d"), fv->dropped()));
+		checked_set (_decode_rate, wxString::Format(_("Decode rate: %.1f fps"), fv->decode_rate()));
+		checked_set (_readahead, wxString::Format(_("Readahead: %d frames"), fv->readahead()));
 	}
 }
 
@@ -39,6 +39,8 @@ private:
 	wxSizer* _sizer;
 	wxStaticText** _dcp;
 	wxStaticText* _dropped;
+	wxStaticText* _decode_rate;
+	wxStaticText* _readahead;
 	wxStaticText* _decode_resolution;
 	boost::scoped_ptr<wxTimer> _timer;
 };
@@ -244,7 +244,7 @@ ScreensPanel::edit_screen_clicked ()
 
 	pair<wxTreeItemId, shared_ptr<Screen> > s = *_selected_screens.begin();
 
-	ScreenDialog* d = new ScreenDialog (GetParent(), _("Edit screen"), s.second->name, s.second->notes, s.second->recipient, s.second->trusted_devices);
+	ScreenDialog* d = new ScreenDialog (GetParent(), _("Edit screen"), s.second->name, s.second->notes, s.second->recipient(), s.second->trusted_devices);
 	if (d->ShowModal () != wxID_OK) {
 		d->Destroy ();
 		return;
@@ -266,7 +266,7 @@ ScreensPanel::edit_screen_clicked ()
 
 	s.second->name = d->name ();
 	s.second->notes = d->notes ();
-	s.second->recipient = d->recipient ();
+	s.second->set_recipient (d->recipient ());
 	s.second->trusted_devices = d->trusted_devices ();
 	_targets->SetItemText (s.first, std_to_wx (d->name()));
 	Config::instance()->changed (Config::CINEMAS);
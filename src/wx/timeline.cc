@@ -37,6 +37,9 @@
 #include "lib/text_content.h"
 #include "lib/video_content.h"
 #include "lib/atmos_mxf_content.h"
+#include "lib/thumbnailer.h"
+#include "lib/config.h"
+#include "lib/image.h"
 #include <wx/graphics.h>
 #include <boost/weak_ptr.hpp>
 #include <boost/foreach.hpp>
@@ -100,6 +103,7 @@ Timeline::Timeline (wxWindow* parent, ContentPanel* cp, shared_ptr<Film> film)
 	_main_canvas->Bind   (wxEVT_LEFT_UP,    boost::bind (&Timeline::left_up,      this, _1));
 	_main_canvas->Bind   (wxEVT_RIGHT_DOWN, boost::bind (&Timeline::right_down,   this, _1));
 	_main_canvas->Bind   (wxEVT_MOTION,     boost::bind (&Timeline::mouse_moved,  this, _1));
+	_main_canvas->Bind   (wxEVT_LEAVE_WINDOW, boost::bind (&Timeline::mouse_left, this));
 	_main_canvas->Bind   (wxEVT_SIZE,       boost::bind (&Timeline::resized,      this));
 	_main_canvas->Bind   (wxEVT_SCROLLWIN_TOP,        boost::bind (&Timeline::scrolled,     this, _1));
 	_main_canvas->Bind   (wxEVT_SCROLLWIN_BOTTOM,     boost::bind (&Timeline::scrolled,     this, _1));
@@ -109,6 +113,19 @@ Timeline::Timeline (wxWindow* parent, ContentPanel* cp, shared_ptr<Film> film)
 	_main_canvas->Bind   (wxEVT_SCROLLWIN_PAGEDOWN,   boost::bind (&Timeline::scrolled,     this, _1));
 	_main_canvas->Bind   (wxEVT_SCROLLWIN_THUMBTRACK, boost::bind (&Timeline::scrolled,     this, _1));
 
+	/* Thumbnails are made every 10 seconds and are big enough to use for the hover preview;
+	   they are scaled down to fit in the tracks.
+	*/
+	Config* config = Config::instance ();
+	optional<boost::filesystem::path> thumbnail_directory;
+	if (config->thumbnail_cache_disk() > 0) {
+		thumbnail_directory = config->thumbnail_cache_directory ();
+	}
+	_thumbnailer.reset (
+		new Thumbnailer (128, 10, 64 * 1024 * 1024, thumbnail_directory, size_t (config->thumbnail_cache_disk()) * 1024 * 1024)
+		);
+	_thumbnail_ready_connection = _thumbnailer->Ready.connect (bind (&Timeline::thumbnail_ready, this, _1));
+
 	film_change (CHANGE_TYPE_DONE, Film::CONTENT);
 
 	SetMinSize (wxSize (640, 4 * pixels_per_track() + 96));
@@ -184,6 +201,16 @@ Timeline::paint_main ()
 		i->paint (gc, overlaps);
 	}
 
+	if (_hover_image) {
+		/* Preview of the content under the mouse pointer */
+		dcpomatic::Rect<int> const r = hover_rect ();
+		wxImage preview (_hover_image->size().width, _hover_image->size().height, _hover_image->data()[0], true);
+		gc->DrawBitmap (wxBitmap (preview), r.x, r.y, r.width, r.height);
+		gc->SetPen (*wxBLACK_PEN);
+		gc->SetBrush (*wxTRANSPARENT_BRUSH);
+		gc->DrawRectangle (r.x, r.y, r.width, r.height);
+	}
+
 	if (_zoom_point) {
 		/* Translate back as _down_point and _zoom_point do not take scroll into account */
 		gc->Translate (vsx * _x_scroll_rate, vsy * _y_scroll_rate);
@@ -247,9 +274,43 @@ Timeline::recreate_views ()
 
 	assign_tracks ();
 	setup_scrollbars ();
+	queue_thumbnails ();
 	Refresh ();
 }
 
+/** Ask our thumbnailer for thumbnails of all the film's video content, in order */
+void
+Timeline::queue_thumbnails ()
+{
+	shared_ptr<const Film> film = _film.lock ();
+	if (!film) {
+		return;
+	}
+
+	_thumbnailer->cancel ();
+	BOOST_FOREACH (shared_ptr<Content> i, film->content ()) {
+		if (i->video) {
+			_thumbnailer->add (film, i);
+		}
+	}
+}
+
+void
+Timeline::thumbnail_ready (weak_ptr<const Content> weak_content)
+{
+	shared_ptr<const Content> content = weak_content.lock ();
+	if (!content) {
+		return;
+	}
+
+	BOOST_FOREACH (shared_ptr<TimelineView> i, _views) {
+		shared_ptr<TimelineVideoContentView> cv = dynamic_pointer_cast<TimelineVideoContentView> (i);
+		if (cv && cv->content() == content) {
+			cv->force_redraw ();
+		}
+	}
+}
+
 void
 Timeline::film_content_change (ChangeType type, int property, bool frequent)
 {
@@ -264,6 +325,8 @@ Timeline::film_content_change (ChangeType type, int property, bool frequent)
 	} else if (property == ContentProperty::POSITION || property == ContentProperty::LENGTH) {
 		_reels_view->force_redraw ();
 	} else if (!frequent) {
+		/* Anything might have changed what the thumbnails look like */
+		queue_thumbnails ();
 		setup_scrollbars ();
 		Refresh ();
 	}
@@ -632,6 +695,7 @@ Timeline::mouse_moved (wxMouseEvent& ev)
 	switch (_tool) {
 	case SELECT:
 		mouse_moved_select (ev);
+		update_hover (ev);
 		break;
 	case ZOOM:
 		mouse_moved_zoom (ev);
@@ -664,6 +728,69 @@ Timeline::mouse_moved_zoom (wxMouseEvent& ev)
 	Refresh ();
 }
 
+void
+Timeline::mouse_left ()
+{
+	if (_hover_image) {
+		refresh_hover ();
+		_hover_image.reset ();
+	}
+}
+
+/** Show a preview of the video content under the mouse pointer, if we have one */
+void
+Timeline::update_hover (wxMouseEvent& ev)
+{
+	/* Position on the whole timeline, taking scroll into account */
+	wxPoint const p = _main_canvas->CalcUnscrolledPosition (ev.GetPosition ());
+
+	shared_ptr<Image> image;
+	if (!_left_down) {
+		/* Search backwards through views so that we find the uppermost one first */
+		for (TimelineViewList::reverse_iterator i = _views.rbegin(); i != _views.rend(); ++i) {
+			if ((*i)->bbox().contains (Position<int> (p.x, p.y))) {
+				shared_ptr<TimelineVideoContentView> view = dynamic_pointer_cast<TimelineVideoContentView> (*i);
+				if (view) {
+					image = view->thumbnail_at (p.x);
+				}
+				break;
+			}
+		}
+	}
+
+	if (!image && !_hover_image) {
+		return;
+	}
+
+	if (_hover_image) {
+		refresh_hover ();
+	}
+
+	_hover_image = image;
+	_hover_point = p;
+
+	if (_hover_image) {
+		refresh_hover ();
+	}
+}
+
+/** Redraw the area covered by the hover preview, which must be set */
+void
+Timeline::refresh_hover ()
+{
+	dcpomatic::Rect<int> const r = hover_rect().extended (1);
+	wxPoint const p = _main_canvas->CalcScrolledPosition (wxPoint (r.x, r.y));
+	_main_canvas->RefreshRect (wxRect (p.x, p.y, r.width, r.height), false);
+}
+
+/** @return Area of the timeline in which to draw _hover_image, which must be set */
+dcpomatic::Rect<int>
+Timeline::hover_rect () const
+{
+	DCPOMATIC_ASSERT (_hover_image);
+	return dcpomatic::Rect<int> (_hover_point.x + 16, _hover_point.y + 16, _hover_image->size().width, _hover_image->size().height);
+}
+
 void
 Timeline::right_down (wxMouseEvent& ev)
 {
@@ -860,6 +987,16 @@ Timeline::width () const
 	return _main_canvas->GetVirtualSize().GetWidth();
 }
 
+/** @return Part of the timeline which can currently be seen */
+dcpomatic::Rect<int>
+Timeline::visible_area () const
+{
+	int vsx, vsy;
+	_main_canvas->GetViewStart (&vsx, &vsy);
+	wxSize const size = _main_canvas->GetClientSize ();
+	return dcpomatic::Rect<int> (vsx * _x_scroll_rate, vsy * _y_scroll_rate, size.GetWidth(), size.GetHeight());
+}
+
 void
 Timeline::scrolled (wxScrollWinEvent& ev)
 {
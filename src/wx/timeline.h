@@ -29,7 +29,10 @@
 #include <boost/signals2.hpp>
 
 class Film;
+class Content;
 class ContentPanel;
+class Thumbnailer;
+class Image;
 class TimelineView;
 class TimelineTimeAxisView;
 class TimelineReelsView;
@@ -78,6 +81,12 @@ public:
 
 	int tracks_y_offset () const;
 
+	boost::shared_ptr<Thumbnailer> thumbnailer () const {
+		return _thumbnailer;
+	}
+
+	dcpomatic::Rect<int> visible_area () const;
+
 private:
 	void paint_labels ();
 	void paint_main ();
@@ -91,6 +100,10 @@ private:
 	void mouse_moved (wxMouseEvent &);
 	void mouse_moved_select (wxMouseEvent &);
 	void mouse_moved_zoom (wxMouseEvent &);
+	void mouse_left ();
+	void update_hover (wxMouseEvent &);
+	void refresh_hover ();
+	dcpomatic::Rect<int> hover_rect () const;
 	void film_change (ChangeType type, Film::Property);
 	void film_content_change (ChangeType type, int, bool frequent);
 	void resized ();
@@ -103,6 +116,8 @@ private:
 	void set_pixels_per_second (double pps);
 	void set_pixels_per_track (int h);
 	void zoom_all ();
+	void queue_thumbnails ();
+	void thumbnail_ready (boost::weak_ptr<const Content> content);
 
 	boost::shared_ptr<TimelineView> event_to_view (wxMouseEvent &);
 	TimelineContentViewList selected_views () const;
@@ -134,10 +149,16 @@ private:
 	int _y_scroll_rate;
 	int _pixels_per_track;
 	bool _first_resize;
+	boost::shared_ptr<Thumbnailer> _thumbnailer;
+	/** thumbnail of the content under the mouse pointer, if there is one */
+	boost::shared_ptr<Image> _hover_image;
+	/** position of the mouse pointer on the whole timeline when _hover_image was set */
+	wxPoint _hover_point;
 
 	static double const _minimum_pixels_per_second;
 	static int const _minimum_pixels_per_track;
 
 	boost::signals2::scoped_connection _film_changed_connection;
 	boost::signals2::scoped_connection _film_content_change_connection;
+	boost::signals2::scoped_connection _thumbnail_ready_connection;
 };
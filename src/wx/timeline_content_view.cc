@@ -128,6 +128,19 @@ TimelineContentView::do_paint (wxGraphicsContext* gc, list<dcpomatic::Rect<int>
 	gc->StrokePath (path);
 	gc->FillPath (path);
 
+	dcpomatic::Rect<int> const interior (
+		time_x (position) + 4,
+		y_pos (_track.get()) + 6,
+		time_x (position + len) - time_x (position) - 7,
+		_timeline.pixels_per_track() - 12
+		);
+
+	if (interior.width > 0 && interior.height > 0) {
+		gc->Clip (wxRegion (interior.x, interior.y, interior.width, interior.height));
+		paint_interior (gc, interior);
+		gc->ResetClip ();
+	}
+
 	/* Reel split points */
 	gc->SetPen (*wxThePenList->FindOrCreatePen (foreground_colour(), 1, wxPENSTYLE_DOT));
 	BOOST_FOREACH (DCPTime i, cont->reel_split_points(film)) {
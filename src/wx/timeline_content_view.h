@@ -51,6 +51,10 @@ public:
 	virtual wxString label () const;
 
 protected:
+	/** Paint anything that should appear inside the outline of the content.
+	 *  @param area Inside of the outline; anything drawn outside it will be clipped.
+	 */
+	virtual void paint_interior (wxGraphicsContext *, dcpomatic::Rect<int>) {}
 
 	boost::weak_ptr<Content> _content;
 
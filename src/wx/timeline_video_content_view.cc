@@ -19,10 +19,19 @@
 */
 
 #include "timeline_video_content_view.h"
+#include "timeline.h"
 #include "lib/image_content.h"
+#include "lib/thumbnailer.h"
+#include "lib/image.h"
+#include "lib/film.h"
+#include "lib/frame_rate_change.h"
+#include <wx/graphics.h>
 
+using std::min;
+using std::max;
 using boost::dynamic_pointer_cast;
 using boost::shared_ptr;
+using boost::optional;
 
 TimelineVideoContentView::TimelineVideoContentView (Timeline& tl, shared_ptr<Content> c)
 	: TimelineContentView (tl, c)
@@ -42,3 +51,48 @@ TimelineVideoContentView::foreground_colour () const
 	return wxColour (0, 0, 0, 255);
 }
 
+
+/** @param x x position on the timeline.
+ *  @return Thumbnail of the content at x, or 0 if none is available.
+ */
+shared_ptr<Image>
+TimelineVideoContentView::thumbnail_at (int x) const
+{
+	shared_ptr<const Film> film = _timeline.film ();
+	shared_ptr<const Content> content = _content.lock ();
+	optional<double> pps = _timeline.pixels_per_second ();
+	if (!film || !content || !pps) {
+		return shared_ptr<Image> ();
+	}
+
+	DCPTime const t = DCPTime::from_seconds (max (0, x - time_x (content->position())) / pps.get());
+	return _timeline.thumbnailer()->get (content, ContentTime (t, FrameRateChange (film, content)) + content->trim_start());
+}
+
+/** Tile the content's outline with thumbnails */
+void
+TimelineVideoContentView::paint_interior (wxGraphicsContext* gc, dcpomatic::Rect<int> area)
+{
+	shared_ptr<const Content> content = _content.lock ();
+	if (!content) {
+		return;
+	}
+
+	dcp::Size const size = _timeline.thumbnailer()->thumbnail_size (content);
+	int const width = max (1, size.width * area.height / size.height);
+
+	/* Tiles are lined up with the start of the content, so that they stay put as we scroll,
+	   but we only look for the ones that can be seen.
+	*/
+	dcpomatic::Rect<int> const visible = _timeline.visible_area ();
+	int x = area.x + max (0, (visible.x - area.x) / width) * width;
+	for (; x < min (area.x + area.width, visible.x + visible.width); x += width) {
+		shared_ptr<Image> image = thumbnail_at (x);
+		if (!image) {
+			continue;
+		}
+
+		wxImage thumbnail (image->size().width, image->size().height, image->data()[0], true);
+		gc->DrawBitmap (wxBitmap (thumbnail), x, area.y, width, area.height);
+	}
+}
@@ -20,6 +20,8 @@
 
 #include "timeline_content_view.h"
 
+class Image;
+
 /** @class TimelineVideoContentView
  *  @brief Timeline view for VideoContent.
  */
@@ -28,10 +30,13 @@ class TimelineVideoContentView : public TimelineContentView
 public:
 	TimelineVideoContentView (Timeline& tl, boost::shared_ptr<Content> c);
 
+	boost::shared_ptr<Image> thumbnail_at (int x) const;
+
 private:
 	bool active () const {
 		return true;
 	}
 	wxColour background_colour () const;
 	wxColour foreground_colour () const;
+	void paint_interior (wxGraphicsContext* gc, dcpomatic::Rect<int> area);
 };
@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/active_text_test.cc
+ *  @brief Test ActiveText.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/active_text.h"
+#include "lib/string_text_file_content.h"
+#include "lib/text_content.h"
+#include "lib/font.h"
+#include "lib/util.h"
+#include "test.h"
+#include <dcp/raw_convert.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+
+using std::list;
+using std::vector;
+using std::string;
+using boost::shared_ptr;
+using dcp::raw_convert;
+
+struct Event
+{
+	int content;
+	DCPTime from;
+	DCPTime to;
+};
+
+static PlayerText
+player_text (int id)
+{
+	PlayerText t;
+	t.fonts.push_back (shared_ptr<Font> (new Font (raw_convert<string> (id))));
+	return t;
+}
+
+/** Check that get_burnt() gives the same subtitles, in the same order, as a search of everything
+ *  that has been added when there are lots of overlapping subtitles from several contents.
+ */
+BOOST_AUTO_TEST_CASE (active_text_dense_test)
+{
+	vector<shared_ptr<StringTextFileContent> > content;
+	for (int i = 0; i < 3; ++i) {
+		content.push_back (shared_ptr<StringTextFileContent> (new StringTextFileContent ("test/data/subrip.srt")));
+		content.back()->only_text()->set_use (true);
+		content.back()->only_text()->set_burn (true);
+	}
+
+	/* Karaoke-style: a new line every 1/10s on each content, each lasting up to 3s */
+	vector<Event> events;
+	for (int i = 0; i < 3000; ++i) {
+		Event e;
+		e.content = i % content.size();
+		e.from = DCPTime::from_seconds (i / 10.0);
+		e.to = e.from + DCPTime::from_seconds (((i * 7919) % 300) / 100.0 + 0.01);
+		events.push_back (e);
+	}
+
+	ActiveText active;
+	size_t next = 0;
+	DCPTime const frame = DCPTime::from_frames (1, 24);
+	for (DCPTime t; t < events.back().to + frame; t += frame) {
+		while (next < events.size() && events[next].from <= t) {
+			shared_ptr<const TextContent> c = content[events[next].content]->only_text();
+			active.add_from (c, player_text(next), events[next].from);
+			active.add_to (c, events[next].to);
+			++next;
+		}
+
+		active.clear_before (t);
+
+		DCPTimePeriod const period (t, t + frame);
+		vector<int> expected;
+		for (size_t i = 0; i < content.size(); ++i) {
+			for (size_t j = 0; j < next; ++j) {
+				if (events[j].content != int(i)) {
+					continue;
+				}
+				boost::optional<DCPTimePeriod> overlap = period.overlap (DCPTimePeriod (events[j].from, events[j].to));
+				if (overlap && overlap->duration() > DCPTime(frame.get() / 2)) {
+					expected.push_back (j);
+				}
+			}
+		}
+
+		/* ActiveText groups its results by content in the order of their weak_ptrs */
+		vector<int> got;
+		BOOST_FOREACH (PlayerText i, active.get_burnt (period, false)) {
+			got.push_back (raw_convert<int> (i.fonts.front()->id()));
+		}
+
+		BOOST_REQUIRE_EQUAL (got.size(), expected.size());
+		vector<int> got_sorted = got;
+		std::sort (got_sorted.begin(), got_sorted.end());
+		std::sort (expected.begin(), expected.end());
+		BOOST_CHECK (got_sorted == expected);
+
+		for (size_t i = 1; i < got.size(); ++i) {
+			if (events[got[i]].content == events[got[i - 1]].content) {
+				BOOST_CHECK (got[i] > got[i - 1]);
+			}
+		}
+	}
+}
+
+/** Check that subtitles which have not finished are kept, and that content which is not
+ *  set to burn is only burnt when asked.
+ */
+BOOST_AUTO_TEST_CASE (active_text_open_test)
+{
+	shared_ptr<StringTextFileContent> content (new StringTextFileContent ("test/data/subrip.srt"));
+	shared_ptr<const TextContent> text = content->only_text ();
+	content->only_text()->set_use (true);
+	content->only_text()->set_burn (false);
+
+	ActiveText active;
+	BOOST_CHECK (!active.have (text));
+
+	active.add_from (text, player_text(0), DCPTime::from_seconds(1));
+	BOOST_CHECK (active.have (text));
+
+	active.clear_before (DCPTime::from_seconds (10));
+	BOOST_CHECK (active.have (text));
+
+	DCPTimePeriod const period (DCPTime::from_seconds(10), DCPTime::from_seconds(11));
+	BOOST_CHECK (active.get_burnt(period, false).empty());
+	BOOST_CHECK_EQUAL (active.get_burnt(period, true).size(), 1);
+
+	active.add_to (text, DCPTime::from_seconds(12));
+	active.clear_before (DCPTime::from_seconds (12));
+	BOOST_CHECK (active.have (text));
+	active.clear_before (DCPTime::from_seconds (13));
+	BOOST_CHECK (!active.have (text));
+}
+
+/** See how long it takes to add, burn and clear a dense set of captions: six contents, each
+ *  with a new line every 1/10s lasting up to 4s, so there are up to 40 lines active from each
+ *  content at any time.  This is only run if DCPOMATIC_TEST_BENCHMARKS is set.
+ */
+BOOST_AUTO_TEST_CASE (active_text_benchmark_test)
+{
+	if (!run_benchmarks ()) {
+		return;
+	}
+
+	vector<shared_ptr<StringTextFileContent> > content;
+	for (int i = 0; i < 6; ++i) {
+		content.push_back (shared_ptr<StringTextFileContent> (new StringTextFileContent ("test/data/subrip.srt")));
+		content.back()->only_text()->set_use (true);
+		content.back()->only_text()->set_burn (true);
+	}
+
+	int const lines = 100000;
+	DCPTime const frame = DCPTime::from_frames (1, 24);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	ActiveText active;
+	int next = 0;
+	size_t burnt = 0;
+	for (DCPTime t; next < lines; t += frame) {
+		while (next < lines && DCPTime::from_seconds ((next / content.size()) / 10.0) <= t) {
+			shared_ptr<const TextContent> c = content[next % content.size()]->only_text();
+			DCPTime const from = DCPTime::from_seconds ((next / content.size()) / 10.0);
+			active.add_from (c, player_text(next), from);
+			active.add_to (c, from + DCPTime::from_seconds (((next * 7919) % 4000) / 1000.0 + 0.05));
+			++next;
+		}
+
+		active.clear_before (t);
+		burnt += active.get_burnt(DCPTimePeriod(t, t + frame), false).size();
+	}
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	BOOST_CHECK (burnt > 0);
+	BOOST_TEST_MESSAGE (lines << " lines from " << content.size() << " contents took " << (seconds(stop) - seconds(start)) << "s");
+}
@@ -98,6 +98,37 @@ BOOST_AUTO_TEST_CASE (audio_analysis_serialisation_test)
 	BOOST_CHECK_EQUAL (a.sample_rate(), 48000);
 }
 
+/** Check that AudioAnalysis makes and saves the coarser levels of its points correctly */
+BOOST_AUTO_TEST_CASE (audio_analysis_levels_test)
+{
+	AudioAnalysis a (2);
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < 1001; ++j) {
+			AudioPoint p;
+			p[AudioPoint::PEAK] = (j % 7) * 0.1;
+			p[AudioPoint::RMS] = 0.5;
+			a.add_point (i, p);
+		}
+	}
+
+	a.set_samples_per_point (10);
+	a.set_sample_rate (48000);
+	/* This should give levels with 10, 40 and 160 samples per point */
+	a.add_levels (639);
+	a.write ("build/test/audio_analysis_levels_test");
+
+	AudioAnalysis b ("build/test/audio_analysis_levels_test");
+	BOOST_REQUIRE_EQUAL (b.levels(), 3);
+	BOOST_CHECK_EQUAL (b.samples_per_point(2), 160);
+	BOOST_CHECK_EQUAL (b.points(0, 0), 1001);
+	BOOST_CHECK_EQUAL (b.points(0, 1), 251);
+	BOOST_CHECK_EQUAL (b.points(1, 2), 63);
+	/* Each peak in a level is the highest of level_factor peaks in the level below */
+	BOOST_CHECK_CLOSE (b.get_point(0, 0, 1)[AudioPoint::PEAK], 0.3, 0.01);
+	BOOST_CHECK_CLOSE (b.get_point(0, 1, 1)[AudioPoint::PEAK], 0.6, 0.01);
+	BOOST_CHECK_CLOSE (b.get_point(1, 62, 2)[AudioPoint::RMS], 0.5, 0.01);
+}
+
 static void
 finished ()
 {
@@ -201,3 +232,61 @@ BOOST_AUTO_TEST_CASE (analyse_audio_test4)
 	JobManager::instance()->analyse_audio (film, playlist, false, c, boost::bind (&finished));
 	BOOST_CHECK (!wait_for_jobs ());
 }
+
+/** Check that an analysis made by composing per-content analyses is close to one made by
+ *  running the whole playlist through the player, and that changing the gain of some content
+ *  re-uses its analysis rather than decoding it again.
+ */
+BOOST_AUTO_TEST_CASE (analyse_audio_compose_test)
+{
+	shared_ptr<Film> film = new_test_film ("analyse_audio_compose_test");
+	film->set_container (Ratio::from_id ("185"));
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TLR"));
+	film->set_name ("frobozz");
+	shared_ptr<FFmpegContent> content (new FFmpegContent(private_data / "betty_L.wav"));
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	shared_ptr<AnalyseAudioJob> full (new AnalyseAudioJob (film, film->playlist(), false));
+	full->_compose = false;
+	JobManager::instance()->add (full);
+	BOOST_REQUIRE (!wait_for_jobs());
+	AudioAnalysis full_analysis (full->path());
+
+	BOOST_REQUIRE (full->can_compose());
+	shared_ptr<AnalyseAudioJob> composed (new AnalyseAudioJob (film, film->playlist(), false));
+	JobManager::instance()->add (composed);
+	BOOST_REQUIRE (!wait_for_jobs());
+	AudioAnalysis composed_analysis (composed->path());
+
+	/* The coarsest levels should have the same number of samples per point */
+	int const full_top = full_analysis.levels() - 1;
+	int const composed_top = composed_analysis.levels() - 1;
+	BOOST_REQUIRE_EQUAL (full_analysis.samples_per_point(full_top), composed_analysis.samples_per_point(composed_top));
+	BOOST_REQUIRE_EQUAL (full_analysis.points(0, full_top), composed_analysis.points(0, composed_top));
+	BOOST_CHECK_CLOSE (full_analysis.overall_sample_peak().first.peak, composed_analysis.overall_sample_peak().first.peak, 0.1);
+	/* Blocks do not line up exactly with points so allow a little slack in each point */
+	int close = 0;
+	int const points = full_analysis.points(0, full_top);
+	for (int i = 0; i < points; ++i) {
+		float const a = full_analysis.get_point(0, i, full_top)[AudioPoint::PEAK];
+		float const b = composed_analysis.get_point(0, i, composed_top)[AudioPoint::PEAK];
+		if (fabs(a - b) <= 0.05 * std::max(a, b)) {
+			++close;
+		}
+	}
+	BOOST_CHECK (close > points * 0.9);
+
+	boost::filesystem::path const content_analysis = film->content_audio_analysis_path (content);
+	BOOST_REQUIRE (boost::filesystem::exists (content_analysis));
+	std::time_t const written = boost::filesystem::last_write_time (content_analysis);
+
+	content->audio->set_gain (-6);
+	shared_ptr<AnalyseAudioJob> again (new AnalyseAudioJob (film, film->playlist(), false));
+	JobManager::instance()->add (again);
+	BOOST_REQUIRE (!wait_for_jobs());
+	AudioAnalysis again_analysis (again->path());
+
+	BOOST_CHECK_EQUAL (boost::filesystem::last_write_time (content_analysis), written);
+	BOOST_CHECK_CLOSE (again_analysis.overall_sample_peak().first.peak, composed_analysis.overall_sample_peak().first.peak / 2, 1);
+}
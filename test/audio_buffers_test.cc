@@ -26,8 +26,11 @@
 #include <cmath>
 #include <boost/test/unit_test.hpp>
 #include "lib/audio_buffers.h"
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 using std::pow;
+using boost::shared_ptr;
 
 static float tolerance = 1e-3;
 
@@ -303,3 +306,100 @@ BOOST_AUTO_TEST_CASE (audio_buffers_accumulate_frames)
 		}
 	}
 }
+
+/** AudioBuffers made from part of another share its data until one of them is changed */
+BOOST_AUTO_TEST_CASE (audio_buffers_share_test)
+{
+	shared_ptr<AudioBuffers> a (new AudioBuffers (2, 256));
+	srand (84);
+	random_fill (*a);
+
+	shared_ptr<AudioBuffers> b (new AudioBuffers (a, 100, 50));
+	BOOST_CHECK_EQUAL (b->channels(), 2);
+	BOOST_CHECK_EQUAL (b->frames(), 50);
+	BOOST_CHECK (b->data(0) == a->data(0) + 100);
+	BOOST_CHECK (b->data(1) == a->data(1) + 100);
+
+	/* Changing b must not change a */
+	b->apply_gain (-6);
+	BOOST_CHECK (b->data(0) != a->data(0) + 100);
+	srand (84);
+	random_check (*a, 0, 256);
+	for (int i = 0; i < 50; ++i) {
+		for (int c = 0; c < 2; ++c) {
+			BOOST_CHECK_CLOSE (b->data(c)[i], a->data(c)[i + 100] * pow (10, -6.0 / 20), tolerance);
+		}
+	}
+
+	/* Nor must changing a change some other buffers which share its data */
+	shared_ptr<AudioBuffers> c (new AudioBuffers (a, 0, 256));
+	a->make_silent ();
+	srand (84);
+	random_check (*c, 0, 256);
+}
+
+static void
+change_slices (shared_ptr<const AudioBuffers> a)
+{
+	for (int i = 0; i < 1000; ++i) {
+		shared_ptr<AudioBuffers> b (new AudioBuffers (a, i % 128, 128));
+		b->apply_gain (-6);
+	}
+}
+
+/** Threads which share data with some AudioBuffers can change their own buffers without
+ *  changing the original, and once they have finished the original has its data to itself again.
+ */
+BOOST_AUTO_TEST_CASE (audio_buffers_share_threads_test)
+{
+	shared_ptr<AudioBuffers> a (new AudioBuffers (2, 256));
+	srand (19);
+	random_fill (*a);
+
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.create_thread (boost::bind (&change_slices, a));
+	}
+	threads.join_all ();
+
+	srand (19);
+	random_check (*a, 0, 256);
+
+	float* data = a->data(0);
+	a->make_silent ();
+	BOOST_CHECK (a->data(0) == data);
+}
+
+/** trim_start */
+BOOST_AUTO_TEST_CASE (audio_buffers_trim_start)
+{
+	shared_ptr<AudioBuffers> a (new AudioBuffers (3, 256));
+	srand (61);
+	random_fill (*a);
+
+	shared_ptr<AudioBuffers> b (new AudioBuffers (a, 0, 40));
+	a->trim_start (40);
+	BOOST_CHECK_EQUAL (a->frames(), 216);
+
+	srand (61);
+	random_check (*b, 0, 40);
+	for (int i = 0; i < 216; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			BOOST_CHECK_CLOSE (a->data(c)[i], random_float (), tolerance);
+		}
+	}
+
+	/* Appending to the trimmed buffers keeps what was left */
+	shared_ptr<AudioBuffers> silence (new AudioBuffers (3, 10));
+	silence->make_silent ();
+	a->append (silence);
+	BOOST_CHECK_EQUAL (a->frames(), 226);
+	srand (61);
+	random_check (*b, 0, 40);
+	random_check (*a, 0, 216);
+	for (int i = 216; i < 226; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			BOOST_CHECK_EQUAL (a->data(c)[i], 0);
+		}
+	}
+}
@@ -19,6 +19,7 @@
 */
 
 #include "lib/audio_ring_buffers.h"
+#include "lib/exceptions.h"
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -191,3 +192,80 @@ BOOST_AUTO_TEST_CASE (audio_ring_buffers_test3)
 	BOOST_CHECK (!rb.get(buffer, 2, 240));
 	BOOST_CHECK_EQUAL (buffer[240 * 2], CANARY);
 }
+
+/** Check timestamps across clear() and discontinuities, and the underrun count */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_test4)
+{
+	AudioRingBuffers rb (1000);
+
+	shared_ptr<AudioBuffers> data (new AudioBuffers (2, 100));
+	data->make_silent ();
+
+	rb.put (data, DCPTime::from_frames(500, 48000), 48000);
+	rb.put (data, DCPTime::from_frames(600, 48000), 48000);
+	BOOST_CHECK_EQUAL (rb.size(), 200);
+	BOOST_CHECK (*rb.peek() == DCPTime::from_frames(500, 48000));
+
+	float buffer[256 * 2];
+	BOOST_CHECK (*rb.get(buffer, 2, 150) == DCPTime::from_frames(500, 48000));
+	BOOST_CHECK (*rb.peek() == DCPTime::from_frames(650, 48000));
+
+	/* After a clear() we can start again from anywhere */
+	rb.clear ();
+	BOOST_CHECK_EQUAL (rb.size(), 0);
+	BOOST_CHECK (!rb.peek());
+	rb.put (data, DCPTime::from_frames(4000, 48000), 48000);
+	BOOST_CHECK (*rb.get(buffer, 2, 50) == DCPTime::from_frames(4000, 48000));
+
+	/* Once everything has been read we can also start from anywhere */
+	BOOST_CHECK_EQUAL (rb.underruns(), 0);
+	BOOST_CHECK (*rb.get(buffer, 2, 60) == DCPTime::from_frames(4050, 48000));
+	BOOST_CHECK_EQUAL (rb.underruns(), 1);
+	rb.put (data, DCPTime::from_frames(9000, 48000), 48000);
+	BOOST_CHECK (*rb.get(buffer, 2, 10) == DCPTime::from_frames(9000, 48000));
+
+	/* Going over the capacity is a bug */
+	for (int i = 0; i < 9; ++i) {
+		rb.put (data, DCPTime::from_frames(9100 + i * 100, 48000), 48000);
+	}
+	BOOST_CHECK_THROW (rb.put(data, DCPTime::from_frames(10000, 48000), 48000), ProgrammingError);
+}
+
+/** Check that the buffer starts small, grows as more is put into it than it has space for,
+ *  and keeps what it holds in order as it grows.
+ */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_grow_test)
+{
+	AudioRingBuffers rb (48000 * 10);
+	BOOST_CHECK_EQUAL (rb.allocated(), 0);
+
+	shared_ptr<AudioBuffers> data (new AudioBuffers (2, 1000));
+	float buffer[700 * 2];
+	int put = 0;
+	int got = 0;
+	Frame largest = 0;
+	/* Put in 1000 frames and take out 700 each time, so the buffer must grow a few times */
+	for (int i = 0; i < 400; ++i) {
+		for (int j = 0; j < 1000; ++j) {
+			data->data(0)[j] = put;
+			data->data(1)[j] = -put;
+			++put;
+		}
+		rb.put (data, DCPTime::from_frames(i * 1000, 48000), 48000);
+		BOOST_REQUIRE (rb.allocated() >= rb.size());
+		BOOST_REQUIRE (rb.allocated() <= 48000 * 10);
+		largest = std::max (largest, rb.allocated());
+
+		BOOST_REQUIRE (rb.get(buffer, 2, 700));
+		for (int j = 0; j < 700; ++j) {
+			BOOST_REQUIRE_EQUAL (buffer[j * 2], got);
+			BOOST_REQUIRE_EQUAL (buffer[j * 2 + 1], -got);
+			++got;
+		}
+	}
+
+	BOOST_CHECK_EQUAL (rb.size(), 400 * 300);
+	/* We only need space for what is in the buffer, rounded up to the next doubling */
+	BOOST_CHECK (largest < 400 * 300 * 2);
+	BOOST_CHECK (largest > 32768);
+}
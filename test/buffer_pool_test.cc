@@ -0,0 +1,243 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/buffer_pool_test.cc
+ *  @brief Test BufferPool class.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/buffer_pool.h"
+#include "lib/audio_buffers.h"
+#include "lib/image.h"
+#include "lib/util.h"
+#include "test.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <sys/time.h>
+#include <set>
+#include <vector>
+
+using std::vector;
+using boost::shared_ptr;
+
+/* Threads only pass on changes to the pool's counts once they add up to a megabyte,
+   so these tests use blocks that are at least that big or check the counts once
+   the threads that allocated the blocks have finished.
+*/
+
+BOOST_AUTO_TEST_CASE (buffer_pool_reuse_test)
+{
+	BufferPool* pool = BufferPool::instance ();
+	pool->clear ();
+	/* Other threads' caches may still have something in them */
+	size_t const used = pool->memory_used ();
+	size_t const cached = pool->memory_cached ();
+
+	uint8_t* a = static_cast<uint8_t*> (pool->allocate (3000000));
+	BOOST_REQUIRE (a);
+	/* This size comes from the 3MB class */
+	BOOST_CHECK_EQUAL (pool->memory_used(), used + 3 * 1024 * 1024);
+	memset (a, 42, 3000000);
+
+	pool->release (a);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used);
+	BOOST_CHECK_EQUAL (pool->memory_cached(), cached + 3 * 1024 * 1024);
+
+	/* Any size in the same class should get the same block back */
+	uint8_t* b = static_cast<uint8_t*> (pool->allocate (2900000));
+	BOOST_CHECK (b == a);
+	BOOST_CHECK_EQUAL (pool->memory_cached(), cached);
+
+	/* ...but a different size should not */
+	uint8_t* c = static_cast<uint8_t*> (pool->allocate (2000000));
+	BOOST_CHECK (c != b);
+
+	pool->release (b);
+	pool->release (c);
+	pool->release (0);
+
+	/* A block which is too big to pool is given back to the system straight away */
+	void* d = pool->allocate (BufferPool::largest_pooled + 1);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used + BufferPool::largest_pooled + 1);
+	pool->release (d);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used);
+
+	/* With the pool disabled nothing is kept */
+	pool->set_enabled (false);
+	size_t const cached_before = pool->memory_cached ();
+	void* e = pool->allocate (3000000);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used + 3000000);
+	pool->release (e);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used);
+	BOOST_CHECK_EQUAL (pool->memory_cached(), cached_before);
+	pool->set_enabled (true);
+
+	pool->clear ();
+	BOOST_CHECK_EQUAL (pool->memory_cached(), cached);
+}
+
+static void
+allocate_some (vector<void*>* blocks)
+{
+	for (int i = 0; i < 64; ++i) {
+		blocks->push_back (BufferPool::instance()->allocate(4096 + i * 64));
+	}
+}
+
+static void
+release_some (vector<void*>* blocks)
+{
+	for (vector<void*>::const_iterator i = blocks->begin(); i != blocks->end(); ++i) {
+		BufferPool::instance()->release (*i);
+	}
+}
+
+/** Check that blocks can be released by a different thread to the one that allocated them,
+ *  and that they can then be used again by another thread.
+ */
+BOOST_AUTO_TEST_CASE (buffer_pool_threads_test)
+{
+	BufferPool* pool = BufferPool::instance ();
+	pool->clear ();
+	size_t const used = pool->memory_used ();
+	size_t const cached = pool->memory_cached ();
+
+	vector<void*> blocks;
+	boost::thread a (boost::bind (&allocate_some, &blocks));
+	a.join ();
+	BOOST_CHECK (pool->memory_used() > used);
+
+	boost::thread r (boost::bind (&release_some, &blocks));
+	r.join ();
+	BOOST_CHECK_EQUAL (pool->memory_used(), used);
+	size_t const released = pool->memory_cached() - cached;
+	BOOST_CHECK (released > 0);
+
+	/* The blocks should all be in the shared cache now, so another thread can have them back */
+	vector<void*> again;
+	boost::thread b (boost::bind (&allocate_some, &again));
+	b.join ();
+	BOOST_CHECK_EQUAL (pool->memory_cached(), cached);
+	BOOST_CHECK_EQUAL (pool->memory_used(), used + released);
+	BOOST_CHECK (std::set<void*>(blocks.begin(), blocks.end()) == std::set<void*>(again.begin(), again.end()));
+	release_some (&again);
+
+	pool->clear ();
+}
+
+/** Check that the blocks that a thread keeps for itself count towards the pool's limit */
+BOOST_AUTO_TEST_CASE (buffer_pool_limit_test)
+{
+	BufferPool* pool = BufferPool::instance ();
+	pool->clear ();
+	size_t const cached = pool->memory_cached ();
+	pool->set_limit (4 * 1024 * 1024);
+
+	/* Without the limit these would all fit in this thread's cache */
+	vector<void*> blocks;
+	for (int i = 0; i < 3; ++i) {
+		blocks.push_back (pool->allocate (2 * 1024 * 1024));
+	}
+	release_some (&blocks);
+	BOOST_CHECK (pool->memory_cached() <= cached + 4 * 1024 * 1024);
+
+	pool->clear ();
+	pool->set_limit (256 * 1024 * 1024);
+}
+
+static double
+time_audio (int blocks, bool pool)
+{
+	BufferPool::instance()->set_enabled (pool);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	for (int i = 0; i < blocks; ++i) {
+		shared_ptr<AudioBuffers> a (new AudioBuffers (16, 2000));
+		for (int j = 0; j < 16; ++j) {
+			a->data(j)[0] = 1;
+		}
+	}
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	BufferPool::instance()->set_enabled (true);
+	return seconds(stop) - seconds(start);
+}
+
+static double
+time_images (int images, bool pool)
+{
+	BufferPool::instance()->set_enabled (pool);
+
+	dcp::Size const size (3996, 2160);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	/* Write to each page, as using the image would, so that we see the cost of the
+	   system giving us new pages.
+	*/
+	int const bytes = size.width * 6 * size.height;
+	for (int i = 0; i < images; ++i) {
+		shared_ptr<Image> image (new Image (AV_PIX_FMT_RGB48LE, size, true));
+		for (int j = 0; j < bytes; j += 4096) {
+			image->data()[0][j] = 1;
+		}
+	}
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	BufferPool::instance()->set_enabled (true);
+	return seconds(stop) - seconds(start);
+}
+
+/** See how long it takes to allocate and free the sort of buffers that the encode
+ *  pipeline uses, with and without the pool.  Both ways go through Image and AudioBuffers;
+ *  without the pool every block comes from av_malloc() and goes back with av_free().
+ *  This is only run if DCPOMATIC_TEST_BENCHMARKS is set.
+ */
+BOOST_AUTO_TEST_CASE (buffer_pool_benchmark_test)
+{
+	if (!run_benchmarks ()) {
+		return;
+	}
+
+	BufferPool::instance()->clear ();
+
+	int const blocks = 100000;
+	double const audio_system = time_audio (blocks, false);
+	double const audio_pool = time_audio (blocks, true);
+
+	int const images = 1000;
+	double const images_system = time_images (images, false);
+	double const images_pool = time_images (images, true);
+
+	BOOST_TEST_MESSAGE (
+		blocks << " 16-channel audio blocks took " << audio_system << "s without the pool and " << audio_pool << "s with the pool; " <<
+		images << " 4K RGB48 images took " << images_system << "s without the pool and " << images_pool << "s with the pool"
+		);
+
+	BufferPool::instance()->clear ();
+}
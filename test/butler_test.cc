@@ -25,8 +25,11 @@
 #include "lib/content_factory.h"
 #include "lib/audio_mapping.h"
 #include "lib/player.h"
+#include "lib/video_content.h"
+#include "lib/config.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using boost::shared_ptr;
 
@@ -69,3 +72,66 @@ BOOST_AUTO_TEST_CASE (butler_test1)
 		BOOST_REQUIRE_EQUAL (buffer[i * 6 + 5], 0);
 	}
 }
+
+/** Check that the butler's video readahead stays where it is when video is taken slowly, grows
+ *  when video is taken faster than it can be made, and shrinks to fit the memory budget, and that
+ *  it stays within its limits throughout.
+ */
+BOOST_AUTO_TEST_CASE (butler_readahead_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("butler_readahead_test");
+	shared_ptr<Content> content = content_factory("test/data/flat_red.png").front ();
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs ());
+	content->video->set_length (24 * 120);
+
+	{
+		Butler butler (shared_ptr<Player>(new Player(film, film->playlist())), AudioMapping(6, 6), 6, bind(&PlayerVideo::force, _1, AV_PIX_FMT_RGB24), false, false);
+		butler.disable_audio ();
+
+		Frame const minimum = butler._minimum_video_readahead;
+		Frame const maximum = butler._maximum_video_readahead;
+		Frame const initial = butler._video_readahead;
+		BOOST_REQUIRE (minimum <= initial);
+		BOOST_REQUIRE (initial < maximum);
+
+		/* Give the butler time to fill up, then take video more slowly than it can be made */
+		boost::this_thread::sleep (boost::posix_time::seconds (1));
+		for (int i = 0; i < 24; ++i) {
+			BOOST_REQUIRE (butler.get_video().first);
+			BOOST_CHECK (butler.video_readahead() >= minimum);
+			BOOST_CHECK (butler.video_readahead() <= initial);
+			boost::this_thread::sleep (boost::posix_time::milliseconds (40));
+		}
+		BOOST_CHECK_EQUAL (butler._video_readahead.load(), initial);
+
+		/* Now take it as fast as we can; the butler will run out and should ask for more */
+		for (int i = 0; i < 24 * 100 && butler._video_readahead < maximum; ++i) {
+			BOOST_REQUIRE (butler.get_video().first);
+			BOOST_CHECK (butler._video_readahead <= maximum);
+			BOOST_CHECK (butler.video_readahead() >= minimum);
+			BOOST_CHECK (butler.video_readahead() <= maximum);
+		}
+		BOOST_CHECK (butler._video_readahead > initial);
+		BOOST_CHECK (butler._video_readahead <= maximum);
+	}
+
+	/* With a budget that has only room for a couple of frames the readahead should shrink to
+	   its minimum once the butler knows how big a frame is.
+	*/
+	Config::instance()->set_readahead_memory (16);
+	{
+		Butler butler (shared_ptr<Player>(new Player(film, film->playlist())), AudioMapping(6, 6), 6, bind(&PlayerVideo::force, _1, AV_PIX_FMT_RGB24), false, false);
+		butler.disable_audio ();
+
+		for (int i = 0; i < 100 && butler._frame_memory == 0; ++i) {
+			boost::this_thread::sleep (boost::posix_time::milliseconds (50));
+		}
+		BOOST_REQUIRE (butler._frame_memory > 0);
+		BOOST_REQUIRE (butler._frame_memory > static_cast<size_t>(16 * 1024 * 1024 / butler._minimum_video_readahead));
+		BOOST_CHECK (butler.video_readahead() < butler._video_readahead);
+		BOOST_CHECK_EQUAL (butler.video_readahead(), butler._minimum_video_readahead);
+		BOOST_REQUIRE (butler.get_video().first);
+	}
+	Config::instance()->set_readahead_memory (2048);
+}
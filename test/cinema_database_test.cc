@@ -0,0 +1,234 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/cinema_database_test.cc
+ *  @brief Test CinemaDatabase and DKDMDatabase.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/cinema_database.h"
+#include "lib/dkdm_database.h"
+#include "lib/dkdm_wrapper.h"
+#include "lib/cinema.h"
+#include "lib/screen.h"
+#include "lib/config.h"
+#include <dcp/certificate_chain.h>
+#include <dcp/decrypted_kdm.h>
+#include <dcp/decrypted_kdm_key.h>
+#include <dcp/encrypted_kdm.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+using std::list;
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+using boost::optional;
+using boost::dynamic_pointer_cast;
+
+static shared_ptr<Cinema>
+make_cinema (string name)
+{
+	return shared_ptr<Cinema> (new Cinema (name, list<string>(), "", 0, 0));
+}
+
+/** Check that cinemas are written only when they change and can be found by ID and name */
+BOOST_AUTO_TEST_CASE (cinema_database_test)
+{
+	boost::filesystem::path dir = "build/test/cinema_database_test";
+	boost::filesystem::remove_all (dir);
+
+	dcp::Certificate cert = Config::instance()->decryption_chain()->leaf ();
+
+	shared_ptr<Cinema> a = make_cinema ("Alpha");
+	shared_ptr<Cinema> b = make_cinema ("Bravo");
+	shared_ptr<Cinema> c = make_cinema ("Charlie");
+	vector<TrustedDevice> trusted;
+	trusted.push_back (TrustedDevice (cert));
+	trusted.push_back (TrustedDevice ("a-thumbprint"));
+	a->add_screen (shared_ptr<Screen> (new Screen ("Screen 1", "", cert, trusted)));
+
+	{
+		CinemaDatabase db (dir);
+		BOOST_CHECK (!db.existed ());
+		db.add (a);
+		db.add (b);
+		db.add (c);
+		db.write ();
+
+		BOOST_CHECK (boost::filesystem::exists (dir / (a->id() + ".xml")));
+		BOOST_CHECK (boost::filesystem::exists (dir / (b->id() + ".xml")));
+		BOOST_CHECK (boost::filesystem::exists (dir / (c->id() + ".xml")));
+
+		/* Removing b's file should go unnoticed if we only change a */
+		boost::filesystem::remove (dir / (b->id() + ".xml"));
+		a->notes = "Some notes";
+		db.write ();
+		BOOST_CHECK (!boost::filesystem::exists (dir / (b->id() + ".xml")));
+
+		/* but b should be written again once it changes */
+		b->name = "Bravo 2";
+		db.write ();
+		BOOST_CHECK (boost::filesystem::exists (dir / (b->id() + ".xml")));
+
+		db.remove (c);
+		db.write ();
+		BOOST_CHECK (!boost::filesystem::exists (dir / (c->id() + ".xml")));
+	}
+
+	{
+		CinemaDatabase db (dir);
+		BOOST_CHECK (db.existed ());
+		BOOST_CHECK (!db.cinema (c->id()));
+		BOOST_CHECK (db.find ("Bravo").empty ());
+		BOOST_REQUIRE_EQUAL (db.find ("Bravo 2").size(), 1U);
+		BOOST_CHECK_EQUAL (db.find("Bravo 2").front()->id(), b->id());
+
+		shared_ptr<Cinema> read = db.cinema (a->id ());
+		BOOST_REQUIRE (read);
+		BOOST_CHECK_EQUAL (read->name, "Alpha");
+		BOOST_CHECK_EQUAL (read->notes, "Some notes");
+		BOOST_REQUIRE_EQUAL (read->screens().size(), 1U);
+		shared_ptr<Screen> screen = read->screens().front ();
+		BOOST_CHECK (screen->cinema == read);
+		BOOST_REQUIRE (screen->has_recipient ());
+		BOOST_CHECK_EQUAL (screen->recipient()->thumbprint(), cert.thumbprint());
+		vector<string> thumbprints = screen->trusted_device_thumbprints ();
+		BOOST_REQUIRE_EQUAL (thumbprints.size(), 2U);
+		BOOST_CHECK_EQUAL (thumbprints[0], cert.thumbprint());
+		BOOST_CHECK_EQUAL (thumbprints[1], "a-thumbprint");
+
+		list<shared_ptr<Cinema> > all = db.cinemas ();
+		BOOST_REQUIRE_EQUAL (all.size(), 2U);
+		BOOST_CHECK (all.front() == read);
+		BOOST_CHECK_EQUAL (all.back()->name, "Bravo 2");
+	}
+}
+
+/** Check that pointing Config at a new cinemas file keeps the cinemas that it had */
+BOOST_AUTO_TEST_CASE (config_new_cinemas_file_test)
+{
+	boost::filesystem::path dir = "build/test/config_new_cinemas_file_test";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir);
+
+	Config* config = Config::instance ();
+	boost::filesystem::path const old_file = config->cinemas_file ();
+
+	config->set_cinemas_file (dir / "first.xml");
+	size_t const before = config->cinemas().size();
+	shared_ptr<Cinema> a = make_cinema ("Alpha");
+	config->add_cinema (a);
+	config->write_cinemas ();
+
+	config->set_cinemas_file (dir / "second.xml");
+	list<shared_ptr<Cinema> > cinemas = config->cinemas ();
+	BOOST_REQUIRE_EQUAL (cinemas.size(), before + 1);
+	BOOST_CHECK_EQUAL (cinemas.back()->id(), a->id());
+	BOOST_CHECK (boost::filesystem::exists (dir / "second.d" / (a->id() + ".xml")));
+
+	/* Going back to an existing database should use what is in it */
+	config->remove_cinema (a);
+	config->write_cinemas ();
+	config->set_cinemas_file (dir / "first.xml");
+	BOOST_CHECK_EQUAL (config->cinemas().size(), before + 1);
+
+	config->set_cinemas_file (old_file);
+}
+
+static shared_ptr<DKDM>
+make_dkdm (string title)
+{
+	dcp::DecryptedKDM kdm (
+		dcp::LocalTime ("2020-01-01T00:00:00+00:00"), dcp::LocalTime ("2030-01-01T00:00:00+00:00"), "", title, dcp::LocalTime().as_string()
+		);
+	kdm.add_key (dcp::DecryptedKDMKey (string ("MDIK"), dcp::make_uuid(), dcp::Key(), dcp::make_uuid(), dcp::SMPTE));
+	return shared_ptr<DKDM> (
+		new DKDM (
+			kdm.encrypt (
+				Config::instance()->signer_chain(), Config::instance()->decryption_chain()->leaf(),
+				vector<string>(), dcp::MODIFIED_TRANSITIONAL_1, true, optional<int>()
+				)
+			)
+		);
+}
+
+/** Check that DKDMs are written once, removed when they leave the tree, and read back lazily */
+BOOST_AUTO_TEST_CASE (dkdm_database_test)
+{
+	boost::filesystem::path dir = "build/test/dkdm_database_test";
+	boost::filesystem::remove_all (dir);
+
+	shared_ptr<DKDM> a = make_dkdm ("Alpha");
+	shared_ptr<DKDM> b = make_dkdm ("Bravo");
+	shared_ptr<DKDM> c = make_dkdm ("Charlie");
+
+	{
+		DKDMDatabase db (dir);
+		shared_ptr<DKDMGroup> root = db.read ();
+		BOOST_CHECK (root->children().empty());
+
+		shared_ptr<DKDMGroup> group (new DKDMGroup ("Group"));
+		root->add (group);
+		group->add (a);
+		root->add (b);
+		db.write (root);
+
+		BOOST_CHECK (boost::filesystem::exists (dir / (a->id() + ".xml")));
+		BOOST_CHECK (boost::filesystem::exists (dir / (b->id() + ".xml")));
+
+		/* Existing DKDMs should not be written again */
+		boost::filesystem::remove (dir / (a->id() + ".xml"));
+		root->add (c);
+		db.write (root);
+		BOOST_CHECK (!boost::filesystem::exists (dir / (a->id() + ".xml")));
+		BOOST_CHECK (boost::filesystem::exists (dir / (c->id() + ".xml")));
+		/* Put a back for the checks below */
+		group->remove (a);
+		db.write (root);
+		group->add (a);
+		db.write (root);
+
+		root->remove (b);
+		db.write (root);
+		BOOST_CHECK (!boost::filesystem::exists (dir / (b->id() + ".xml")));
+	}
+
+	{
+		DKDMDatabase db (dir);
+		shared_ptr<DKDMGroup> root = db.read ();
+		BOOST_REQUIRE_EQUAL (root->children().size(), 2U);
+
+		shared_ptr<DKDMGroup> group = dynamic_pointer_cast<DKDMGroup> (root->children().front());
+		BOOST_REQUIRE (group);
+		BOOST_CHECK_EQUAL (group->name(), "Group");
+		BOOST_REQUIRE_EQUAL (group->children().size(), 1U);
+
+		shared_ptr<DKDM> read_a = dynamic_pointer_cast<DKDM> (group->children().front());
+		BOOST_REQUIRE (read_a);
+		BOOST_CHECK_EQUAL (read_a->name(), a->name());
+		BOOST_CHECK_EQUAL (read_a->cpl_id(), a->cpl_id());
+		BOOST_CHECK_EQUAL (read_a->dkdm().id(), a->id());
+
+		shared_ptr<DKDM> read_c = dynamic_pointer_cast<DKDM> (root->children().back());
+		BOOST_REQUIRE (read_c);
+		BOOST_CHECK_EQUAL (read_c->id(), c->id());
+	}
+}
@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/dcp_decoder_test.cc
+ *  @brief Test DCPDecoder.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/film.h"
+#include "lib/content_factory.h"
+#include "lib/dcp_content.h"
+#include "lib/dcp_decoder.h"
+#include "lib/video_content.h"
+#include "lib/cross.h"
+#include "test.h"
+#include <dcp/reel.h>
+#include <boost/test/unit_test.hpp>
+
+using boost::shared_ptr;
+
+/** Check that DCPDecoders share the DCP that they read unless it changes on disk */
+BOOST_AUTO_TEST_CASE (dcp_decoder_shared_cpls_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("dcp_decoder_shared_cpls_test");
+	shared_ptr<Content> content = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs());
+	content->video->set_length (24);
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	shared_ptr<Film> film2 = new_test_film2 ("dcp_decoder_shared_cpls_test2");
+	shared_ptr<DCPContent> dcp (new DCPContent(film->dir(film->dcp_name())));
+	film2->examine_and_add_content (dcp);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	DCPDecoder a (film2, dcp, false);
+	DCPDecoder b (film2, dcp, false);
+	BOOST_REQUIRE (!a.reels().empty());
+	BOOST_CHECK (a.reels().front() == b.reels().front());
+
+	/* A decoder which asks for its own copy should get one */
+	DCPDecoder c (film2, dcp, false, false);
+	BOOST_REQUIRE (!c.reels().empty());
+	BOOST_CHECK (a.reels().front() != c.reels().front());
+
+	/* and a change to the DCP on disk should mean that it is read again */
+	boost::filesystem::path assetmap = film->dir(film->dcp_name()) / "ASSETMAP.xml";
+	if (!boost::filesystem::exists(assetmap)) {
+		/* Interop */
+		assetmap = film->dir(film->dcp_name()) / "ASSETMAP";
+	}
+	BOOST_REQUIRE (boost::filesystem::exists(assetmap));
+	boost::filesystem::last_write_time (assetmap, boost::filesystem::last_write_time(assetmap) + 10);
+	DCPDecoder d (film2, dcp, false);
+	BOOST_REQUIRE (!d.reels().empty());
+	BOOST_CHECK (a.reels().front() != d.reels().front());
+
+	/* as should a change to a file in a subdirectory, where the ASSETMAP may point */
+	boost::filesystem::path sub = film->dir(film->dcp_name()) / "sub";
+	boost::filesystem::create_directory (sub);
+	FILE* f = fopen_boost (sub / "asset", "wb");
+	BOOST_REQUIRE (f);
+	fclose (f);
+	DCPDecoder e (film2, dcp, false);
+	BOOST_REQUIRE (!e.reels().empty());
+	BOOST_CHECK (d.reels().front() != e.reels().front());
+
+	boost::filesystem::last_write_time (sub / "asset", boost::filesystem::last_write_time(sub / "asset") + 10);
+	DCPDecoder g (film2, dcp, false);
+	BOOST_REQUIRE (!g.reels().empty());
+	BOOST_CHECK (e.reels().front() != g.reels().front());
+}
@@ -31,6 +31,7 @@
 #include "lib/text_content.h"
 #include "lib/compose.hpp"
 #include "lib/content_factory.h"
+#include "lib/config.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 
@@ -338,3 +339,130 @@ BOOST_AUTO_TEST_CASE (ffmpeg_encoder_h264_test7)
 	encoder.go ();
 }
 
+
+/** Check that exporting reels to separate files gives the same files whether or not the reels
+ *  are encoded at the same time.
+ */
+BOOST_AUTO_TEST_CASE (ffmpeg_encoder_parallel_reels_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("ffmpeg_encoder_parallel_reels_test");
+	shared_ptr<Content> red = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (red);
+	shared_ptr<Content> green = content_factory("test/data/flat_green.png").front();
+	film->examine_and_add_content (green);
+	shared_ptr<Content> sine = content_factory("test/data/sine_440.wav").front();
+	film->examine_and_add_content (sine);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	red->video->set_length (48);
+	green->video->set_length (72);
+	green->set_position (film, DCPTime::from_frames(48, film->video_frame_rate()));
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+	BOOST_REQUIRE_EQUAL (film->reels().size(), 2);
+
+	int const old_threads = Config::instance()->export_reel_threads ();
+
+	Config::instance()->set_export_reel_threads (1);
+	{
+		shared_ptr<Job> job (new TranscodeJob (film));
+		FFmpegEncoder encoder (film, job, "build/test/ffmpeg_encoder_parallel_reels_test_serial.mov", EXPORT_FORMAT_PRORES, false, true, 23);
+		encoder.go ();
+	}
+
+	Config::instance()->set_export_reel_threads (2);
+	{
+		shared_ptr<Job> job (new TranscodeJob (film));
+		FFmpegEncoder encoder (film, job, "build/test/ffmpeg_encoder_parallel_reels_test_parallel.mov", EXPORT_FORMAT_PRORES, false, true, 23);
+		encoder.go ();
+	}
+
+	Config::instance()->set_export_reel_threads (old_threads);
+
+	for (int i = 1; i <= 2; ++i) {
+		check_file (
+			String::compose("build/test/ffmpeg_encoder_parallel_reels_test_serial_reel%1.mov", i),
+			String::compose("build/test/ffmpeg_encoder_parallel_reels_test_parallel_reel%1.mov", i)
+			);
+	}
+}
+
+/** Check that exporting to a single file by encoding segments at the same time gives the same
+ *  video and audio as encoding the film in one go.
+ */
+BOOST_AUTO_TEST_CASE (ffmpeg_encoder_parallel_segments_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("ffmpeg_encoder_parallel_segments_test");
+	shared_ptr<Content> red = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (red);
+	shared_ptr<Content> green = content_factory("test/data/flat_green.png").front();
+	film->examine_and_add_content (green);
+	shared_ptr<Content> sine = content_factory("test/data/sine_440.wav").front();
+	film->examine_and_add_content (sine);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	/* Long enough to make three segments */
+	red->video->set_length (24 * 15);
+	green->video->set_length (24 * 10);
+	green->set_position (film, DCPTime::from_frames(24 * 15, film->video_frame_rate()));
+
+	int const old_threads = Config::instance()->export_segment_threads ();
+
+	Config::instance()->set_export_segment_threads (1);
+	{
+		shared_ptr<Job> job (new TranscodeJob (film));
+		FFmpegEncoder encoder (film, job, "build/test/ffmpeg_encoder_parallel_segments_test_serial.mov", EXPORT_FORMAT_PRORES, false, false, 23);
+		encoder.go ();
+	}
+
+	Config::instance()->set_export_segment_threads (2);
+	{
+		shared_ptr<Job> job (new TranscodeJob (film));
+		FFmpegEncoder encoder (film, job, "build/test/ffmpeg_encoder_parallel_segments_test_parallel.mov", EXPORT_FORMAT_PRORES, false, false, 23);
+		encoder.go ();
+	}
+
+	Config::instance()->set_export_segment_threads (old_threads);
+
+	check_ffmpeg ("build/test/ffmpeg_encoder_parallel_segments_test_serial.mov", "build/test/ffmpeg_encoder_parallel_segments_test_parallel.mov", 1);
+
+	/* The segments should have been tidied up */
+	for (int i = 1; i <= 3; ++i) {
+		BOOST_CHECK (!boost::filesystem::exists(String::compose("build/test/ffmpeg_encoder_parallel_segments_test_parallel.segment%1.mov", i)));
+	}
+}
+
+/** Check that an H.264 export made by encoding segments at the same time can be written and
+ *  has all the frames of the film.
+ */
+BOOST_AUTO_TEST_CASE (ffmpeg_encoder_parallel_segments_h264_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("ffmpeg_encoder_parallel_segments_h264_test");
+	shared_ptr<Content> red = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (red);
+	shared_ptr<Content> green = content_factory("test/data/flat_green.png").front();
+	film->examine_and_add_content (green);
+	shared_ptr<Content> sine = content_factory("test/data/sine_440.wav").front();
+	film->examine_and_add_content (sine);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	/* Long enough to make three segments */
+	red->video->set_length (24 * 15);
+	green->video->set_length (24 * 10);
+	green->set_position (film, DCPTime::from_frames(24 * 15, film->video_frame_rate()));
+
+	int const old_threads = Config::instance()->export_segment_threads ();
+	Config::instance()->set_export_segment_threads (2);
+	{
+		shared_ptr<Job> job (new TranscodeJob (film));
+		FFmpegEncoder encoder (film, job, "build/test/ffmpeg_encoder_parallel_segments_h264_test.mp4", EXPORT_FORMAT_H264, false, false, 23);
+		encoder.go ();
+	}
+	Config::instance()->set_export_segment_threads (old_threads);
+
+	shared_ptr<Film> check = new_test_film2 ("ffmpeg_encoder_parallel_segments_h264_test_check");
+	shared_ptr<FFmpegContent> output (new FFmpegContent("build/test/ffmpeg_encoder_parallel_segments_h264_test.mp4"));
+	check->examine_and_add_content (output);
+	BOOST_REQUIRE (!wait_for_jobs());
+	BOOST_REQUIRE (output->video);
+	BOOST_CHECK_EQUAL (output->video->length(), 24 * 25);
+}
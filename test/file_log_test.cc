@@ -25,9 +25,14 @@
 
 #include "lib/file_log.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <fstream>
 #include <iostream>
 
 using std::cout;
+using std::string;
+using std::ifstream;
 
 BOOST_AUTO_TEST_CASE (file_log_test)
 {
@@ -35,3 +40,94 @@ BOOST_AUTO_TEST_CASE (file_log_test)
 	BOOST_CHECK_EQUAL (log.head_and_tail (1024), "This is a short log.\nWith only two lines.\n");
 	BOOST_CHECK_EQUAL (log.head_and_tail (8), "This is \n .\n .\n .\no lines.\n");
 }
+
+static void
+log_lines (FileLog* log, int lines)
+{
+	for (int i = 0; i < lines; ++i) {
+		log->log ("file-log-test", LogEntry::TYPE_GENERAL);
+	}
+}
+
+static int
+count_lines (boost::filesystem::path file)
+{
+	ifstream f (file.string().c_str());
+	int n = 0;
+	string line;
+	while (getline (f, line)) {
+		if (line.find ("file-log-test") != string::npos) {
+			++n;
+		}
+	}
+	return n;
+}
+
+/** Check that everything logged from several threads gets to the file */
+BOOST_AUTO_TEST_CASE (file_log_threads_test)
+{
+	boost::filesystem::path const file = "build/test/file_log_threads_test.log";
+	boost::filesystem::remove (file);
+
+	FileLog log (file);
+	log.set_types (LogEntry::TYPE_GENERAL);
+
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.create_thread (boost::bind (&log_lines, &log, 1000));
+	}
+	threads.join_all ();
+
+	log.flush ();
+	BOOST_CHECK_EQUAL (count_lines (file), 4000);
+}
+
+/** Check that a log which gets too big is moved aside and a new one started */
+BOOST_AUTO_TEST_CASE (file_log_rotate_test)
+{
+	boost::filesystem::path const file = "build/test/file_log_rotate_test.log";
+	boost::filesystem::path const backup = "build/test/file_log_rotate_test.log.1";
+	boost::filesystem::remove (file);
+	boost::filesystem::remove (backup);
+
+	{
+		FileLog log (file, 4096);
+		log.set_types (LogEntry::TYPE_GENERAL);
+		for (int i = 0; i < 500; ++i) {
+			log_lines (&log, 1);
+			log.flush ();
+		}
+	}
+
+	BOOST_REQUIRE (boost::filesystem::exists (backup));
+	BOOST_CHECK (boost::filesystem::file_size (file) <= 4096);
+	BOOST_CHECK (boost::filesystem::file_size (backup) <= 4096);
+	BOOST_CHECK (count_lines (file) > 0);
+}
+
+/** Check that two logs writing to the same file take turns to move it aside */
+BOOST_AUTO_TEST_CASE (file_log_shared_rotate_test)
+{
+	boost::filesystem::path const file = "build/test/file_log_shared_rotate_test.log";
+	boost::filesystem::path const backup = "build/test/file_log_shared_rotate_test.log.1";
+	boost::filesystem::remove (file);
+	boost::filesystem::remove (backup);
+
+	{
+		FileLog a (file, 4096);
+		FileLog b (file, 4096);
+		a.set_types (LogEntry::TYPE_GENERAL);
+		b.set_types (LogEntry::TYPE_GENERAL);
+		for (int i = 0; i < 500; ++i) {
+			log_lines (&a, 1);
+			a.flush ();
+			log_lines (&b, 1);
+			b.flush ();
+		}
+	}
+
+	BOOST_REQUIRE (boost::filesystem::exists (backup));
+	BOOST_CHECK (boost::filesystem::file_size (file) <= 4096);
+	BOOST_CHECK (boost::filesystem::file_size (backup) <= 4096);
+	BOOST_CHECK (count_lines (file) > 0);
+}
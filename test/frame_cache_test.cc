@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/frame_cache_test.cc
+ *  @brief Test FrameCache.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/frame_cache.h"
+#include "lib/image.h"
+#include <boost/test/unit_test.hpp>
+
+using boost::shared_ptr;
+using boost::optional;
+
+static shared_ptr<Image>
+make_image (int seed)
+{
+	shared_ptr<Image> image (new Image(AV_PIX_FMT_RGB24, dcp::Size(64, 32), false));
+	for (int y = 0; y < 32; ++y) {
+		uint8_t* p = image->data()[0] + y * image->stride()[0];
+		for (int x = 0; x < 64 * 3; ++x) {
+			*p++ = (x + y + seed) & 0xff;
+		}
+	}
+	return image;
+}
+
+/** Check that the memory level of the cache evicts least-recently-used frames */
+BOOST_AUTO_TEST_CASE (frame_cache_memory_test)
+{
+	size_t const one = make_image(0)->memory_used();
+
+	FrameCache cache (AV_PIX_FMT_RGB24, one * 2, optional<boost::filesystem::path>(), 0);
+
+	cache.put ("a", make_image(0));
+	cache.put ("b", make_image(1));
+	BOOST_CHECK_EQUAL (cache.memory_used(), one * 2);
+
+	/* Touch a so that b becomes the least recently used */
+	BOOST_REQUIRE (cache.get("a"));
+	cache.put ("c", make_image(2));
+	BOOST_CHECK_EQUAL (cache.memory_used(), one * 2);
+
+	BOOST_CHECK (cache.get("a"));
+	BOOST_CHECK (!cache.get("b"));
+	BOOST_CHECK (cache.get("c"));
+	BOOST_CHECK_EQUAL (cache.hits(), 3);
+	BOOST_CHECK_EQUAL (cache.misses(), 1);
+
+	/* Images in the wrong format are not stored */
+	cache.put ("d", shared_ptr<Image>(new Image(AV_PIX_FMT_RGB48LE, dcp::Size(64, 32), false)));
+	BOOST_CHECK (!cache.get("d"));
+
+	cache.clear ();
+	BOOST_CHECK_EQUAL (cache.memory_used(), 0);
+	BOOST_CHECK (!cache.get("a"));
+}
+
+/** Check that frames evicted from memory can be got back from disk, including
+ *  by a new cache using the same directory, and that the disk limit is respected.
+ */
+BOOST_AUTO_TEST_CASE (frame_cache_disk_test)
+{
+	boost::filesystem::path dir = "build/test/frame_cache_disk_test";
+	boost::filesystem::remove_all (dir);
+
+	size_t const one = make_image(0)->memory_used();
+
+	{
+		FrameCache cache (AV_PIX_FMT_RGB24, one, dir, 1024 * 1024);
+		cache.put ("a", make_image(0));
+		cache.put ("b", make_image(1));
+		/* a has now gone from memory but should be on disk */
+		BOOST_CHECK_EQUAL (cache.memory_used(), one);
+		shared_ptr<Image> a = cache.get ("a");
+		BOOST_REQUIRE (a);
+		BOOST_CHECK (*a == *make_image(0));
+	}
+
+	{
+		FrameCache cache (AV_PIX_FMT_RGB24, one, dir, 1024 * 1024);
+		shared_ptr<Image> b = cache.get ("b");
+		BOOST_REQUIRE (b);
+		BOOST_CHECK (*b == *make_image(1));
+		BOOST_CHECK (!cache.get("c"));
+	}
+
+	{
+		/* A new cache with a smaller disk limit should throw away the least-recently used frame (a) */
+		size_t const file_size = boost::filesystem::file_size (dir / "a");
+		FrameCache cache (AV_PIX_FMT_RGB24, one, dir, file_size);
+		BOOST_CHECK_EQUAL (cache.disk_used(), file_size);
+		BOOST_CHECK (!boost::filesystem::exists(dir / "a"));
+		BOOST_CHECK (cache.get("b"));
+	}
+}
@@ -27,6 +27,9 @@
 #include "lib/image.h"
 #include "lib/ffmpeg_image_proxy.h"
 #include "test.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -367,3 +370,55 @@ BOOST_AUTO_TEST_CASE (fade_test)
 	fade_test_format_red   (AV_PIX_FMT_RGB48LE,   0.5, "rgb48le_50");
 	fade_test_format_red   (AV_PIX_FMT_RGB48LE,   1,   "rgb48le_100");
 }
+
+/** Check that an Image made from a reference-counted AVFrame uses the frame's data, and that
+ *  it takes its own copy before it is modified.
+ */
+BOOST_AUTO_TEST_CASE (image_from_frame_test)
+{
+	AVFrame* frame = av_frame_alloc ();
+	BOOST_REQUIRE (frame);
+	frame->format = AV_PIX_FMT_YUV420P;
+	frame->width = 1998;
+	frame->height = 1080;
+	BOOST_REQUIRE (av_frame_get_buffer (frame, 32) >= 0);
+
+	for (int i = 0; i < 3; ++i) {
+		int const lines = i == 0 ? frame->height : frame->height / 2;
+		for (int y = 0; y < lines; ++y) {
+			memset (frame->data[i] + y * frame->linesize[i], 42 + i, frame->linesize[i]);
+		}
+	}
+
+	shared_ptr<Image> image (new Image (frame));
+	for (int i = 0; i < 3; ++i) {
+		BOOST_CHECK (image->data()[i] == frame->data[i]);
+		BOOST_CHECK_EQUAL (image->stride()[i], frame->linesize[i]);
+	}
+
+	/* The image should still be usable after the frame has gone */
+	uint8_t* const original = frame->data[0];
+	av_frame_free (&frame);
+	BOOST_CHECK_EQUAL (image->data()[0][0], 42);
+	BOOST_CHECK_EQUAL (image->data()[2][image->stride()[2] * 539], 44);
+
+	Image copy (*image);
+	image->make_black ();
+	BOOST_CHECK (image->data()[0] != original);
+	BOOST_CHECK_EQUAL (image->data()[0][0], 0);
+	BOOST_CHECK_EQUAL (copy.data()[0][0], 42);
+
+	/* A frame which does not own its data must be copied */
+	uint8_t data[64 * 64 * 3];
+	memset (data, 7, sizeof(data));
+	frame = av_frame_alloc ();
+	frame->format = AV_PIX_FMT_RGB24;
+	frame->width = 64;
+	frame->height = 64;
+	frame->data[0] = data;
+	frame->linesize[0] = 64 * 3;
+	Image unshared (frame);
+	av_frame_free (&frame);
+	BOOST_CHECK (unshared.data()[0] != data);
+	BOOST_CHECK_EQUAL (unshared.data()[0][64 * 3 * 63], 7);
+}
@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/j2k_frame_cache_test.cc
+ *  @brief Test J2KFrameCache.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/j2k_frame_cache.h"
+#include <boost/test/unit_test.hpp>
+
+using boost::optional;
+using dcp::Data;
+
+static Data
+make_data (int seed)
+{
+	Data data (4096);
+	uint8_t* p = data.data().get();
+	/* Start-of-codestream marker */
+	p[0] = 0xff;
+	p[1] = 0x4f;
+	for (int i = 2; i < data.size(); ++i) {
+		p[i] = (i + seed) & 0xff;
+	}
+	return data;
+}
+
+static bool
+data_equal (Data const & a, Data const & b)
+{
+	return a.size() == b.size() && memcmp (a.data().get(), b.data().get(), a.size()) == 0;
+}
+
+/** Check that frames can be put and got, that they persist into a new cache
+ *  using the same directory, and that the least-recently-used ones are evicted.
+ */
+BOOST_AUTO_TEST_CASE (j2k_frame_cache_test)
+{
+	boost::filesystem::path dir = "build/test/j2k_frame_cache_test";
+	boost::filesystem::remove_all (dir);
+
+	{
+		J2KFrameCache cache (dir, 4096 * 2);
+		cache.put ("aaaa", make_data(0));
+		cache.put ("bbbb", make_data(1));
+		BOOST_CHECK_EQUAL (cache.disk_used(), 4096 * 2);
+
+		/* Touch aaaa so that bbbb becomes the least recently used */
+		optional<Data> a = cache.get ("aaaa");
+		BOOST_REQUIRE (a);
+		BOOST_CHECK (data_equal(*a, make_data(0)));
+
+		cache.put ("cccc", make_data(2));
+		BOOST_CHECK_EQUAL (cache.disk_used(), 4096 * 2);
+		BOOST_CHECK (!cache.get("bbbb"));
+		BOOST_CHECK (cache.get("cccc"));
+		BOOST_CHECK_EQUAL (cache.hits(), 2);
+		BOOST_CHECK_EQUAL (cache.misses(), 1);
+	}
+
+	{
+		J2KFrameCache cache (dir, 4096 * 2);
+		BOOST_CHECK_EQUAL (cache.disk_used(), 4096 * 2);
+		optional<Data> c = cache.get ("cccc");
+		BOOST_REQUIRE (c);
+		BOOST_CHECK (data_equal(*c, make_data(2)));
+
+		/* Something that is not J2K should not be returned */
+		cache.put ("dddd", Data(4096));
+		BOOST_CHECK (!cache.get("dddd"));
+
+		cache.clear ();
+		BOOST_CHECK_EQUAL (cache.disk_used(), 0);
+		BOOST_CHECK (!cache.get("cccc"));
+	}
+}
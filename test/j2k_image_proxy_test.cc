@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/j2k_image_proxy_test.cc
+ *  @brief Test J2KImageProxy class.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/j2k_image_proxy.h"
+#include <boost/test/unit_test.hpp>
+#include <stdint.h>
+#include <vector>
+
+using std::vector;
+
+/** Check that interleave_planes gives the same results for pixels done 8 at a time
+ *  as for the ones left over at the end of a line, including for samples which are
+ *  too big to fit into 16 bits once they are shifted.
+ */
+BOOST_AUTO_TEST_CASE (j2k_image_proxy_interleave_test)
+{
+	int const n = 8 * 4 + 5;
+	int const shift = 4;
+
+	vector<int> planes[3];
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < n; ++j) {
+			/* Use the same out-of-range values in the vector and scalar parts of the line */
+			switch (j % 8) {
+			case 0:
+				planes[i].push_back (0xfff);
+				break;
+			case 1:
+				planes[i].push_back (0x1000);
+				break;
+			case 2:
+				planes[i].push_back (0x1abcd + i);
+				break;
+			case 3:
+				planes[i].push_back (0xfffff);
+				break;
+			default:
+				planes[i].push_back (j * 100 + i);
+				break;
+			}
+		}
+	}
+
+	vector<uint16_t> out (n * 3);
+	J2KImageProxy::interleave_planes (&planes[0][0], &planes[1][0], &planes[2][0], &out[0], n, shift);
+
+	for (int j = 0; j < n; ++j) {
+		for (int i = 0; i < 3; ++i) {
+			BOOST_CHECK_EQUAL (out[j * 3 + i], static_cast<uint16_t> (planes[i][j] << shift));
+		}
+	}
+}
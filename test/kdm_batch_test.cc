@@ -0,0 +1,190 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/kdm_batch_test.cc
+ *  @brief Test KDMBatch.
+ *  @ingroup specific
+ */
+
+#include "test.h"
+#include "lib/film.h"
+#include "lib/screen.h"
+#include "lib/kdm_batch.h"
+#include "lib/ratio.h"
+#include "lib/dcp_content_type.h"
+#include "lib/ffmpeg_content.h"
+#include "lib/config.h"
+#include "lib/cross.h"
+#include "lib/util.h"
+#include <dcp/cpl.h>
+#include <dcp/dcp.h>
+#include <dcp/decrypted_kdm.h>
+#include <dcp/raw_convert.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <sys/time.h>
+
+using std::list;
+using std::vector;
+using std::string;
+using boost::shared_ptr;
+using boost::optional;
+
+static float last_progress = 0;
+
+static void
+progress (float p)
+{
+	last_progress = p;
+}
+
+/** Make KDMs for a lot of screens using several threads and check that they are all correct */
+BOOST_AUTO_TEST_CASE (kdm_batch_test)
+{
+	shared_ptr<Film> film = new_test_film ("kdm_batch_test");
+	film->set_container (Ratio::from_id ("185"));
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TLR"));
+	film->set_name ("frobozz");
+	film->set_interop (false);
+
+	shared_ptr<FFmpegContent> c (new FFmpegContent("test/data/test.mp4"));
+	film->examine_and_add_content (c);
+	film->set_encrypted (true);
+	BOOST_CHECK (!wait_for_jobs ());
+
+	film->make_dcp ();
+	BOOST_CHECK (!wait_for_jobs ());
+
+	dcp::DCP dcp ("build/test/kdm_batch_test/" + film->dcp_name());
+	dcp.read ();
+
+	Config::instance()->set_decryption_chain (shared_ptr<dcp::CertificateChain> (new dcp::CertificateChain (openssl_path ())));
+
+	list<shared_ptr<Screen> > screens;
+	for (int i = 0; i < 32; ++i) {
+		screens.push_back (
+			shared_ptr<Screen> (
+				new Screen (dcp::raw_convert<string> (i), "", Config::instance()->decryption_chain()->leaf(), vector<TrustedDevice>())
+				)
+			);
+	}
+	/* This one should be skipped */
+	screens.push_back (shared_ptr<Screen> (new Screen ("no recipient", "", optional<dcp::Certificate>(), vector<TrustedDevice>())));
+
+	KDMBatch batch (film, dcp.cpls().front()->file().get());
+
+	list<ScreenKDM> kdms = batch.make (
+		screens,
+		boost::posix_time::time_from_string ("2014-07-21 00:00:00"),
+		boost::posix_time::time_from_string ("2024-07-21 00:00:00"),
+		dcp::MODIFIED_TRANSITIONAL_1,
+		false,
+		optional<int>(),
+		4,
+		&progress
+		);
+
+	BOOST_REQUIRE_EQUAL (kdms.size(), 32U);
+	BOOST_CHECK_CLOSE (last_progress, 1, 0.001);
+
+	list<shared_ptr<Screen> >::const_iterator screen = screens.begin ();
+	BOOST_FOREACH (ScreenKDM const & i, kdms) {
+		/* KDMs should be in the same order as the screens */
+		BOOST_CHECK (i.screen == *screen);
+		++screen;
+
+		dcp::DecryptedKDM decrypted (i.kdm, Config::instance()->decryption_chain()->key().get());
+		BOOST_REQUIRE (!decrypted.keys().empty());
+		BOOST_CHECK_EQUAL (decrypted.keys().front().cpl_id(), dcp.cpls().front()->id());
+		BOOST_CHECK (decrypted.keys().front().key() == film->key());
+	}
+}
+
+static double
+time_batch (KDMBatch& batch, list<shared_ptr<Screen> > screens, int threads)
+{
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	list<ScreenKDM> kdms = batch.make (
+		screens,
+		boost::posix_time::time_from_string ("2014-07-21 00:00:00"),
+		boost::posix_time::time_from_string ("2024-07-21 00:00:00"),
+		dcp::MODIFIED_TRANSITIONAL_1,
+		false,
+		optional<int>(),
+		threads
+		);
+	BOOST_CHECK_EQUAL (kdms.size(), screens.size());
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+	return seconds(stop) - seconds(start);
+}
+
+/** Check that making KDMs with several threads is quicker than with one, since signing is
+ *  what takes the time and that is done in parallel.
+ */
+BOOST_AUTO_TEST_CASE (kdm_batch_speed_test)
+{
+	shared_ptr<Film> film = new_test_film ("kdm_batch_speed_test");
+	film->set_container (Ratio::from_id ("185"));
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TLR"));
+	film->set_name ("frobozz");
+	film->set_interop (false);
+
+	shared_ptr<FFmpegContent> c (new FFmpegContent("test/data/test.mp4"));
+	film->examine_and_add_content (c);
+	film->set_encrypted (true);
+	BOOST_CHECK (!wait_for_jobs ());
+
+	film->make_dcp ();
+	BOOST_CHECK (!wait_for_jobs ());
+
+	dcp::DCP dcp ("build/test/kdm_batch_speed_test/" + film->dcp_name());
+	dcp.read ();
+
+	Config::instance()->set_decryption_chain (shared_ptr<dcp::CertificateChain> (new dcp::CertificateChain (openssl_path ())));
+
+	list<shared_ptr<Screen> > screens;
+	for (int i = 0; i < 64; ++i) {
+		screens.push_back (
+			shared_ptr<Screen> (
+				new Screen (dcp::raw_convert<string> (i), "", Config::instance()->decryption_chain()->leaf(), vector<TrustedDevice>())
+				)
+			);
+	}
+
+	KDMBatch batch (film, dcp.cpls().front()->file().get());
+
+	int const threads = 4;
+	double const serial = time_batch (batch, screens, 1);
+	double const parallel = time_batch (batch, screens, threads);
+
+	BOOST_TEST_MESSAGE (screens.size() << " KDMs took " << serial << "s with 1 thread and " << parallel << "s with " << threads);
+
+	if (boost::thread::hardware_concurrency() >= 4) {
+		/* Allow plenty of slack for a busy machine, but a lock around signing would
+		   make this no quicker than the serial run.
+		*/
+		BOOST_CHECK (parallel < serial * 0.75);
+	}
+}
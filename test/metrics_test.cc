@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/metrics_test.cc
+ *  @brief Test Metrics.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/metrics.h"
+#include <boost/test/unit_test.hpp>
+
+using std::string;
+using std::make_pair;
+
+/** Check that samples of the same metric are grouped together, and the output formats */
+BOOST_AUTO_TEST_CASE (metrics_test)
+{
+	Metrics m;
+	m.add ("dcpomatic_queue_frames", Metrics::GAUGE, "Frames in the queue", 4);
+	m.add ("dcpomatic_frames_total", Metrics::COUNTER, "Frames done", 1000, make_pair (string ("server"), string ("localhost")));
+	m.add ("dcpomatic_frames_total", Metrics::COUNTER, "Frames done", 250, make_pair (string ("server"), string ("my \"server\"")));
+
+	BOOST_CHECK_EQUAL (
+		m.prometheus (),
+		"# HELP dcpomatic_queue_frames Frames in the queue\n"
+		"# TYPE dcpomatic_queue_frames gauge\n"
+		"dcpomatic_queue_frames 4\n"
+		"# HELP dcpomatic_frames_total Frames done\n"
+		"# TYPE dcpomatic_frames_total counter\n"
+		"dcpomatic_frames_total{server=\"localhost\"} 1000\n"
+		"dcpomatic_frames_total{server=\"my \\\"server\\\"\"} 250\n"
+		);
+
+	BOOST_CHECK_EQUAL (
+		m.json (),
+		"{ \"dcpomatic_queue_frames\": [{ \"value\": 4 }], "
+		"\"dcpomatic_frames_total\": [{ \"server\": \"localhost\", \"value\": 1000 }, { \"server\": \"my \\\"server\\\"\", \"value\": 250 }] }"
+		);
+}
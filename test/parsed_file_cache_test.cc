@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/parsed_file_cache_test.cc
+ *  @brief Test ParsedFileCache.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/parsed_file_cache.h"
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+
+using std::string;
+using std::ofstream;
+using boost::shared_ptr;
+
+static int parses = 0;
+
+static shared_ptr<const string>
+parse (boost::filesystem::path file)
+{
+	++parses;
+	return shared_ptr<const string> (new string (file.filename().string()));
+}
+
+static void
+write (boost::filesystem::path file, string content)
+{
+	ofstream f (file.string().c_str());
+	f << content;
+}
+
+/** Check that files are only parsed again when they change or have dropped out of the cache */
+BOOST_AUTO_TEST_CASE (parsed_file_cache_test)
+{
+	boost::filesystem::path const dir = "build/test/parsed_file_cache_test";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir);
+
+	write (dir / "a", "a");
+	write (dir / "b", "b");
+	write (dir / "c", "c");
+
+	ParsedFileCache<string> cache (2);
+	parses = 0;
+
+	shared_ptr<const string> a = cache.get (dir / "a", &parse);
+	BOOST_CHECK_EQUAL (*a, "a");
+	BOOST_CHECK_EQUAL (parses, 1);
+
+	/* Same file: same result without parsing again */
+	BOOST_CHECK (cache.get (dir / "a", &parse) == a);
+	BOOST_CHECK_EQUAL (parses, 1);
+
+	/* Change the file */
+	write (dir / "a", "aa");
+	BOOST_CHECK (cache.get (dir / "a", &parse) != a);
+	BOOST_CHECK_EQUAL (parses, 2);
+
+	/* a is now most recently used, so c pushes b out */
+	cache.get (dir / "b", &parse);
+	cache.get (dir / "a", &parse);
+	cache.get (dir / "c", &parse);
+	BOOST_CHECK_EQUAL (parses, 4);
+	cache.get (dir / "a", &parse);
+	BOOST_CHECK_EQUAL (parses, 4);
+	cache.get (dir / "b", &parse);
+	BOOST_CHECK_EQUAL (parses, 5);
+
+	cache.clear ();
+	cache.get (dir / "a", &parse);
+	BOOST_CHECK_EQUAL (parses, 6);
+}
@@ -38,9 +38,11 @@
 #include "lib/butler.h"
 #include "lib/compose.hpp"
 #include "lib/cross.h"
+#include "lib/metrics.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 
 using std::cout;
@@ -398,3 +400,143 @@ BOOST_AUTO_TEST_CASE (player_silence_at_end_crash)
 	film2->make_dcp ();
 	BOOST_REQUIRE (!wait_for_jobs());
 }
+
+static shared_ptr<Decoder>
+decoder_for (list<shared_ptr<Piece> > pieces, shared_ptr<const Content> content)
+{
+	BOOST_FOREACH (shared_ptr<Piece> i, pieces) {
+		if (i->content == content) {
+			return i->decoder;
+		}
+	}
+	return shared_ptr<Decoder> ();
+}
+
+/** Check that the Player only makes new decoders for content when it needs to */
+BOOST_AUTO_TEST_CASE (player_keeps_decoders_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_keeps_decoders_test");
+	shared_ptr<Content> a = content_factory("test/data/test.mp4").front();
+	shared_ptr<Content> b = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (a);
+	film->examine_and_add_content (b);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	shared_ptr<Player> player (new Player (film, film->playlist()));
+	shared_ptr<Decoder> a_decoder = decoder_for (player->_pieces, a);
+	shared_ptr<Decoder> b_decoder = decoder_for (player->_pieces, b);
+	BOOST_REQUIRE (a_decoder);
+	BOOST_REQUIRE (b_decoder);
+
+	/* Moving and cropping content should not need new decoders */
+	b->set_position (film, DCPTime::from_seconds(10));
+	a->video->set_left_crop (16);
+	while (signal_manager->ui_idle ()) {}
+	BOOST_CHECK (decoder_for(player->_pieces, a) == a_decoder);
+	BOOST_CHECK (decoder_for(player->_pieces, b) == b_decoder);
+
+	/* but changing the frame rate of one piece of content should give just that a new one */
+	a->set_video_frame_rate (25);
+	while (signal_manager->ui_idle ()) {}
+	BOOST_CHECK (decoder_for(player->_pieces, a) != a_decoder);
+	BOOST_CHECK (decoder_for(player->_pieces, b) == b_decoder);
+
+	/* Removing content should leave the other's decoder alone */
+	a_decoder = decoder_for (player->_pieces, a);
+	film->remove_content (b);
+	while (signal_manager->ui_idle ()) {}
+	BOOST_CHECK (decoder_for(player->_pieces, a) == a_decoder);
+	BOOST_CHECK (!decoder_for(player->_pieces, b));
+
+	/* and the player should still play */
+	player->seek (DCPTime(), true);
+	for (int i = 0; i < 16; ++i) {
+		player->pass ();
+	}
+}
+
+static optional<FrameRateChange>
+frc_for (list<shared_ptr<Piece> > pieces, shared_ptr<const Content> content)
+{
+	BOOST_FOREACH (shared_ptr<Piece> i, pieces) {
+		if (i->content == content) {
+			return i->frc;
+		}
+	}
+	return optional<FrameRateChange> ();
+}
+
+/** Check that the Player makes new pieces for content which takes its frame rate from the
+ *  video underneath it when that content is moved over video of a different rate.
+ */
+BOOST_AUTO_TEST_CASE (player_remakes_pieces_for_new_frame_rate_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_remakes_pieces_for_new_frame_rate_test");
+	film->set_video_frame_rate (24);
+	shared_ptr<Content> v1 = content_factory("test/data/flat_red.png").front();
+	shared_ptr<Content> v2 = content_factory("test/data/flat_red.png").front();
+	shared_ptr<Content> sound = content_factory("test/data/white.wav").front();
+	shared_ptr<Content> text = content_factory("test/data/subrip.srt").front();
+	film->examine_and_add_content (v1);
+	film->examine_and_add_content (v2);
+	film->examine_and_add_content (sound);
+	film->examine_and_add_content (text);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	v1->set_video_frame_rate (24);
+	v1->set_position (film, DCPTime());
+	v1->video->set_length (24 * 10);
+	v2->set_video_frame_rate (25);
+	v2->set_position (film, DCPTime::from_seconds(10));
+	sound->set_position (film, DCPTime());
+	text->set_position (film, DCPTime());
+	while (signal_manager->ui_idle ()) {}
+
+	shared_ptr<Player> player (new Player (film, film->playlist()));
+	BOOST_REQUIRE (frc_for(player->_pieces, sound));
+	BOOST_REQUIRE (frc_for(player->_pieces, text));
+	BOOST_CHECK_EQUAL (frc_for(player->_pieces, sound)->source, 24);
+	BOOST_CHECK_EQUAL (frc_for(player->_pieces, text)->source, 24);
+	shared_ptr<Decoder> sound_decoder = decoder_for (player->_pieces, sound);
+	shared_ptr<Decoder> text_decoder = decoder_for (player->_pieces, text);
+
+	/* Moving over the 25fps video should give new pieces set up for 25fps */
+	sound->set_position (film, DCPTime::from_seconds(12));
+	text->set_position (film, DCPTime::from_seconds(12));
+	while (signal_manager->ui_idle ()) {}
+	BOOST_CHECK_EQUAL (frc_for(player->_pieces, sound)->source, 25);
+	BOOST_CHECK_EQUAL (frc_for(player->_pieces, text)->source, 25);
+	BOOST_CHECK (decoder_for(player->_pieces, sound) != sound_decoder);
+	BOOST_CHECK (decoder_for(player->_pieces, text) != text_decoder);
+
+	/* but moving within it should not */
+	sound_decoder = decoder_for (player->_pieces, sound);
+	sound->set_position (film, DCPTime::from_seconds(13));
+	while (signal_manager->ui_idle ()) {}
+	BOOST_CHECK (decoder_for(player->_pieces, sound) == sound_decoder);
+
+	player->seek (DCPTime(), true);
+	for (int i = 0; i < 16; ++i) {
+		player->pass ();
+	}
+}
+
+/** Check that pieces made from files with the same name get different metrics */
+BOOST_AUTO_TEST_CASE (player_metrics_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_metrics_test");
+	shared_ptr<Content> A = content_factory("test/data/flat_red.png").front();
+	shared_ptr<Content> B = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (A);
+	film->examine_and_add_content (B);
+	BOOST_REQUIRE (!wait_for_jobs ());
+	B->set_position (film, A->end(film));
+
+	shared_ptr<Player> player (new Player (film, film->playlist()));
+	Metrics metrics;
+	player->metrics (metrics);
+
+	std::string const prometheus = metrics.prometheus ();
+	BOOST_CHECK (boost::algorithm::contains (prometheus, "dcpomatic_player_decoded_video_frames_total{piece=\"0\",file=\"flat_red.png\"}"));
+	BOOST_CHECK (boost::algorithm::contains (prometheus, "dcpomatic_player_decoded_video_frames_total{piece=\"1\",file=\"flat_red.png\"}"));
+}
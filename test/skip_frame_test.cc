@@ -23,6 +23,9 @@
  *  source into a 24fps DCP.
  *  @ingroup specific
  *
+ *  Also check that decoders can skip frames themselves, and measure how much
+ *  quicker that is.
+ *
  *  @see test/repeat_frame_test.cc
  */
 
@@ -33,8 +36,19 @@
 #include "lib/ffmpeg_content.h"
 #include "lib/dcp_content_type.h"
 #include "lib/video_content.h"
+#include "lib/ffmpeg_decoder.h"
+#include "lib/video_decoder.h"
+#include "lib/content_video.h"
+#include "lib/util.h"
+#include <boost/foreach.hpp>
+#include <sys/time.h>
 
+using std::list;
 using boost::shared_ptr;
+using boost::bind;
+#if BOOST_VERSION >= 106100
+using namespace boost::placeholders;
+#endif
 
 BOOST_AUTO_TEST_CASE (skip_frame_test)
 {
@@ -60,3 +74,54 @@ BOOST_AUTO_TEST_CASE (skip_frame_test)
 	*/
 	check_dcp ("test/data/skip_frame_test", film->dir (film->dcp_name ()));
 }
+
+static void
+store_frame (list<Frame>* frames, ContentVideo video)
+{
+	frames->push_back (video.frame);
+}
+
+/** Decode some content, returning the indices of the frames that come out and the time taken */
+static double
+decode_all (shared_ptr<Film> film, shared_ptr<FFmpegContent> content, bool skip, list<Frame>& frames)
+{
+	shared_ptr<FFmpegDecoder> decoder (new FFmpegDecoder(film, content, false));
+	decoder->video->set_skip (skip);
+	decoder->video->Data.connect (bind(&store_frame, &frames, _1));
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+	while (!decoder->pass()) {}
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	return seconds(stop) - seconds(start);
+}
+
+/** Check that a decoder told to skip frames only gives the even ones, and see how
+ *  much quicker it is for it to skip than to decode everything.
+ */
+BOOST_AUTO_TEST_CASE (skip_frame_decode_test)
+{
+	shared_ptr<Film> film = new_test_film ("skip_frame_decode_test");
+	shared_ptr<FFmpegContent> content (new FFmpegContent("test/data/count300bd48.m2ts"));
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs());
+	film->set_video_frame_rate (24);
+
+	list<Frame> all;
+	double const all_time = decode_all (film, content, false, all);
+	list<Frame> skipped;
+	double const skipped_time = decode_all (film, content, true, skipped);
+
+	BOOST_REQUIRE (!all.empty());
+	BOOST_CHECK_EQUAL (skipped.size(), (all.size() + 1) / 2);
+	BOOST_FOREACH (Frame i, skipped) {
+		BOOST_CHECK_EQUAL (i % 2, 0);
+	}
+
+	BOOST_TEST_MESSAGE (
+		"Decoded " << all.size() << " frames at " << (all.size() / all_time) << " fps; skipping every other frame "
+		"got through them at " << (all.size() / skipped_time) << " fps"
+		);
+}
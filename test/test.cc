@@ -522,3 +522,13 @@ make_random_file (boost::filesystem::path path, size_t size)
 	fclose (r);
 	free (buffer);
 }
+
+/** @return true if tests which only measure how long things take should be run; they are
+ *  slow and their results need a person to look at them, so they are skipped unless
+ *  DCPOMATIC_TEST_BENCHMARKS is set.
+ */
+bool
+run_benchmarks ()
+{
+	return getenv ("DCPOMATIC_TEST_BENCHMARKS");
+}
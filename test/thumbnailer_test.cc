@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/thumbnailer_test.cc
+ *  @brief Test Thumbnailer.
+ *  @ingroup specific
+ */
+
+#include "lib/thumbnailer.h"
+#include "lib/film.h"
+#include "lib/content_factory.h"
+#include "lib/image.h"
+#include "lib/cross.h"
+#include "test.h"
+#include <boost/test/unit_test.hpp>
+
+using boost::shared_ptr;
+
+/** Make thumbnails of some video and check that they are found again by a new
+ *  Thumbnailer using the same directory, and that they depend on the frame rate.
+ */
+BOOST_AUTO_TEST_CASE (thumbnailer_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("thumbnailer_test");
+	shared_ptr<Content> content = content_factory("test/data/test.mp4").front();
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	boost::filesystem::path dir = "build/test/thumbnailer_test/thumbnails";
+	boost::filesystem::remove_all (dir);
+
+	{
+		Thumbnailer thumbnailer (64, 1, 16 * 1024 * 1024, dir, 16 * 1024 * 1024);
+		thumbnailer.add (film, content);
+		while (!thumbnailer.idle ()) {
+			dcpomatic_sleep (1);
+		}
+
+		shared_ptr<Image> first = thumbnailer.get (content, ContentTime ());
+		BOOST_REQUIRE (first);
+		BOOST_CHECK (first->size() == thumbnailer.thumbnail_size(content));
+		BOOST_CHECK_EQUAL (first->size().height, 64);
+		BOOST_CHECK_EQUAL (first->pixel_format(), AV_PIX_FMT_RGB24);
+
+		/* Times up to the next thumbnail should give the first one */
+		BOOST_CHECK (thumbnailer.get (content, ContentTime::from_seconds (0.9)) == first);
+		shared_ptr<Image> second = thumbnailer.get (content, ContentTime::from_seconds (1));
+		BOOST_REQUIRE (second);
+		BOOST_CHECK (second != first);
+	}
+
+	{
+		Thumbnailer thumbnailer (64, 1, 16 * 1024 * 1024, dir, 16 * 1024 * 1024);
+
+		/* get() never reads the disk itself; it asks the thumbnailer's thread to do it */
+		BOOST_CHECK (!thumbnailer.get (content, ContentTime ()));
+		shared_ptr<Image> first;
+		for (int i = 0; i < 10 && !first; ++i) {
+			dcpomatic_sleep (1);
+			first = thumbnailer.get (content, ContentTime ());
+		}
+		BOOST_CHECK (first);
+
+		/* The frame rate decides which frame is which, so changing it means different thumbnails */
+		content->set_video_frame_rate (content->video_frame_rate().get() * 2);
+		BOOST_CHECK (!thumbnailer.get (content, ContentTime ()));
+	}
+}
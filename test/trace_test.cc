@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/trace_test.cc
+ *  @brief Test Trace.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/trace.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+using std::string;
+
+static void
+record (int events)
+{
+	for (int i = 0; i < events; ++i) {
+		TRACE_INSTANT (TRACE_WRITER, "trace-test", i);
+	}
+}
+
+static int
+count (string haystack, string needle)
+{
+	int n = 0;
+	for (size_t i = haystack.find(needle); i != string::npos; i = haystack.find(needle, i + 1)) {
+		++n;
+	}
+	return n;
+}
+
+/** Check that events are only recorded when tracing is enabled, and that each
+ *  thread's buffer keeps its most recent events until it is re-used.
+ */
+BOOST_AUTO_TEST_CASE (trace_test)
+{
+	Trace* trace = Trace::instance ();
+	trace->set_enabled (false);
+	trace->clear ();
+
+	TRACE_INSTANT (TRACE_WRITER, "trace-test-ignored");
+
+	trace->set_enabled (true);
+	boost::thread thread (boost::bind (&record, Trace::events_per_thread + 10));
+	thread.join ();
+	trace->set_enabled (false);
+
+	string json = trace->chrome_json ();
+	BOOST_CHECK_EQUAL (count (json, "trace-test-ignored"), 0);
+	/* The oldest event in a full buffer is dropped as its thread could be overwriting it */
+	BOOST_CHECK_EQUAL (count (json, "\"name\": \"trace-test\""), Trace::events_per_thread - 1);
+	BOOST_CHECK_EQUAL (count (json, "\"frame\": 10 }"), 0);
+	BOOST_CHECK_EQUAL (count (json, "\"frame\": 11 }"), 1);
+	BOOST_CHECK_EQUAL (count (json, "\"name\": \"thread_name\""), 1);
+
+	trace->clear ();
+	BOOST_CHECK_EQUAL (count (trace->chrome_json(), "trace-test"), 0);
+
+	/* A new thread should re-use the finished thread's buffer rather than having another */
+	trace->set_enabled (true);
+	boost::thread again (boost::bind (&record, 5));
+	again.join ();
+	trace->set_enabled (false);
+
+	json = trace->chrome_json ();
+	BOOST_CHECK_EQUAL (count (json, "\"name\": \"trace-test\""), 5);
+	BOOST_CHECK_EQUAL (count (json, "\"name\": \"thread_name\""), 1);
+}
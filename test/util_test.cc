@@ -26,10 +26,13 @@
 #include "lib/util.h"
 #include "lib/cross.h"
 #include "lib/exceptions.h"
+#include "lib/audio_buffers.h"
+#include "lib/audio_mapping.h"
 #include "test.h"
 #include <dcp/certificate_chain.h>
 #include <boost/test/unit_test.hpp>
 #include <boost/bind.hpp>
+#include <cmath>
 
 using std::string;
 using std::vector;
@@ -152,3 +155,38 @@ BOOST_AUTO_TEST_CASE (copy_in_bits_test)
 		check_file ("build/test/random.dat", "build/test/random.dat2");
 	}
 }
+
+/** remap() should apply gain and mapping together, and share the input's data when they would make no difference */
+BOOST_AUTO_TEST_CASE (remap_test)
+{
+	shared_ptr<AudioBuffers> input (new AudioBuffers (2, 64));
+	for (int i = 0; i < 64; ++i) {
+		input->data(0)[i] = i;
+		input->data(1)[i] = -i;
+	}
+
+	AudioMapping map (2, 3);
+	map.set (0, 0, 1);
+	map.set (1, 1, 1);
+
+	shared_ptr<const AudioBuffers> out = remap (input, 2, map);
+	BOOST_CHECK (out->data(0) == input->data(0));
+	BOOST_CHECK (out->data(1) == input->data(1));
+
+	/* Changing something made from the output must change neither the output nor the input */
+	shared_ptr<AudioBuffers> changed (new AudioBuffers (out, 0, out->frames()));
+	changed->make_silent ();
+	BOOST_CHECK_EQUAL (out->data(0)[1], 1);
+	BOOST_CHECK_EQUAL (input->data(0)[1], 1);
+
+	/* Gain is applied before the mapping */
+	map.set (0, 1, 0.5);
+	out = remap (input, 3, map, -6);
+	BOOST_CHECK_EQUAL (out->channels(), 3);
+	float const linear = pow (10, -6.0f / 20);
+	for (int i = 0; i < 64; ++i) {
+		BOOST_CHECK_EQUAL (out->data(0)[i], (i * linear) * 1);
+		BOOST_CHECK_EQUAL (out->data(1)[i], 0 + (i * linear) * 0.5f + (-i * linear) * 1);
+		BOOST_CHECK_EQUAL (out->data(2)[i], 0);
+	}
+}
@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/video_ring_buffers_test.cc
+ *  @brief Test VideoRingBuffers class.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/video_ring_buffers.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+
+using boost::shared_ptr;
+
+/** Check that clear() makes room for new frames even if get() is never called */
+BOOST_AUTO_TEST_CASE (video_ring_buffers_clear_test)
+{
+	VideoRingBuffers rb (8);
+
+	for (int i = 0; i < 100; ++i) {
+		for (int j = 0; j < 6; ++j) {
+			rb.put (shared_ptr<PlayerVideo>(), DCPTime(i * 10 + j + 1));
+		}
+		BOOST_CHECK_EQUAL (rb.size(), 6);
+		BOOST_CHECK (rb.next_time() == DCPTime(i * 10 + 1));
+		rb.clear ();
+		BOOST_CHECK (rb.empty());
+		BOOST_CHECK (!rb.next_time());
+	}
+
+	/* Nothing that was cleared should come out */
+	BOOST_CHECK (rb.get().second == DCPTime());
+	BOOST_CHECK_EQUAL (rb.underruns(), 1);
+
+	rb.put (shared_ptr<PlayerVideo>(), DCPTime(42));
+	BOOST_CHECK (rb.get().second == DCPTime(42));
+}
+
+static void
+produce (VideoRingBuffers* rb, boost::atomic<bool>* done)
+{
+	for (int i = 1; i < 200000; ++i) {
+		while (rb->size() >= 6) {
+			rb->clear ();
+		}
+		rb->put (shared_ptr<PlayerVideo>(), DCPTime(i));
+	}
+	*done = true;
+}
+
+/** Check that frames come out in order while another thread is putting and clearing */
+BOOST_AUTO_TEST_CASE (video_ring_buffers_threads_test)
+{
+	VideoRingBuffers rb (8);
+	boost::atomic<bool> done (false);
+	boost::thread producer (boost::bind (&produce, &rb, &done));
+
+	DCPTime last;
+	int got = 0;
+	while (!done) {
+		DCPTime const t = rb.get().second;
+		if (t != DCPTime()) {
+			BOOST_REQUIRE (t > last);
+			last = t;
+			++got;
+		}
+	}
+
+	producer.join ();
+	BOOST_CHECK (got > 0);
+}